@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief count the library allocations
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "bench/bench.h"
+
+#include <sys/mman.h>
+
+std::atomic<uint64_t> benchAllocs;
+
+// The library calls are wrapped with the linker '--wrap' option
+extern "C" {
+  void *__real_malloc(size_t size);
+  void *__real_calloc(size_t num, size_t size);
+  void *__real_realloc(void *ptr, size_t size);
+  void *__real_aligned_alloc(size_t alignment, size_t size);
+  char *__real_strdup(const char *s);
+  void *__real_mmap(void *addr, size_t length, int prot, int flags, int fd,
+    off_t offset);
+
+  void *__wrap_malloc(size_t size)
+  {
+    benchAllocs++;
+    return __real_malloc(size);
+  }
+  void *__wrap_calloc(size_t num, size_t size)
+  {
+    benchAllocs++;
+    return __real_calloc(num, size);
+  }
+  void *__wrap_realloc(void *ptr, size_t size)
+  {
+    benchAllocs++;
+    return __real_realloc(ptr, size);
+  }
+  void *__wrap_aligned_alloc(size_t alignment, size_t size)
+  {
+    benchAllocs++;
+    return __real_aligned_alloc(alignment, size);
+  }
+  char *__wrap_strdup(const char *s)
+  {
+    benchAllocs++;
+    return __real_strdup(s);
+  }
+  void *__wrap_mmap(void *addr, size_t length, int prot, int flags, int fd,
+    off_t offset)
+  {
+    benchAllocs++;
+    return __real_mmap(addr, length, prot, flags, fd, offset);
+  }
+}
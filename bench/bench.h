@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief benchmarks common header
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_BENCH_H_
+#define __CSPTP_BENCH_H_
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+
+// Number of allocations done by the library, see alloc.cpp
+extern std::atomic<uint64_t> benchAllocs;
+
+// Count the library allocations of a benchmark loop
+class allocCounter
+{
+  benchmark::State &state;
+  uint64_t start;
+public:
+  allocCounter(benchmark::State &s) : state(s), start(benchAllocs) {}
+  ~allocCounter() {
+    state.counters["allocs/op"] = benchmark::Counter(benchAllocs - start,
+        benchmark::Counter::kAvgIterations);
+  }
+};
+
+#endif /* __CSPTP_BENCH_H_ */
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief benchmarks main
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "bench/bench.h"
+
+extern "C" {
+#include "src/log.h"
+}
+
+int main(int argc, char **argv)
+{
+  // Errors only, the debug messages mix with the results
+  const struct log_options_t lopt = { LOG_ERR, false, true };
+  setLog("csptp_bench", &lopt);
+  benchmark::Initialize(&argc, argv);
+  if(benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
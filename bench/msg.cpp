@@ -0,0 +1,240 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief benchmark message object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "bench/bench.h"
+
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include "src/msg.h"
+}
+
+// Messages size, the client pads the request to the response size
+#define MSG_SIZE (160)
+
+// The TLVs combination is the CSPTP_REQUEST tlvRequestFlags[0]
+static const char *tlvsName(uint8_t flags)
+{
+  switch(flags & (Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv)) {
+    case Flags0_Req_StatusTlv:
+      return "status";
+    case Flags0_Req_AlternateTimeTlv:
+      return "altTime";
+    case Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv:
+      return "status+altTime";
+    default:
+      return "none";
+  }
+}
+static void initParams(struct ptp_params_t &p, enum messageType_e type)
+{
+  memset(&p, 0, sizeof(p));
+  p.type = type;
+  p.domainNumber = 128;
+  p.sequenceId = 17;
+  set_uint48(&p.timestamp.secondsField, 1750000000);
+  p.timestamp.nanosecondsField = 123456789;
+}
+// Build a Sync response like the service does
+static bool buildResp(pmsg m, pcparms p, pbuffer b, uint8_t flags)
+{
+  if(!m->init(m, p, b))
+    return false;
+  struct CSPTP_RESPONSE_t *rp = (struct CSPTP_RESPONSE_t *)
+      m->nextTlv(m, m->getTlvSize(CSPTP_RESPONSE_id));
+  if(rp == nullptr)
+    return false;
+  memcpy(rp->organizationId, "\x1\x2\x3", 3);
+  memcpy(rp->organizationSubType, "\x4\x5\x6", 3);
+  rp->reqIngressTimestamp = p->timestamp;
+  rp->reqCorrectionField = 0;
+  if(!m->addTlv(m, CSPTP_RESPONSE_id))
+    return false;
+  if((flags & Flags0_Req_StatusTlv) > 0) {
+    struct CSPTP_STATUS_t *st = (struct CSPTP_STATUS_t *)
+        m->nextTlv(m, m->getCSPTPStatusTlvSize(UDP_IPv4));
+    if(st == nullptr)
+      return false;
+    memset((uint8_t *)st + sizeof(struct tlv_hdr_t), 0,
+      m->getCSPTPStatusTlvSize(UDP_IPv4) - sizeof(struct tlv_hdr_t));
+    st->grandmasterPriority1 = 127;
+    st->grandmasterPriority2 = 127;
+    st->currentUtcOffset = 37;
+    st->parentAddress.networkProtocol = UDP_IPv4;
+    st->parentAddress.addressLength = IPV4_ADDR_LEN;
+    if(!m->addTlv(m, CSPTP_STATUS_id))
+      return false;
+  }
+  if((flags & Flags0_Req_AlternateTimeTlv) > 0) {
+    struct ALTERNATE_TIME_OFFSET_INDICATOR_t *a =
+        (struct ALTERNATE_TIME_OFFSET_INDICATOR_t *)
+        m->nextTlv(m, m->getTlvSize(ALTERNATE_TIME_OFFSET_INDICATOR_id));
+    if(a == nullptr)
+      return false;
+    a->keyField = 1;
+    a->currentOffset = 10800;
+    a->jumpSeconds = 1;
+    set_uint48(&a->timeOfNextJump, 175863);
+    a->displayName.lengthField = 4;
+    memcpy(a->displayName.textField, "CEST", 4);
+    if(!m->addTlv(m, ALTERNATE_TIME_OFFSET_INDICATOR_id))
+      return false;
+  }
+  return m->buildDone(m, MSG_SIZE);
+}
+// Build a Sync request like the client does
+static bool buildReq(pmsg m, pcparms p, pbuffer b, uint8_t flags)
+{
+  return m->init(m, p, b) && m->addCSPTPReqTlv(m, flags) &&
+    m->buildDone(m, MSG_SIZE);
+}
+
+// Objects of a message benchmark
+struct msgBench {
+  pmsg m;
+  pbuffer b;
+  struct ptp_params_t p;
+  msgBench(enum messageType_e type) {
+    m = msg_alloc();
+    b = buffer_alloc(MSG_SIZE * 2);
+    initParams(p, type);
+  }
+  ~msgBench() {
+    m->free(m);
+    b->free(b);
+  }
+};
+
+// Build Sync response, per TLVs combination
+static void buildRespSync(benchmark::State &state)
+{
+  uint8_t flags = state.range(0);
+  msgBench t(Sync);
+  state.SetLabel(tlvsName(flags));
+  allocCounter c(state);
+  for(auto _ : state) {
+    if(!buildResp(t.m, &t.p, t.b, flags)) {
+      state.SkipWithError("build");
+      break;
+    }
+  }
+}
+BENCHMARK(buildRespSync)->DenseRange(0, 3);
+
+// Build Sync request, per TLVs request flags
+static void buildReqSync(benchmark::State &state)
+{
+  uint8_t flags = state.range(0);
+  msgBench t(Sync);
+  state.SetLabel(tlvsName(flags));
+  allocCounter c(state);
+  for(auto _ : state) {
+    if(!buildReq(t.m, &t.p, t.b, flags)) {
+      state.SkipWithError("build");
+      break;
+    }
+  }
+}
+BENCHMARK(buildReqSync)->DenseRange(0, 3);
+
+// Build Follow_Up
+static void buildFollowUp(benchmark::State &state)
+{
+  msgBench t(Follow_Up);
+  allocCounter c(state);
+  for(auto _ : state) {
+    if(!t.m->init(t.m, &t.p, t.b) || !t.m->buildDone(t.m, MSG_SIZE)) {
+      state.SkipWithError("build");
+      break;
+    }
+  }
+}
+BENCHMARK(buildFollowUp);
+
+// Received Sync response in network order, in an image and in the buffer
+struct rxBench : msgBench {
+  uint8_t image[MSG_SIZE];
+  rxBench(benchmark::State &state, bool response, uint8_t flags) :
+    msgBench(Sync) {
+    state.SetLabel(tlvsName(flags));
+    if(!(response ? buildResp(m, &p, b, flags) : buildReq(m, &p, b, flags)))
+      state.SkipWithError("build");
+    memcpy(image, b->getBuf(b), MSG_SIZE);
+    m->detach(m);
+  }
+};
+
+// Parse Sync response to host order, per TLVs combination
+// The parse converts in place, each loop copies the received image
+static void parseRespSync(benchmark::State &state)
+{
+  rxBench t(state, true, state.range(0));
+  allocCounter c(state);
+  for(auto _ : state) {
+    memcpy(t.b->getBuf(t.b), t.image, MSG_SIZE);
+    if(!t.m->parse(t.m, &t.p, t.b)) {
+      state.SkipWithError("parse");
+      break;
+    }
+  }
+}
+BENCHMARK(parseRespSync)->DenseRange(0, 3);
+
+// View Sync response and copy its CSPTP_RESPONSE TLV, per TLVs combination
+static void viewRespSync(benchmark::State &state)
+{
+  rxBench t(state, true, state.range(0));
+  struct CSPTP_RESPONSE_t r;
+  allocCounter c(state);
+  for(auto _ : state) {
+    if(!t.m->view(t.m, &t.p, t.b) ||
+      t.m->copyTlv(t.m, CSPTP_RESPONSE_id, &r, sizeof(r)) == 0) {
+      state.SkipWithError("view");
+      break;
+    }
+    benchmark::DoNotOptimize(r);
+  }
+}
+BENCHMARK(viewRespSync)->DenseRange(0, 3);
+
+// View Sync request and find its CSPTP_REQUEST TLV, like the service
+static void viewReqSync(benchmark::State &state)
+{
+  rxBench t(state, false, state.range(0));
+  allocCounter c(state);
+  for(auto _ : state) {
+    if(!t.m->view(t.m, &t.p, t.b) ||
+      t.m->findTlv(t.m, CSPTP_REQUEST_id) == nullptr) {
+      state.SkipWithError("view");
+      break;
+    }
+  }
+}
+BENCHMARK(viewReqSync)->DenseRange(0, 3);
+
+// Check the headers of a batch of requests, per message
+static void checkBatch(benchmark::State &state)
+{
+  size_t num = state.range(0);
+  rxBench t(state, false, 0);
+  std::vector<pcbuffer> bufs(num, t.b);
+  std::unique_ptr<bool[]> valid(new bool[num]);
+  allocCounter c(state);
+  for(auto _ : state) {
+    if(t.m->check(t.m, bufs.data(), num, valid.get()) != num) {
+      state.SkipWithError("check");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num);
+}
+BENCHMARK(checkBatch)->Arg(1)->Arg(8)->Arg(32);
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief benchmark shared memory socket object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "bench/bench.h"
+
+#include <string>
+#include <unistd.h>
+
+extern "C" {
+#include "src/shmsock.h"
+}
+
+// Messages size, a two steps Sync request with all TLVs
+#define MSG_SIZE (160)
+
+// Service and a client, in our process
+struct shmBench {
+  psock srv, cl;
+  size_t num;
+  pbuffer bufs[SHMSOCK_RING];
+  pipaddr addrs[SHMSOCK_RING];
+  pts ts[SHMSOCK_RING];
+  pipaddr srvAddr;
+  shmBench(benchmark::State &state) : num(state.range(0)) {
+    std::string path = "/dev/shm/csptp_bench_" + std::to_string(getpid());
+    srv = shmsock_alloc(UDP_IPv4, path.c_str());
+    cl = shmsock_alloc(UDP_IPv4, path.c_str());
+    srvAddr = addr_alloc(UDP_IPv4);
+    bool ok = srv != nullptr && cl != nullptr && srvAddr != nullptr &&
+      srv->initSrv(srv, srvAddr) && cl->init(cl, UDP_IPv4) &&
+      srvAddr->setEndpoint(srvAddr, SHMSOCK_SERVICE_ID);
+    for(size_t i = 0; i < SHMSOCK_RING; i++) {
+      bufs[i] = buffer_alloc(SHMSOCK_MTU);
+      addrs[i] = addr_alloc(UDP_IPv4);
+      ts[i] = ts_alloc();
+      ok = ok && bufs[i] != nullptr && addrs[i] != nullptr && ts[i] != nullptr;
+      if(ok) {
+        memset(buffer_getBuf(bufs[i]), 0, MSG_SIZE);
+        buffer_setLen(bufs[i], MSG_SIZE);
+        addrs[i]->setEndpoint(addrs[i], SHMSOCK_SERVICE_ID);
+      }
+    }
+    if(!ok)
+      state.SkipWithError("alloc");
+  }
+  ~shmBench() {
+    for(size_t i = 0; i < SHMSOCK_RING; i++) {
+      if(bufs[i] != nullptr)
+        bufs[i]->free(bufs[i]);
+      if(addrs[i] != nullptr)
+        addrs[i]->free(addrs[i]);
+      if(ts[i] != nullptr)
+        ts[i]->free(ts[i]);
+    }
+    if(cl != nullptr)
+      cl->free(cl);
+    if(srv != nullptr)
+      srv->free(srv);
+    if(srvAddr != nullptr)
+      srvAddr->free(srvAddr);
+  }
+};
+
+// Round trip of requests, per batch size
+// The client sends a batch, the service receives it and responds,
+// the client receives the responses.
+// Each side wakes its peer through the doorbell once per batch.
+static void shmRoundTrip(benchmark::State &state)
+{
+  shmBench t(state);
+  size_t num = t.num;
+  allocCounter c(state);
+  for(auto _ : state) {
+    if(t.cl->sendBatch(t.cl, (pcbuffer *)t.bufs, (pcipaddr *)t.addrs,
+        num) != num ||
+      t.srv->recvBatch(t.srv, t.bufs, t.addrs, t.ts, num) != num ||
+      t.srv->sendBatch(t.srv, (pcbuffer *)t.bufs, (pcipaddr *)t.addrs,
+        num) != num ||
+      t.cl->recvBatch(t.cl, t.bufs, t.addrs, t.ts, num) != num) {
+      state.SkipWithError("round trip");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num);
+}
+BENCHMARK(shmRoundTrip)->Arg(1)->Arg(8)->Arg(SHMSOCK_RING);
@@ -0,0 +1,139 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief benchmark single liked list objects
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "bench/bench.h"
+
+extern "C" {
+#include "src/slist.h"
+}
+
+struct data_t {
+  int key;
+  int val;
+};
+
+static int cmp(void *data, void *cookie)
+{
+  struct data_t *d = (struct data_t *)cookie;
+  struct data_t *nd = (struct data_t *)data;
+  return d->key > nd->key ? 1 : (d->key < nd->key ? -1 : 0);
+}
+static int set(void *data, void *cookie)
+{
+  struct data_t *d = (struct data_t *)cookie;
+  struct data_t *nd = (struct data_t *)data;
+  nd->key = d->key;
+  nd->val = d->val;
+  return 0;
+}
+static int cleanup(void *data, void *cookie)
+{
+  struct data_t *d = (struct data_t *)cookie;
+  struct data_t *nd = (struct data_t *)data;
+  return nd->val < d->val ? 1 : 0;
+}
+
+// Objects of a list benchmark, a sorted list of nodes
+struct slistBench {
+  pslistmgr m;
+  struct s_link_list_t list;
+  int nodes;
+  slistBench(benchmark::State &state) : nodes(state.range(0)) {
+    list._head = nullptr;
+    m = pslistmgr_alloc(sizeof(struct data_t), cmp, set, cleanup, nullptr);
+    if(m == nullptr)
+      state.SkipWithError("alloc");
+  }
+  ~slistBench() {
+    if(m != nullptr) {
+      m->freeList(m, &list, false);
+      m->free(m);
+    }
+  }
+  // Key of a node, visit the nodes in a scrambled order
+  int key(int i) {
+    return (int)(((unsigned)i * 0x9e3779b1U) >> 1);
+  }
+  bool fill(int val) {
+    for(int i = 0; i < nodes; i++) {
+      struct data_t d = { key(i), val };
+      if(!m->updateNode(m, &list, &d))
+        return false;
+    }
+    return true;
+  }
+};
+
+// Update a node in a list, per list length
+static void slistUpdate(benchmark::State &state)
+{
+  slistBench b(state);
+  if(!b.fill(0)) {
+    state.SkipWithError("fill");
+    return;
+  }
+  int i = 0;
+  allocCounter c(state);
+  for(auto _ : state) {
+    struct data_t d = { b.key(i), i };
+    if(!b.m->updateNode(b.m, &b.list, &d)) {
+      state.SkipWithError("update");
+      break;
+    }
+    if(++i == b.nodes)
+      i = 0;
+  }
+}
+BENCHMARK(slistUpdate)->RangeMultiplier(4)->Range(8, 1024);
+
+// Fetch a node from a list, per list length
+static void slistFetch(benchmark::State &state)
+{
+  slistBench b(state);
+  if(!b.fill(0)) {
+    state.SkipWithError("fill");
+    return;
+  }
+  int i = 0;
+  allocCounter c(state);
+  for(auto _ : state) {
+    struct data_t d = { b.key(i), 0 };
+    if(b.m->fetchNode(b.m, &b.list, &d) == nullptr) {
+      state.SkipWithError("fetch");
+      break;
+    }
+    if(++i == b.nodes)
+      i = 0;
+  }
+}
+BENCHMARK(slistFetch)->RangeMultiplier(4)->Range(8, 1024);
+
+// Clean up all the nodes and add them back from the free list, per node
+static void slistChurn(benchmark::State &state)
+{
+  slistBench b(state);
+  int val = 0;
+  allocCounter c(state);
+  for(auto _ : state) {
+    if(!b.fill(val)) {
+      state.SkipWithError("fill");
+      break;
+    }
+    struct data_t d = { 0, ++val };
+    if(b.m->cleanUpNodes(b.m, &b.list, &d) != (size_t)b.nodes) {
+      state.SkipWithError("cleanup");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * b.nodes);
+  state.counters["memory"] = b.m->getMemUse(b.m);
+}
+BENCHMARK(slistChurn)->RangeMultiplier(4)->Range(8, 1024);
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief benchmark socket object, system calls against io_uring
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "bench/bench.h"
+
+#include <sys/socket.h>
+
+extern "C" {
+#include "src/sock.h"
+}
+
+// Messages size, a two steps Sync request with all TLVs
+#define MSG_SIZE (160)
+// Largest batch
+#define BATCH_MAX (64)
+
+// Service and a client on the loopback, in our process
+struct sockBench {
+  psock srv, cl;
+  size_t num;
+  pbuffer bufs[BATCH_MAX];
+  pipaddr addrs[BATCH_MAX];
+  pts ts[BATCH_MAX];
+  pipaddr srvAddr, clAddr;
+  // Bind to the loopback with a free port
+  static bool bindLo(psock s, pipaddr a) {
+    socklen_t size = a->getSize(a);
+    a->setPort(a, 0);
+    return a->setIPStr(a, "127.0.0.1") && s->initSrv(s, a) &&
+      getsockname(s->_fd, a->getAddr(a), &size) == 0;
+  }
+  sockBench(benchmark::State &state, bool useUring) : num(state.range(0)) {
+    struct sock_opt_t opt = {};
+    opt.entries = BATCH_MAX;
+    opt.useUring = useUring;
+    srv = sock_alloc_opt(&opt);
+    cl = sock_alloc();
+    srvAddr = addr_alloc(UDP_IPv4);
+    clAddr = addr_alloc(UDP_IPv4);
+    bool ok = srv != nullptr && cl != nullptr && srvAddr != nullptr &&
+      clAddr != nullptr && bindLo(srv, srvAddr) && bindLo(cl, clAddr);
+    for(size_t i = 0; i < BATCH_MAX; i++) {
+      bufs[i] = buffer_alloc(MSG_SIZE);
+      addrs[i] = addr_alloc(UDP_IPv4);
+      ts[i] = ts_alloc();
+      ok = ok && bufs[i] != nullptr && addrs[i] != nullptr && ts[i] != nullptr;
+      if(ok) {
+        memset(buffer_getBuf(bufs[i]), 0, MSG_SIZE);
+        buffer_setLen(bufs[i], MSG_SIZE);
+        ok = addrs[i]->setIP(addrs[i], srvAddr->getIP(srvAddr));
+        addrs[i]->setPort(addrs[i], srvAddr->getPort(srvAddr));
+      }
+    }
+    if(!ok)
+      state.SkipWithError("alloc");
+    else if(useUring && srv->fileno(srv) == srv->_fd)
+      state.SkipWithError("io_uring is not supported");
+  }
+  ~sockBench() {
+    for(size_t i = 0; i < BATCH_MAX; i++) {
+      if(bufs[i] != nullptr)
+        bufs[i]->free(bufs[i]);
+      if(addrs[i] != nullptr)
+        addrs[i]->free(addrs[i]);
+      if(ts[i] != nullptr)
+        ts[i]->free(ts[i]);
+    }
+    if(cl != nullptr)
+      cl->free(cl);
+    if(srv != nullptr)
+      srv->free(srv);
+    if(srvAddr != nullptr)
+      srvAddr->free(srvAddr);
+    if(clAddr != nullptr)
+      clAddr->free(clAddr);
+  }
+  // Receive the whole batch, the io_uring receive completes in the kernel
+  bool recvAll(psock s) {
+    size_t got = 0;
+    while(got < num) {
+      if(!s->poll(s, 1000))
+        return false;
+      got += s->recvBatch(s, bufs + got, addrs + got, ts + got, num - got);
+    }
+    return true;
+  }
+  // The client sends a batch, the service receives it and responds,
+  // the client receives the responses from the service address
+  bool roundTrip() {
+    return cl->sendBatch(cl, (pcbuffer *)bufs, (pcipaddr *)addrs, num) == num &&
+      recvAll(srv) &&
+      srv->sendBatch(srv, (pcbuffer *)bufs, (pcipaddr *)addrs, num) == num &&
+      recvAll(cl);
+  }
+};
+
+static void sockRun(benchmark::State &state, bool useUring)
+{
+  sockBench t(state, useUring);
+  size_t num = t.num;
+  allocCounter c(state);
+  for(auto _ : state) {
+    if(!t.roundTrip()) {
+      state.SkipWithError("round trip");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num);
+}
+
+// Round trip per batch size, the service uses recvmmsg() and sendmmsg()
+static void sockMmsg(benchmark::State &state)
+{
+  sockRun(state, false);
+}
+BENCHMARK(sockMmsg)->Arg(1)->Arg(8)->Arg(BATCH_MAX);
+
+// Round trip per batch size, the service uses io_uring
+static void sockUring(benchmark::State &state)
+{
+  sockRun(state, true);
+}
+BENCHMARK(sockUring)->Arg(1)->Arg(8)->Arg(BATCH_MAX);
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief benchmark store object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "bench/bench.h"
+
+#include <ctime>
+#include <thread>
+
+extern "C" {
+#include "src/store.h"
+}
+
+// Objects of a store benchmark, a hash table that fits the clients
+// with up to 75% of its records used
+struct storeBench {
+  pstore s;
+  pipaddr a;
+  pts t;
+  size_t clients;
+  storeBench(benchmark::State &state) : clients(state.range(0)) {
+    size_t bits = 0;
+    while(((size_t)STORE_SLOTS_IPV4 << bits) * 3 < clients * 4)
+      bits++;
+    s = store_alloc(UDP_IPv4, bits);
+    a = addr_alloc(UDP_IPv4);
+    t = ts_alloc();
+    if(s == nullptr || a == nullptr || t == nullptr)
+      state.SkipWithError("alloc");
+    else
+      t->setTs(t, 1750000000123456789);
+  }
+  ~storeBench() {
+    if(s != nullptr)
+      s->free(s);
+    if(a != nullptr)
+      a->free(a);
+    if(t != nullptr)
+      t->free(t);
+  }
+  // Client address, visit the clients in a scrambled order
+  void client(size_t i) {
+    // Odd multiplier modulo power of 2 is a permutation
+    uint32_t n = (uint32_t)(i * 0x9e3779b1U);
+    a->setIP4Val(a, 0x0a000000 | (n & 0xffffff));
+    a->setPort(a, 320 + (n >> 24));
+  }
+  bool fill() {
+    for(size_t i = 0; i < clients; i++) {
+      client(i);
+      if(!s->update(s, a, t, 1, 128, 0, nullptr))
+        return false;
+    }
+    return true;
+  }
+};
+
+// Update a record of a stored client, per number of clients
+static void storeUpdate(benchmark::State &state)
+{
+  storeBench b(state);
+  if(!b.fill()) {
+    state.SkipWithError("fill");
+    return;
+  }
+  size_t i = 0;
+  uint16_t seq = 2;
+  allocCounter c(state);
+  for(auto _ : state) {
+    b.client(i);
+    if(!b.s->update(b.s, b.a, b.t, seq, 128, 0, nullptr)) {
+      state.SkipWithError("update");
+      break;
+    }
+    if(++i == b.clients) {
+      i = 0;
+      seq++;
+    }
+  }
+  state.counters["records"] = b.s->records(b.s);
+  state.counters["memory"] = b.s->memUse(b.s);
+}
+BENCHMARK(storeUpdate)->RangeMultiplier(10)->Range(1000, 10000000);
+
+// Fetch a record of a stored client, per number of clients
+static void storeFetch(benchmark::State &state)
+{
+  storeBench b(state);
+  if(!b.fill()) {
+    state.SkipWithError("fill");
+    return;
+  }
+  size_t i = 0, found = 0;
+  allocCounter c(state);
+  for(auto _ : state) {
+    b.client(i);
+    if(b.s->fetch(b.s, b.a, b.t, 1, 128, nullptr, false))
+      found++;
+    if(++i == b.clients)
+      i = 0;
+  }
+  // A new record replaces the oldest when all probed buckets are full
+  state.counters["found"] = benchmark::Counter(found,
+      benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(storeFetch)->RangeMultiplier(10)->Range(1000, 10000000);
+
+// Remove all the records of the previous second, per record
+static void storeCleanup(benchmark::State &state)
+{
+  storeBench b(state);
+  size_t removed = 0;
+  allocCounter c(state);
+  for(auto _ : state) {
+    state.PauseTiming();
+    if(!b.fill()) {
+      state.SkipWithError("fill");
+      break;
+    }
+    // Records store the time in seconds
+    time_t now = time(nullptr);
+    while(time(nullptr) == now)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    state.ResumeTiming();
+    removed += b.s->cleanup(b.s, 0);
+  }
+  state.SetItemsProcessed(removed);
+}
+BENCHMARK(storeCleanup)->RangeMultiplier(10)->Range(1000, 10000000)
+->Iterations(3);
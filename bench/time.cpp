@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief benchmark timestamp object and conversions
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "bench/bench.h"
+
+extern "C" {
+#include "src/time.h"
+}
+
+// Timestamp object of a benchmark
+struct tsBench {
+  pts t;
+  tsBench() {
+    t = ts_alloc();
+    t->setTs(t, 1750000000123456789);
+  }
+  ~tsBench() {
+    t->free(t);
+  }
+};
+
+// Set from timespec
+static void fromTimespec(benchmark::State &state)
+{
+  tsBench b;
+  struct timespec ts = { 1750000000, 123456789 };
+  allocCounter c(state);
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(ts);
+    b.t->fromTimespec(b.t, &ts);
+  }
+}
+BENCHMARK(fromTimespec);
+
+// Convert to timespec
+static void toTimespec(benchmark::State &state)
+{
+  tsBench b;
+  struct timespec ts;
+  allocCounter c(state);
+  for(auto _ : state) {
+    b.t->toTimespec(b.t, &ts);
+    benchmark::DoNotOptimize(ts);
+  }
+}
+BENCHMARK(toTimespec);
+
+// Set from PTP Timestamp_t
+static void fromTimestamp(benchmark::State &state)
+{
+  tsBench b;
+  struct Timestamp_t ts;
+  set_uint48(&ts.secondsField, 1750000000);
+  ts.nanosecondsField = 123456789;
+  allocCounter c(state);
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(ts);
+    if(!b.t->fromTimestamp(b.t, &ts)) {
+      state.SkipWithError("fromTimestamp");
+      break;
+    }
+  }
+}
+BENCHMARK(fromTimestamp);
+
+// Convert to PTP Timestamp_t
+static void toTimestamp(benchmark::State &state)
+{
+  tsBench b;
+  struct Timestamp_t ts;
+  allocCounter c(state);
+  for(auto _ : state) {
+    if(!b.t->toTimestamp(b.t, &ts)) {
+      state.SkipWithError("toTimestamp");
+      break;
+    }
+    benchmark::DoNotOptimize(ts);
+  }
+}
+BENCHMARK(toTimestamp);
+
+// Get nanoseconds using the object method
+static void getTs(benchmark::State &state)
+{
+  tsBench b;
+  allocCounter c(state);
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(b.t);
+    benchmark::DoNotOptimize(b.t->getTs(b.t));
+  }
+}
+BENCHMARK(getTs);
+
+// Get nanoseconds using the inline accessor of the fast path
+static void getTsInline(benchmark::State &state)
+{
+  tsBench b;
+  allocCounter c(state);
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(b.t);
+    benchmark::DoNotOptimize(ts_getTs(b.t));
+  }
+}
+BENCHMARK(getTsInline);
+
+// Set nanoseconds
+static void setTs(benchmark::State &state)
+{
+  tsBench b;
+  int64_t v = 1750000000123456789;
+  allocCounter c(state);
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(v);
+    b.t->setTs(b.t, v);
+  }
+}
+BENCHMARK(setTs);
+
+// Set and get 48 bits unsigned integer
+static void uint48(benchmark::State &state)
+{
+  struct UInteger48_t n;
+  uint64_t v = 1750000000;
+  allocCounter c(state);
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(v);
+    set_uint48(&n, v);
+    benchmark::DoNotOptimize(n);
+    benchmark::DoNotOptimize(get_uint48(&n));
+  }
+}
+BENCHMARK(uint48);
+
+// Convert 48 bits unsigned integer to network order and back
+static void netOrder48(benchmark::State &state)
+{
+  struct UInteger48_t n;
+  set_uint48(&n, 1750000000);
+  allocCounter c(state);
+  for(auto _ : state) {
+    cpu_to_net48(&n);
+    benchmark::DoNotOptimize(n);
+    net_to_cpu48(&n);
+    benchmark::DoNotOptimize(n);
+  }
+}
+BENCHMARK(netOrder48);
+
+// Convert PTP Timestamp_t to network order and back
+static void netOrderTs(benchmark::State &state)
+{
+  struct Timestamp_t ts;
+  set_uint48(&ts.secondsField, 1750000000);
+  ts.nanosecondsField = 123456789;
+  allocCounter c(state);
+  for(auto _ : state) {
+    cpu_to_net_ts(&ts);
+    benchmark::DoNotOptimize(ts);
+    net_to_cpu_ts(&ts);
+    benchmark::DoNotOptimize(ts);
+  }
+}
+BENCHMARK(netOrderTs);
@@ -0,0 +1,35 @@
+#ifndef __CSPTP_CONFIG_H_
+#define __CSPTP_CONFIG_H_
+#define HAVE_STDBOOL_H 1
+#define HAVE_THREADS_H 1
+#define HAVE_UNISTD_H 1
+#define HAVE_PTHREAD_H 1
+#define HAVE_SYSLOG_H 1
+#define HAVE_STRINGS_H 1
+#define HAVE_FCNTL_H 1
+#define HAVE_POLL_H 1
+#define HAVE_NETDB_H 1
+#define HAVE_ENDIAN_H 1
+#define HAVE_SYS_STAT_H 1
+#define HAVE_SYS_SOCKET_H 1
+#define HAVE_SYS_TYPES_H 1
+#define HAVE_SYS_MMAN_H 1
+#define HAVE_SYS_UN_H 1
+#define HAVE_SYS_RESOURCE_H 1
+#define HAVE_ARPA_INET_H 1
+#define HAVE_NET_IF_H 1
+#define HAVE_NETINET_IN_H 1
+#define HAVE_IFADDRS_H 1
+#define HAVE_GETOPT_H 1
+#define HAVE_SYS_IOCTL_H 1
+#define HAVE_SYS_EPOLL_H 1
+#define HAVE_SYS_TIMERFD_H 1
+#define HAVE_SYS_SIGNALFD_H 1
+#define HAVE_SYS_EVENTFD_H 1
+#define HAVE_DECL_GETLINE 1
+#define HAVE_DECL_REALPATH 1
+/* #undef HAVE_DECL_HTONLL */
+#define HAVE_TM_GMTOFF 1
+#define HAVE_IO_URING 1
+#define HAVE_BPF_XDP 1
+#endif
@@ -47,6 +47,7 @@
 #include <linux/ptp_clock.h>
 #include <linux/ethtool.h>
 #include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
 /*****************************************************************************/
 static const size_t single_print = 1024;
 static std::string out_buf;
@@ -109,6 +110,8 @@ sysFuncDec(ssize_t, recvfrom, int, void *, size_t, int, sockaddr *, socklen_t *)
 sysFuncDec(ssize_t, sendto, int, const void *, size_t, int, const sockaddr *, socklen_t);
 sysFuncDec(ssize_t, recvmsg, int, msghdr *, int);
 sysFuncDec(ssize_t, sendmsg, int, const msghdr *, int);
+sysFuncDec(int, recvmmsg, int, mmsghdr *, unsigned int, int, timespec *);
+sysFuncDec(int, sendmmsg, int, mmsghdr *, unsigned int, int);
 sysFuncDec(int, poll, pollfd *, nfds_t, int);
 sysFuncDec(int, __poll_chk, pollfd *, nfds_t, int, size_t);
 sysFuncDec(int, printf, const char *, ...);
@@ -160,6 +163,8 @@ void initLibSys()
     sysFuncAgn(ssize_t, sendto, int, const void *, size_t, int, const sockaddr *, socklen_t);
     sysFuncAgn(ssize_t, recvmsg, int, msghdr *, int);
     sysFuncAgn(ssize_t, sendmsg, int, const msghdr *, int);
+    sysFuncAgn(int, recvmmsg, int, mmsghdr *, unsigned int, int, timespec *);
+    sysFuncAgn(int, sendmmsg, int, mmsghdr *, unsigned int, int);
     sysFuncAgn(int, poll, pollfd *, nfds_t, int);
     sysFuncAgn(int, __poll_chk, pollfd *, nfds_t, int, size_t);
     sysFuncAgn(int, printf, const char *, ...);
@@ -327,11 +332,19 @@ int setsockopt(int fd, int level, int optname, const void *optval, socklen_t opt
                     if(fd == 7 && optlen == 7 &&
                        strcmp("enp0s25", (const char*)optval) == 0)
                         return 0;
+                case SO_REUSEPORT:
+                case SO_INCOMING_CPU:
+                    if(fd == 7 && optlen == sizeof(int) && *(const int *)optval >= 0)
+                        return 0;
+                    break;
                 case SO_TIMESTAMPING:
                     ts = (so_timestamping *)optval;
                     if(fd == 7 && optlen == sizeof(so_timestamping) &&
-                       ts->flags == (SOF_TIMESTAMPING_TX_HARDWARE |
-                           SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE) &&
+                       (ts->flags & ~(SOF_TIMESTAMPING_TX_SOFTWARE |
+                           SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY)) ==
+                       (SOF_TIMESTAMPING_TX_HARDWARE |
+                           SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+                           SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE) &&
                        ts->bind_phc == 0)
                         return 0;
                 default:
@@ -371,9 +384,59 @@ ssize_t sendto(int fd, const void *buf, size_t len, int flags, const sockaddr *a
     }
     return retErr(EINVAL);
 }
+/* Add receive timestamp control message
+ * index 0 for software and 2 for hardware */
+static void addRxTs(msghdr *m, int index, time_t sec)
+{
+    cmsghdr *cm = CMSG_FIRSTHDR(m);
+    if(cm == nullptr || m->msg_controllen < CMSG_SPACE(sizeof(scm_timestamping))) {
+        m->msg_controllen = 0;
+        return;
+    }
+    scm_timestamping tss = {};
+    tss.ts[index].tv_sec = sec;
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_TIMESTAMPING;
+    cm->cmsg_len = CMSG_LEN(sizeof(tss));
+    memcpy(CMSG_DATA(cm), &tss, sizeof(tss));
+    m->msg_controllen = CMSG_SPACE(sizeof(tss));
+}
 ssize_t recvmsg(int fd, msghdr *msg, int flags)
 {
     retTest(recvmsg, fd, msg, flags);
+    /* Transmit timestamp of message ID 5 */
+    if(fd == 7 && msg != nullptr && flags == (MSG_ERRQUEUE | MSG_DONTWAIT)) {
+        size_t size = msg->msg_controllen;
+        addRxTs(msg, 0, 11); // Software timestamp
+        size_t len = msg->msg_controllen;
+        sock_extended_err err = {};
+        if(len == 0 || len + CMSG_SPACE(sizeof(err)) > size)
+            return retErr(EINVAL);
+        cmsghdr *cm = (cmsghdr *)((uint8_t *)msg->msg_control + len);
+        err.ee_errno = ENOMSG;
+        err.ee_origin = SO_EE_ORIGIN_TIMESTAMPING;
+        err.ee_data = 5;
+        cm->cmsg_level = SOL_IP;
+        cm->cmsg_type = IP_RECVERR;
+        cm->cmsg_len = CMSG_LEN(sizeof(err));
+        memcpy(CMSG_DATA(cm), &err, sizeof(err));
+        msg->msg_controllen = len + CMSG_SPACE(sizeof(err));
+        msg->msg_flags = MSG_ERRQUEUE;
+        return 0;
+    }
+    if(fd == 7 && msg != nullptr && flags == MSG_DONTWAIT && msg->msg_iovlen == 1 &&
+       msg->msg_iov != nullptr && msg->msg_iov->iov_len == 10 &&
+       msg->msg_iov->iov_base != nullptr && msg->msg_namelen == 16) {
+        sockaddr *addr = (sockaddr *)msg->msg_name;
+        if(addr == nullptr || addr->sa_family != AF_INET)
+            return retErr(EINVAL);
+        static const uint8_t d[6] = { 10, 7, 1, 10, 5, 10 };
+        memcpy(addr->sa_data, d, 6);
+        memcpy(msg->msg_iov->iov_base, "test", 4);
+        addRxTs(msg, 0, 7); // Software timestamp
+        msg->msg_flags = 0;
+        return 4;
+    }
     return retErr(EINVAL);
 }
 ssize_t sendmsg(int fd, const msghdr *msg, int flags)
@@ -381,6 +444,51 @@ ssize_t sendmsg(int fd, const msghdr *msg, int flags)
     retTest(sendmsg, fd, msg, flags);
     return retErr(EINVAL);
 }
+int recvmmsg(int fd, mmsghdr *msgs, unsigned int vlen, int flags, timespec *tmo)
+{
+    retTest(recvmmsg, fd, msgs, vlen, flags, tmo);
+    if(fd == 7 && msgs != nullptr && vlen == 2 && flags == MSG_DONTWAIT && tmo == nullptr) {
+        static const uint8_t d[2][6] = {{ 10, 7, 1, 10, 5, 10 }, { 10, 8, 1, 10, 5, 11 }};
+        static const char *data[2] = { "test", "tst2" };
+        for(unsigned int i = 0; i < vlen; i++) {
+            msghdr *m = &msgs[i].msg_hdr;
+            sockaddr *addr = (sockaddr *)m->msg_name;
+            if(m->msg_iovlen != 1 || m->msg_iov == nullptr ||
+               m->msg_iov->iov_len != 10 || m->msg_iov->iov_base == nullptr ||
+               m->msg_namelen != 16 || addr == nullptr || addr->sa_family != AF_INET)
+                return retErr(EINVAL);
+            memcpy(addr->sa_data, d[i], 6);
+            memcpy(m->msg_iov->iov_base, data[i], 4);
+            if(i == 1)
+                addRxTs(m, 2, 9); // Hardware timestamp
+            else
+                m->msg_controllen = 0;
+            msgs[i].msg_len = 4;
+        }
+        return vlen;
+    }
+    return retErr(EINVAL);
+}
+int sendmmsg(int fd, mmsghdr *msgs, unsigned int vlen, int flags)
+{
+    retTest(sendmmsg, fd, msgs, vlen, flags);
+    if(fd == 7 && msgs != nullptr && vlen == 2 && flags == 0) {
+        static const uint8_t d[6] = { 1, 64, 1, 2, 5, 1 };
+        for(unsigned int i = 0; i < vlen; i++) {
+            msghdr *m = &msgs[i].msg_hdr;
+            sockaddr *addr = (sockaddr *)m->msg_name;
+            if(m->msg_iovlen != 1 || m->msg_iov == nullptr ||
+               m->msg_iov->iov_len != 10 ||
+               memcmp(m->msg_iov->iov_base, "test1246xx", 10) != 0 ||
+               m->msg_namelen != 16 || addr == nullptr || addr->sa_family != AF_INET ||
+               memcmp(d, addr->sa_data, 6) != 0)
+                return retErr(EINVAL);
+            msgs[i].msg_len = 10;
+        }
+        return vlen;
+    }
+    return retErr(EINVAL);
+}
 int poll(pollfd *fds, nfds_t nfds, int timeout)
 {
     retTest(poll, fds, nfds, timeout);
@@ -78,6 +78,53 @@ struct buffer_t {
     bool (*resize)(pbuffer self, size_t newSize);
 };
 
+/* Fast path functions, without the object checks of the methods.
+ * Used per packet where the caller ensures the buffer object exists. */
+
+/**
+ * Get pointer to actual buffer
+ * @param[in] self buffer object
+ * @return pointer to actual buffer
+ */
+static inline uint8_t *buffer_getBuf(pcbuffer self)
+{
+    return (uint8_t *)self->_buffer;
+}
+
+/**
+ * Get buffer data length
+ * @param[in] self buffer object
+ * @return buffer data length
+ */
+static inline size_t buffer_getLen(pcbuffer self)
+{
+    return self->_len;
+}
+
+/**
+ * Get buffer size available to use
+ * @param[in] self buffer object
+ * @return buffer size
+ */
+static inline size_t buffer_getSize(pcbuffer self)
+{
+    return self->_size;
+}
+
+/**
+ * Set buffer data length
+ * @param[in, out] self buffer object
+ * @param[in] len new legth
+ * @return true if length is valid
+ */
+static inline bool buffer_setLen(pbuffer self, size_t len)
+{
+    if(UNLIKELY_COND(len > self->_size))
+        return false;
+    self->_len = len;
+    return true;
+}
+
 /**
  * Allocate a buffer object
  * @param[in] size of buffer
@@ -15,6 +15,7 @@
 #include "src/log.h"
 #include "src/msg.h"
 #include "src/opt.h"
+#include "src/transport.h"
 
 /*
  * TODO contain information on our clock
@@ -42,6 +43,8 @@ struct ifClk_t {
     int32_t jumpSeconds; /* the size of the next discontinuity in second */
     uint64_t timeOfNextJump; /* The PTP time of the next discontinuity */
     const char *TZName; /** Time zone arbiviation */
+    /* Increment on any change, to invalidate cached responses */
+    uint32_t generation;
 };
 
 struct service_opt {
@@ -50,6 +53,21 @@ struct service_opt {
     struct ifClk_t clockInfo;
     prot type;
     const char *ifName;
+    size_t batchSize; /* Maximum messages handled in a single system call */
+    size_t workers; /* Number of worker threads, each with its own socket */
+    bool useIncomingCpu; /* Match workers to NIC receive queues */
+    bool useUring; /* Send and receive with io_uring */
+    bool usePacket; /* Send and receive with a packet ring on ifName */
+    bool useXdp; /* Answer one step Sync requests with XDP on ifName */
+    uint32_t clientRate; /* Requests per second from a client, zero for no limit */
+    uint32_t clientBurst; /* Requests a client can send at once */
+    uint32_t rate; /* Requests per second of the service, zero for no limit */
+    size_t storeBits; /* Bits of the two steps Sync hash table size, per worker */
+    const char *statsSocket; /* Unix socket to export statistics, or empty */
+    int statsWindow; /* Seconds of the latency window of the statistics */
+    uint16_t port; /* UDP port of the service, zero for the PTP event port */
+    enum transport_e transport; /* Transport of the service socket */
+    const char *shmPath; /* Shared memory file of the shared memory transport */
 };
 
 struct client_opt {
@@ -60,6 +78,35 @@ struct client_opt {
     prot type;
     const char *ifName;
     const char *ip;
+    enum transport_e transport; /* Transport to the service */
+    const char *shmPath; /* Shared memory file of the shared memory transport */
+};
+
+struct loadgen_opt {
+    uint8_t domainNumber;
+    prot type;
+    const char *ip;
+    size_t clients; /* Number of clients, each with its own socket */
+    size_t addresses; /* Loopback source addresses of the clients */
+    uint32_t rate; /* Requests per second of all clients */
+    bool usePoisson; /* Poisson arrivals, constant rate otherwise */
+    uint32_t duration; /* Seconds of sending requests */
+    uint32_t timeout; /* Milliseconds to wait for responses */
+    uint8_t twoStepsPct; /* Percent of clients using two steps */
+    uint8_t statusPct; /* Percent of clients requesting CSPTP status TLV */
+    uint8_t altTimePct; /* Percent of clients requesting alternate timescale TLV */
+};
+
+struct replay_opt {
+    bool useRxTwoSteps;
+    bool useTxTwoSteps;
+    prot type;
+    const char *ifName;
+    const char *input; /* Capture file of the requests */
+    const char *output; /* Capture file of the responses, or empty */
+    size_t batchSize; /* Maximum messages handled in a single call */
+    uint16_t port; /* UDP port of the service in the capture */
+    uint32_t loops; /* Number of times we replay the capture */
 };
 
 enum cmd_ret {
@@ -96,6 +143,24 @@ enum cmd_ret cmd_service(int argc, char *argv[], struct service_opt *options);
  */
 enum cmd_ret cmd_client(int argc, char *argv[], struct client_opt *options);
 
+/**
+ * Parse command line for load generator
+ * @param[in] argc main pass number of arguments passed
+ * @param[in] argcv main pass array of strings
+ * @param[in, out] options structure for load generator
+ * @return enum cmd_ret state
+ */
+enum cmd_ret cmd_loadgen(int argc, char *argv[], struct loadgen_opt *options);
+
+/**
+ * Parse command line for replay
+ * @param[in] argc main pass number of arguments passed
+ * @param[in] argcv main pass array of strings
+ * @param[in, out] options structure for replay
+ * @return enum cmd_ret state
+ */
+enum cmd_ret cmd_replay(int argc, char *argv[], struct replay_opt *options);
+
 #define CMD_CALL(func) \
     switch(cmd_##func(argc, argv, &options)) {\
     case CMD_ERR: return EXIT_FAILURE;\
@@ -19,6 +19,8 @@ static const struct opt_rec_t client_options[] = {
     KEY_BOOL("ipv4", '4', "Force IPv4 service", false),
     KEY_BOOL("ipv6", '6', "Force IPv6 service", false),
     KEY_INT("domainNumber", 'n', "<domain number> domainNumber", 128, 128, 239),
+    KEY_ENUM("transport", 'T', "<transport> udp or shm, shared memory with a local service", TRANSPORT_UDP, transport2str, 7, TRANSPORT_UDP, TRANSPORT_SHM),
+    KEY_STR("shmPath", 'S', "<path> of the shared memory file", "/dev/shm/csptp", 0),
     KEY_LAST
 };
 
@@ -53,6 +55,8 @@ enum cmd_ret cmd_client(int argc, char *argv[], struct client_opt *o)
     o->useAltTimeScale = GET_OPT_FALSE('a');
     o->ip = GET_OPT_STR('d');
     o->domainNumber = GET_OPT_INT('n', 128);
+    o->transport = GET_OPT_INT('T', TRANSPORT_UDP);
+    o->shmPath = GET_OPT_STR('S');
     opt->free(opt);
     return CMD_OK;
 }
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief command line parsing for load generator
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/cmdl.h"
+
+static const struct opt_rec_t loadgen_options[] = {
+    KEY_STR("serviceAddress", 'd', "<address> IP address or host name of service", "", 0),
+    KEY_BOOL("ipv4", '4', "Force IPv4 service", false),
+    KEY_BOOL("ipv6", '6', "Force IPv6 service", false),
+    KEY_INT("domainNumber", 'n', "<domain number> domainNumber", 128, 128, 239),
+    KEY_INT("clients", 'c', "<number> of clients, each with its own socket", 1000, 1, 1000000),
+    KEY_INT("addresses", 'A', "<number> of loopback source addresses, IPv4 loopback service only", 1, 1, 65536),
+    KEY_INT("rate", 'r', "<number> requests per second of all clients", 1000, 1, 10000000),
+    KEY_BOOL("poisson", 'p', "Use Poisson arrivals (default constant rate)", false),
+    KEY_INT("duration", 'D', "<seconds> of sending requests", 10, 1, 86400),
+    KEY_INT("timeout", 'w', "<milliseconds> to wait for responses", 1000, 1, 60000),
+    KEY_INT("twoSteps", 't', "<percent> of clients using two-steps PTP messages", 0, 0, 100),
+    KEY_INT("reqStatTLV", 's', "<percent> of clients requesting CSPTP status TLV", 0, 0, 100),
+    KEY_INT("reqAltTLV", 'a', "<percent> of clients requesting alternate timescale TLV", 0, 0, 100),
+    KEY_LAST
+};
+
+enum cmd_ret cmd_loadgen(int argc, char *argv[], struct loadgen_opt *o)
+{
+    popt opt;
+    optRecVal v;
+    bool h4, h6;
+    enum cmd_ret ret;
+    if(o == NULL || argc == 0 || argv == NULL)
+        return CMD_ERR;
+    ret = cmd_base(argc, argv, &opt, loadgen_options);
+    if(ret != CMD_OK)
+        return ret;
+    h4 = GET_OPT_FALSE('4');
+    h6 = GET_OPT_FALSE('6');
+    if(h4 && h6) {
+        CMD_OERR("options '-4' and '-6' can not be used together\n");
+        opt->free(opt);
+        return CMD_ERR;
+    }
+    if(h4)
+        o->type = UDP_IPv4;
+    else if(h6)
+        o->type = UDP_IPv6;
+    else
+        o->type = Invalid_PROTO;
+    o->ip = GET_OPT_STR('d');
+    o->domainNumber = GET_OPT_INT('n', 128);
+    o->clients = GET_OPT_INT('c', 1000);
+    o->addresses = GET_OPT_INT('A', 1);
+    o->rate = GET_OPT_INT('r', 1000);
+    o->usePoisson = GET_OPT_FALSE('p');
+    o->duration = GET_OPT_INT('D', 10);
+    o->timeout = GET_OPT_INT('w', 1000);
+    o->twoStepsPct = GET_OPT_INT('t', 0);
+    o->statusPct = GET_OPT_INT('s', 0);
+    o->altTimePct = GET_OPT_INT('a', 0);
+    opt->free(opt);
+    return CMD_OK;
+}
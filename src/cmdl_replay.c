@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief command line parsing for replay
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/cmdl.h"
+
+static const struct opt_rec_t replay_options[] = {
+    KEY_STR("input", 'p', "<file> pcap or pcapng capture of the requests", "", 0),
+    KEY_STR("output", 'o', "<file> pcap to write the responses", "", 0),
+    KEY_INT("oneStepRx", 'r', "1 receive one-step PTP messages only\n2 receive two-steps PTP messages only", 2, 1, 2),
+    KEY_INT("oneStepTx", 't', "1 transmit one-step PTP messages only\n2 transmit two-steps PTP messages only", 2, 1, 2),
+    KEY_BOOL("ipv6", '6', "Use IPv6 (defualt IPv4)", false),
+    KEY_INT("batch", 'b', "<number> maximum messages handled in a single call", 1, 1, 1024),
+    KEY_INT("port", 'P', "<port> UDP port of the service in the capture", 320, 1, UINT16_MAX),
+    KEY_INT("loops", 'n', "<number> of times to replay the capture", 1, 1, 1000000),
+    KEY_LAST
+};
+
+enum cmd_ret cmd_replay(int argc, char *argv[], struct replay_opt *o)
+{
+    popt opt;
+    optRecVal v;
+    enum cmd_ret ret;
+    if(o == NULL || argc == 0 || argv == NULL)
+        return CMD_ERR;
+    ret = cmd_base(argc, argv, &opt, replay_options);
+    if(ret != CMD_OK)
+        return ret;
+    o->input = GET_OPT_STR('p');
+    if(*o->input == 0) {
+        CMD_OERR("option '-p' is mandatory\n");
+        opt->free(opt);
+        return CMD_ERR;
+    }
+    o->output = GET_OPT_STR('o');
+    o->ifName = GET_OPT_STR('i');
+    o->useRxTwoSteps = GET_OPT_INT('r', 2) == 2;
+    o->useTxTwoSteps = GET_OPT_INT('t', 2) == 2;
+    o->type = GET_OPT_FALSE('6') ? UDP_IPv6 : UDP_IPv4;
+    o->batchSize = GET_OPT_INT('b', 1);
+    o->port = GET_OPT_INT('P', 320);
+    o->loops = GET_OPT_INT('n', 1);
+    opt->free(opt);
+    return CMD_OK;
+}
@@ -10,6 +10,7 @@
  */
 
 #include "src/cmdl.h"
+#include "src/store.h"
 
 static const struct opt_rec_t service_options[] = {
     KEY_INT("oneStepRx", 'r', "1 receive one-step PTP messages only\n2 receive two-steps PTP messages only", 2, 1, 2),
@@ -21,6 +22,20 @@ static const struct opt_rec_t service_options[] = {
     KEY_INT("clockAccuracy", 0, NULL, 0xfe, 0, 0xfe),
     KEY_INT("offsetScaledLogVariance", 0, NULL, 0xffff, 0, UINT16_MAX),
     KEY_BOOL("ipv6", '6', "Use IPv6 (defualt IPv4)", false),
+    KEY_INT("batch", 'b', "<number> maximum messages handled in a single system call", 1, 1, 1024),
+    KEY_INT("workers", 'w', "<number> of worker threads, 0 for a worker per CPU", 1, 0, 1024),
+    KEY_BOOL("incomingCpu", 'c', "Match workers to NIC receive queues by their CPU", false),
+    KEY_BOOL("uring", 'u', "Use io_uring when the kernel supports it", false),
+    KEY_BOOL("packet", 'p', "Use a packet ring on the interface", false),
+    KEY_BOOL("xdp", 'x', "Answer one step Sync requests with XDP on the interface", false),
+    KEY_INT("clientRate", 'q', "<number> requests per second from a client, 0 for no limit", 0, 0, 1000000),
+    KEY_INT("clientBurst", 0, NULL, 8, 1, 65535),
+    KEY_INT("rate", 'g', "<number> requests per second of the service, 0 for no limit", 0, 0, 100000000),
+    KEY_INT("storeBits", 0, NULL, STORE_HASH_BITS, 0, 31),
+    KEY_STR("statsSocket", 'm', "<path> of a Unix socket to export statistics", "", 0),
+    KEY_INT("statsWindow", 0, NULL, 60, 1, 86400),
+    KEY_ENUM("transport", 'T', "<transport> udp or shm, shared memory with local clients", TRANSPORT_UDP, transport2str, 7, TRANSPORT_UDP, TRANSPORT_SHM),
+    KEY_STR("shmPath", 'S', "<path> of the shared memory file", "/dev/shm/csptp", 0),
     KEY_LAST
 };
 
@@ -38,6 +53,21 @@ enum cmd_ret cmd_service(int argc, char *argv[], struct service_opt *o)
     o->useRxTwoSteps = GET_OPT_INT('r', 2) == 2;
     o->useTxTwoSteps = GET_OPT_INT('t', 2) == 2;
     o->type = GET_OPT_FALSE('6') ? UDP_IPv6 : UDP_IPv4;
+    o->batchSize = GET_OPT_INT('b', 1);
+    o->workers = GET_OPT_INT('w', 1);
+    o->useIncomingCpu = GET_OPT_FALSE('c');
+    o->useUring = GET_OPT_FALSE('u');
+    o->usePacket = GET_OPT_FALSE('p');
+    o->useXdp = GET_OPT_FALSE('x');
+    o->clientRate = GET_OPT_INT('q', 0);
+    o->clientBurst = opt->getValKey(opt, "clientBurst", &v) ? v.i : 8;
+    o->rate = GET_OPT_INT('g', 0);
+    o->storeBits = opt->getValKey(opt, "storeBits", &v) ? v.i : STORE_HASH_BITS;
+    o->statsSocket = GET_OPT_STR('m');
+    o->statsWindow = opt->getValKey(opt, "statsWindow", &v) ? v.i : 60;
+    o->port = 0;
+    o->transport = GET_OPT_INT('T', TRANSPORT_UDP);
+    o->shmPath = GET_OPT_STR('S');
     opt->free(opt);
     return CMD_OK;
 }
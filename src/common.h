@@ -42,6 +42,7 @@ https://clang.llvm.org/docs/AttributeReference.html
 https://learn.microsoft.com/en-us/cpp/cpp/attributes?view=msvc-170#microsoft-specific-attributes
 #endif
 #define _PACKED__ __attribute__((packed))
+#define _ALIGNED__(_n) __attribute__((aligned(_n)))
 
 #define LIKELY_COND(_expr) (__builtin_expect((_expr), true))
 #define UNLIKELY_COND(_expr) (__builtin_expect((_expr), false))
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief log-linear histogram of latency
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/hist.h"
+#include "src/log.h"
+
+/* Highest value of a bucket */
+static inline uint64_t highest(size_t index)
+{
+    int shift;
+    if(index < 2 * HIST_SUB)
+        return index;
+    shift = index / HIST_SUB - 1;
+    return (((index % HIST_SUB) + HIST_SUB + 1) << shift) - 1;
+}
+static inline uint64_t load(const uint64_t *v)
+{
+    return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+static void _free(phist self)
+{
+    free(self);
+}
+static void _clear(phist self)
+{
+    if(LIKELY_COND(self != NULL)) {
+        memset(self->_cnt, 0, sizeof(self->_cnt));
+        self->_num = 0;
+        self->_sum = 0;
+        self->_max = 0;
+    }
+}
+static void _add(phist self, pchist other)
+{
+    uint64_t max;
+    if(UNLIKELY_COND(self == NULL || other == NULL))
+        return;
+    for(size_t i = 0; i < HIST_BUCKETS; i++)
+        self->_cnt[i] += load(other->_cnt + i);
+    self->_num += load(&other->_num);
+    self->_sum += load(&other->_sum);
+    max = load(&other->_max);
+    if(max > self->_max)
+        self->_max = max;
+}
+static void _sub(phist self, pchist other)
+{
+    size_t top = 0;
+    if(UNLIKELY_COND(self == NULL || other == NULL))
+        return;
+    for(size_t i = 0; i < HIST_BUCKETS; i++) {
+        /* The workers may record values while we add them */
+        self->_cnt[i] = self->_cnt[i] > other->_cnt[i] ?
+            self->_cnt[i] - other->_cnt[i] : 0;
+        if(self->_cnt[i] > 0)
+            top = i;
+    }
+    self->_num = self->_num > other->_num ? self->_num - other->_num : 0;
+    self->_sum = self->_sum > other->_sum ? self->_sum - other->_sum : 0;
+    if(self->_num == 0)
+        self->_max = 0;
+    else if(highest(top) < self->_max)
+        self->_max = highest(top);
+}
+static uint64_t _count(pchist self)
+{
+    return UNLIKELY_COND(self == NULL) ? 0 : load(&self->_num);
+}
+static uint64_t _sum(pchist self)
+{
+    return UNLIKELY_COND(self == NULL) ? 0 : load(&self->_sum);
+}
+static uint64_t _max(pchist self)
+{
+    return UNLIKELY_COND(self == NULL) ? 0 : load(&self->_max);
+}
+static uint64_t _value(pchist self, double percentile)
+{
+    double t;
+    uint64_t target, num = 0, max;
+    if(UNLIKELY_COND(self == NULL))
+        return 0;
+    for(size_t i = 0; i < HIST_BUCKETS; i++)
+        num += load(self->_cnt + i);
+    if(num == 0)
+        return 0;
+    if(percentile < 0)
+        percentile = 0;
+    /* Round up the rank of the percentile */
+    t = num * percentile / 100;
+    target = t;
+    if(target < t)
+        target++;
+    if(target == 0)
+        target = 1;
+    else if(target > num)
+        target = num;
+    max = load(&self->_max);
+    num = 0;
+    for(size_t i = 0; i < HIST_BUCKETS; i++) {
+        num += load(self->_cnt + i);
+        if(num >= target)
+            return highest(i) < max ? highest(i) : max;
+    }
+    return max;
+}
+
+phist hist_alloc()
+{
+    phist ret = malloc(sizeof(struct hist_t));
+    if(ret == NULL) {
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    _clear(ret);
+#define asg(a) ret->a = _##a
+    asg(free);
+    asg(clear);
+    asg(add);
+    asg(sub);
+    asg(count);
+    asg(sum);
+    asg(max);
+    asg(value);
+    return ret;
+}
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief log-linear histogram of latency
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_HIST_H_
+#define __CSPTP_HIST_H_
+
+#include "src/common.h"
+
+/** Number of bits of linear buckets in each power of two */
+#define HIST_SUB_BITS (5)
+/** Number of linear buckets in each power of two */
+#define HIST_SUB (1 << HIST_SUB_BITS)
+/** Number of bits of the highest value, about 18 minutes in nanoseconds */
+#define HIST_MAX_BITS (40)
+/** Number of buckets */
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct hist_t *phist;
+typedef const struct hist_t *pchist;
+
+struct hist_t {
+    uint64_t _cnt[HIST_BUCKETS]; /**> number of values in each bucket */
+    uint64_t _num; /**> number of values */
+    uint64_t _sum; /**> sum of values */
+    uint64_t _max; /**> highest value */
+
+    /**
+     * Free this histogram object
+     * @param[in, out] self histogram object
+     */
+    void (*free)(phist self);
+
+    /**
+     * Remove all values
+     * @param[in, out] self histogram object
+     */
+    void (*clear)(phist self);
+
+    /**
+     * Add values of another histogram
+     * @param[in, out] self histogram object
+     * @param[in] other histogram object, may be written by another thread
+     */
+    void (*add)(phist self, pchist other);
+
+    /**
+     * Subtract values of an older copy of this histogram
+     * @param[in, out] self histogram object
+     * @param[in] other older histogram object
+     * @note the highest value is taken from the buckets
+     */
+    void (*sub)(phist self, pchist other);
+
+    /**
+     * Get number of values
+     * @param[in] self histogram object
+     * @return number of values
+     */
+    uint64_t (*count)(pchist self);
+
+    /**
+     * Get sum of values
+     * @param[in] self histogram object
+     * @return sum of values
+     */
+    uint64_t (*sum)(pchist self);
+
+    /**
+     * Get highest value
+     * @param[in] self histogram object
+     * @return highest value
+     */
+    uint64_t (*max)(pchist self);
+
+    /**
+     * Get value at a percentile
+     * @param[in] self histogram object
+     * @param[in] percentile between 0 and 100
+     * @return highest value of the bucket that holds the percentile,
+     *         or zero without values
+     * @note the relative error is below 1 / HIST_SUB
+     */
+    uint64_t (*value)(pchist self, double percentile);
+};
+
+/**
+ * Get bucket of a value
+ * @param[in] value to record
+ * @return bucket index
+ * @note values up to 2 * HIST_SUB have their own bucket, higher values
+ *       share HIST_SUB buckets in each power of two
+ */
+static inline size_t hist_index(uint64_t value)
+{
+    int shift;
+    if(value < 2 * HIST_SUB)
+        return value;
+    if(value >> HIST_MAX_BITS > 0)
+        return HIST_BUCKETS - 1;
+    shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return shift * HIST_SUB + (value >> shift);
+}
+
+/**
+ * Record a value
+ * @param[in, out] self histogram object
+ * @param[in] value to record
+ * @note a single writer, the stores are atomic for the readers,
+ *       without a locked instruction
+ */
+static inline void hist_record(phist self, uint64_t value)
+{
+    uint64_t *c = self->_cnt + hist_index(value);
+    __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + 1,
+        __ATOMIC_RELAXED);
+    __atomic_store_n(&self->_num, self->_num + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->_sum, self->_sum + value, __ATOMIC_RELAXED);
+    if(value > self->_max)
+        __atomic_store_n(&self->_max, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Allocate a histogram object
+ * @return pointer to a new histogram object or null
+ */
+phist hist_alloc();
+
+#endif /* __CSPTP_HIST_H_ */
@@ -0,0 +1,498 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief event loop object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/loop.h"
+#include "src/log.h"
+
+#include <errno.h>
+#include <signal.h>
+
+#if defined HAVE_SYS_EPOLL_H && defined HAVE_SYS_TIMERFD_H && \
+    defined HAVE_SYS_SIGNALFD_H && defined HAVE_SYS_EVENTFD_H
+#define __CSPTP_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <pthread.h> /* For pthread_sigmask() */
+#else /* HAVE_SYS_EPOLL_H */
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef _WIN32
+#include <winsock2.h>
+#define poll(fds, nfds, timeout) WSAPoll(fds, nfds, timeout)
+#endif /* _WIN32 */
+/* Without signalfd and eventfd, we poll with a limited timeout,
+ * to catch signals and stop requests */
+#define POLL_MAX_MS (100)
+#define MAX_SIGNAL (65)
+static volatile sig_atomic_t pendingSignals[MAX_SIGNAL];
+static void signal_handler(int signal)
+{
+    if(signal > 0 && signal < MAX_SIGNAL)
+        pendingSignals[signal] = 1;
+}
+static inline int64_t monoMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+#define ENTRIES_START (8) /* First entries allocation */
+#define WAIT_EVENTS (16) /* Maximum events in a single wait */
+#ifdef __CSPTP_EPOLL
+#define WAKE_ID UINT32_MAX /* epoll data of wake file descriptor */
+#define SIGNAL_ID (UINT32_MAX - 1) /* epoll data of signals file descriptor */
+#endif
+
+enum loop_ent_e {
+    ENT_FREE = 0,
+    ENT_FD,
+    ENT_TIMER,
+    ENT_SIGNAL,
+};
+
+struct loop_ent_t {
+    enum loop_ent_e kind;
+    int fd; /* file descriptor or timer file descriptor */
+    int events; /* loop_events_e we wait for */
+    int signal;
+    int interval; /* timer interval in milliseconds */
+    int64_t expire; /* timer next expiration in monotonic milliseconds */
+    loop_f func;
+    void *cookie;
+};
+
+static inline int newEnt(ploop self, enum loop_ent_e kind, const loop_f func,
+    void *cookie)
+{
+    size_t id;
+    struct loop_ent_t *e;
+    if(func == NULL) {
+        log_err("function is missing");
+        return -1;
+    }
+    for(id = 0; id < self->_num; id++) {
+        if(self->_ents[id].kind == ENT_FREE)
+            break;
+    }
+    if(id == self->_num) {
+        size_t num = self->_num == 0 ? ENTRIES_START : self->_num * 2;
+        e = realloc(self->_ents, num * sizeof(struct loop_ent_t));
+        if(e == NULL) {
+            log_err("memory allocation failed");
+            return -1;
+        }
+        memset(e + self->_num, 0, (num - self->_num) * sizeof(struct loop_ent_t));
+        self->_ents = e;
+        self->_num = num;
+    }
+    e = self->_ents + id;
+    e->kind = kind;
+    e->fd = -1;
+    e->events = 0;
+    e->signal = 0;
+    e->interval = 0;
+    e->expire = 0;
+    e->func = func;
+    e->cookie = cookie;
+    return id;
+}
+static inline bool callEnt(ploop self, size_t id, int events)
+{
+    struct loop_ent_t *e = self->_ents + id;
+    /* The entry may be removed by a previous call back */
+    if(e->kind == ENT_FREE)
+        return true;
+    if(!e->func(self, events, e->cookie)) {
+        atomic_store_explicit(&self->_run, false, memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+#ifdef __CSPTP_EPOLL
+static inline bool setSignals(ploop self, int how, sigset_t *mask)
+{
+    sigemptyset(mask);
+    for(size_t i = 0; i < self->_num; i++) {
+        if(self->_ents[i].kind == ENT_SIGNAL)
+            sigaddset(mask, self->_ents[i].signal);
+    }
+    if(pthread_sigmask(how, mask, NULL) != 0) {
+        logp_err("pthread_sigmask");
+        return false;
+    }
+    return true;
+}
+static inline void readSignals(ploop self)
+{
+    struct signalfd_siginfo info;
+    while(read(self->_sigFd, &info, sizeof(info)) == sizeof(info)) {
+        for(size_t i = 0; i < self->_num; i++) {
+            if(self->_ents[i].kind == ENT_SIGNAL &&
+                self->_ents[i].signal == info.ssi_signo)
+                callEnt(self, i, 0);
+        }
+    }
+}
+#endif /* __CSPTP_EPOLL */
+
+static void _free(ploop self)
+{
+    if(UNLIKELY_COND(self == NULL))
+        return;
+    #ifdef __CSPTP_EPOLL
+    if(self->_sigFd >= 0) {
+        sigset_t mask;
+        setSignals(self, SIG_UNBLOCK, &mask);
+        close(self->_sigFd);
+    }
+    for(size_t i = 0; i < self->_num; i++) {
+        if(self->_ents[i].kind == ENT_TIMER)
+            close(self->_ents[i].fd);
+    }
+    if(self->_wakeFd >= 0)
+        close(self->_wakeFd);
+    if(self->_fd >= 0)
+        close(self->_fd);
+    #else /* __CSPTP_EPOLL */
+    for(size_t i = 0; i < self->_num; i++) {
+        if(self->_ents[i].kind == ENT_SIGNAL)
+            signal(self->_ents[i].signal, SIG_DFL);
+    }
+    #endif /* __CSPTP_EPOLL */
+    free(self->_ents);
+    free(self);
+}
+static int _addFd(ploop self, int fd, int events, const loop_f func,
+    void *cookie)
+{
+    int id;
+    if(UNLIKELY_COND(self == NULL))
+        return -1;
+    if(fd < 0) {
+        log_err("wrong file descriptor %d", fd);
+        return -1;
+    }
+    id = newEnt(self, ENT_FD, func, cookie);
+    if(id < 0)
+        return -1;
+    #ifdef __CSPTP_EPOLL
+    struct epoll_event ev;
+    ev.events = ((events & LOOP_IN) ? EPOLLIN : 0) |
+        ((events & LOOP_ERR) ? EPOLLERR : 0);
+    ev.data.u64 = 0;
+    ev.data.u32 = id;
+    if(epoll_ctl(self->_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        logp_err("epoll_ctl");
+        self->_ents[id].kind = ENT_FREE;
+        return -1;
+    }
+    #endif /* __CSPTP_EPOLL */
+    self->_ents[id].fd = fd;
+    self->_ents[id].events = events;
+    return id;
+}
+static int _addTimer(ploop self, int interval, const loop_f func, void *cookie)
+{
+    int id;
+    if(UNLIKELY_COND(self == NULL))
+        return -1;
+    if(interval <= 0) {
+        log_err("wrong timer interval %d", interval);
+        return -1;
+    }
+    id = newEnt(self, ENT_TIMER, func, cookie);
+    if(id < 0)
+        return -1;
+    self->_ents[id].interval = interval;
+    #ifdef __CSPTP_EPOLL
+    struct epoll_event ev;
+    struct itimerspec its;
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(fd < 0) {
+        logp_err("timerfd_create");
+        self->_ents[id].kind = ENT_FREE;
+        return -1;
+    }
+    its.it_interval.tv_sec = interval / 1000;
+    its.it_interval.tv_nsec = (interval % 1000) * 1000000;
+    its.it_value = its.it_interval;
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    ev.data.u32 = id;
+    if(timerfd_settime(fd, 0, &its, NULL) < 0 ||
+        epoll_ctl(self->_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        logp_err("timer");
+        close(fd);
+        self->_ents[id].kind = ENT_FREE;
+        return -1;
+    }
+    self->_ents[id].fd = fd;
+    #else /* __CSPTP_EPOLL */
+    self->_ents[id].expire = monoMs() + interval;
+    #endif /* __CSPTP_EPOLL */
+    return id;
+}
+static int _addSignal(ploop self, int sig, const loop_f func, void *cookie)
+{
+    int id;
+    if(UNLIKELY_COND(self == NULL))
+        return -1;
+    id = newEnt(self, ENT_SIGNAL, func, cookie);
+    if(id < 0)
+        return -1;
+    self->_ents[id].signal = sig;
+    #ifdef __CSPTP_EPOLL
+    int fd;
+    sigset_t mask;
+    if(!setSignals(self, SIG_BLOCK, &mask)) {
+        self->_ents[id].kind = ENT_FREE;
+        return -1;
+    }
+    fd = signalfd(self->_sigFd, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(fd < 0) {
+        logp_err("signalfd");
+        self->_ents[id].kind = ENT_FREE;
+        return -1;
+    }
+    if(self->_sigFd < 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0;
+        ev.data.u32 = SIGNAL_ID;
+        if(epoll_ctl(self->_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            logp_err("epoll_ctl");
+            close(fd);
+            self->_ents[id].kind = ENT_FREE;
+            return -1;
+        }
+        self->_sigFd = fd;
+    }
+    #else /* __CSPTP_EPOLL */
+    if(sig <= 0 || sig >= MAX_SIGNAL || signal(sig, signal_handler) == SIG_ERR) {
+        log_err("capture of signal %d fail", sig);
+        self->_ents[id].kind = ENT_FREE;
+        return -1;
+    }
+    #endif /* __CSPTP_EPOLL */
+    return id;
+}
+static bool _del(ploop self, int id)
+{
+    struct loop_ent_t *e;
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    if(id < 0 || id >= self->_num || self->_ents[id].kind == ENT_FREE) {
+        log_err("wrong event ID %d", id);
+        return false;
+    }
+    e = self->_ents + id;
+    #ifdef __CSPTP_EPOLL
+    switch(e->kind) {
+        case ENT_FD:
+            epoll_ctl(self->_fd, EPOLL_CTL_DEL, e->fd, NULL);
+            break;
+        case ENT_TIMER:
+            close(e->fd); /* Closing remove it from epoll */
+            break;
+        case ENT_SIGNAL: {
+            /* The signal remain blocked, till we free the loop */
+            sigset_t mask;
+            e->kind = ENT_FREE;
+            setSignals(self, SIG_BLOCK, &mask);
+            signalfd(self->_sigFd, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+            break;
+        }
+        default:
+            break;
+    }
+    #else /* __CSPTP_EPOLL */
+    if(e->kind == ENT_SIGNAL)
+        signal(e->signal, SIG_DFL);
+    #endif /* __CSPTP_EPOLL */
+    e->kind = ENT_FREE;
+    return true;
+}
+static bool _runOnce(ploop self, int timeout)
+{
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    if(!atomic_load_explicit(&self->_run, memory_order_relaxed))
+        return false;
+    #ifdef __CSPTP_EPOLL
+    uint64_t cnt;
+    struct epoll_event evs[WAIT_EVENTS];
+    int num = epoll_wait(self->_fd, evs, WAIT_EVENTS, timeout < 0 ? -1 : timeout);
+    if(num < 0) {
+        if(errno == EINTR)
+            return true;
+        logp_err("epoll_wait");
+        return false;
+    }
+    for(int i = 0; i < num; i++) {
+        uint32_t id = evs[i].data.u32;
+        switch(id) {
+            case WAKE_ID:
+                if(read(self->_wakeFd, &cnt, sizeof(cnt)) < 0)
+                    logp_debug("wake read");
+                break;
+            case SIGNAL_ID:
+                readSignals(self);
+                break;
+            default:
+                if(id >= self->_num)
+                    break;
+                switch(self->_ents[id].kind) {
+                    case ENT_TIMER:
+                        /* Timer may be read already */
+                        if(read(self->_ents[id].fd, &cnt, sizeof(cnt)) == sizeof(cnt))
+                            callEnt(self, id, 0);
+                        break;
+                    case ENT_FD:
+                        callEnt(self, id,
+                            ((evs[i].events & EPOLLIN) ? LOOP_IN : 0) |
+                            ((evs[i].events & (EPOLLERR | EPOLLHUP)) ? LOOP_ERR : 0));
+                        break;
+                    default:
+                        break;
+                }
+                break;
+        }
+    }
+    #else /* __CSPTP_EPOLL */
+    int num;
+    int64_t now = monoMs();
+    size_t nfds = 0;
+    struct pollfd fds[self->_num + 1];
+    size_t ids[self->_num + 1];
+    if(timeout < 0 || timeout > POLL_MAX_MS)
+        timeout = POLL_MAX_MS;
+    for(size_t i = 0; i < self->_num; i++) {
+        struct loop_ent_t *e = self->_ents + i;
+        switch(e->kind) {
+            case ENT_FD:
+                fds[nfds].fd = e->fd;
+                fds[nfds].events = (e->events & LOOP_IN) ? POLLIN : 0;
+                fds[nfds].revents = 0;
+                ids[nfds++] = i;
+                break;
+            case ENT_TIMER:
+                if(e->expire - now < timeout)
+                    timeout = e->expire > now ? e->expire - now : 0;
+                break;
+            default:
+                break;
+        }
+    }
+    num = poll(fds, nfds, timeout);
+    if(num < 0 && errno != EINTR) {
+        logp_err("poll");
+        return false;
+    }
+    for(size_t i = 0; num > 0 && i < nfds; i++) {
+        if(fds[i].revents != 0)
+            callEnt(self, ids[i],
+                ((fds[i].revents & POLLIN) ? LOOP_IN : 0) |
+                ((fds[i].revents & (POLLERR | POLLHUP)) ? LOOP_ERR : 0));
+    }
+    now = monoMs();
+    for(size_t i = 0; i < self->_num; i++) {
+        struct loop_ent_t *e = self->_ents + i;
+        switch(e->kind) {
+            case ENT_TIMER:
+                if(e->expire <= now) {
+                    e->expire += e->interval;
+                    if(e->expire <= now) /* We are late, skip expirations */
+                        e->expire = now + e->interval;
+                    callEnt(self, i, 0);
+                }
+                break;
+            case ENT_SIGNAL:
+                if(pendingSignals[e->signal]) {
+                    pendingSignals[e->signal] = 0;
+                    callEnt(self, i, 0);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    #endif /* __CSPTP_EPOLL */
+    return atomic_load_explicit(&self->_run, memory_order_relaxed);
+}
+static void _run(ploop self)
+{
+    while(_runOnce(self, -1));
+}
+static void _stop(ploop self)
+{
+    if(UNLIKELY_COND(self == NULL))
+        return;
+    atomic_store_explicit(&self->_run, false, memory_order_relaxed);
+    #ifdef __CSPTP_EPOLL
+    uint64_t cnt = 1;
+    if(write(self->_wakeFd, &cnt, sizeof(cnt)) < 0)
+        logp_err("wake write");
+    #endif /* __CSPTP_EPOLL */
+}
+ploop loop_alloc()
+{
+    ploop ret = malloc(sizeof(struct loop_t));
+    if(ret == NULL) {
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    ret->_fd = -1;
+    ret->_sigFd = -1;
+    ret->_wakeFd = -1;
+    ret->_ents = NULL;
+    ret->_num = 0;
+    atomic_store_explicit(&ret->_run, true, memory_order_relaxed);
+#define asg(a) ret->a = _##a
+    asg(free);
+    asg(addFd);
+    asg(addTimer);
+    asg(addSignal);
+    asg(del);
+    asg(runOnce);
+    asg(run);
+    asg(stop);
+    #ifdef __CSPTP_EPOLL
+    struct epoll_event ev;
+    ret->_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(ret->_fd < 0) {
+        logp_err("epoll_create1");
+        goto err;
+    }
+    ret->_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(ret->_wakeFd < 0) {
+        logp_err("eventfd");
+        goto err;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    ev.data.u32 = WAKE_ID;
+    if(epoll_ctl(ret->_fd, EPOLL_CTL_ADD, ret->_wakeFd, &ev) < 0) {
+        logp_err("epoll_ctl");
+        goto err;
+    }
+    #endif /* __CSPTP_EPOLL */
+    return ret;
+    #ifdef __CSPTP_EPOLL
+err:
+    _free(ret);
+    return NULL;
+    #endif /* __CSPTP_EPOLL */
+}
@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief event loop object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_LOOP_H_
+#define __CSPTP_LOOP_H_
+
+#include "src/common.h"
+
+#include <stdatomic.h>
+
+typedef struct loop_t *ploop;
+typedef const struct loop_t *pcloop;
+struct loop_ent_t;
+
+/**
+ * Event call back
+ * @param[in, out] loop the event loop object
+ * @param[in] events bit mask of loop_events_e, zero for timers and signals
+ * @param[in] cookie passed when adding the event
+ * @return false to stop the loop
+ */
+typedef bool (*loop_f)(ploop loop, int events, void *cookie);
+
+enum loop_events_e {
+    LOOP_IN = 1, /**> File descriptor is readable */
+    LOOP_ERR = 2, /**> File descriptor has an error, like a pending error queue */
+};
+
+struct loop_t {
+    int _fd; /**> epoll file descriptor */
+    int _sigFd; /**> signals file descriptor */
+    int _wakeFd; /**> file descriptor used to wake the loop */
+    struct loop_ent_t *_ents; /**> events entries */
+    size_t _num; /**> number of allocated entries */
+    atomic_bool _run; /**> loop is running */
+
+    /**
+     * Free this event loop object
+     * @param[in, out] self event loop object
+     * @note signals added to the loop are unblocked
+     */
+    void (*free)(ploop self);
+
+    /**
+     * Watch a file descriptor
+     * @param[in, out] self event loop object
+     * @param[in] fd file descriptor
+     * @param[in] events bit mask of loop_events_e
+     * @param[in] function to call when file descriptor is ready
+     * @param[in] cookie to pass to function
+     * @return event ID or negative on error
+     */
+    int (*addFd)(ploop self, int fd, int events, const loop_f function,
+        void *cookie);
+
+    /**
+     * Add a periodic timer
+     * @param[in, out] self event loop object
+     * @param[in] interval in milliseconds
+     * @param[in] function to call when timer expires
+     * @param[in] cookie to pass to function
+     * @return event ID or negative on error
+     */
+    int (*addTimer)(ploop self, int interval, const loop_f function,
+        void *cookie);
+
+    /**
+     * Catch a signal
+     * @param[in, out] self event loop object
+     * @param[in] signal number
+     * @param[in] function to call when signal is received
+     * @param[in] cookie to pass to function
+     * @return event ID or negative on error
+     * @note On Linux the signal is blocked and read with signalfd.
+     *       Add signals before creating threads, so the threads inherit
+     *       the blocked signals mask.
+     */
+    int (*addSignal)(ploop self, int signal, const loop_f function,
+        void *cookie);
+
+    /**
+     * Remove an event
+     * @param[in, out] self event loop object
+     * @param[in] id of event to remove
+     * @return true on success
+     */
+    bool (*del)(ploop self, int id);
+
+    /**
+     * Wait for events and call their functions once
+     * @param[in, out] self event loop object
+     * @param[in] timeout in milliseconds, negative for infinite
+     * @return false if loop should stop
+     */
+    bool (*runOnce)(ploop self, int timeout);
+
+    /**
+     * Run the loop until stopped
+     * @param[in, out] self event loop object
+     * @note loop stops by a function returning false or calling stop()
+     */
+    void (*run)(ploop self);
+
+    /**
+     * Stop the loop
+     * @param[in, out] self event loop object
+     * @note can be called from another thread
+     */
+    void (*stop)(ploop self);
+};
+
+/**
+ * Allocate a new event loop object
+ * @return pointer to a new event loop object or null
+ */
+ploop loop_alloc();
+
+#endif /* __CSPTP_LOOP_H_ */
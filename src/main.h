@@ -14,6 +14,34 @@
 
 #include "src/sock.h"
 #include "src/cmdl.h"
+#include "src/store.h"
+#include "src/rate.h"
+#include "src/stats.h"
+
+/** Size of a Sync response template */
+#define RESP_TMPL_SIZE (256)
+/** Number of Sync response templates, one per CSPTP_REQUEST flags */
+#define RESP_TMPL_NUM (4)
+
+/** Sync response network order image, without the PAD TLV */
+struct resp_tmpl_t {
+    uint8_t data[RESP_TMPL_SIZE]; /** message image */
+    size_t len; /** image length, zero if not build */
+    uint32_t generation; /** clock information generation used to build */
+    bool useTwoSteps; /** two steps flag used to build */
+};
+
+/** Follow_Up waiting for the transmit timestamp of its Sync */
+struct fu_pend_t {
+    bool used; /** entry is waiting */
+    bool aged; /** entry passed an expire period */
+    uint32_t id; /** transmit ID of the Sync */
+    size_t size; /** size of client Request Sync message */
+    struct ptp_params_t params; /** Sync parameters */
+    pts t2; /** Sync transmit time from system clock, used on expire */
+    pipaddr address; /** client address */
+    pbuffer buffer; /** Follow_Up message */
+};
 
 struct service_state_t {
     struct ifClk_t *clockInfo;
@@ -24,7 +52,30 @@ struct service_state_t {
     pts rxTs;
     pts t2;
     pbuffer buffer;
-    //pstore storage;
+    pstore storage; /** Receive time of two steps Sync until its Follow_Up */
+    /* Batch mode, when batchSize > 1
+     * address, rxTs and buffer point to the first batch slot
+     */
+    size_t batchSize; /** Maximum messages in a batch */
+    size_t batchCur; /** Current batch size, follows the receive queue depth */
+    pbuffer *rxBuffers; /** Receive buffers, Sync responses are build in place */
+    pipaddr *rxAddresses; /** Peers addresses of received messages */
+    pts *rxTss; /** Receive timestamps of received messages */
+    pbuffer *fuBuffers; /** FollowUp messages buffers */
+    pcbuffer *txBuffers; /** Transmit queue buffers */
+    pcipaddr *txAddresses; /** Transmit queue peers addresses */
+    bool *rxValid; /** Header check of received messages */
+    int cpu; /** CPU the worker is pinned to, negative for any */
+    struct resp_tmpl_t respTmpl[RESP_TMPL_NUM]; /** Sync response templates */
+    /* Two steps using transmit timestamps, when pend is not null */
+    uint32_t txId; /** transmit ID of next message we send */
+    struct fu_pend_t *pend; /** pending Follow_Up, index is ID modulo pendNum */
+    size_t pendNum; /** number of pending Follow_Up entries */
+    pcbuffer *fuTxBuffers; /** Follow_Up transmit queue buffers */
+    pcipaddr *fuTxAddresses; /** Follow_Up transmit queue peers addresses */
+    pts txTs; /** transmit timestamp from socket */
+    prate rate; /** Requests rate limit, or null */
+    pstats stats; /** Counters of the worker, or null */
 };
 
 struct client_state_t {
@@ -61,6 +112,15 @@ struct client_state_t {
     pts r2;
 };
 
+/** client event loop state */
+struct client_run_t {
+    struct client_state_t *st;
+    bool useTwoSteps;
+    uint8_t domainNumber;
+    uint16_t sequenceId;
+    uint8_t wait; /**< Bits of the responses we still wait for */
+};
+
 /**
  * service main function
  * @param[in] argc main pass number of arguments passed
@@ -72,9 +132,22 @@ int service_main(int argc, char *argv[]);
 /**
  * service main create socket object for client
  * @param[in] address of the service
+ * @param[in] opt options of the UDP socket, or null
  * @return new socket or null
  */
-psock service_main_create_socket(pcipaddr address);
+psock service_main_create_socket(pcipaddr address,
+    const struct sock_opt_t *opt);
+
+/**
+ * service main create a socket object for a worker
+ * @param[in] address of the service
+ * @param[in] cpu to match with the NIC receive queue, or negative
+ * @param[in] opt options of the UDP socket, or null
+ * @return new socket or null
+ * @note the workers sockets share the service address
+ */
+psock service_main_create_shard_socket(pcipaddr address, int cpu,
+    const struct sock_opt_t *opt);
 
 /**
  * service main send Response Sync message
@@ -108,9 +181,37 @@ bool service_main_rcvReqSync(struct service_state_t *state,
  * @param[in, out] state service state object
  * @param[in] useTxTwoSteps flag to send two steps packets
  * @return true on success
+ * @note with storage, a two steps Sync request is answered on its Follow_Up
  */
 bool service_main_flow(struct service_state_t *state, bool useTxTwoSteps);
 
+/**
+ * service main batch flow
+ * @param[in, out] state service state object
+ * @param[in] useTxTwoSteps flag to send two steps packets
+ * @return true on success
+ * @note handle multiple messages in a single receive and a single send
+ */
+bool service_main_flowBatch(struct service_state_t *state,
+    bool useTxTwoSteps);
+
+/**
+ * service main fetch transmit timestamps and send the pending Follow_Up
+ * @param[in, out] state service state object
+ * @return true on success
+ * @note Follow_Up messages are send in a single batch
+ */
+bool service_main_txTs(struct service_state_t *state);
+
+/**
+ * service main send the pending Follow_Up that wait for too long
+ * @param[in, out] state service state object
+ * @return true on success
+ * @note The Follow_Up use the system clock time, taken when building the Sync
+ * @note Call periodically, entries expire on the second call
+ */
+bool service_main_expireTxTs(struct service_state_t *state);
+
 /**
  * service main create working objects
  * @param[in] options service options
@@ -120,6 +221,16 @@ bool service_main_flow(struct service_state_t *state, bool useTxTwoSteps);
 bool service_main_allocObjs(struct service_opt *options,
     struct service_state_t *state);
 
+/**
+ * service main create working objects of a worker
+ * @param[in] options service options
+ * @param[in, out] state worker state object
+ * @param[in] cpu to pin the worker to, or negative
+ * @return true on success
+ */
+bool service_main_allocWorker(struct service_opt *options,
+    struct service_state_t *state, int cpu);
+
 /**
  * servive main free working objects
  * @param[in, out] state service state object
@@ -149,6 +260,16 @@ pipaddr client_main_create_address(struct client_opt *options, prot *type);
  */
 psock client_main_create_socket(prot type);
 
+/**
+ * client main create socket object of a transport for client
+ * @param[in] transport to the service
+ * @param[in] path of the shared memory file
+ * @param[in] type protocol
+ * @return new socket or null
+ */
+psock client_main_create_transport(enum transport_e transport,
+    const char *path, prot type);
+
 /**
  * client main calculate message size based on options and protocol
  * @param[in] options client options
@@ -210,6 +331,15 @@ bool client_main_rcvRespSync(struct client_state_t *state);
 bool client_main_flow(struct client_state_t *state, uint8_t domainNumber,
     bool useTwoSteps, uint16_t *sequenceId);
 
+/**
+ * client main receive a message on a readable socket
+ * @param[in, out] run client event loop state
+ * @return true if the responses are complete
+ * @note the message is always read, a message the client does not
+ *       wait for is dropped. Leaving it would keep the socket readable.
+ */
+bool client_main_rx(struct client_run_t *run);
+
 /**
  * client main create working objects
  * @param[in] options client options
@@ -225,6 +355,34 @@ bool client_main_allocObjs(struct client_opt *options,
  */
 void client_main_clean(struct client_state_t *state);
 
+/**
+ * train main function, a synthetic request workload on the loopback
+ * @param[in] argc main pass number of arguments passed
+ * @param[in] argcv main pass array of strings
+ * @return main success of failure
+ * @note used to train the profile guided build
+ */
+int train_main(int argc, char *argv[]);
+
+/**
+ * load generator main function, a fleet of synthetic clients
+ * @param[in] argc main pass number of arguments passed
+ * @param[in] argcv main pass array of strings
+ * @return main success of failure
+ * @note measures the responses rate, loss and round trip time of a service
+ */
+int loadgen_main(int argc, char *argv[]);
+
+/**
+ * replay main function, feed captured requests to the service flow
+ * @param[in] argc main pass number of arguments passed
+ * @param[in] argcv main pass array of strings
+ * @return main success of failure
+ * @note uses an in-memory socket, no network and no privileges
+ * @note measures the service processing time of each request
+ */
+int replay_main(int argc, char *argv[]);
+
 /* For service_main_allocObjs, client_main_allocObjs */
 #define INIT(a) do{st->a = NULL;}while(false)
 #define ALLOC(a, f) do{st->a = f;if(st->a == NULL)return false;}while(false)
@@ -10,6 +10,8 @@
  */
 
 #include "src/main.h"
+#include "src/loop.h"
+#include "src/shmsock.h"
 
 #include <signal.h>
 
@@ -29,11 +31,22 @@ pipaddr client_main_create_address(struct client_opt *opt, prot *type)
         log_err("domainNumber %d out of range", opt->domainNumber);
         return NULL;
     }
+    *type = opt->type;
+    /* The local service uses the shared memory endpoint ID */
+    if(opt->transport != TRANSPORT_UDP) {
+        if(*type == Invalid_PROTO)
+            *type = UDP_IPv4;
+        ret = addr_alloc(*type);
+        if(ret != NULL && !ret->setEndpoint(ret, SHMSOCK_SERVICE_ID)) {
+            ret->free(ret);
+            return NULL;
+        }
+        return ret;
+    }
     if(opt->ip == NULL) {
         log_err("client miss the service IP address");
         return NULL;
     }
-    *type = opt->type;
     if(!addressStringToBinary(opt->ip, type, bin))
         return NULL;
     ret = addr_alloc(*type);
@@ -48,7 +61,12 @@ pipaddr client_main_create_address(struct client_opt *opt, prot *type)
 }
 psock client_main_create_socket(prot type)
 {
-    psock ret = sock_alloc();
+    return client_main_create_transport(TRANSPORT_UDP, NULL, type);
+}
+psock client_main_create_transport(enum transport_e transport,
+    const char *path, prot type)
+{
+    psock ret = transport_alloc(transport, type, path, 1);
     if(ret != NULL) {
         if(!ret->init(ret, type)) {
             ret->free(ret);
@@ -125,95 +143,117 @@ bool client_main_sendFollowUp(struct client_state_t *st, uint16_t sequenceId)
 bool client_main_rcvRespSync(struct client_state_t *st)
 {
     pmsg m;
-    size_t numTlvs;
-    bool haveResp = false;
+    struct CSPTP_RESPONSE_t r;
     if(UNLIKELY_COND(st == NULL || st->message == NULL))
         return false;
     m = st->message;
-    numTlvs = m->getTlvs(m);
-    for(size_t i = 0; i < numTlvs; i++) {
-        switch(m->getTlvID(m, i)) {
-            case CSPTP_RESPONSE_id: {
-                struct CSPTP_RESPONSE_t *r = (struct CSPTP_RESPONSE_t *)m->getTlv(m, i);
-                if(UNLIKELY_COND(r == NULL))
-                    return false;
-                st->r1->fromTimestamp(st->r1, &r->reqIngressTimestamp);
-                haveResp = true;
-                /*
-                 * TODO
-                 * r.organizationId[3];
-                 * r.organizationSubType[3];
-                 * r.reqCorrectionField;
-                 */
-                break;
+    if(m->copyTlv(m, CSPTP_RESPONSE_id, &r, sizeof(r)) == 0)
+        return false;
+    st->r1->fromTimestamp(st->r1, &r.reqIngressTimestamp);
+    /*
+     * TODO
+     * r.organizationId[3];
+     * r.organizationSubType[3];
+     * r.reqCorrectionField;
+     * CSPTP_STATUS_id
+     * ALTERNATE_TIME_OFFSET_INDICATOR_id
+     */
+    return true;
+}
+static inline bool txReq(struct client_state_t *st, bool useTwoSteps,
+    uint16_t sequenceId)
+{
+    return client_main_sendReqSync(st, sequenceId) &&
+        (!useTwoSteps || client_main_sendFollowUp(st, sequenceId));
+}
+/* Wait for RespSync with bit 1 and Follow_Up wit bit 2 */
+#define WAIT_ALL (3)
+/**
+ * Receive a response
+ * @return negative on error, zero if message does not match, positive on match
+ */
+static inline int rxResp(struct client_state_t *st, uint8_t domainNumber,
+    uint16_t sequenceId, uint8_t *wait)
+{
+    struct ptp_params_t rxParams;
+    psock sock = st->socket;
+    pbuffer buf = st->buffer;
+    pmsg msg = st->message;
+    pts tmpTs = st->tmpTs;
+    if(!sock->recv(sock, buf, st->RxAddress, tmpTs) ||
+        !msg->view(msg, &rxParams, buf) ||
+        rxParams.sequenceId != sequenceId ||
+        rxParams.domainNumber != domainNumber ||
+        !(st->type == UDP_IPv4 ? addr4_eq(st->address, st->RxAddress) :
+            addr6_eq(st->address, st->RxAddress)))
+        return 0;
+    /* TODO
+     * rxParams.correctionField
+     * rxParams.flagField2
+     */
+    switch(rxParams.type) {
+        case Sync:
+            *wait &= 2; /* clear bit 1 */
+            if(!rxParams.useTwoSteps) {
+                *wait &= 1; /* clear bit 2 */
+                st->t2->fromTimestamp(st->t2, &rxParams.timestamp);
             }
-            case CSPTP_STATUS_id:
-                // TODO
-                break;
-            case ALTERNATE_TIME_OFFSET_INDICATOR_id:
-                // TODO
-                break;
-            default: /* Message check integrety, we just ignore the other */
-                break;
-        }
+            st->r2->assign(st->r2, tmpTs);
+            if(!client_main_rcvRespSync(st))
+                return -1;
+            break;
+        case Follow_Up:
+            *wait &= 1; /* clear bit 2 */
+            st->t2->fromTimestamp(st->t2, &rxParams.timestamp);
+            break;
+        default:
+            log_debug("Recieve unkown PTP message type %d", rxParams.type);
+            break;
     }
-    return haveResp;
+    return 1;
+}
+static inline void report(struct client_state_t *st)
+{
+    int64_t _t1, _t2;
+    _t1 = st->t1->getTs(st->t1);
+    _t2 = st->t2->getTs(st->t2);
+    log_info("Offset from master %zd", _t2 - _t1);
+    log_debug("Summary of times:");
+    log_debug("T1: %zd", _t1);
+    log_debug("R1: %zd", st->r1->getTs(st->r1));
+    log_debug("T2: %zd", _t2);
+    log_debug("R2: %zd, %s timestamp", st->r2->getTs(st->r2),
+        ts_srcStr(st->r2->getSrc(st->r2)));
+}
+static inline uint16_t nextSequenceId(uint16_t sequenceId)
+{
+    /* Skip zero on overflow */
+    return sequenceId == 0xffff ? 1 : sequenceId + 1;
 }
 bool client_main_flow(struct client_state_t *st, uint8_t domainNumber,
     bool useTwoSteps, uint16_t *sID)
 {
+    int rx;
     bool ret = false;
     psock sock;
-    pbuffer buf;
-    pmsg msg;
     pts tmpTs;
     size_t loops = WAIT_LOOP;
     size_t timeouted = 0;
-    struct ptp_params_t rxParams;
-    /* Wait for RespSync with bit 1 and Follow_Up wit bit 2 */
-    uint8_t wait = 3;
+    uint8_t wait = WAIT_ALL;
     if(UNLIKELY_COND(st == NULL || sID == NULL || st->socket == NULL ||
             st->buffer == NULL || st->message == NULL))
         return false;
     uint16_t sequenceId = *sID;
-    if(!client_main_sendReqSync(st, sequenceId) ||
-        (useTwoSteps && !client_main_sendFollowUp(st, sequenceId)))
+    if(!txReq(st, useTwoSteps, sequenceId))
         return false;
     sock = st->socket;
-    buf = st->buffer;
-    msg = st->message;
     tmpTs = st->tmpTs;
     while(loops > 0 && wait > 0) {
         if(sock->poll(sock, POLL_MS)) {
-            if(sock->recv(sock, buf, st->RxAddress, tmpTs) &&
-                msg->parse(msg, &rxParams, buf) &&
-                rxParams.sequenceId == sequenceId &&
-                rxParams.domainNumber == domainNumber &&
-                st->address->eq(st->address, st->RxAddress)) {
-                /* TODO
-                 * rxParams.correctionField
-                 * rxParams.flagField2
-                 */
-                switch(rxParams.type) {
-                    case Sync:
-                        wait &= 2; /* clear bit 1 */
-                        if(!rxParams.useTwoSteps) {
-                            wait &= 1; /* clear bit 2 */
-                            st->t2->fromTimestamp(st->t2, &rxParams.timestamp);
-                        }
-                        st->r2->assign(st->r2, tmpTs);
-                        if(!client_main_rcvRespSync(st))
-                            return false;
-                        break;
-                    case Follow_Up:
-                        wait &= 1; /* clear bit 2 */
-                        st->t2->fromTimestamp(st->t2, &rxParams.timestamp);
-                        break;
-                    default:
-                        log_debug("Recieve unkown PTP message type %d", rxParams.type);
-                        break;
-                }
-            } else
+            rx = rxResp(st, domainNumber, sequenceId, &wait);
+            if(rx < 0)
+                return false;
+            else if(rx == 0)
                 loops--;
         } else {
             loops--;
@@ -221,22 +261,11 @@ bool client_main_flow(struct client_state_t *st, uint8_t domainNumber,
         }
     }
     if(wait == 0) {
-        int64_t _t1, _t2;
-        _t1 = st->t1->getTs(st->t1);
-        _t2 = st->t2->getTs(st->t2);
-        log_info("Offset from master %zd", _t2 - _t1);
-        log_debug("Summary of times:");
-        log_debug("T1: %zd", _t1);
-        log_debug("R1: %zd", st->r1->getTs(st->r1));
-        log_debug("T2: %zd", _t2);
-        log_debug("R2: %zd", st->r2->getTs(st->r2));
+        report(st);
         ret = true;
     } else
         log_debug("Tine out waiting for responce");
-    if(sequenceId == 0xffff)
-        *sID = 1; /* overflow */
-    else
-        *sID = sequenceId + 1; /* next sequenceId */
+    *sID = nextSequenceId(sequenceId);
     /* Sleep to next cycle */
     tmpTs->fromTimespec(tmpTs, &cycleTime);
     tmpTs->addMilliseconds(tmpTs, (-timeouted) * POLL_MS);
@@ -257,7 +286,8 @@ bool client_main_allocObjs(struct client_opt *opt, struct client_state_t *st)
     INIT(r2);
     ALLOC(address, client_main_create_address(opt, &st->type));
     ALLOC(RxAddress, addr_alloc(st->type));
-    ALLOC(socket, client_main_create_socket(st->type));
+    ALLOC(socket, client_main_create_transport(opt->transport, opt->shmPath,
+            st->type));
     ALLOC(message, msg_alloc());
     size = client_main_get_msg_size(opt, st->message, st->type);
     if(UNLIKELY_COND(size == 0))
@@ -288,26 +318,69 @@ void client_main_clean(struct client_state_t *st)
     doneLog();
 }
 static struct client_state_t state;
-static void interupt_handler(int signal)
+static bool client_tx(ploop loop, int events, void *cookie)
+{
+    struct client_run_t *r = (struct client_run_t *)cookie;
+    if(r->wait > 0)
+        log_debug("Tine out waiting for responce");
+    r->sequenceId = nextSequenceId(r->sequenceId);
+    r->wait = WAIT_ALL;
+    if(!txReq(r->st, r->useTwoSteps, r->sequenceId))
+        log_warning("send");
+    return true;
+}
+static bool client_rx(ploop loop, int events, void *cookie)
+{
+    struct client_run_t *r = (struct client_run_t *)cookie;
+    if((events & LOOP_IN) != 0 && client_main_rx(r))
+        report(r->st);
+    return true;
+}
+bool client_main_rx(struct client_run_t *r)
+{
+    struct client_state_t *st = r->st;
+    if(r->wait == 0) {
+        /* Late or duplicate response, drop it */
+        st->socket->recv(st->socket, st->buffer, st->RxAddress, st->tmpTs);
+        return false;
+    }
+    return rxResp(st, r->domainNumber, r->sequenceId, &r->wait) > 0 &&
+        r->wait == 0;
+}
+static bool client_stop(ploop loop, int events, void *cookie)
 {
     printf(" ...\n"); /* The terminal outout "^C", we complete! */
     log_debug("exit");
-    client_main_clean(&state);
-    exit(EXIT_SUCCESS);
+    return false;
 }
 int client_main(int argc, char *argv[])
 {
+    int ret = EXIT_FAILURE;
+    ploop loop = NULL;
     struct client_opt options;
+    struct client_run_t run;
     CMD_CALL(client);
     if(client_main_allocObjs(&options, &state)) {
-        uint16_t sequenceId = 1;
-        if(signal(SIGINT, interupt_handler) == SIG_ERR) /* Capture Ctrl-C */
-            log_err("capture of SIGINT fail");
-        else
-            for(;;)
-                client_main_flow(&state, options.domainNumber, options.useTwoSteps,
-                    &sequenceId);
+        psock sock = state.socket;
+        run.st = &state;
+        run.useTwoSteps = options.useTwoSteps;
+        run.domainNumber = options.domainNumber;
+        run.sequenceId = 0; /* First cycle use 1 */
+        run.wait = 0;
+        loop = loop_alloc();
+        if(loop != NULL &&
+            loop->addSignal(loop, SIGINT, client_stop, NULL) >= 0 &&
+            loop->addSignal(loop, SIGTERM, client_stop, NULL) >= 0 &&
+            loop->addFd(loop, sock->fileno(sock), LOOP_IN, client_rx, &run) >= 0 &&
+            loop->addTimer(loop, cycleTime.tv_sec * 1000 + cycleTime.tv_nsec / 1000000,
+                client_tx, &run) >= 0) {
+            client_tx(loop, 0, &run);
+            loop->run(loop);
+            ret = EXIT_SUCCESS;
+        }
     }
+    if(loop != NULL)
+        loop->free(loop);
     client_main_clean(&state);
-    return EXIT_FAILURE;
+    return ret;
 }
@@ -0,0 +1,369 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief load generator, a fleet of synthetic clients
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/main.h"
+#include "src/loop.h"
+#include "src/hist.h"
+
+#include <math.h>
+#include <signal.h>
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+#define TICK_MS (1) /* Period of the transmit timer in milliseconds */
+#define REPORT_NS (NSEC_PER_SEC) /* Period of the progress report */
+#define MAX_BURST_MS (10) /* Maximum requests send in a tick, in milliseconds */
+#define FIRST_ADDRESS (0x7f000001) /* First loopback source address */
+/* Wait for RespSync with bit 1 and Follow_Up wit bit 2 */
+#define WAIT_ALL (3)
+/* Number of request kinds, index is the tlvReqFlags0 value */
+#define KINDS ((Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv) + 1)
+
+/* A synthetic client, sends requests from its own socket */
+struct lg_client_t {
+    psock socket;
+    /* Scheduled send time of the waiting request, zero if none */
+    int64_t sent;
+    uint16_t sequenceId;
+    uint8_t wait; /* Responses we wait for */
+    uint8_t tlvReqFlags0; /* CSPTP_REQUEST flags */
+    bool useTwoSteps;
+};
+
+struct loadgen_t {
+    struct loadgen_opt *opt;
+    /* Objects shared by the clients, the socket belongs to the sender */
+    struct client_state_t st;
+    psock socket; /* Socket of the shared objects */
+    size_t sizes[KINDS]; /* Messages size per CSPTP_REQUEST flags */
+    struct lg_client_t *clients;
+    size_t clientsNum; /* Number of clients with a socket */
+    /* Round trip time of the requests in nanoseconds,
+     * from the scheduled send time, a late send counts as latency */
+    phist rtt;
+    size_t next; /* Next client to send */
+    int64_t start; /* Start of sending */
+    int64_t end; /* End of sending */
+    int64_t drain; /* End of waiting to responses */
+    int64_t nextTx; /* Time of the next request */
+    double interval; /* Mean nanoseconds between requests */
+    size_t maxBurst; /* Maximum requests send in a tick */
+    unsigned short xsubi[3]; /* State of the Poisson arrivals random */
+    size_t sent; /* Requests we send */
+    size_t done; /* Requests with all responses */
+    size_t lost; /* Requests without all responses */
+    size_t errors; /* Requests failed to send */
+    size_t late; /* Responses of an old request */
+    int64_t lastReport;
+    size_t lastSent;
+    size_t lastDone;
+    size_t lastLost;
+};
+
+static struct loadgen_t lg;
+
+static inline int64_t monoNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+static inline uint16_t nextSequenceId(uint16_t sequenceId)
+{
+    /* Skip zero on overflow */
+    return sequenceId == 0xffff ? 1 : sequenceId + 1;
+}
+/* Spread a percent of the clients, a different spread per property */
+static inline bool inPct(size_t i, size_t mul, size_t add, uint8_t pct)
+{
+    /* Multiplier coprime with 100 permutes each 100 clients */
+    return (i * mul + add) % 100 < pct;
+}
+/* Each client uses a file descriptor */
+static bool setFilesLimit(size_t files)
+{
+    #ifdef HAVE_SYS_RESOURCE_H
+    struct rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+        logp_err("getrlimit");
+        return false;
+    }
+    if(rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < files) {
+        if(rl.rlim_max != RLIM_INFINITY && rl.rlim_max < files) {
+            log_err("%zu clients exceed the open files limit %zu",
+                files, (size_t)rl.rlim_max);
+            return false;
+        }
+        rl.rlim_cur = files;
+        if(setrlimit(RLIMIT_NOFILE, &rl) < 0) {
+            logp_err("setrlimit");
+            return false;
+        }
+    }
+    #endif /* HAVE_SYS_RESOURCE_H */
+    return true;
+}
+static psock createSocket(struct loadgen_t *g, size_t i, pipaddr src)
+{
+    psock ret;
+    if(src == NULL)
+        return client_main_create_socket(g->st.type);
+    /* Bind to a loopback address, the kernel picks the port */
+    src->setIP4Val(src, FIRST_ADDRESS + i % g->opt->addresses);
+    src->setPort(src, 0);
+    ret = sock_alloc();
+    if(ret != NULL && !ret->initSrv(ret, src)) {
+        ret->free(ret);
+        return NULL;
+    }
+    return ret;
+}
+static bool allocClients(struct loadgen_t *g)
+{
+    bool ret = true;
+    pipaddr src = NULL;
+    struct loadgen_opt *opt = g->opt;
+    if(opt->addresses > 1) {
+        if(g->st.type != UDP_IPv4 ||
+            (g->st.address->getIP4Val(g->st.address) >> 24) != 127) {
+            log_err("source addresses need an IPv4 loopback service");
+            return false;
+        }
+        src = addr_alloc(UDP_IPv4);
+        if(src == NULL)
+            return false;
+    }
+    g->clients = calloc(opt->clients, sizeof(struct lg_client_t));
+    if(g->clients == NULL) {
+        log_err("memory allocation failed");
+        ret = false;
+    }
+    for(size_t i = 0; ret && i < opt->clients; i++) {
+        struct lg_client_t *c = g->clients + i;
+        c->useTwoSteps = inPct(i, 61, 0, opt->twoStepsPct);
+        c->tlvReqFlags0 =
+            (inPct(i, 41, 17, opt->statusPct) ? Flags0_Req_StatusTlv : 0) |
+            (inPct(i, 83, 29, opt->altTimePct) ? Flags0_Req_AlternateTimeTlv : 0);
+        c->socket = createSocket(g, i, src);
+        if(c->socket == NULL)
+            ret = false;
+        else
+            g->clientsNum++;
+    }
+    if(src != NULL)
+        src->free(src);
+    return ret;
+}
+static bool allocObjs(struct loadgen_t *g)
+{
+    struct loadgen_opt *opt = g->opt;
+    /* The shared buffer fits all requests kinds */
+    struct client_opt copt = {
+        .useCSPTPstatus = true,
+        .useAltTimeScale = true,
+        .domainNumber = opt->domainNumber,
+        .type = opt->type,
+        .ip = opt->ip,
+    };
+    if(!setFilesLimit(opt->clients + 64) ||
+        !client_main_allocObjs(&copt, &g->st))
+        return false;
+    g->socket = g->st.socket;
+    for(uint8_t k = 0; k < KINDS; k++) {
+        copt.useCSPTPstatus = (k & Flags0_Req_StatusTlv) > 0;
+        copt.useAltTimeScale = (k & Flags0_Req_AlternateTimeTlv) > 0;
+        g->sizes[k] = client_main_smooth_size(client_main_get_msg_size(&copt,
+                    g->st.message, g->st.type));
+    }
+    g->rtt = hist_alloc();
+    return g->rtt != NULL && allocClients(g);
+}
+static void cleanObjs(struct loadgen_t *g)
+{
+    for(size_t i = 0; i < g->clientsNum; i++)
+        g->clients[i].socket->free(g->clients[i].socket);
+    free(g->clients);
+    if(g->rtt != NULL)
+        g->rtt->free(g->rtt);
+    if(g->socket != NULL)
+        g->st.socket = g->socket;
+    client_main_clean(&g->st);
+}
+/* Gap to the next request */
+static inline double nextGap(struct loadgen_t *g)
+{
+    if(g->opt->usePoisson)
+        return -log(1 - erand48(g->xsubi)) * g->interval;
+    return g->interval;
+}
+static inline void sendReq(struct loadgen_t *g, struct lg_client_t *c,
+    int64_t scheduled)
+{
+    struct client_state_t *st = &g->st;
+    /* Open loop, the previous request is lost */
+    if(c->sent != 0)
+        g->lost++;
+    c->sequenceId = nextSequenceId(c->sequenceId);
+    c->wait = WAIT_ALL;
+    st->socket = c->socket;
+    st->size = g->sizes[c->tlvReqFlags0];
+    st->tlvReqFlags0 = c->tlvReqFlags0;
+    st->params.useTwoSteps = c->useTwoSteps;
+    c->sent = scheduled;
+    if(client_main_sendReqSync(st, c->sequenceId) &&
+        (!c->useTwoSteps || client_main_sendFollowUp(st, c->sequenceId)))
+        g->sent++;
+    else {
+        g->errors++;
+        c->sent = 0;
+    }
+}
+static void report(struct loadgen_t *g, int64_t now)
+{
+    double sec = (now - g->lastReport) / (double)NSEC_PER_SEC;
+    printf("%7.1f s %9.0f requests/s %9.0f responses/s %7zu lost\n",
+        (now - g->start) / (double)NSEC_PER_SEC,
+        (g->sent - g->lastSent) / sec, (g->done - g->lastDone) / sec,
+        g->lost - g->lastLost);
+    g->lastReport = now;
+    g->lastSent = g->sent;
+    g->lastDone = g->done;
+    g->lastLost = g->lost;
+}
+static bool lg_tx(ploop loop, int events, void *cookie)
+{
+    struct loadgen_t *g = (struct loadgen_t *)cookie;
+    int64_t now = monoNow();
+    size_t burst = 0;
+    if(now >= g->drain)
+        return false;
+    /* Send the requests that their time passed */
+    while(g->nextTx <= now && g->nextTx < g->end && burst < g->maxBurst) {
+        sendReq(g, g->clients + g->next, g->nextTx);
+        if(++g->next == g->clientsNum)
+            g->next = 0;
+        g->nextTx += nextGap(g);
+        burst++;
+    }
+    if(now - g->lastReport >= REPORT_NS && g->lastReport < g->end)
+        report(g, now);
+    return true;
+}
+static bool lg_rx(ploop loop, int events, void *cookie)
+{
+    struct ptp_params_t rxParams;
+    struct lg_client_t *c = (struct lg_client_t *)cookie;
+    struct client_state_t *st = &lg.st;
+    if((events & LOOP_IN) == 0 ||
+        !c->socket->recv(c->socket, st->buffer, st->RxAddress, st->tmpTs) ||
+        !st->message->view(st->message, &rxParams, st->buffer) ||
+        rxParams.domainNumber != lg.opt->domainNumber ||
+        !(st->type == UDP_IPv4 ? addr4_eq(st->address, st->RxAddress) :
+            addr6_eq(st->address, st->RxAddress)))
+        return true;
+    if(c->sent == 0 || rxParams.sequenceId != c->sequenceId) {
+        lg.late++;
+        return true;
+    }
+    switch(rxParams.type) {
+        case Sync:
+            c->wait &= 2; /* clear bit 1 */
+            if(!rxParams.useTwoSteps)
+                c->wait &= 1; /* clear bit 2 */
+            break;
+        case Follow_Up:
+            c->wait &= 1; /* clear bit 2 */
+            break;
+        default:
+            break;
+    }
+    if(c->wait == 0) {
+        hist_record(lg.rtt, monoNow() - c->sent);
+        lg.done++;
+        c->sent = 0;
+    }
+    return true;
+}
+static bool lg_stop(ploop loop, int events, void *cookie)
+{
+    printf(" ...\n"); /* The terminal outout "^C", we complete! */
+    return false;
+}
+static void summary(struct loadgen_t *g, int64_t now)
+{
+    static const double pcts[] = { 50, 90, 99, 99.9, 99.99 };
+    pchist h = g->rtt;
+    double sec;
+    /* Requests we still wait for */
+    for(size_t i = 0; i < g->clientsNum; i++) {
+        if(g->clients[i].sent != 0)
+            g->lost++;
+    }
+    if(now > g->end)
+        now = g->end;
+    sec = (now - g->start) / (double)NSEC_PER_SEC;
+    printf("clients %zu, requests %zu, responses %zu, lost %zu (%.3f%%), "
+        "send errors %zu, late responses %zu\n", g->clientsNum, g->sent, g->done,
+        g->lost, g->sent > 0 ? 100.0 * g->lost / g->sent : 0, g->errors,
+        g->late);
+    printf("rate %.0f requests/s, %.0f responses/s\n", g->sent / sec,
+        g->done / sec);
+    printf("rtt us:");
+    for(size_t i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++)
+        printf(" p%g %.1f", pcts[i], h->value(h, pcts[i]) / 1000.0);
+    printf(" max %.1f mean %.1f\n", h->max(h) / 1000.0,
+        h->count(h) > 0 ? h->sum(h) / 1000.0 / h->count(h) : 0);
+}
+int loadgen_main(int argc, char *argv[])
+{
+    int ret = EXIT_FAILURE;
+    ploop loop = NULL;
+    struct loadgen_opt options;
+    struct loadgen_t *g = &lg;
+    CMD_CALL(loadgen);
+    memset(g, 0, sizeof(struct loadgen_t));
+    g->opt = &options;
+    if(allocObjs(g)) {
+        loop = loop_alloc();
+        if(loop != NULL &&
+            loop->addSignal(loop, SIGINT, lg_stop, NULL) >= 0 &&
+            loop->addSignal(loop, SIGTERM, lg_stop, NULL) >= 0 &&
+            loop->addTimer(loop, TICK_MS, lg_tx, g) >= 0) {
+            size_t i;
+            for(i = 0; i < g->clientsNum; i++) {
+                struct lg_client_t *c = g->clients + i;
+                if(loop->addFd(loop, c->socket->fileno(c->socket), LOOP_IN,
+                        lg_rx, c) < 0)
+                    break;
+            }
+            if(i == g->clientsNum) {
+                g->interval = (double)NSEC_PER_SEC / options.rate;
+                g->maxBurst = options.rate / (1000 / MAX_BURST_MS) + 1;
+                g->xsubi[0] = 0x330e;
+                g->xsubi[1] = 0xabcd;
+                g->xsubi[2] = 0x1234;
+                g->start = monoNow();
+                g->end = g->start + (int64_t)options.duration * NSEC_PER_SEC;
+                g->drain = g->end + (int64_t)options.timeout * 1000000;
+                g->nextTx = g->start;
+                g->lastReport = g->start;
+                loop->run(loop);
+                summary(g, monoNow());
+                ret = EXIT_SUCCESS;
+            }
+        }
+    }
+    if(loop != NULL)
+        loop->free(loop);
+    cleanObjs(g);
+    return ret;
+}
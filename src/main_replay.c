@@ -0,0 +1,272 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief replay captured requests through the service flow
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/main.h"
+#include "src/memsock.h"
+#include "src/pcap.h"
+#include "src/hist.h"
+
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+/* Largest response we capture */
+#define REPLAY_RESP_SIZE (256)
+/* Size of the counters text */
+#define REPLAY_STATS_SIZE (4096)
+
+/* A response of the service, written to the output after the timing */
+struct replay_resp_t {
+    uint8_t data[REPLAY_RESP_SIZE];
+    size_t len;
+    uint8_t ip[IPV6_ADDR_LEN]; /* Client IP address */
+    uint16_t port; /* Client UDP port */
+};
+
+struct replay_t {
+    struct replay_opt *opt;
+    struct service_opt sopt;
+    struct service_state_t srv;
+    ppcap in;
+    ppcap out; /* Responses capture, or null */
+    pipaddr peer; /* Client address of a request */
+    pts ts; /* Capture time of a request */
+    phist cost; /* Nanoseconds the service spends on a batch of requests */
+    struct pkt_info_t *reqs; /* Headers of the requests in the batch */
+    struct replay_resp_t *resps; /* Responses of the batch */
+    size_t respsNum; /* Size of responses array */
+    size_t respsCur; /* Responses of the current batch */
+    size_t requests; /* Requests we feed the service */
+    size_t filtered; /* UDP datagrams that are not for the service */
+    size_t skipped; /* Records that are not UDP datagrams */
+    size_t responses;
+    size_t lost; /* Responses we could not capture */
+};
+
+static inline int64_t monoNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+/* User space CPU time */
+static inline int64_t userNow()
+{
+    #ifdef HAVE_SYS_RESOURCE_H
+    struct rusage ru;
+    if(getrusage(RUSAGE_SELF, &ru) == 0)
+        return (int64_t)ru.ru_utime.tv_sec * NSEC_PER_SEC +
+            ru.ru_utime.tv_usec * 1000;
+    #endif /* HAVE_SYS_RESOURCE_H */
+    return 0;
+}
+/* Called by the in-memory socket, inside the timing */
+static void replay_tx(pcbuffer buffer, pcipaddr address, void *cookie)
+{
+    struct replay_t *r = (struct replay_t *)cookie;
+    struct replay_resp_t *p;
+    size_t len = buffer_getLen(buffer);
+    r->responses++;
+    if(r->out == NULL)
+        return;
+    if(r->respsCur == r->respsNum || len > REPLAY_RESP_SIZE) {
+        r->lost++;
+        return;
+    }
+    p = r->resps + r->respsCur++;
+    memcpy(p->data, buffer_getBuf(buffer), len);
+    p->len = len;
+    memcpy(p->ip, address->getIP(address), address->getIPSize(address));
+    p->port = address->getPort(address);
+}
+/* Find the request of a response, for the MAC addresses */
+static inline const struct pkt_info_t *findReq(struct replay_t *r,
+    size_t num, const struct replay_resp_t *p)
+{
+    size_t ipLen = r->peer->getIPSize(r->peer);
+    for(size_t i = 0; i < num; i++) {
+        const struct pkt_info_t *q = r->reqs + i;
+        if(q->srcPort == p->port && memcmp(q->srcIp, p->ip, ipLen) == 0)
+            return q;
+    }
+    return NULL;
+}
+/* Write the responses from the service to the clients */
+static bool writeResps(struct replay_t *r, size_t num, int64_t cost)
+{
+    struct pkt_info_t info;
+    size_t ipLen = r->peer->getIPSize(r->peer);
+    r->ts->setTs(r->ts, ts_getTs(r->ts) + cost);
+    for(size_t i = 0; i < r->respsCur; i++) {
+        const struct replay_resp_t *p = r->resps + i;
+        const struct pkt_info_t *q = findReq(r, num, p);
+        memset(&info, 0, sizeof(info));
+        info.type = r->opt->type;
+        if(q != NULL) {
+            memcpy(info.srcMac, q->dstMac, PKT_MAC_LEN);
+            memcpy(info.dstMac, q->srcMac, PKT_MAC_LEN);
+            memcpy(info.srcIp, q->dstIp, ipLen);
+        }
+        memcpy(info.dstIp, p->ip, ipLen);
+        info.srcPort = r->opt->port;
+        info.dstPort = p->port;
+        info.payload = p->data;
+        info.len = p->len;
+        if(!r->out->write(r->out, &info, r->ts))
+            return false;
+    }
+    r->respsCur = 0;
+    return true;
+}
+/* The service handles the queued requests */
+static bool runBatch(struct replay_t *r)
+{
+    struct service_state_t *st = &r->srv;
+    psock sock = st->socket;
+    size_t num = memsock_queued(sock);
+    int64_t start, cost;
+    if(num == 0)
+        return true;
+    start = monoNow();
+    /* Each call may handle part of the queue, failures are counted */
+    while(memsock_queued(sock) > 0) {
+        if(st->batchSize > 1)
+            service_main_flowBatch(st, r->sopt.useTxTwoSteps);
+        else
+            service_main_flow(st, r->sopt.useTxTwoSteps);
+    }
+    cost = monoNow() - start;
+    /* One sample per batch, the cost of a request in it is not known */
+    hist_record(r->cost, cost);
+    return r->out == NULL || writeResps(r, num, cost);
+}
+static bool replayFile(struct replay_t *r)
+{
+    struct pkt_info_t info;
+    psock sock = r->srv.socket;
+    size_t num;
+    if(!r->in->open(r->in, r->opt->input))
+        return false;
+    while(r->in->next(r->in, &info, r->ts)) {
+        if(info.type != r->opt->type || info.dstPort != r->opt->port) {
+            r->filtered++;
+            continue;
+        }
+        r->peer->setIP(r->peer, info.srcIp);
+        r->peer->setPort(r->peer, info.srcPort);
+        num = memsock_queued(sock);
+        if(!memsock_push(sock, info.payload, info.len, r->peer, r->ts)) {
+            r->filtered++;
+            continue;
+        }
+        r->reqs[num] = info;
+        r->requests++;
+        if(num + 1 == r->srv.batchSize && !runBatch(r))
+            return false;
+    }
+    r->skipped += r->in->skipped(r->in);
+    return runBatch(r);
+}
+static bool allocReplay(struct replay_t *r)
+{
+    struct replay_opt *opt = r->opt;
+    struct service_opt *sopt = &r->sopt;
+    memset(sopt, 0, sizeof(struct service_opt));
+    sopt->useRxTwoSteps = opt->useRxTwoSteps;
+    sopt->useTxTwoSteps = opt->useTxTwoSteps;
+    sopt->type = opt->type;
+    sopt->ifName = opt->ifName;
+    sopt->batchSize = opt->batchSize;
+    sopt->workers = 1;
+    sopt->statsSocket = "";
+    sopt->transport = TRANSPORT_MEMORY;
+    if(!service_main_allocObjs(sopt, &r->srv))
+        return false;
+    /* Responses are two steps Sync and Follow_Up */
+    r->respsNum = opt->batchSize * 2;
+    r->in = pcap_alloc();
+    r->peer = addr_alloc(opt->type);
+    r->ts = ts_alloc();
+    r->cost = hist_alloc();
+    r->reqs = calloc(opt->batchSize, sizeof(struct pkt_info_t));
+    r->resps = calloc(r->respsNum, sizeof(struct replay_resp_t));
+    if(r->in == NULL || r->peer == NULL || r->ts == NULL || r->cost == NULL ||
+        r->reqs == NULL || r->resps == NULL) {
+        log_err("memory allocation failed");
+        return false;
+    }
+    if(*opt->output != 0) {
+        r->out = pcap_alloc();
+        if(r->out == NULL || !r->out->create(r->out, opt->output))
+            return false;
+    }
+    memsock_setTx(r->srv.socket, replay_tx, r);
+    return true;
+}
+static void cleanReplay(struct replay_t *r)
+{
+#define FREE_REPLAY(a) do{if(r->a != NULL)r->a->free(r->a);}while(false)
+    FREE_REPLAY(in);
+    FREE_REPLAY(out);
+    FREE_REPLAY(peer);
+    FREE_REPLAY(ts);
+    FREE_REPLAY(cost);
+#undef FREE_REPLAY
+    free(r->reqs);
+    free(r->resps);
+    service_main_clean(&r->srv);
+}
+static void report(struct replay_t *r, int64_t user)
+{
+    static const double pcts[] = { 50, 90, 99, 99.9 };
+    char buf[REPLAY_STATS_SIZE];
+    uint64_t values[STATS_NUM];
+    pchist h = r->cost;
+    pcstats s = r->srv.stats;
+    printf("replayed %zu filtered %zu skipped %zu responses %zu",
+        r->requests, r->filtered, r->skipped, r->responses);
+    if(r->out != NULL)
+        printf(" lost %zu", r->lost);
+    printf("\nns per request mean %.0f user %.0f\n",
+        r->requests > 0 ? h->sum(h) / (double)r->requests : 0,
+        r->requests > 0 ? user / (double)r->requests : 0);
+    /* Percentiles are per request only with batch of one */
+    if(r->srv.batchSize > 1)
+        printf("ns per batch of up to %zu", r->srv.batchSize);
+    else
+        printf("ns per request");
+    for(size_t i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++)
+        printf(" p%g %llu", pcts[i], (unsigned long long)h->value(h, pcts[i]));
+    printf(" max %llu\n", (unsigned long long)h->max(h));
+    /* The service counters tell why requests are not answered */
+    stats_sum(&s, 1, values);
+    if(stats_print(values, buf, sizeof(buf), false) > 0)
+        fputs(buf, stdout);
+}
+int replay_main(int argc, char *argv[])
+{
+    bool ret;
+    int64_t user;
+    struct replay_t r;
+    struct replay_opt options;
+    CMD_CALL(replay);
+    memset(&r, 0, sizeof(struct replay_t));
+    r.opt = &options;
+    ret = allocReplay(&r);
+    user = userNow();
+    for(uint32_t i = 0; ret && i < options.loops; i++)
+        ret = replayFile(&r);
+    user = userNow() - user;
+    if(ret)
+        report(&r, user);
+    cleanReplay(&r);
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
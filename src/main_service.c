@@ -10,10 +10,26 @@
  */
 
 #include "src/main.h"
+#include "src/thread.h"
+#include "src/loop.h"
+#include "src/swap.h"
+#include "src/xdp.h"
 
 #include <signal.h>
 
 #define POLL_MS (3000) /* Timeout im milliseconds of a single poll */
+/* Period in milliseconds to expire pending Follow_Up */
+#define TXTS_EXPIRE_MS (100)
+/* Minimum number of pending Follow_Up entries */
+#define TXTS_PEND_MIN (64)
+/* Period in milliseconds to remove two steps Sync without Follow_Up */
+#define STORE_EXPIRE_MS (1000)
+/* Seconds a two steps Sync waits for its Follow_Up */
+#define STORE_EXPIRE_SEC (2)
+/* Number of bits of the rate limit clients hash table size, per worker */
+#define RATE_HASH_BITS (14)
+/* Period in milliseconds to update the XDP program clock information */
+#define XDP_CLOCK_MS (1000)
 
 /* TODO: fill dummy information */
 void dummyClockInfo(struct service_opt *opt, struct ifClk_t *clk)
@@ -36,10 +52,11 @@ void dummyClockInfo(struct service_opt *opt, struct ifClk_t *clk)
     clk->jumpSeconds = 1;
     clk->timeOfNextJump = 175863;
     clk->TZName = "CEST";
+    clk->generation++;
 }
-psock service_main_create_socket(pcipaddr addr)
+psock service_main_create_socket(pcipaddr addr, const struct sock_opt_t *opt)
 {
-    psock ret = sock_alloc();
+    psock ret = sock_alloc_opt(opt);
     if(ret != NULL) {
         if(!ret->initSrv(ret, addr)) {
             ret->free(ret);
@@ -48,6 +65,18 @@ psock service_main_create_socket(pcipaddr addr)
     }
     return ret;
 }
+psock service_main_create_shard_socket(pcipaddr addr, int cpu,
+    const struct sock_opt_t *opt)
+{
+    psock ret = sock_alloc_opt(opt);
+    if(ret != NULL) {
+        if(!ret->initSrvShard(ret, addr, cpu)) {
+            ret->free(ret);
+            return NULL;
+        }
+    }
+    return ret;
+}
 static inline bool addRespTlv(pmsg msg, struct ifClk_t *clk, pts rxTs)
 {
     struct CSPTP_RESPONSE_t *rp = (struct CSPTP_RESPONSE_t *)
@@ -120,23 +149,152 @@ static inline bool addAltTimeTlv(pmsg msg, struct ifClk_t *clk)
         return false;
     return true;
 }
-static inline bool sendRespSync(struct service_state_t *st, size_t size,
+/* Add PAD TLV to match the request size, message is in network order */
+static inline bool padRespSync(pbuffer b, size_t len, size_t size)
+{
+    size_t pad;
+    struct tlv_hdr_t *h;
+    struct msg_t *m = (struct msg_t *)buffer_getBuf(b);
+    if(size != len) {
+        if((size & 1) > 0 || size < len + sizeof(struct tlv_hdr_t) ||
+            size > buffer_getSize(b)) {
+            log_err("Wrong request size %d", (int)size);
+            return false;
+        }
+        h = (struct tlv_hdr_t *)((uint8_t *)m + len);
+        pad = size - len - sizeof(struct tlv_hdr_t);
+        h->tlvType = cpu_to_net16(PAD_id);
+        h->lengthField = cpu_to_net16(pad);
+        memset(h + 1, 0, pad);
+    }
+    m->messageLength = cpu_to_net16(size);
+    return buffer_setLen(b, size);
+}
+/* Copy the template and update the fields that change with each request */
+static inline bool fillRespSync(struct service_state_t *st, size_t size,
+    const struct resp_tmpl_t *tmpl)
+{
+    pts rxTs = st->rxTs;
+    pbuffer b = st->buffer;
+    pparms prms = &st->params;
+    struct msg_t *m = (struct msg_t *)buffer_getBuf(b);
+    /* The CSPTP_RESPONSE TLV follows the header */
+    struct CSPTP_RESPONSE_t *rp = (struct CSPTP_RESPONSE_t *)(m + 1);
+    memcpy(m, tmpl->data, tmpl->len);
+    m->domainNumber = prms->domainNumber;
+    m->flagField[1] = prms->flagField2;
+    m->correctionField = cpu_to_net64(prms->correctionField);
+    m->sequenceId = cpu_to_net16(prms->sequenceId);
+    m->timestamp = prms->timestamp;
+    cpu_to_net_ts(&m->timestamp);
+    if(UNLIKELY_COND(!rxTs->toTimestamp(rxTs, &rp->reqIngressTimestamp)))
+        return false;
+    cpu_to_net_ts(&rp->reqIngressTimestamp);
+    return padRespSync(b, tmpl->len, size);
+}
+static inline bool buildRespSyncMsg(struct service_state_t *st,
     uint8_t tlvReqFlags0)
 {
-    pts t2 = st->t2;
     pmsg msg = st->message;
-    pparms prms = &st->params;
     struct ifClk_t *clk = st->clockInfo;
-    prms->type = Sync;
-    getUtcClock(t2);// TODO oneStep fill TX in HW or twoSteps fetch later
-    return LIKELY_COND(t2->toTimestamp(t2, &prms->timestamp)) &&
-        msg->init(msg, prms, st->buffer) && addRespTlv(msg, clk, st->rxTs) &&
+    return msg->init(msg, &st->params, st->buffer) &&
+        addRespTlv(msg, clk, st->rxTs) &&
         msg->addTlv(msg, CSPTP_RESPONSE_id) &&
         ((tlvReqFlags0 & Flags0_Req_StatusTlv) == 0 || addStatusTlv(msg, clk)) &&
         ((tlvReqFlags0 & Flags0_Req_AlternateTimeTlv) == 0 ||
             addAltTimeTlv(msg, clk)) &&
-        msg->buildDone(msg, size) &&
-        st->socket->send(st->socket, st->buffer, st->address);
+        msg->buildDone(msg, 0);
+}
+static inline bool buildRespSync(struct service_state_t *st, size_t size,
+    uint8_t tlvReqFlags0)
+{
+    size_t len;
+    pts t2 = st->t2;
+    pbuffer b = st->buffer;
+    pparms prms = &st->params;
+    uint32_t generation = st->clockInfo->generation;
+    struct resp_tmpl_t *tmpl = &st->respTmpl[tlvReqFlags0 &
+               (Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv)];
+    prms->type = Sync;
+    getUtcClock(t2);// TODO oneStep fill TX in HW or twoSteps fetch later
+    if(UNLIKELY_COND(!t2->toTimestamp(t2, &prms->timestamp)))
+        return false;
+    /* The templates depend on the request flags, the clock information
+     * and the two steps flag. All other fields are updated per request. */
+    if(LIKELY_COND(tmpl->len > 0 && tmpl->generation == generation &&
+            tmpl->useTwoSteps == prms->useTwoSteps))
+        return fillRespSync(st, size, tmpl);
+    if(!buildRespSyncMsg(st, tlvReqFlags0))
+        return false;
+    len = buffer_getLen(b);
+    if(len <= RESP_TMPL_SIZE) {
+        memcpy(tmpl->data, buffer_getBuf(b), len);
+        tmpl->len = len;
+        tmpl->generation = generation;
+        tmpl->useTwoSteps = prms->useTwoSteps;
+    }
+    return padRespSync(b, len, size);
+}
+/* Count a message we send, message is in network order */
+static inline void countTx(pstats s, pcbuffer b)
+{
+    const struct msg_t *m = (const struct msg_t *)buffer_getBuf(b);
+    stats_inc(s, (m->messageType_majorSdoId & 0xf) == Follow_Up ?
+        STATS_TX_FOLLOW_UP : STATS_TX_SYNC);
+    stats_add(s, STATS_TX_BYTES, buffer_getLen(b));
+}
+/* Count the messages of a batch we send, and the failures */
+static inline void countTxBatch(pstats s, pcbuffer *buffers, size_t sent,
+    size_t tx)
+{
+    if(s == NULL)
+        return;
+    for(size_t i = 0; i < sent; i++)
+        countTx(s, buffers[i]);
+    stats_add(s, STATS_ERR_SEND, tx - sent);
+}
+/* Record the time from the request receive timestamp to the response T2.
+ * A hardware timestamp uses the PHC, not the system clock */
+static inline void turnaroundLat(struct service_state_t *st)
+{
+    pcts rxTs = st->rxTs;
+    if(stats_useLat(st->stats) && ts_getSrc(rxTs) != TS_SRC_HW)
+        stats_lat(st->stats, STATS_LAT_TURNAROUND,
+            ts_getTs(st->t2) - ts_getTs(rxTs));
+}
+/* Record the time a message waits in the socket receive queue */
+static inline void queueLat(pstats s, pcts rxTs, int64_t now)
+{
+    if(ts_getSrc(rxTs) == TS_SRC_SW)
+        stats_lat(s, STATS_LAT_QUEUE, now - ts_getTs(rxTs));
+}
+static inline int64_t utcNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+static inline bool sendMsg(struct service_state_t *st)
+{
+    if(!st->socket->send(st->socket, st->buffer, st->address)) {
+        stats_inc(st->stats, STATS_ERR_SEND);
+        return false;
+    }
+    countTx(st->stats, st->buffer);
+    st->txId++;
+    return true;
+}
+static inline bool sendRespSync(struct service_state_t *st, size_t size,
+    uint8_t tlvReqFlags0)
+{
+    if(!buildRespSync(st, size, tlvReqFlags0)) {
+        stats_inc(st->stats, STATS_ERR_BUILD);
+        return false;
+    }
+    if(!sendMsg(st))
+        return false;
+    turnaroundLat(st);
+    return true;
 }
 bool service_main_sendRespSync(struct service_state_t *st, size_t size,
     uint8_t tlvReqFlags0)
@@ -145,76 +303,227 @@ bool service_main_sendRespSync(struct service_state_t *st, size_t size,
             st->address == NULL || st->buffer == NULL || st->rxTs == NULL ||
             st->t2 == NULL) ? false : sendRespSync(st, size, tlvReqFlags0);
 }
-static inline bool sendFollowUp(struct service_state_t *st, size_t size)
+static inline bool buildFollowUpMsg(pmsg msg, pparms prms, pcts t2,
+    size_t size, pbuffer buffer)
 {
-    pmsg msg = st->message;
-    pparms prms = &st->params;
     prms->type = Follow_Up;
-    return st->t2->toTimestamp(st->t2, &prms->timestamp) &&
-        msg->init(msg, prms, st->buffer) &&
-        msg->buildDone(msg, size) &&
-        st->socket->send(st->socket, st->buffer, st->address);
+    return t2->toTimestamp(t2, &prms->timestamp) &&
+        msg->init(msg, prms, buffer) &&
+        msg->buildDone(msg, size);
+}
+static inline bool buildFollowUp(struct service_state_t *st, size_t size,
+    pbuffer buffer)
+{
+    return buildFollowUpMsg(st->message, &st->params, st->t2, size, buffer);
+}
+static inline bool sendFollowUp(struct service_state_t *st, size_t size)
+{
+    if(!buildFollowUp(st, size, st->buffer)) {
+        stats_inc(st->stats, STATS_ERR_BUILD);
+        return false;
+    }
+    return sendMsg(st);
 }
 bool service_main_sendFollowUp(struct service_state_t *st, size_t size)
 {
     return UNLIKELY_COND(st == NULL || st->message == NULL || st->socket == NULL ||
-            st->address == NULL || st->buffer == NULL || st->t2 == NULL ||
-            st->rxTs == NULL) ? false : sendFollowUp(st, size);
+            st->address == NULL || st->buffer == NULL ||
+            st->t2 == NULL) ? false : sendFollowUp(st, size);
+}
+/* Keep the Follow_Up of the Sync we send, until we get its transmit timestamp */
+static inline bool addPend(struct service_state_t *st, uint32_t id, size_t size)
+{
+    pcipaddr a = st->address;
+    struct fu_pend_t *p = st->pend + id % st->pendNum;
+    if(p->used) {
+        log_warning("Follow_Up of transmit ID %u is lost", p->id);
+        p->used = false;
+    }
+    if(!p->address->setIP(p->address, a->getIP(a)))
+        return false;
+    p->address->setPort(p->address, a->getPort(a));
+    p->id = id;
+    p->size = size;
+    p->params = st->params;
+    p->t2->assign(p->t2, st->t2);
+    p->aged = false;
+    p->used = true;
+    return true;
+}
+/* Release a pending Follow_Up of a Sync that we fail to send */
+static inline void dropPend(struct service_state_t *st, uint32_t id)
+{
+    struct fu_pend_t *p = st->pend + id % st->pendNum;
+    if(p->used && p->id == id)
+        p->used = false;
+}
+static inline void queuePend(struct service_state_t *st, struct fu_pend_t *p,
+    pcts t2, size_t *tx)
+{
+    p->used = false;
+    if(!buildFollowUpMsg(st->message, &p->params, t2, p->size, p->buffer)) {
+        stats_inc(st->stats, STATS_ERR_BUILD);
+        return;
+    }
+    st->fuTxBuffers[*tx] = p->buffer;
+    st->fuTxAddresses[*tx] = p->address;
+    (*tx)++;
+}
+static inline bool sendPend(struct service_state_t *st, size_t tx)
+{
+    size_t sent;
+    psock sock = st->socket;
+    if(tx == 0)
+        return true;
+    sent = sock->sendBatch(sock, st->fuTxBuffers, st->fuTxAddresses, tx);
+    countTxBatch(st->stats, st->fuTxBuffers, sent, tx);
+    st->txId += sent;
+    return sent == tx;
+}
+static inline bool txTs(struct service_state_t *st)
+{
+    uint32_t id;
+    size_t tx = 0;
+    psock sock = st->socket;
+    pts txTs = st->txTs;
+    /* Each timestamp sends at most one Follow_Up */
+    for(size_t i = 0; i < st->pendNum && sock->recvTxTs(sock, &id, txTs); i++) {
+        struct fu_pend_t *p = st->pend + id % st->pendNum;
+        /* The Follow_Up messages get transmit timestamps as well */
+        if(p->used && p->id == id)
+            queuePend(st, p, txTs, &tx);
+    }
+    return sendPend(st, tx);
+}
+bool service_main_txTs(struct service_state_t *st)
+{
+    return UNLIKELY_COND(st == NULL || st->message == NULL ||
+            st->socket == NULL || st->pend == NULL ||
+            st->txTs == NULL) ? false : txTs(st);
+}
+static inline bool expireTxTs(struct service_state_t *st)
+{
+    size_t tx = 0;
+    for(size_t i = 0; i < st->pendNum; i++) {
+        struct fu_pend_t *p = st->pend + i;
+        if(!p->used)
+            continue;
+        if(p->aged) {
+            log_debug("missing transmit timestamp of ID %u", p->id);
+            queuePend(st, p, p->t2, &tx);
+        } else
+            p->aged = true;
+    }
+    return sendPend(st, tx);
+}
+bool service_main_expireTxTs(struct service_state_t *st)
+{
+    return UNLIKELY_COND(st == NULL || st->message == NULL ||
+            st->socket == NULL || st->pend == NULL) ? false : expireTxTs(st);
 }
 static inline bool rcvReqSync(struct service_state_t *st, uint8_t *tlvReqFlags0)
 {
-    bool haveReq = false;
     pmsg m = st->message;
-    size_t numTlvs = m->getTlvs(m);
-    for(size_t i = 0; i < numTlvs; i++) {
-        switch(m->getTlvID(m, i)) {
-            case CSPTP_REQUEST_id: {
-                struct CSPTP_REQUEST_t *r = (struct CSPTP_REQUEST_t *)m->getTlv(m, i);
-                if(UNLIKELY_COND(r == NULL))
-                    return false;
-                *tlvReqFlags0 = r->tlvRequestFlags[0];
-                haveReq = true;
-                break;
-            }
-            default: /* Message check integrety, we just ignore the other */
-                break;
-        }
-    }
-    return haveReq;
+    /* The flags are octets, the same in network and host order */
+    const struct CSPTP_REQUEST_t *r = m->findTlv(m, CSPTP_REQUEST_id);
+    if(r == NULL)
+        return false;
+    *tlvReqFlags0 = r->tlvRequestFlags[0];
+    return true;
 }
 bool service_main_rcvReqSync(struct service_state_t *st, uint8_t *tlvReqFlags0)
 {
     return UNLIKELY_COND(st == NULL || st->message == NULL ||
             tlvReqFlags0 == NULL) ? false : rcvReqSync(st, tlvReqFlags0);
 }
-static bool inline main_flow(struct service_state_t *st, bool useTxTwoSteps)
+/* Return true if we answer the request now,
+ * a two steps Sync keeps its receive time until its Follow_Up.
+ * The Follow_Up restores the Sync receive time and its CSPTP_REQUEST flags
+ */
+static inline bool rcvReq(struct service_state_t *st, uint8_t *tlvReqFlags0)
+{
+    pstore s = st->storage;
+    pparms prms = &st->params;
+    bool evicted;
+    switch(prms->type) {
+        case Sync:
+            if(!rcvReqSync(st, tlvReqFlags0)) {
+                stats_inc(st->stats, STATS_DROP_NO_REQUEST);
+                return false;
+            }
+            if((*tlvReqFlags0 & Flags0_Req_StatusTlv) > 0)
+                stats_inc(st->stats, STATS_REQ_STATUS);
+            if((*tlvReqFlags0 & Flags0_Req_AlternateTimeTlv) > 0)
+                stats_inc(st->stats, STATS_REQ_ALT_TIME);
+            if(s == NULL || !prms->useTwoSteps)
+                return true;
+            if(!s->update(s, st->address, st->rxTs, prms->sequenceId,
+                    prms->domainNumber, *tlvReqFlags0, &evicted))
+                log_warning("store");
+            else if(evicted)
+                stats_inc(st->stats, STATS_STORE_EVICT);
+            return false;
+        case Follow_Up:
+            stats_inc(st->stats, STATS_RX_FOLLOW_UP);
+            /* The Follow_Up frees the record, a repeated one finds none */
+            if(s != NULL && s->fetch(s, st->address, st->rxTs, prms->sequenceId,
+                    prms->domainNumber, tlvReqFlags0, true))
+                return true;
+            log_debug("Follow_Up without Sync, sequenceId %u", prms->sequenceId);
+            stats_inc(st->stats, STATS_DROP_ORPHAN);
+            return false;
+        default:
+            stats_inc(st->stats, STATS_DROP_MESSAGE);
+            log_debug("Recieve unkown PTP message type %d", prms->type);
+            return false;
+    }
+}
+/* Count a message that fails parsing by its reason */
+static inline void countParse(struct service_state_t *st)
+{
+    pmsg msg = st->message;
+    stats_inc(st->stats, STATS_DROP_ARGS + msg->getParseErr(msg) - MSG_PARSE_ARGS);
+}
+static bool inline main_rx(struct service_state_t *st, bool useTxTwoSteps)
 {
     size_t size;
     uint8_t tlvReqFlags0;
     pmsg msg = st->message;
     psock sock = st->socket;
     pbuffer b = st->buffer;
-    if(sock->poll(sock, POLL_MS)) {
-        if(sock->recv(sock, b, st->address, st->rxTs)) {
-            if(msg->parse(msg, &st->params, b)) {
-                switch(st->params.type) {
-                    case Sync:
-                        size = b->getLen(b);
-                        st->params.useTwoSteps = useTxTwoSteps;
-                        return rcvReqSync(st, &tlvReqFlags0) && sendRespSync(st, size, tlvReqFlags0) &&
-                            (!useTxTwoSteps || sendFollowUp(st, size));
-                    case Follow_Up:
-                        break;
-                    default:
-                        log_debug("Recieve unkown PTP message type %d", st->params.type);
-                        break;
-                }
-            } else
-                log_warning("parse");
-        } else
-            log_warning("recv");
-    } else
-        log_debug("idle");
+    if(sock->recv(sock, b, st->address, st->rxTs)) {
+        stats_inc(st->stats, STATS_RX);
+        stats_add(st->stats, STATS_RX_BYTES, buffer_getLen(b));
+        if(stats_useLat(st->stats))
+            queueLat(st->stats, st->rxTs, utcNow());
+        /* Drop over limit requests before we parse them */
+        if(st->rate != NULL && !st->rate->allow(st->rate, st->address, rate_now())) {
+            stats_inc(st->stats, STATS_DROP_RATE);
+            return false;
+        }
+        if(msg->view(msg, &st->params, b)) {
+            if(!rcvReq(st, &tlvReqFlags0))
+                return false;
+            size = buffer_getLen(b);
+            st->params.useTwoSteps = useTxTwoSteps;
+            return sendRespSync(st, size, tlvReqFlags0) &&
+                (!useTxTwoSteps || (st->pend != NULL ?
+                        addPend(st, st->txId - 1, size) : sendFollowUp(st, size)));
+        }
+        log_warning("parse");
+        countParse(st);
+    } else {
+        log_warning("recv");
+        stats_inc(st->stats, STATS_ERR_RECV);
+    }
+    return false;
+}
+static bool inline main_flow(struct service_state_t *st, bool useTxTwoSteps)
+{
+    psock sock = st->socket;
+    if(sock->poll(sock, POLL_MS))
+        return main_rx(st, useTxTwoSteps);
+    log_debug("idle");
     return false;
 }
 bool service_main_flow(struct service_state_t *st, bool useTxTwoSteps)
@@ -223,10 +532,232 @@ bool service_main_flow(struct service_state_t *st, bool useTxTwoSteps)
             st->address != NULL && st->buffer != NULL && st->rxTs != NULL &&
             st->t2 != NULL) ? main_flow(st, useTxTwoSteps) : false;
 }
-bool service_main_allocObjs(struct service_opt *opt, struct service_state_t *st)
+/* Grow the batch while the receive queue fills it, shrink when it is idle */
+static inline void adaptBatch(struct service_state_t *st, size_t num)
+{
+    if(num >= st->batchCur) {
+        st->batchCur *= 2;
+        if(st->batchCur > st->batchSize)
+            st->batchCur = st->batchSize;
+    } else if(num < st->batchCur / 4)
+        st->batchCur /= 2;
+}
+static inline void queueTx(struct service_state_t *st, size_t *tx, pcbuffer b,
+    pcipaddr a)
+{
+    st->txBuffers[*tx] = b;
+    st->txAddresses[*tx] = a;
+    (*tx)++;
+}
+static inline bool main_rx_batch(struct service_state_t *st,
+    bool useTxTwoSteps)
+{
+    size_t num, sent, tx = 0;
+    int64_t now, deq;
+    uint8_t tlvReqFlags0;
+    pmsg msg = st->message;
+    psock sock = st->socket;
+    num = sock->recvBatch(sock, st->rxBuffers, st->rxAddresses, st->rxTss,
+            st->batchCur);
+    if(num == 0) {
+        log_warning("recv");
+        stats_inc(st->stats, STATS_ERR_RECV);
+        return false;
+    }
+    stats_add(st->stats, STATS_RX, num);
+    /* Check the headers of the whole batch */
+    msg->check(msg, (pcbuffer *)st->rxBuffers, num, st->rxValid);
+    /* The dequeue time of the whole batch */
+    deq = stats_useLat(st->stats) ? utcNow() : 0;
+    adaptBatch(st, num);
+    now = st->rate != NULL ? rate_now() : 0;
+    for(size_t i = 0; i < num; i++) {
+        size_t size;
+        /* Point the single message objects to the current slot */
+        pbuffer b = st->rxBuffers[i];
+        st->buffer = b;
+        st->address = st->rxAddresses[i];
+        st->rxTs = st->rxTss[i];
+        stats_add(st->stats, STATS_RX_BYTES, buffer_getLen(b));
+        if(deq > 0)
+            queueLat(st->stats, st->rxTs, deq);
+        if(UNLIKELY_COND(!st->rxValid[i])) {
+            /* Parse the failed message for the reason only */
+            msg->view(msg, &st->params, b);
+            log_warning("parse");
+            countParse(st);
+            continue;
+        }
+        if(st->rate != NULL && !st->rate->allow(st->rate, st->address, now)) {
+            stats_inc(st->stats, STATS_DROP_RATE);
+            continue;
+        }
+        if(!msg->viewChecked(msg, &st->params, b)) {
+            log_warning("parse");
+            countParse(st);
+            continue;
+        }
+        if(!rcvReq(st, &tlvReqFlags0))
+            continue;
+        size = buffer_getLen(b);
+        st->params.useTwoSteps = useTxTwoSteps;
+        if(!buildRespSync(st, size, tlvReqFlags0)) {
+            stats_inc(st->stats, STATS_ERR_BUILD);
+            continue;
+        }
+        queueTx(st, &tx, b, st->address);
+        turnaroundLat(st);
+        if(!useTxTwoSteps)
+            continue;
+        /* The Sync transmit ID follows its place in the queue */
+        if(st->pend != NULL)
+            addPend(st, st->txId + tx - 1, size);
+        else if(buildFollowUp(st, size, st->fuBuffers[i]))
+            queueTx(st, &tx, st->fuBuffers[i], st->address);
+        else
+            stats_inc(st->stats, STATS_ERR_BUILD);
+    }
+    st->buffer = st->rxBuffers[0];
+    st->address = st->rxAddresses[0];
+    st->rxTs = st->rxTss[0];
+    if(tx == 0)
+        return false;
+    sent = sock->sendBatch(sock, st->txBuffers, st->txAddresses, tx);
+    countTxBatch(st->stats, st->txBuffers, sent, tx);
+    if(st->pend != NULL) {
+        for(size_t i = sent; i < tx; i++)
+            dropPend(st, st->txId + i);
+    }
+    st->txId += sent;
+    return sent == tx;
+}
+static inline bool main_flow_batch(struct service_state_t *st,
+    bool useTxTwoSteps)
+{
+    psock sock = st->socket;
+    if(sock->poll(sock, POLL_MS))
+        return main_rx_batch(st, useTxTwoSteps);
+    log_debug("idle");
+    return false;
+}
+bool service_main_flowBatch(struct service_state_t *st, bool useTxTwoSteps)
+{
+    return LIKELY_COND(st != NULL && st->message != NULL && st->socket != NULL &&
+            st->t2 != NULL && st->rxBuffers != NULL && st->batchCur > 0) ?
+        main_flow_batch(st, useTxTwoSteps) : false;
+}
+static inline bool allocBatch(struct service_state_t *st, prot type,
+    size_t size)
 {
-    if(UNLIKELY_COND(opt == NULL || st == NULL))
+    size_t num = st->batchSize;
+    /* 4 receive arrays and 2 transmit arrays of double size,
+     * followed by the header check results */
+    void **m = calloc(1, num * 8 * sizeof(void *) + num * sizeof(bool));
+    if(m == NULL) {
+        log_err("memory allocation failed");
         return false;
+    }
+    st->rxBuffers = (pbuffer *)m;
+    st->rxAddresses = (pipaddr *)(m + num);
+    st->rxTss = (pts *)(m + num * 2);
+    st->fuBuffers = (pbuffer *)(m + num * 3);
+    st->txBuffers = (pcbuffer *)(m + num * 4);
+    st->txAddresses = (pcipaddr *)(m + num * 6);
+    st->rxValid = (bool *)(m + num * 8);
+    /* The first slot use the single message objects */
+    st->rxBuffers[0] = st->buffer;
+    st->rxAddresses[0] = st->address;
+    st->rxTss[0] = st->rxTs;
+    for(size_t i = 0; i < num; i++) {
+        if(i > 0) {
+            st->rxBuffers[i] = buffer_alloc(size);
+            st->rxAddresses[i] = addr_alloc(type);
+            st->rxTss[i] = ts_alloc();
+            if(st->rxBuffers[i] == NULL || st->rxAddresses[i] == NULL ||
+                st->rxTss[i] == NULL)
+                return false;
+        }
+        st->fuBuffers[i] = buffer_alloc(size);
+        if(st->fuBuffers[i] == NULL)
+            return false;
+    }
+    st->batchCur = 1;
+    return true;
+}
+static inline void freeBatch(struct service_state_t *st)
+{
+    if(st->rxBuffers == NULL)
+        return;
+    for(size_t i = 0; i < st->batchSize; i++) {
+#define FREE_SLOT(a) do{if(st->a[i] != NULL)st->a[i]->free(st->a[i]);}while(false)
+        if(i > 0) {
+            FREE_SLOT(rxBuffers);
+            FREE_SLOT(rxAddresses);
+            FREE_SLOT(rxTss);
+        }
+        FREE_SLOT(fuBuffers);
+#undef FREE_SLOT
+    }
+    free(st->rxBuffers);
+    st->rxBuffers = NULL;
+}
+static inline bool allocPend(struct service_state_t *st, prot type,
+    size_t size)
+{
+    void **m;
+    psock sock = st->socket;
+    size_t num = st->batchSize * 4;
+    if(num < TXTS_PEND_MIN)
+        num = TXTS_PEND_MIN;
+    if(!sock->enableTxTs(sock)) {
+        log_info("Follow_Up use the system clock");
+        return true;
+    }
+    st->txTs = ts_alloc();
+    st->pend = calloc(num, sizeof(struct fu_pend_t));
+    m = calloc(num * 2, sizeof(void *));
+    if(st->txTs == NULL || st->pend == NULL || m == NULL) {
+        free(m);
+        log_err("memory allocation failed");
+        return false;
+    }
+    st->pendNum = num;
+    st->txId = 0;
+    st->fuTxBuffers = (pcbuffer *)m;
+    st->fuTxAddresses = (pcipaddr *)(m + num);
+    for(size_t i = 0; i < num; i++) {
+        struct fu_pend_t *p = st->pend + i;
+        p->t2 = ts_alloc();
+        p->address = addr_alloc(type);
+        p->buffer = buffer_alloc(size);
+        if(p->t2 == NULL || p->address == NULL || p->buffer == NULL)
+            return false;
+    }
+    return true;
+}
+static inline void freePend(struct service_state_t *st)
+{
+    if(st->pend != NULL) {
+        for(size_t i = 0; i < st->pendNum; i++) {
+            struct fu_pend_t *p = st->pend + i;
+#define FREE_PEND(a) do{if(p->a != NULL)p->a->free(p->a);}while(false)
+            FREE_PEND(t2);
+            FREE_PEND(address);
+            FREE_PEND(buffer);
+#undef FREE_PEND
+        }
+        free(st->pend);
+        st->pend = NULL;
+    }
+    free(st->fuTxBuffers);
+    st->fuTxBuffers = NULL;
+    FREE(txTs);
+    st->txTs = NULL;
+}
+static inline bool allocObjs(struct service_opt *opt,
+    struct service_state_t *st, bool shard, int cpu, size_t workers)
+{
+    struct sock_opt_t sopt;
     st->clockInfo = &opt->clockInfo;
     INIT(address);
     INIT(socket);
@@ -234,13 +765,44 @@ bool service_main_allocObjs(struct service_opt *opt, struct service_state_t *st)
     INIT(rxTs);
     INIT(t2);
     INIT(buffer);
-    //INIT(storage);
-    if(opt->useRxTwoSteps && !opt->useRxTwoSteps) {
+    INIT(storage);
+    INIT(rxBuffers);
+    INIT(pend);
+    INIT(fuTxBuffers);
+    INIT(txTs);
+    INIT(rate);
+    INIT(stats);
+    for(size_t i = 0; i < RESP_TMPL_NUM; i++)
+        st->respTmpl[i].len = 0;
+    st->batchSize = opt->batchSize;
+    if(opt->useRxTwoSteps && !opt->useTxTwoSteps) {
         log_err("Receiving two steps with sending one step mode is not supported");
         return false;
     }
     ALLOC(address, addr_alloc(opt->type));
-    ALLOC(socket, service_main_create_socket(st->address));
+    if(opt->port > 0)
+        st->address->setPort(st->address, opt->port);
+    st->cpu = cpu;
+    sopt.entries = st->batchSize * 4;
+    sopt.useUring = opt->useUring;
+    sopt.ifName = opt->usePacket ? opt->ifName : NULL;
+    if(opt->transport != TRANSPORT_UDP) {
+        if(shard) {
+            log_err("%s transport supports a single worker",
+                transport2str(opt->transport));
+            return false;
+        }
+        if(opt->useUring || opt->usePacket)
+            log_info("io_uring and packet ring are used with UDP only");
+        ALLOC(socket, transport_alloc(opt->transport, opt->type, opt->shmPath,
+                st->batchSize));
+        if(!st->socket->initSrv(st->socket, st->address))
+            return false;
+    } else if(shard)
+        ALLOC(socket, service_main_create_shard_socket(st->address,
+                opt->useIncomingCpu ? cpu : -1, &sopt));
+    else
+        ALLOC(socket, service_main_create_socket(st->address, &sopt));
     ALLOC(message, msg_alloc());
     ALLOC(rxTs, ts_alloc());
     ALLOC(t2, ts_alloc());
@@ -248,44 +810,291 @@ bool service_main_allocObjs(struct service_opt *opt, struct service_state_t *st)
      * Sending all 3 TLVs possible require 150, 256 should cover
      */
     ALLOC(buffer, buffer_alloc(256));
-    #if 0
-    /* We start with 1 octet hash, TODO increase to 2 octets? */
+    if(st->batchSize > 1 && !allocBatch(st, opt->type, 256))
+        return false;
+    if(opt->useTxTwoSteps && !allocPend(st, opt->type, 256))
+        return false;
     if(opt->useRxTwoSteps)
-        ALLOC(storage, store_alloc(opt->type, 8));
-    #endif
+        ALLOC(storage, store_alloc(opt->type, opt->storeBits));
+    /* Each worker takes its share of the service rate */
+    if(opt->clientRate > 0 || opt->rate > 0)
+        ALLOC(rate, rate_alloc(opt->type, RATE_HASH_BITS, opt->clientRate,
+                opt->clientBurst, opt->rate > 0 && opt->rate < workers ? 1 :
+                opt->rate / workers));
+    /* Latency is recorded for the export only */
+    ALLOC(stats, stats_alloc(opt->statsSocket != NULL &&
+            *opt->statsSocket != 0));
     dummyClockInfo(opt, st->clockInfo);
     return true;
 }
-void service_main_clean(struct service_state_t *st)
+bool service_main_allocObjs(struct service_opt *opt, struct service_state_t *st)
+{
+    return UNLIKELY_COND(opt == NULL || st == NULL) ? false :
+        allocObjs(opt, st, false, -1, 1);
+}
+bool service_main_allocWorker(struct service_opt *opt,
+    struct service_state_t *st, int cpu)
+{
+    return UNLIKELY_COND(opt == NULL || st == NULL) ? false :
+        allocObjs(opt, st, true, cpu, 1);
+}
+static inline void cleanObjs(struct service_state_t *st)
 {
+    freeBatch(st);
+    freePend(st);
     FREE(address);
     FREE(socket);
     FREE(message);
     FREE(rxTs);
     FREE(t2);
     FREE(buffer);
-    //FREE(storage);
+    FREE(storage);
+    if(st->rate != NULL && st->rate->dropped(st->rate) > 0)
+        log_info("drop %zu requests over the rate limit",
+            st->rate->dropped(st->rate));
+    FREE(rate);
+    FREE(stats);
+}
+void service_main_clean(struct service_state_t *st)
+{
+    cleanObjs(st);
     doneLog();
 }
-static struct service_state_t state;
-static void interupt_handler(int signal)
+struct service_worker_t {
+    struct service_state_t state;
+    pthread thread;
+    ploop loop;
+    bool useTxTwoSteps;
+};
+static bool service_rx(ploop loop, int events, void *cookie)
+{
+    struct service_worker_t *w = (struct service_worker_t *)cookie;
+    struct service_state_t *st = &w->state;
+    if((events & LOOP_ERR) > 0 && st->pend != NULL)
+        txTs(st);
+    if((events & LOOP_IN) > 0) {
+        if(st->batchSize > 1)
+            main_rx_batch(st, w->useTxTwoSteps);
+        else
+            main_rx(st, w->useTxTwoSteps);
+    }
+    return true;
+}
+static bool service_expire(ploop loop, int events, void *cookie)
+{
+    struct service_worker_t *w = (struct service_worker_t *)cookie;
+    expireTxTs(&w->state);
+    return true;
+}
+static bool service_stop(ploop loop, int events, void *cookie)
 {
     printf(" ...\n"); /* The terminal outout "^C", we complete! */
     log_debug("exit");
-    service_main_clean(&state);
-    exit(EXIT_SUCCESS);
+    return false;
+}
+struct service_xdp_t {
+    pxdp xdp;
+    const struct ifClk_t *clockInfo;
+};
+static bool service_xdp(ploop loop, int events, void *cookie)
+{
+    struct service_xdp_t *x = (struct service_xdp_t *)cookie;
+    /* The map is updated only when the clock information changes */
+    if(!x->xdp->update(x->xdp, x->clockInfo))
+        log_warning("XDP clock information update failed");
+    return true;
+}
+/* The XDP program answers on the interface, the workers get the rest */
+static inline pxdp allocXdp(struct service_opt *opt,
+    struct service_state_t *st)
+{
+    pxdp ret;
+    if(opt->useTxTwoSteps) {
+        log_warning("XDP answers one step Sync requests only");
+        return NULL;
+    }
+    ret = xdp_alloc();
+    if(ret == NULL)
+        return NULL;
+    /* The address still holds the service address */
+    if(ret->attach(ret, opt->ifName, st->address->getPort(st->address)) &&
+        ret->update(ret, st->clockInfo))
+        return ret;
+    ret->free(ret);
+    log_info("XDP is not used");
+    return NULL;
+}
+/* Maintenance thread, keeps the expire work out of the workers */
+struct service_maint_t {
+    ploop loop;
+    pthread thread;
+    struct service_worker_t *workers;
+    size_t num;
+};
+static bool service_orphans(ploop loop, int events, void *cookie)
+{
+    struct service_maint_t *m = (struct service_maint_t *)cookie;
+    size_t num = 0;
+    for(size_t i = 0; i < m->num; i++) {
+        pstore s = m->workers[i].state.storage;
+        num += s->cleanup(s, STORE_EXPIRE_SEC);
+    }
+    if(num > 0)
+        log_debug("remove %zu two steps Sync without Follow_Up", num);
+    return true;
+}
+static bool maint_run(void *cookie)
+{
+    struct service_maint_t *m = (struct service_maint_t *)cookie;
+    m->loop->run(m->loop);
+    return true;
+}
+/* Export the counters of all workers */
+static inline pstatssrv allocStats(struct service_opt *opt,
+    struct service_worker_t *workers, size_t num)
+{
+    pstatssrv ret;
+    pcstats *s = calloc(num, sizeof(pcstats));
+    if(s == NULL) {
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    for(size_t i = 0; i < num; i++)
+        s[i] = workers[i].state.stats;
+    ret = stats_srv_alloc(opt->statsSocket, s, num, opt->statsWindow);
+    free(s);
+    return ret;
+}
+static bool worker_run(void *cookie)
+{
+    struct service_worker_t *w = (struct service_worker_t *)cookie;
+    struct service_state_t *st = &w->state;
+    if(st->cpu >= 0 && !thread_pinCpu(st->cpu))
+        log_warning("worker is not pinned to CPU %d", st->cpu);
+    w->loop->run(w->loop);
+    return true;
+}
+static inline bool allocWorker(struct service_opt *opt,
+    struct service_worker_t *w, size_t num, int cpu)
+{
+    struct service_state_t *st = &w->state;
+    w->useTxTwoSteps = opt->useTxTwoSteps;
+    if(!(num > 1 ? allocObjs(opt, st, true, cpu, num) :
+            allocObjs(opt, st, false, -1, 1)))
+        return false;
+    w->loop = loop_alloc();
+    if(w->loop == NULL)
+        return false;
+    /* Transmit timestamps are queued in the socket error queue */
+    if(st->pend != NULL)
+        return w->loop->addFd(w->loop, st->socket->fileno(st->socket),
+                LOOP_IN | LOOP_ERR, service_rx, w) >= 0 &&
+            w->loop->addTimer(w->loop, TXTS_EXPIRE_MS, service_expire, w) >= 0;
+    return w->loop->addFd(w->loop, st->socket->fileno(st->socket), LOOP_IN,
+            service_rx, w) >= 0;
+}
+static inline bool run_workers(struct service_opt *opt)
+{
+    bool ret = false;
+    ploop loop;
+    pstatssrv srv;
+    struct service_xdp_t x;
+    struct service_maint_t m;
+    struct service_worker_t *workers;
+    int cpus = thread_numCpus();
+    size_t num = opt->workers > 0 ? opt->workers : cpus;
+    workers = calloc(num, sizeof(struct service_worker_t));
+    if(workers == NULL) {
+        log_err("memory allocation failed");
+        return false;
+    }
+    for(size_t i = 0; i < num; i++) {
+        if(!allocWorker(opt, workers + i, num, i % cpus))
+            goto clean;
+    }
+    /* A single worker runs in our thread */
+    loop = workers[0].loop;
+    if(num > 1) {
+        loop = loop_alloc();
+        if(loop == NULL)
+            goto clean;
+    }
+    /* Capture Ctrl-C and termination before we create threads */
+    if(loop->addSignal(loop, SIGINT, service_stop, NULL) < 0 ||
+        loop->addSignal(loop, SIGTERM, service_stop, NULL) < 0)
+        goto free_loop;
+    x.xdp = opt->useXdp ? allocXdp(opt, &workers[0].state) : NULL;
+    x.clockInfo = workers[0].state.clockInfo;
+    if(x.xdp != NULL &&
+        loop->addTimer(loop, XDP_CLOCK_MS, service_xdp, &x) < 0)
+        goto free_xdp;
+    m.loop = NULL;
+    m.thread = NULL;
+    if(opt->useRxTwoSteps) {
+        m.workers = workers;
+        m.num = num;
+        m.loop = loop_alloc();
+        if(m.loop == NULL ||
+            m.loop->addTimer(m.loop, STORE_EXPIRE_MS, service_orphans, &m) < 0)
+            goto free_maint;
+        m.thread = thread_create(maint_run, &m);
+        if(m.thread == NULL)
+            goto free_maint;
+    }
+    srv = NULL;
+    if(opt->statsSocket != NULL && *opt->statsSocket != 0) {
+        srv = allocStats(opt, workers, num);
+        if(srv == NULL)
+            goto free_srv;
+    }
+    ret = true;
+    if(num > 1) {
+        log_debug("start %zu workers on %d CPUs", num, cpus);
+        for(size_t i = 0; i < num; i++) {
+            workers[i].thread = thread_create(worker_run, workers + i);
+            if(workers[i].thread == NULL) {
+                ret = false;
+                break;
+            }
+        }
+    }
+    if(ret)
+        loop->run(loop);
+    for(size_t i = 0; i < num && workers[i].thread != NULL; i++) {
+        workers[i].loop->stop(workers[i].loop);
+        workers[i].thread->free(workers[i].thread);
+    }
+free_srv:
+    if(srv != NULL)
+        srv->free(srv);
+free_maint:
+    if(m.thread != NULL) {
+        m.loop->stop(m.loop);
+        m.thread->free(m.thread);
+    }
+    if(m.loop != NULL)
+        m.loop->free(m.loop);
+free_xdp:
+    if(x.xdp != NULL)
+        x.xdp->free(x.xdp);
+free_loop:
+    if(num > 1)
+        loop->free(loop);
+clean:
+    for(size_t i = 0; i < num; i++) {
+        if(workers[i].loop != NULL)
+            workers[i].loop->free(workers[i].loop);
+        cleanObjs(&workers[i].state);
+    }
+    free(workers);
+    return ret;
 }
 int service_main(int argc, char *argv[])
 {
+    bool ret;
     struct service_opt options;
     CMD_CALL(service);
-    if(service_main_allocObjs(&options, &state)) {
-        if(signal(SIGINT, interupt_handler) == SIG_ERR) /* Capture Ctrl-C */
-            log_err("capture of SIGINT fail");
-        else
-            for(;;)
-                main_flow(&state, options.useTxTwoSteps);
-    }
-    service_main_clean(&state);
-    return EXIT_FAILURE;
+    ret = run_workers(&options);
+    doneLog();
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
 }
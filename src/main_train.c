@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief synthetic request workload, trains the profile guided build
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/main.h"
+
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+/* First UDP port of the service on the loopback */
+#define TRAIN_PORT (32320)
+/* Number of ports we try */
+#define TRAIN_PORTS (16)
+/* Number of clients, each with its own socket */
+#define TRAIN_CLIENTS (16)
+/* Default number of requests of each phase */
+#define TRAIN_REQUESTS (100000)
+/* Milliseconds a client waits for a response */
+#define TRAIN_WAIT_MS (100)
+/* Batch size of the batch phases */
+#define TRAIN_BATCH (32)
+/* The client domain */
+#define TRAIN_DOMAIN (128)
+
+/* A phase of the workload, the service mode and the client requests */
+struct train_phase_t {
+    const char *name;
+    bool useTwoSteps; /* Both client and service */
+    size_t batchSize;
+    bool useRate; /* Check the requests rate, without dropping */
+};
+
+static const struct train_phase_t phases[] = {
+    { "one step", false, 1, false },
+    { "two steps", true, 1, true },
+    { "one step batch", false, TRAIN_BATCH, true },
+    { "two steps batch", true, TRAIN_BATCH, false },
+};
+
+struct train_t {
+    const struct train_phase_t *phase;
+    struct service_opt opt;
+    struct service_state_t srv;
+    struct client_state_t cl[TRAIN_CLIENTS];
+    size_t clients; /* Number of allocated clients */
+    uint16_t sequenceId;
+    size_t done; /* Requests with all responses */
+    size_t lost; /* Requests with a missing response */
+};
+
+static inline int64_t monoNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+/* User space CPU time, the system calls dominate the wall time */
+static inline int64_t userNow()
+{
+    #ifdef HAVE_SYS_RESOURCE_H
+    struct rusage ru;
+    if(getrusage(RUSAGE_SELF, &ru) == 0)
+        return (int64_t)ru.ru_utime.tv_sec * NSEC_PER_SEC +
+            ru.ru_utime.tv_usec * 1000;
+    #endif /* HAVE_SYS_RESOURCE_H */
+    return 0;
+}
+static bool allocClients(struct train_t *t)
+{
+    struct client_opt copt = {
+        .useTwoSteps = t->phase->useTwoSteps,
+        .domainNumber = TRAIN_DOMAIN,
+        .type = UDP_IPv4,
+        .ip = "127.0.0.1",
+    };
+    for(size_t i = 0; i < TRAIN_CLIENTS; i++) {
+        struct client_state_t *st = t->cl + i;
+        /* Mix the TLVs the clients request */
+        copt.useCSPTPstatus = (i & 1) > 0;
+        copt.useAltTimeScale = (i & 2) > 0;
+        memset(st, 0, sizeof(struct client_state_t));
+        t->clients++;
+        if(!client_main_allocObjs(&copt, st))
+            return false;
+        st->address->setPort(st->address, t->opt.port);
+    }
+    return true;
+}
+static bool allocSrv(struct train_t *t)
+{
+    struct service_opt *opt = &t->opt;
+    memset(opt, 0, sizeof(struct service_opt));
+    opt->useRxTwoSteps = t->phase->useTwoSteps;
+    opt->useTxTwoSteps = t->phase->useTwoSteps;
+    opt->type = UDP_IPv4;
+    opt->ifName = "lo";
+    opt->batchSize = t->phase->batchSize;
+    opt->workers = 1;
+    opt->storeBits = STORE_HASH_BITS;
+    opt->statsSocket = "";
+    if(t->phase->useRate) {
+        /* High limits, the workload checks the rate without drops */
+        opt->clientRate = 1000000;
+        opt->clientBurst = 65535;
+        opt->rate = 100000000;
+    }
+    /* Another process may use our port */
+    for(uint16_t p = TRAIN_PORT; p < TRAIN_PORT + TRAIN_PORTS; p++) {
+        memset(&t->srv, 0, sizeof(struct service_state_t));
+        opt->port = p;
+        if(service_main_allocObjs(opt, &t->srv))
+            return true;
+        service_main_clean(&t->srv);
+    }
+    log_err("no free UDP port for the service");
+    memset(&t->srv, 0, sizeof(struct service_state_t));
+    return false;
+}
+static void cleanTrain(struct train_t *t)
+{
+    for(size_t i = 0; i < t->clients; i++)
+        client_main_clean(t->cl + i);
+    t->clients = 0;
+    service_main_clean(&t->srv);
+}
+/* The service handles all the messages the clients send */
+static void srvRound(struct train_t *t, uint64_t expect)
+{
+    struct service_state_t *st = &t->srv;
+    bool useTwoSteps = t->phase->useTwoSteps;
+    while(st->stats->get(st->stats, STATS_RX) < expect) {
+        uint64_t rx = st->stats->get(st->stats, STATS_RX);
+        if(st->batchSize > 1)
+            service_main_flowBatch(st, useTwoSteps);
+        else
+            service_main_flow(st, useTwoSteps);
+        if(st->pend != NULL)
+            service_main_txTs(st);
+        /* Nothing received on the poll timeout */
+        if(st->stats->get(st->stats, STATS_RX) == rx)
+            break;
+    }
+}
+/* Receive the responses of a client, return true if all arrive */
+static bool clientRound(struct train_t *t, struct client_state_t *st)
+{
+    struct ptp_params_t prms;
+    psock sock = st->socket;
+    pmsg msg = st->message;
+    uint8_t wait = t->phase->useTwoSteps ? 3 : 1;
+    while(wait > 0 && sock->poll(sock, TRAIN_WAIT_MS)) {
+        if(!sock->recv(sock, st->buffer, st->RxAddress, st->tmpTs) ||
+            !msg->view(msg, &prms, st->buffer) ||
+            prms.sequenceId != t->sequenceId)
+            continue;
+        switch(prms.type) {
+            case Sync:
+                st->r2->assign(st->r2, st->tmpTs);
+                if(!client_main_rcvRespSync(st))
+                    return false;
+                wait &= 2;
+                break;
+            case Follow_Up:
+                st->t2->fromTimestamp(st->t2, &prms.timestamp);
+                wait &= 1;
+                break;
+            default:
+                break;
+        }
+    }
+    return wait == 0;
+}
+static bool runPhase(struct train_t *t, size_t requests)
+{
+    int64_t start, end, user;
+    uint64_t expect = 0;
+    size_t msgs = t->phase->useTwoSteps ? 2 : 1;
+    if(!allocSrv(t) || !allocClients(t))
+        return false;
+    t->sequenceId = 0;
+    t->done = 0;
+    t->lost = 0;
+    start = monoNow();
+    user = userNow();
+    while(t->done + t->lost < requests) {
+        t->sequenceId = t->sequenceId == 0xffff ? 1 : t->sequenceId + 1;
+        for(size_t i = 0; i < t->clients; i++) {
+            if(!client_main_sendReqSync(t->cl + i, t->sequenceId) ||
+                (t->phase->useTwoSteps &&
+                    !client_main_sendFollowUp(t->cl + i, t->sequenceId)))
+                return false;
+        }
+        expect += t->clients * msgs;
+        srvRound(t, expect);
+        /* Follow_Up of a missing transmit timestamp */
+        if(t->srv.pend != NULL) {
+            service_main_expireTxTs(&t->srv);
+            service_main_expireTxTs(&t->srv);
+        }
+        for(size_t i = 0; i < t->clients; i++) {
+            if(clientRound(t, t->cl + i))
+                t->done++;
+            else
+                t->lost++;
+        }
+    }
+    end = monoNow();
+    user = userNow() - user;
+    printf("%-16s %8zu requests %5zu lost %8.0f per second %6.0f user ns\n",
+        t->phase->name, t->done, t->lost,
+        t->done * (double)NSEC_PER_SEC / (end - start),
+        t->done > 0 ? user / (double)t->done : 0);
+    return true;
+}
+int train_main(int argc, char *argv[])
+{
+    int ret = EXIT_SUCCESS;
+    struct train_t t;
+    size_t requests = TRAIN_REQUESTS;
+    const struct log_options_t lopt = { LOG_ERR, false, true };
+    if(argc > 1) {
+        char *end;
+        requests = strtoul(argv[1], &end, 0);
+        if(*end != 0 || requests == 0) {
+            fprintf(stderr, "Usage: %s [requests of each phase]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    setLog("csptp_train", &lopt);
+    memset(&t, 0, sizeof(struct train_t));
+    for(size_t i = 0; i < sizeof(phases) / sizeof(phases[0]) &&
+        ret == EXIT_SUCCESS; i++) {
+        t.phase = phases + i;
+        if(!runPhase(&t, requests))
+            ret = EXIT_FAILURE;
+        cleanTrain(&t);
+    }
+    return ret;
+}
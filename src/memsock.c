@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief in-memory socket, datagrams are pushed and sent to a call back
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/memsock.h"
+#include "src/log.h"
+
+#include <sys/socket.h>
+
+struct memsock_ent_t {
+    struct sockaddr_storage addr; /* peer address */
+    size_t addrLen;
+    int64_t ts; /* receive timestamp */
+    size_t len;
+    uint8_t data[MEMSOCK_MTU];
+};
+
+struct memsock_t {
+    struct memsock_ent_t *ents; /* receive queue ring */
+    size_t num; /* number of entries */
+    size_t head; /* next entry to receive */
+    size_t count; /* number of queued entries */
+    memsock_tx_f tx;
+    void *cookie;
+};
+
+static inline struct memsock_t *mem(pcsock self)
+{
+    return self->_backend;
+}
+static void m_free(psock self)
+{
+    if(LIKELY_COND(self != NULL)) {
+        free(mem(self)->ents);
+        free(self->_backend);
+    }
+    free(self);
+}
+static inline bool isMem(pcsock self)
+{
+    if(UNLIKELY_COND(self == NULL || self->free != m_free)) {
+        log_err("not an in-memory socket");
+        return false;
+    }
+    return true;
+}
+static bool m_close(psock self)
+{
+    if(LIKELY_COND(self != NULL)) {
+        mem(self)->count = 0;
+        return true;
+    }
+    return false;
+}
+static int m_fileno(pcsock self)
+{
+    return -1;
+}
+static bool m_init(psock self, prot type)
+{
+    return LIKELY_COND(self != NULL) && self->_type == type;
+}
+static bool m_initSrv(psock self, pcipaddr address)
+{
+    return LIKELY_COND(self != NULL && address != NULL) &&
+        self->_type == address->_type;
+}
+static bool m_initSrvShard(psock self, pcipaddr address, int cpu)
+{
+    return m_initSrv(self, address);
+}
+static bool m_send(pcsock self, pcbuffer buffer, pcipaddr address)
+{
+    struct memsock_t *m;
+    if(!isMem(self))
+        return false;
+    if(address == NULL || buffer == NULL) {
+        log_err("buffer or address is missing");
+        return false;
+    }
+    m = mem(self);
+    if(m->tx != NULL)
+        m->tx(buffer, address, m->cookie);
+    return true;
+}
+static inline bool pop(struct memsock_t *m, pbuffer buffer, pipaddr address,
+    pts ts)
+{
+    struct memsock_ent_t *e;
+    if(m->count == 0)
+        return false;
+    e = m->ents + m->head;
+    m->head = (m->head + 1) % m->num;
+    m->count--;
+    if(e->len > buffer_getSize(buffer) ||
+        e->addrLen != address->getSize(address)) {
+        log_warning("datagram does not fit");
+        return false;
+    }
+    memcpy(buffer_getBuf(buffer), e->data, e->len);
+    buffer_setLen(buffer, e->len);
+    memcpy(address->getAddr(address), &e->addr, e->addrLen);
+    ts->setTs(ts, e->ts);
+    ts->setSrc(ts, TS_SRC_SW);
+    return true;
+}
+static bool m_recv(pcsock self, pbuffer buffer, pipaddr address, pts ts)
+{
+    if(!isMem(self))
+        return false;
+    if(buffer == NULL || address == NULL || ts == NULL) {
+        log_err("buffer, address or timestamp is missing");
+        return false;
+    }
+    return pop(mem(self), buffer, address, ts);
+}
+static bool m_poll(pcsock self, int timeout)
+{
+    return isMem(self) && mem(self)->count > 0;
+}
+static size_t m_sendBatch(pcsock self, pcbuffer *buffers, pcipaddr *addresses,
+    size_t num)
+{
+    size_t i;
+    if(buffers == NULL || addresses == NULL) {
+        log_err("buffers or addresses are missing");
+        return 0;
+    }
+    for(i = 0; i < num && m_send(self, buffers[i], addresses[i]); i++);
+    return i;
+}
+static size_t m_recvBatch(pcsock self, pbuffer *buffers, pipaddr *addresses,
+    pts *ts, size_t num)
+{
+    size_t i;
+    if(!isMem(self))
+        return 0;
+    if(buffers == NULL || addresses == NULL || ts == NULL) {
+        log_err("buffers, addresses or timestamps are missing");
+        return 0;
+    }
+    for(i = 0; i < num && pop(mem(self), buffers[i], addresses[i], ts[i]); i++);
+    return i;
+}
+static bool m_enableTxTs(pcsock self)
+{
+    return false;
+}
+static bool m_recvTxTs(pcsock self, uint32_t *id, pts ts)
+{
+    return false;
+}
+static prot m_getType(pcsock self)
+{
+    return UNLIKELY_COND(self == NULL) ? Invalid_PROTO : self->_type;
+}
+
+psock memsock_alloc(prot type, size_t entries)
+{
+    psock ret;
+    struct memsock_t *m;
+    if(type != UDP_IPv4 && type != UDP_IPv6) {
+        log_err("unkown protocol %d", type);
+        return NULL;
+    }
+    if(entries == 0) {
+        log_err("queue is empty");
+        return NULL;
+    }
+    ret = malloc(sizeof(struct sock_t));
+    m = malloc(sizeof(struct memsock_t));
+    if(ret == NULL || m == NULL) {
+        free(ret);
+        free(m);
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    m->ents = calloc(entries, sizeof(struct memsock_ent_t));
+    if(m->ents == NULL) {
+        free(ret);
+        free(m);
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    m->num = entries;
+    m->head = 0;
+    m->count = 0;
+    m->tx = NULL;
+    m->cookie = NULL;
+    ret->_fd = -1;
+    ret->_type = type;
+    ret->_backend = m;
+#define asg(a) ret->a = m_##a
+    asg(free);
+    asg(close);
+    asg(fileno);
+    asg(init);
+    asg(initSrv);
+    asg(initSrvShard);
+    asg(send);
+    asg(recv);
+    asg(poll);
+    asg(sendBatch);
+    asg(recvBatch);
+    asg(enableTxTs);
+    asg(recvTxTs);
+    asg(getType);
+    return ret;
+}
+bool memsock_push(psock sock, const uint8_t *data, size_t len,
+    pcipaddr address, pcts ts)
+{
+    struct memsock_t *m;
+    struct memsock_ent_t *e;
+    if(!isMem(sock))
+        return false;
+    if(data == NULL || address == NULL || ts == NULL) {
+        log_err("data, address or timestamp is missing");
+        return false;
+    }
+    if(len > MEMSOCK_MTU || address->_type != sock->_type) {
+        log_err("datagram does not fit the socket");
+        return false;
+    }
+    m = mem(sock);
+    if(m->count == m->num)
+        return false;
+    e = m->ents + (m->head + m->count) % m->num;
+    memcpy(e->data, data, len);
+    e->len = len;
+    e->addrLen = address->getSize(address);
+    memcpy(&e->addr, address->getAddr(address), e->addrLen);
+    e->ts = ts_getTs(ts);
+    m->count++;
+    return true;
+}
+size_t memsock_queued(pcsock sock)
+{
+    return isMem(sock) ? mem(sock)->count : 0;
+}
+void memsock_setTx(psock sock, memsock_tx_f function, void *cookie)
+{
+    if(isMem(sock)) {
+        mem(sock)->tx = function;
+        mem(sock)->cookie = cookie;
+    }
+}
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief in-memory socket, datagrams are pushed and sent to a call back
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_MEMSOCK_H_
+#define __CSPTP_MEMSOCK_H_
+
+#include "src/sock.h"
+
+/** Largest datagram in the queue */
+#define MEMSOCK_MTU (1500)
+
+/**
+ * Call back of a sent datagram
+ * @param[in] buffer of datagram
+ * @param[in] address of peer
+ * @param[in] cookie passed to memsock_setTx()
+ */
+typedef void (*memsock_tx_f)(pcbuffer buffer, pcipaddr address, void *cookie);
+
+/**
+ * Allocate an in-memory socket object
+ * @param[in] type of addresses
+ * @param[in] entries number of datagrams in the receive queue
+ * @return pointer to a new socket object or null
+ * @note the socket does not use a file descriptor or the network,
+ *       poll does not wait and returns if the receive queue holds datagrams
+ * @note transmit timestamps are not supported
+ */
+psock memsock_alloc(prot type, size_t entries);
+
+/**
+ * Queue a datagram for receive
+ * @param[in, out] sock in-memory socket object
+ * @param[in] data of datagram
+ * @param[in] len of datagram
+ * @param[in] address of peer
+ * @param[in] ts receive timestamp
+ * @return true on success, false if the queue is full
+ */
+bool memsock_push(psock sock, const uint8_t *data, size_t len,
+    pcipaddr address, pcts ts);
+
+/**
+ * Get number of datagrams in the receive queue
+ * @param[in] sock in-memory socket object
+ * @return number of datagrams
+ */
+size_t memsock_queued(pcsock sock);
+
+/**
+ * Set the call back of sent datagrams
+ * @param[in, out] sock in-memory socket object
+ * @param[in] function to call per datagram, null to drop them
+ * @param[in] cookie to pass to function
+ */
+void memsock_setTx(psock sock, memsock_tx_f function, void *cookie);
+
+#endif /* __CSPTP_MEMSOCK_H_ */
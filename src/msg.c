@@ -16,6 +16,7 @@
 static const size_t _msg_size = sizeof(struct msg_t);
 static const size_t _tlv_hdr = sizeof(struct tlv_hdr_t);
 static const size_t _csptp_req = sizeof(struct CSPTP_REQUEST_t);
+#define ALT_TIME struct ALTERNATE_TIME_OFFSET_INDICATOR_t
 static const uint8_t versionPTP = 2;
 static const uint8_t minorVersionPTP = 1;
 static const uint8_t majorSdoId = 0x3;
@@ -24,6 +25,111 @@ static const uint8_t twoStepsFlag = 1 << 1;
 static const uint8_t unicastFlag = 1 << 2;
 static const uint8_t zeroClockIdentity[8] = { 0 };
 
+#ifdef __GNUC__
+/* The compiler uses the vector instructions of the target, or scalar */
+typedef uint8_t v16u8 __attribute__((vector_size(16)));
+#ifndef __clang__
+/* GCC shuffles vectors with a variable mask */
+#define VEC_SHUFFLE
+#endif
+#endif
+
+/* Variable length part of a TLV */
+enum tlv_var_e {
+    TLV_VAR_NONE, /* fixed size */
+    TLV_VAR_TEXT, /* PTPText_t, padded to even size */
+    TLV_VAR_ADDR, /* PortAddress_t, address length follows the protocol */
+    TLV_VAR_ANY, /* any data, used by PAD */
+};
+/* Field of TLV to swap between host and network order */
+struct tlv_field_t {
+    uint8_t off; /* offset in TLV */
+    uint8_t width; /* 2, 4 or 8 octets, zero ends the fields */
+};
+#define TLV_FIELDS (6)
+/* Description of a TLV, the TLV header is swapped on all TLVs */
+struct tlv_desc_t {
+    const char *name;
+    enum tlv_type_id id;
+    size_t size; /* fixed size with the header */
+    enum tlv_var_e var; /* variable length part */
+    size_t varOff; /* offset of the variable length field */
+    size_t varMax; /* maximum size of the variable length part */
+    bool add; /* added with addTlv() */
+    struct tlv_field_t fields[TLV_FIELDS];
+};
+#define F(_s, _f, _w) { offsetof(_s, _f), _w }
+/* UInteger48_t is 16 bits high and 32 bits low */
+#define U48(_s, _f) F(_s, _f._high, 2), F(_s, _f._low, 4)
+#define TS(_s, _f) U48(_s, _f.secondsField), F(_s, _f.nanosecondsField, 4)
+/* The TLVs by their slot, see tlvSlot() */
+static const struct tlv_desc_t tlvDescs[MSG_TLV_IDS] = {
+    {
+        .name = "ALTERNATE_TIME_OFFSET_INDICATOR",
+        .id = ALTERNATE_TIME_OFFSET_INDICATOR_id,
+        .size = sizeof(ALT_TIME),
+        .var = TLV_VAR_TEXT,
+        .varOff = offsetof(ALT_TIME, displayName),
+        .varMax = MAX_TZ_LEN,
+        .add = true,
+        .fields = {
+            F(ALT_TIME, currentOffset, 4),
+            F(ALT_TIME, jumpSeconds, 4),
+            U48(ALT_TIME, timeOfNextJump),
+        },
+    }, {
+        .name = "CSPTP_REQUEST",
+        .id = CSPTP_REQUEST_id,
+        .size = sizeof(struct CSPTP_REQUEST_t),
+        .var = TLV_VAR_NONE,
+        .add = false, /* Use addCSPTPReqTlv() */
+    }, {
+        .name = "CSPTP_RESPONSE",
+        .id = CSPTP_RESPONSE_id,
+        .size = sizeof(struct CSPTP_RESPONSE_t),
+        .var = TLV_VAR_NONE,
+        .add = true,
+        .fields = {
+            TS(struct CSPTP_RESPONSE_t, reqIngressTimestamp),
+            F(struct CSPTP_RESPONSE_t, reqCorrectionField, 8),
+        },
+    }, {
+        .name = "CSPTP_STATUS",
+        .id = CSPTP_STATUS_id,
+        .size = sizeof(struct CSPTP_STATUS_t),
+        .var = TLV_VAR_ADDR,
+        .varOff = offsetof(struct CSPTP_STATUS_t, parentAddress),
+        .varMax = IPV6_ADDR_LEN,
+        .add = true,
+        .fields = {
+            F(struct CSPTP_STATUS_t,
+                grandmasterClockQuality.offsetScaledLogVariance, 2),
+            F(struct CSPTP_STATUS_t, stepsRemoved, 2),
+            F(struct CSPTP_STATUS_t, currentUtcOffset, 2),
+            F(struct CSPTP_STATUS_t, parentAddress.networkProtocol, 2),
+            F(struct CSPTP_STATUS_t, parentAddress.addressLength, 2),
+        },
+    }, {
+        .name = "PAD",
+        .id = PAD_id,
+        .size = sizeof(struct tlv_hdr_t),
+        .var = TLV_VAR_ANY,
+        .add = false, /* We do not add pad directly! */
+    },
+};
+#undef F
+/* swapTlv() copies the fixed part of a TLV to a MSG_TLV_FIXED buffer */
+#define TLV_FIT(_s) _Static_assert(sizeof(_s) <= MSG_TLV_FIXED, \
+        #_s " exceeds MSG_TLV_FIXED")
+TLV_FIT(ALT_TIME);
+TLV_FIT(struct CSPTP_REQUEST_t);
+TLV_FIT(struct CSPTP_RESPONSE_t);
+TLV_FIT(struct CSPTP_STATUS_t);
+TLV_FIT(struct tlv_hdr_t);
+#undef TLV_FIT
+#undef U48
+#undef TS
+
 static inline bool _isOdd(size_t v) { return (v & 1) > 0; }
 static inline size_t _makeEven(size_t v) { return v + (v & 1); }
 static inline void detach(pmsg self)
@@ -34,29 +140,44 @@ static inline void detach(pmsg self)
     self->_left = 0;
     self->_end = NULL;
     self->_type = -1;
+    self->_net = false;
     self->_num_tlvs = 0;
+    memset(self->_tlvIdx, 0, sizeof(self->_tlvIdx));
 }
-static inline size_t _min_tlv_size(enum tlv_type_id id, bool high)
+/* Slot of TLV ID in the TLVs table and in the TLVs index */
+static inline int tlvSlot(enum tlv_type_id id)
 {
     switch(id) {
         case ALTERNATE_TIME_OFFSET_INDICATOR_id:
-            return sizeof(struct ALTERNATE_TIME_OFFSET_INDICATOR_t);
+            return 0;
         case CSPTP_REQUEST_id:
-            return _csptp_req;
+            return 1;
         case CSPTP_RESPONSE_id:
-            return sizeof(struct CSPTP_RESPONSE_t);
+            return 2;
         case CSPTP_STATUS_id:
-            return sizeof(struct CSPTP_STATUS_t);
+            return 3;
         case PAD_id:
-            return _tlv_hdr;
+            return 4;
         default:
-            if(high)
-                log_err("No such ID 0x%x", id);
-            else
-                log_info("No such ID 0x%x", id);
-            return 0;
+            return -1;
     }
 }
+static inline const struct tlv_desc_t *tlvDesc(enum tlv_type_id id, bool high)
+{
+    int slot = tlvSlot(id);
+    if(slot >= 0)
+        return tlvDescs + slot;
+    if(high)
+        log_err("No such ID 0x%x", id);
+    else
+        log_info("No such ID 0x%x", id);
+    return NULL;
+}
+static inline size_t _min_tlv_size(enum tlv_type_id id, bool high)
+{
+    const struct tlv_desc_t *d = tlvDesc(id, high);
+    return d == NULL ? 0 : d->size;
+}
 static inline size_t _adderSize(prot p, bool high)
 {
     switch(p) {
@@ -72,6 +193,151 @@ static inline size_t _adderSize(prot p, bool high)
             return 0;
     }
 }
+/* Size of a TLV with its variable length part, zero if it is wrong */
+static inline size_t tlvSize(const struct tlv_desc_t *d, const uint8_t *p,
+    size_t len, bool net)
+{
+    switch(d->var) {
+        case TLV_VAR_TEXT: {
+            const struct PTPText_t *t = (const struct PTPText_t *)(p + d->varOff);
+            return d->size + _makeEven(t->lengthField);
+        }
+        case TLV_VAR_ADDR: {
+            size_t alen, nlen;
+            const struct PortAddress_t *a =
+                (const struct PortAddress_t *)(p + d->varOff);
+            alen = net ? net_to_cpu16(a->addressLength) : a->addressLength;
+            nlen = _adderSize(net ? net_to_cpu16(a->networkProtocol) :
+                    a->networkProtocol, false);
+            return nlen == 0 || nlen != alen ? 0 : d->size + alen;
+        }
+        case TLV_VAR_ANY:
+            return len;
+        default:
+            return d->size;
+    }
+}
+static inline void swapField(uint8_t *perm, size_t off, size_t width)
+{
+    for(size_t i = 0; i < width; i++)
+        perm[off + i] = off + width - 1 - i;
+}
+/* Build the permutations that swap the TLVs fields,
+ * reject a TLV with a fixed part larger than the permutation */
+static inline bool tlvPerm(pmsg self)
+{
+    for(size_t i = 0; i < MSG_TLV_IDS; i++) {
+        const struct tlv_desc_t *d = tlvDescs + i;
+        uint8_t *perm = self->_tlvPerm[i];
+        if(UNLIKELY_COND(d->size > MSG_TLV_FIXED)) {
+            log_err("%s TLV exceeds %d octets", d->name, MSG_TLV_FIXED);
+            return false;
+        }
+        for(size_t j = 0; j < MSG_TLV_FIXED; j++)
+            perm[j] = j;
+        swapField(perm, offsetof(struct tlv_hdr_t, tlvType), 2);
+        swapField(perm, offsetof(struct tlv_hdr_t, lengthField), 2);
+        for(size_t j = 0; j < TLV_FIELDS && d->fields[j].width > 0; j++) {
+            if(UNLIKELY_COND(d->fields[j].off + d->fields[j].width > d->size)) {
+                log_err("%s TLV field exceeds the TLV", d->name);
+                return false;
+            }
+            swapField(perm, d->fields[j].off, d->fields[j].width);
+        }
+    }
+    return true;
+}
+/* Swap the fields of the fixed part of a TLV, in both directions */
+static inline void swapTlv(pcmsg self, int slot, void *p)
+{
+    size_t size = tlvDescs[slot].size;
+    const uint8_t *perm = self->_tlvPerm[slot];
+    uint8_t in[MSG_TLV_FIXED] = { 0 }, out[MSG_TLV_FIXED];
+    memcpy(in, p, size);
+    #ifdef VEC_SHUFFLE
+    v16u8 a, b, m0, m1;
+    memcpy(&a, in, 16);
+    memcpy(&b, in + 16, 16);
+    memcpy(&m0, perm, 16);
+    memcpy(&m1, perm + 16, 16);
+    m0 = __builtin_shuffle(a, b, m0);
+    m1 = __builtin_shuffle(a, b, m1);
+    memcpy(out, &m0, 16);
+    memcpy(out + 16, &m1, 16);
+    #else /* VEC_SHUFFLE */
+    for(size_t i = 0; i < size; i++)
+        out[i] = in[perm[i]];
+    #endif /* VEC_SHUFFLE */
+    memcpy(p, out, size);
+}
+/* Store a TLV, the index keeps the first TLV of each ID */
+static inline void storeTlv(pmsg self, void *tlv, size_t len,
+    enum tlv_type_id id)
+{
+    size_t num_tlvs = self->_num_tlvs;
+    int slot = tlvSlot(id);
+    self->_tlvs[num_tlvs].tlv = tlv;
+    self->_tlvs[num_tlvs].len = len;
+    self->_tlvs[num_tlvs].id = id;
+    if(slot >= 0 && self->_tlvIdx[slot] == 0)
+        self->_tlvIdx[slot] = num_tlvs + 1;
+    self->_num_tlvs++;
+}
+/* Build the templates of the fixed header fields */
+static inline void hdrTmpl(pmsg self)
+{
+    uint8_t *v = self->_hdrVal[0], *k = self->_hdrMask;
+    memset(self->_hdrVal, 0, sizeof(self->_hdrVal));
+    memset(k, 0, MSG_HDR_FIXED);
+#define FIELD(_f, _v, _k) do{size_t o = offsetof(struct msg_t, _f);\
+        v[o] = _v; k[o] = _k;}while(false)
+    FIELD(messageType_majorSdoId, Sync | (majorSdoId << 4), 0xff);
+    FIELD(versionPTP, (minorVersionPTP << 4) | versionPTP, 0xff);
+    FIELD(minorSdoId, minorSdoId, 0xff);
+    FIELD(flagField[0], unicastFlag, (uint8_t)~twoStepsFlag);
+    FIELD(flagField[1], 0, 0xc0);
+    FIELD(controlField, 0, 0xff);
+    FIELD(logMessageInterval, 0x7f, 0xff);
+#undef FIELD
+    /* sourcePortIdentity is zero */
+    memset(k + offsetof(struct msg_t, sourcePortIdentity), 0xff,
+        sizeof(struct PortIdentity_t));
+    memcpy(self->_hdrVal[1], v, MSG_HDR_FIXED);
+    v = self->_hdrVal[1];
+    v[offsetof(struct msg_t, messageType_majorSdoId)] =
+        Follow_Up | (majorSdoId << 4);
+    v[offsetof(struct msg_t, controlField)] = 2;
+}
+/* Compare the fixed header fields with the template of the message type.
+ * Other message types fail on the messageType.
+ * The message is in network order. */
+static inline bool hdrValid(pcmsg self, const uint8_t *p)
+{
+    const uint8_t *v = self->_hdrVal[(p[0] & 0xf) == Follow_Up];
+    const uint8_t *k = self->_hdrMask;
+    #ifdef __GNUC__
+    /* Octets 0 to 31, and 18 to 33 */
+    v16u8 a, b, c, va, vb, vc, ka, kb, kc;
+    uint64_t r[2];
+    memcpy(&a, p, 16);
+    memcpy(&b, p + 16, 16);
+    memcpy(&c, p + MSG_HDR_FIXED - 16, 16);
+    memcpy(&va, v, 16);
+    memcpy(&vb, v + 16, 16);
+    memcpy(&vc, v + MSG_HDR_FIXED - 16, 16);
+    memcpy(&ka, k, 16);
+    memcpy(&kb, k + 16, 16);
+    memcpy(&kc, k + MSG_HDR_FIXED - 16, 16);
+    a = ((a ^ va) & ka) | ((b ^ vb) & kb) | ((c ^ vc) & kc);
+    memcpy(r, &a, 16);
+    return (r[0] | r[1]) == 0;
+    #else /* __GNUC__ */
+    uint8_t r = 0;
+    for(size_t i = 0; i < MSG_HDR_FIXED; i++)
+        r |= (p[i] ^ v[i]) & k[i];
+    return r == 0;
+    #endif /* __GNUC__ */
+}
 static inline size_t net_to_cpu_msg(struct msg_t *m)
 {
     uint16_t len = net_to_cpu16(m->messageLength);
@@ -97,20 +363,20 @@ static inline void cpu_to_net_msg(struct msg_t *m, size_t len)
     m->sequenceId = cpu_to_net16(m->sequenceId);
     cpu_to_net_ts(&m->timestamp);
 }
-static inline enum tlv_type_id net_to_cpu_tlv(uint8_t *p, size_t size,
+/* Validate a TLV in network order, without changing it */
+static inline enum tlv_type_id tlvCheck(const uint8_t *p, size_t size,
     size_t *tlv_len)
 {
-    size_t len, min_sz;
+    size_t len;
     enum tlv_type_id id;
-    struct tlv_hdr_t *h = (struct tlv_hdr_t *)p;
-    h->tlvType = net_to_cpu16(h->tlvType);
-    h->lengthField = net_to_cpu16(h->lengthField);
-    id = h->tlvType;
-    len = h->lengthField + _tlv_hdr;
-    min_sz = _min_tlv_size(id, false);
-    if(min_sz == 0)
+    const struct tlv_desc_t *d;
+    const struct tlv_hdr_t *h = (const struct tlv_hdr_t *)p;
+    id = net_to_cpu16(h->tlvType);
+    len = net_to_cpu16(h->lengthField) + _tlv_hdr;
+    d = tlvDesc(id, false);
+    if(d == NULL)
         return Invalid_tlv_ID;
-    if(len < min_sz) {
+    if(len < d->size) {
         log_info("TLV to short 0x%x", id);
         return Invalid_tlv_ID;
     }
@@ -118,127 +384,40 @@ static inline enum tlv_type_id net_to_cpu_tlv(uint8_t *p, size_t size,
         log_warning("TLV overflow message 0x%x", id);
         return Invalid_tlv_ID;
     }
-    switch(id) {
-        case ALTERNATE_TIME_OFFSET_INDICATOR_id: {
-            struct ALTERNATE_TIME_OFFSET_INDICATOR_t *t =
-                (struct ALTERNATE_TIME_OFFSET_INDICATOR_t *)h;
-            /* Verify size match */
-            if(len != min_sz + _makeEven(t->displayName.lengthField)) {
-                log_warning("ALTERNATE_TIME_OFFSET_INDICATOR TLV with wrong size");
-                return Invalid_tlv_ID;
-            }
-            t->currentOffset = net_to_cpu32(t->currentOffset);
-            t->jumpSeconds = net_to_cpu32(t->jumpSeconds);
-            net_to_cpu48(&t->timeOfNextJump);
-            break;
-        }
-        case CSPTP_REQUEST_id:
-            if(len != min_sz) {
-                log_warning("CSPTP_REQUEST TLV with wrong size");
-                return Invalid_tlv_ID;
-            }
-            break;
-        case CSPTP_RESPONSE_id: {
-            if(len != min_sz) {
-                log_warning("CSPTP_RESPONSE TLV with wrong size");
-                return Invalid_tlv_ID;
-            }
-            struct CSPTP_RESPONSE_t *t = (struct CSPTP_RESPONSE_t *)h;
-            net_to_cpu_ts(&t->reqIngressTimestamp);
-            t->reqCorrectionField = net_to_cpu64(t->reqCorrectionField);
-            break;
-        }
-        case CSPTP_STATUS_id: {
-            prot pt;
-            size_t alen, nlen;
-            struct CSPTP_STATUS_t *t = (struct CSPTP_STATUS_t *)h;
-            pt = net_to_cpu16(t->parentAddress.networkProtocol);
-            alen = net_to_cpu16(t->parentAddress.addressLength);
-            nlen = _adderSize(pt, false);
-            if(nlen == 0)
-                return Invalid_tlv_ID;
-            if(nlen != alen || len != min_sz + alen) {
-                log_warning("CSPTP_STATUS TLV with wrong size");
-                return Invalid_tlv_ID;
-            }
-            t->parentAddress.networkProtocol = pt;
-            t->parentAddress.addressLength = alen;
-            t->grandmasterClockQuality.offsetScaledLogVariance =
-                net_to_cpu16(t->grandmasterClockQuality.offsetScaledLogVariance);
-            t->stepsRemoved = net_to_cpu16(t->stepsRemoved);
-            t->currentUtcOffset = net_to_cpu16(t->currentUtcOffset);
-            break;
-        }
-        case PAD_id:
-            break;
-        default:
-            return Invalid_tlv_ID;
+    if(len != tlvSize(d, p, len, true)) {
+        log_warning("%s TLV with wrong size", d->name);
+        return Invalid_tlv_ID;
     }
     *tlv_len = len;
     return id;
 }
-static bool cpu_to_net_tlv(enum tlv_type_id id, void *p, size_t tlv_len)
+/* Convert a valid TLV to host order */
+static inline void net_to_cpu_tlv(pcmsg self, enum tlv_type_id id, void *p)
+{
+    swapTlv(self, tlvSlot(id), p);
+}
+static bool cpu_to_net_tlv(pcmsg self, enum tlv_type_id id, void *p,
+    size_t tlv_len)
 {
-    size_t sz = _min_tlv_size(id, false);
+    int slot = tlvSlot(id);
+    const struct tlv_desc_t *d;
     struct tlv_hdr_t *h = (struct tlv_hdr_t *)p;
-    if(UNLIKELY_COND(sz == 0 || h == NULL || tlv_len < sz || h->tlvType != id ||
+    if(UNLIKELY_COND(slot < 0 || h == NULL))
+        return false;
+    d = tlvDescs + slot;
+    if(UNLIKELY_COND(tlv_len < d->size || h->tlvType != id ||
             h->lengthField + _tlv_hdr != tlv_len))
         return false;
-    switch(id) {
-        case ALTERNATE_TIME_OFFSET_INDICATOR_id: {
-            size_t l;
-            struct ALTERNATE_TIME_OFFSET_INDICATOR_t *t =
-                (struct ALTERNATE_TIME_OFFSET_INDICATOR_t *)h;
-            l = t->displayName.lengthField;
-            if(_isOdd(l)) {
-                /* Ensure pad is zero */
-                t->displayName.textField[l] = 0;
-                l++;
-            }
-            /* Verify size match */
-            if(UNLIKELY_COND(tlv_len != sz + l))
-                return false;
-            t->currentOffset = cpu_to_net32(t->currentOffset);
-            t->jumpSeconds = cpu_to_net32(t->jumpSeconds);
-            cpu_to_net48(&t->timeOfNextJump);
-            break;
-        }
-        case CSPTP_REQUEST_id:
-            if(UNLIKELY_COND(tlv_len != sz))
-                return false;
-            break;
-        case CSPTP_RESPONSE_id: {
-            if(UNLIKELY_COND(tlv_len != sz))
-                return false;
-            struct CSPTP_RESPONSE_t *t = (struct CSPTP_RESPONSE_t *)h;
-            cpu_to_net_ts(&t->reqIngressTimestamp);
-            t->reqCorrectionField = cpu_to_net64(t->reqCorrectionField);
-            break;
-        }
-        case CSPTP_STATUS_id: {
-            prot pt;
-            size_t alen, nlen;
-            struct CSPTP_STATUS_t *t = (struct CSPTP_STATUS_t *)h;
-            alen = t->parentAddress.addressLength;
-            pt = t->parentAddress.networkProtocol;
-            nlen = _adderSize(pt, false);
-            if(UNLIKELY_COND(nlen == 0 || nlen != alen || tlv_len != sz + alen))
-                return false;
-            t->parentAddress.networkProtocol = cpu_to_net16(pt);
-            t->parentAddress.addressLength = cpu_to_net16(alen);
-            t->grandmasterClockQuality.offsetScaledLogVariance =
-                cpu_to_net16(t->grandmasterClockQuality.offsetScaledLogVariance);
-            t->stepsRemoved = cpu_to_net16(t->stepsRemoved);
-            t->currentUtcOffset = cpu_to_net16(t->currentUtcOffset);
-            break;
-        }
-        case PAD_id:
-            break;
-        default:
-            return false;
+    if(d->var == TLV_VAR_TEXT) {
+        struct PTPText_t *t = (struct PTPText_t *)((uint8_t *)p + d->varOff);
+        /* Ensure pad is zero */
+        if(_isOdd(t->lengthField))
+            t->textField[t->lengthField] = 0;
     }
-    h->tlvType = cpu_to_net16(id);
-    h->lengthField = cpu_to_net16(tlv_len - _tlv_hdr);
+    /* Verify size match */
+    if(UNLIKELY_COND(tlvSize(d, p, tlv_len, false) != tlv_len))
+        return false;
+    swapTlv(self, slot, p);
     return true;
 }
 
@@ -261,7 +440,7 @@ static bool _init(pmsg self, pcparms params, pbuffer buf)
         log_err("buffer does not exist");
         return false;
     }
-    buf_size = buf->getSize(buf);
+    buf_size = buffer_getSize(buf);
     if(buf_size < _msg_size) {
         log_err("buffer is too small");
         return false;
@@ -278,7 +457,7 @@ static bool _init(pmsg self, pcparms params, pbuffer buf)
             log_err("Unsupport nessage type");
             return false;
     }
-    m = (struct msg_t *)buf->getBuf(buf);
+    m = (struct msg_t *)buffer_getBuf(buf);
     memset(m, 0, _msg_size);
     m->messageType_majorSdoId = type | (majorSdoId << 4);
     m->versionPTP = (minorVersionPTP << 4) | versionPTP;
@@ -297,12 +476,14 @@ static bool _init(pmsg self, pcparms params, pbuffer buf)
     self->_msg = m;
     self->_buf = buf;
     self->_len = _msg_size;
-    buf->setLen(buf, _msg_size);
+    buffer_setLen(buf, _msg_size);
     self->_left = buf_size - _msg_size;
     /* pointer to unused buffer memory */
     self->_end = (void *)(m + 1);
     self->_type = type;
+    self->_net = false;
     self->_num_tlvs = 0;
+    memset(self->_tlvIdx, 0, sizeof(self->_tlvIdx));
     return true;
 }
 static void *_nextTlv(pmsg self, size_t need)
@@ -312,8 +493,9 @@ static void *_nextTlv(pmsg self, size_t need)
 }
 static bool _addTlv(pmsg self, enum tlv_type_id id)
 {
-    size_t sz, num_tlvs;
+    size_t sz;
     struct tlv_hdr_t *h;
+    const struct tlv_desc_t *d;
     if(UNLIKELY_COND(self == NULL))
         return false;
     if(self->_end == NULL) {
@@ -328,45 +510,42 @@ static bool _addTlv(pmsg self, enum tlv_type_id id)
         log_err("message buffer is too small");
         return false;
     }
-    sz = _min_tlv_size(id, true);
-    /* Here we check the minimum size of the TLV */
-    if(sz == 0)
+    d = tlvDesc(id, true);
+    if(d == NULL)
+        return false;
+    /* CSPTP_REQUEST and PAD have their own functions */
+    if(!d->add)
         return false;
+    sz = d->size;
+    /* Here we check the minimum size of the TLV */
     if(sz > self->_left) {
         log_err("message buffer is too small");
         return false;
     }
     h = (struct tlv_hdr_t *)self->_end;
     h->tlvType = id;
-    switch(id) {
-        case ALTERNATE_TIME_OFFSET_INDICATOR_id: {
-            uint8_t l;
-            struct ALTERNATE_TIME_OFFSET_INDICATOR_t *t = (struct
-                    ALTERNATE_TIME_OFFSET_INDICATOR_t *)h;
-            l = _makeEven(t->displayName.lengthField);
-            if(l > MAX_TZ_LEN) {
-                log_err("Time zone acronyms exceed allowed maximum %d", l);
+    switch(d->var) {
+        case TLV_VAR_TEXT: {
+            size_t l = _makeEven(((struct PTPText_t *)((uint8_t *)h +
+                            d->varOff))->lengthField);
+            if(l > d->varMax) {
+                log_err("%s text exceed allowed maximum %zu", d->name, l);
                 return false;
             }
             sz += l;
             break;
         }
-        case CSPTP_REQUEST_id: /* Use addCSPTPReqTlv() !*/
-            return false;
-        case CSPTP_STATUS_id: {
-            struct CSPTP_STATUS_t *t = (struct CSPTP_STATUS_t *)h;
-            size_t add = _adderSize(t->parentAddress.networkProtocol, true);
+        case TLV_VAR_ADDR: {
+            struct PortAddress_t *a =
+                (struct PortAddress_t *)((uint8_t *)h + d->varOff);
+            size_t add = _adderSize(a->networkProtocol, true);
             if(add == 0)
                 return false;
             sz += add;
             break;
         }
-        case CSPTP_RESPONSE_id:
+        default:
             break;
-        case PAD_id: /* We do not add pad directly! */
-            return false;
-        default: /* Unknown TLV */
-            return false;
     }
     /* Here we check the actual size of the TLV */
     if(sz > self->_left) {
@@ -375,22 +554,17 @@ static bool _addTlv(pmsg self, enum tlv_type_id id)
     }
     /* Update the TLV with its size */
     h->lengthField = sz - _tlv_hdr;
-    num_tlvs = self->_num_tlvs;
     /* Store the TLV */
-    self->_tlvs[num_tlvs].tlv = self->_end;
-    self->_tlvs[num_tlvs].len = sz;
-    self->_tlvs[num_tlvs].id = id;
+    storeTlv(self, self->_end, sz, id);
     /* Move the pointer to unused buffer memory */
     self->_end = (void *)((uint8_t *)h + sz);
     self->_left -= sz;
-    self->_num_tlvs++;
     self->_len += sz;
-    self->_buf->setLen(self->_buf, self->_len);
+    buffer_setLen(self->_buf, self->_len);
     return true;
 }
 bool _addCSPTPReqTlv(pmsg self, uint8_t flags)
 {
-    size_t num_tlvs;
     struct CSPTP_REQUEST_t *t;
     if(UNLIKELY_COND(self == NULL))
         return false;
@@ -414,17 +588,13 @@ bool _addCSPTPReqTlv(pmsg self, uint8_t flags)
     t->tlvRequestFlags[1] = 0;
     t->tlvRequestFlags[2] = 0;
     t->tlvRequestFlags[3] = 0;
-    num_tlvs = self->_num_tlvs;
     /* Store the TLV */
-    self->_tlvs[num_tlvs].tlv = self->_end;
-    self->_tlvs[num_tlvs].len = _csptp_req;
-    self->_tlvs[num_tlvs].id = CSPTP_REQUEST_id;
+    storeTlv(self, self->_end, _csptp_req, CSPTP_REQUEST_id);
     /* Move the pointer to unused buffer memory */
     self->_end = (void *)((uint8_t *)t + _csptp_req);
     self->_left -= _csptp_req;
-    self->_num_tlvs++;
     self->_len += _csptp_req;
-    self->_buf->setLen(self->_buf, self->_len);
+    buffer_setLen(self->_buf, self->_len);
     return true;
 }
 static bool _buildDone(pmsg self, size_t size)
@@ -450,7 +620,7 @@ static bool _buildDone(pmsg self, size_t size)
             log_err("message will not shrink");
             return false;
         }
-        if(size > buf->getSize(buf)) {
+        if(size > buffer_getSize(buf)) {
             log_err("message buffer is too small");
             return false;
         }
@@ -459,23 +629,19 @@ static bool _buildDone(pmsg self, size_t size)
     if(pad_sz > 0 && (pad_sz < _tlv_hdr || self->_left < pad_sz))
         return false;
     for(i = 0; i < self->_num_tlvs; i++) {
-        if(!cpu_to_net_tlv(self->_tlvs[i].id, self->_tlvs[i].tlv, self->_tlvs[i].len))
+        if(!cpu_to_net_tlv(self, self->_tlvs[i].id, self->_tlvs[i].tlv,
+                self->_tlvs[i].len))
             return false;
     }
-    buf->setLen(buf, size);
+    buffer_setLen(buf, size);
     cpu_to_net_msg(self->_msg, size);
     /* Add the PAD TLV */
     if(pad_sz >= _tlv_hdr) {
         struct tlv_hdr_t *h = (struct tlv_hdr_t *)self->_end;
         /* We add the PAD TLV any way
          * If we have place, we mark it */
-        if(self->_num_tlvs < MAX_TLVS) {
-            size_t num_tlvs = self->_num_tlvs;
-            self->_tlvs[num_tlvs].tlv = self->_end;
-            self->_tlvs[num_tlvs].len = pad_sz;
-            self->_tlvs[num_tlvs].id = PAD_id;
-            self->_num_tlvs++;
-        }
+        if(self->_num_tlvs < MAX_TLVS)
+            storeTlv(self, self->_end, pad_sz, PAD_id);
         self->_end = (void *)((uint8_t *)h + pad_sz);
         self->_len += pad_sz;
         self->_left -= pad_sz;
@@ -488,45 +654,16 @@ static bool _buildDone(pmsg self, size_t size)
     }
     return true;
 }
-static bool _parse(pmsg self, pparms params, pbuffer buf)
+static inline bool parseErr(pmsg self, enum msg_parse_e err)
 {
-    struct msg_t *m;
-    uint8_t type, controlField, *tlv_prt;
-    size_t len, size, msg_len, buf_size, num_tlvs;
-    if(UNLIKELY_COND(self == NULL))
-        return false;
-    if(params == NULL) {
-        log_err("parameters does not exist");
-        return false;
-    }
-    if(buf == NULL) {
-        log_err("buffer does not exist");
-        return false;
-    }
-    /* message data length */
-    len = buf->getLen(buf);
-    /* buffer size */
-    buf_size = buf->getSize(buf);
-    /* Ensure buffer data do not pass the buffer size, prevent bugy code */
-    if(UNLIKELY_COND(len > buf_size))
-        return false;
-    /* Ensure we have the minimum PTP message */
-    if(len < _msg_size) {
-        log_notice("nessage is too short");
-        return false;
-    }
-    /* Pointer to PTP message data */
-    m = (struct msg_t *)buf->getBuf(buf);
-    /* Convert Network to host order of the PTP message without the TLVs.
-     * and return total PTP message length includes the TLVs */
-    msg_len = net_to_cpu_msg(m);
-    /* Ensure the message do not exceed the recieve data length */
-    if(msg_len > len) {
-        log_warning("received message is smaller than PTP message length");
-        return false;
-    }
-    /* left TLVs size */
-    size = msg_len - _msg_size;
+    self->_parseErr = err;
+    return false;
+}
+/* Slow path, find the wrong header field.
+ * The fields we check are the same in network and host order */
+static bool hdrErr(pmsg self, const struct msg_t *m)
+{
+    uint8_t type, controlField;
     /* PTP Message type */
     type = m->messageType_majorSdoId & 0xf;
     /* the controlField value depends on PTP message type */
@@ -539,82 +676,178 @@ static bool _parse(pmsg self, pparms params, pbuffer buf)
             break;
         default:
             log_notice("Unsupport nessage type");
-            return false;
+            return parseErr(self, MSG_PARSE_TYPE);
     }
     /* Verify fileds with predefined values */
     if(m->controlField != controlField) {
         log_warning("Wrong controlField value");
-        return false;
+        return parseErr(self, MSG_PARSE_HEADER);
     }
     if(m->logMessageInterval != 0x7f) {
         log_warning("Wrong logMessageInterval value");
-        return false;
+        return parseErr(self, MSG_PARSE_HEADER);
     }
     if(m->versionPTP != ((minorVersionPTP << 4) | versionPTP)) {
         log_warning("Wrong versionPTP value");
-        return false;
+        return parseErr(self, MSG_PARSE_VERSION);
     }
     if((m->messageType_majorSdoId >> 4) != majorSdoId) {
         log_warning("Wrong messageType_majorSdoId value");
-        return false;
+        return parseErr(self, MSG_PARSE_VERSION);
     }
     if(memcmp(m->sourcePortIdentity.clockIdentity, zeroClockIdentity, 8) != 0 ||
         m->sourcePortIdentity.portNumber != 0) {
         log_warning("Wrong sourcePortIdentity value");
-        return false;
+        return parseErr(self, MSG_PARSE_HEADER);
     }
     if(m->minorSdoId != minorSdoId) {
         log_warning("Wrong minorSdoId value");
-        return false;
+        return parseErr(self, MSG_PARSE_VERSION);
     }
     if((m->flagField[0] & ~twoStepsFlag) != unicastFlag) {
         log_warning("Wrong flagField[0] value");
-        return false;
+        return parseErr(self, MSG_PARSE_FLAGS);
     }
     if((m->flagField[1] & 0xc0) != 0) {
         log_warning("Wrong flagField[1] value");
+        return parseErr(self, MSG_PARSE_FLAGS);
+    }
+    log_warning("Wrong header value");
+    return parseErr(self, MSG_PARSE_HEADER);
+}
+/* Parse a received message.
+ * With net the message stays in network order and only the parameters
+ * are converted, otherwise the message is converted in place */
+static inline bool parse(pmsg self, pparms params, pcbuffer buf, bool checked,
+    bool net)
+{
+    struct msg_t *m;
+    bool valid;
+    uint8_t type, *tlv_prt;
+    size_t len, size, msg_len, buf_size;
+    if(UNLIKELY_COND(self == NULL))
         return false;
+    self->_parseErr = MSG_PARSE_OK;
+    if(params == NULL) {
+        log_err("parameters does not exist");
+        return parseErr(self, MSG_PARSE_ARGS);
+    }
+    if(buf == NULL) {
+        log_err("buffer does not exist");
+        return parseErr(self, MSG_PARSE_ARGS);
+    }
+    /* message data length */
+    len = buffer_getLen(buf);
+    /* buffer size */
+    buf_size = buffer_getSize(buf);
+    /* Ensure buffer data do not pass the buffer size, prevent bugy code */
+    if(UNLIKELY_COND(len > buf_size))
+        return parseErr(self, MSG_PARSE_SHORT);
+    /* Ensure we have the minimum PTP message */
+    if(len < _msg_size) {
+        log_notice("nessage is too short");
+        return parseErr(self, MSG_PARSE_SHORT);
+    }
+    /* Pointer to PTP message data */
+    m = (struct msg_t *)buffer_getBuf(buf);
+    /* Fast check of the fixed header fields before the byte swap */
+    valid = checked || LIKELY_COND(hdrValid(self, (uint8_t *)m));
+    /* Convert Network to host order of the PTP message without the TLVs.
+     * and return total PTP message length includes the TLVs */
+    msg_len = net ? net_to_cpu16(m->messageLength) : net_to_cpu_msg(m);
+    /* Ensure the message do not exceed the recieve data length */
+    if(msg_len > len) {
+        log_warning("received message is smaller than PTP message length");
+        return parseErr(self, MSG_PARSE_LENGTH);
     }
+    /* left TLVs size */
+    size = msg_len - _msg_size;
+    /* PTP Message type */
+    type = m->messageType_majorSdoId & 0xf;
+    if(!valid)
+        return hdrErr(self, m);
+    self->_num_tlvs = 0; /* Number of TLVs */
+    memset(self->_tlvIdx, 0, sizeof(self->_tlvIdx));
     tlv_prt = (uint8_t *)(m + 1); /* Pointer to TLV */
-    num_tlvs = 0; /* Number of TLVs */
-    while(size > _tlv_hdr && num_tlvs < MAX_TLVS) {
+    while(size > _tlv_hdr && self->_num_tlvs < MAX_TLVS) {
         size_t tlv_len;
-        enum tlv_type_id id = net_to_cpu_tlv(tlv_prt, size, &tlv_len);
+        enum tlv_type_id id = tlvCheck(tlv_prt, size, &tlv_len);
         if(id == Invalid_tlv_ID) {
-            log_debug("TLV %d failed", num_tlvs);
+            log_debug("TLV %zu failed", self->_num_tlvs);
             break;
         }
+        if(!net)
+            net_to_cpu_tlv(self, id, tlv_prt);
         /* Store the TLV */
-        self->_tlvs[num_tlvs].tlv = tlv_prt;
-        self->_tlvs[num_tlvs].len = tlv_len;
-        self->_tlvs[num_tlvs].id = id;
+        storeTlv(self, tlv_prt, tlv_len, id);
         tlv_prt += tlv_len;
         size -= tlv_len;
-        num_tlvs++;
     };
     /* PTP Message type */
     self->_type = type;
     /* Pointer to PTP message data */
     self->_msg = m;
-    self->_buf = buf;
     /* total PTP message length includes the TLVs */
     self->_len = msg_len;
-    /* left size avaialable for more TLVs */
-    self->_left = size + buf_size - msg_len;
-    /* Pointer to unused buffer memory */
-    self->_end = tlv_prt;
-    /* Number of TLVs */
-    self->_num_tlvs = num_tlvs;
+    self->_net = net;
+    if(net) {
+        /* A view can not be used to build */
+        self->_buf = NULL;
+        self->_left = 0;
+        self->_end = NULL;
+    } else {
+        self->_buf = (pbuffer)buf;
+        /* left size avaialable for more TLVs */
+        self->_left = size + buf_size - msg_len;
+        /* Pointer to unused buffer memory */
+        self->_end = tlv_prt;
+    }
     /* Store PTP message values in ptp_params_t structire */
     params->type = type;
     params->useTwoSteps = (m->flagField[0] & twoStepsFlag) == twoStepsFlag;
     params->flagField2 = m->flagField[1];
-    params->correctionField = m->correctionField;
     params->domainNumber = m->domainNumber;
-    params->sequenceId = m->sequenceId;
     params->timestamp = m->timestamp;
+    if(net) {
+        params->correctionField = net_to_cpu64(m->correctionField);
+        params->sequenceId = net_to_cpu16(m->sequenceId);
+        net_to_cpu_ts(&params->timestamp);
+    } else {
+        params->correctionField = m->correctionField;
+        params->sequenceId = m->sequenceId;
+    }
     return true;
 }
+static bool _parse(pmsg self, pparms params, pbuffer buf)
+{
+    return parse(self, params, buf, false, false);
+}
+static bool _view(pmsg self, pparms params, pcbuffer buf)
+{
+    return parse(self, params, buf, false, true);
+}
+static size_t _check(pcmsg self, pcbuffer *bufs, size_t num, bool *valid)
+{
+    size_t len, ret = 0;
+    if(UNLIKELY_COND(self == NULL || bufs == NULL || valid == NULL))
+        return 0;
+    for(size_t i = 0; i < num; i++) {
+        pcbuffer b = bufs[i];
+        len = buffer_getLen(b);
+        valid[i] = len >= _msg_size && len <= buffer_getSize(b) &&
+            hdrValid(self, buffer_getBuf(b));
+        ret += valid[i];
+    }
+    return ret;
+}
+static bool _viewChecked(pmsg self, pparms params, pcbuffer buf)
+{
+    return parse(self, params, buf, true, true);
+}
+static enum msg_parse_e _getParseErr(pcmsg self)
+{
+    return UNLIKELY_COND(self == NULL) ? MSG_PARSE_ARGS : self->_parseErr;
+}
 static bool _copy(pmsg self, pbuffer buf)
 {
     size_t len;
@@ -633,13 +866,13 @@ static bool _copy(pmsg self, pbuffer buf)
     len = self->_len;
     if(UNLIKELY_COND(len < _msg_size))
         return false;
-    if(buf->getSize(buf) < len) {
+    if(buffer_getSize(buf) < len) {
         log_err("buffer is too small");
         return false;
     }
-    if(UNLIKELY_COND(!buf->setLen(buf, len)))
+    if(UNLIKELY_COND(!buffer_setLen(buf, len)))
         return false;
-    memcpy(buf->getBuf(buf), m, len);
+    memcpy(buffer_getBuf(buf), m, len);
     return true;
 }
 static void _detach(pmsg self)
@@ -661,8 +894,9 @@ static size_t _getPTPMsgSize()
 }
 static size_t _getTlvSize(enum tlv_type_id id)
 {
-    return _min_tlv_size(id, false) +
-        (id == ALTERNATE_TIME_OFFSET_INDICATOR_id ? MAX_TZ_LEN : 0);
+    const struct tlv_desc_t *d = tlvDesc(id, false);
+    return d == NULL ? 0 : d->size +
+        (d->var == TLV_VAR_TEXT ? d->varMax : 0);
 }
 static size_t _getCSPTPStatusTlvSize(prot p)
 {
@@ -688,12 +922,40 @@ static void *_getTlv(pcmsg self, size_t index)
     return UNLIKELY_COND(self == NULL) ||
         index >= self->_num_tlvs ? NULL : self->_tlvs[index].tlv;
 }
+static inline const struct tlvs_t *findTlv(pcmsg self, enum tlv_type_id id)
+{
+    int slot = tlvSlot(id);
+    if(UNLIKELY_COND(self == NULL) || slot < 0 || self->_tlvIdx[slot] == 0)
+        return NULL;
+    return self->_tlvs + self->_tlvIdx[slot] - 1;
+}
+static const void *_findTlv(pcmsg self, enum tlv_type_id id)
+{
+    const struct tlvs_t *t = findTlv(self, id);
+    return t == NULL ? NULL : t->tlv;
+}
+static size_t _copyTlv(pcmsg self, enum tlv_type_id id, void *tlv, size_t size)
+{
+    const struct tlvs_t *t = findTlv(self, id);
+    if(t == NULL || tlv == NULL || t->len > size)
+        return 0;
+    memcpy(tlv, t->tlv, t->len);
+    if(self->_net)
+        net_to_cpu_tlv(self, id, tlv);
+    return t->len;
+}
 
 pmsg msg_alloc()
 {
     pmsg ret = (pmsg)malloc(sizeof(struct ptp_msg_t));
     if(ret != NULL) {
         detach(ret);
+        ret->_parseErr = MSG_PARSE_OK;
+        hdrTmpl(ret);
+        if(!tlvPerm(ret)) {
+            free(ret);
+            return NULL;
+        }
 #define asg(a) ret->a = _##a
         asg(free);
         asg(init);
@@ -702,6 +964,10 @@ pmsg msg_alloc()
         asg(addCSPTPReqTlv);
         asg(buildDone);
         asg(parse);
+        asg(check);
+        asg(view);
+        asg(viewChecked);
+        asg(getParseErr);
         asg(copy);
         asg(detach);
         asg(getMsgType);
@@ -713,6 +979,8 @@ pmsg msg_alloc()
         asg(getTlvLen);
         asg(getTlvID);
         asg(getTlv);
+        asg(findTlv);
+        asg(copyTlv);
     } else
         log_err("memory allocation failed");
     return ret;
@@ -148,6 +148,27 @@ struct CSPTP_STATUS_t {
     struct PortAddress_t parentAddress;
 } _PACKED__;
 
+/** Number of TLV IDs in the TLVs index */
+#define MSG_TLV_IDS (5)
+/** Maximum fixed size of a TLV, CSPTP_STATUS */
+#define MSG_TLV_FIXED (32)
+
+/** Octets of PTP header with fixed values, up to logMessageInterval */
+#define MSG_HDR_FIXED (34)
+
+/** Reason a message fails parsing */
+enum msg_parse_e {
+    MSG_PARSE_OK, /**> message is parsed */
+    MSG_PARSE_ARGS, /**> missing parameters or buffer */
+    MSG_PARSE_SHORT, /**> message is shorter than the PTP header */
+    MSG_PARSE_LENGTH, /**> messageLength exceeds the received data */
+    MSG_PARSE_TYPE, /**> unsupported message type */
+    MSG_PARSE_VERSION, /**> wrong PTP version or SDO ID */
+    MSG_PARSE_HEADER, /**> wrong header field value */
+    MSG_PARSE_FLAGS, /**> wrong flagField value */
+    MSG_PARSE_NUM
+};
+
 struct ptp_params_t {
     enum messageType_e type;
     uint8_t domainNumber;
@@ -171,6 +192,14 @@ struct ptp_msg_t {
         enum tlv_type_id id; /**> TLV ID */
     } _tlvs[MAX_TLVS];
     size_t _num_tlvs;
+    uint8_t _tlvIdx[MSG_TLV_IDS]; /**> first TLV of each ID, plus one */
+    bool _net; /**> message is a view in network order */
+    enum msg_parse_e _parseErr; /**> reason last parse failed */
+    /**> header values of Sync and Follow_Up, in network order */
+    uint8_t _hdrVal[2][MSG_HDR_FIXED];
+    uint8_t _hdrMask[MSG_HDR_FIXED]; /**> mask of fixed header fields */
+    /**> permutations that swap the fixed part of each TLV */
+    uint8_t _tlvPerm[MSG_TLV_IDS][MSG_TLV_FIXED];
 
     /**
      * Free this message object
@@ -240,6 +269,46 @@ struct ptp_msg_t {
      */
     bool (*parse)(pmsg self, pparms params, pbuffer buffer);
 
+    /**
+     * Check fixed header fields of received messages
+     * @param[in] self message object
+     * @param[in] buffers array of buffers with received messages
+     * @param[in] num number of buffers
+     * @param[out] valid array of num results
+     * @return number of messages that pass
+     * @note a message that pass may still fail parsing, by its length
+     */
+    size_t (*check)(pcmsg self, pcbuffer *buffers, size_t num, bool *valid);
+
+    /**
+     * Parse a received message without changing it
+     * @param[in, out] self message object
+     * @param[in, out] params of message to initilize
+     * @param[in] buffer to parse
+     * @return true if parsing success
+     * @note the message and its TLVs stay in network order,
+     *       use copyTlv() to read a TLV in host order.
+     *       The message object can not build on the view.
+     */
+    bool (*view)(pmsg self, pparms params, pcbuffer buffer);
+
+    /**
+     * Parse a received message that pass check() without changing it
+     * @param[in, out] self message object
+     * @param[in, out] params of message to initilize
+     * @param[in] buffer to parse
+     * @return true if parsing success
+     * @note skip the header check
+     */
+    bool (*viewChecked)(pmsg self, pparms params, pcbuffer buffer);
+
+    /**
+     * Get reason last parsing failed
+     * @param[in] self message object
+     * @return reason, MSG_PARSE_OK if last parsing success
+     */
+    enum msg_parse_e (*getParseErr)(pcmsg self);
+
     /**
      * Copy message to another buffer
      * @param[in, out] self message object
@@ -323,6 +392,25 @@ struct ptp_msg_t {
      * @return pointer to TLV or NULL
      */
     void *(*getTlv)(pcmsg self, size_t index);
+
+    /**
+     * Find TLV by its ID
+     * @param[in] self message object
+     * @param[in] id of TLV
+     * @return pointer to the first TLV with the ID or NULL
+     * @note the TLV of a view is in network order
+     */
+    const void *(*findTlv)(pcmsg self, enum tlv_type_id id);
+
+    /**
+     * Copy TLV by its ID in host order
+     * @param[in] self message object
+     * @param[in] id of TLV
+     * @param[out] tlv memory to copy to
+     * @param[in] size of memory
+     * @return size of TLV with the header or zero
+     */
+    size_t (*copyTlv)(pcmsg self, enum tlv_type_id id, void *tlv, size_t size);
 };
 
 /**
@@ -0,0 +1,501 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief read and write UDP datagrams in capture files
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/pcap.h"
+#include "src/log.h"
+
+#include <stdio.h>
+
+/* pcap file magic, microseconds and nanoseconds timestamps */
+#define PCAP_MAGIC_US (0xa1b2c3d4)
+#define PCAP_MAGIC_NS (0xa1b23c4d)
+#define PCAP_HDR_LEN (24)
+#define PCAP_REC_LEN (16)
+#define PCAP_SNAPLEN (65535)
+/* pcapng blocks */
+#define NG_SHB (0x0a0d0d0a) /* Section Header, same in both byte orders */
+#define NG_IDB (1) /* Interface Description */
+#define NG_OPB (2) /* Obsolete Packet */
+#define NG_SPB (3) /* Simple Packet */
+#define NG_EPB (6) /* Enhanced Packet */
+#define NG_BYTE_ORDER (0x1a2b3c4d)
+#define NG_OPT_END (0)
+#define NG_OPT_TSRESOL (9)
+/* Link types */
+#define LINK_NULL (0) /* BSD loopback */
+#define LINK_ETHERNET (1)
+#define LINK_RAW (101)
+#define LINK_SLL (113) /* Linux cooked */
+#define LINK_IPV4 (228)
+#define LINK_IPV6 (229)
+#define LINK_SLL2 (276) /* Linux cooked version 2 */
+#define ETH_HDR_LEN (14)
+#define ETH_TYPE_IP4 (0x0800)
+#define ETH_TYPE_IP6 (0x86dd)
+#define ETH_TYPE_VLAN (0x8100)
+#define VLAN_HDR_LEN (4)
+/* Longest record we read */
+#define PCAP_MAX_REC (0x40000)
+/* Room in front of record data to place an Ethernet header */
+#define PCAP_HEADROOM (16)
+
+struct pcap_if_t {
+    uint32_t link;
+    uint64_t units; /* timestamp units per second */
+};
+
+static inline uint16_t get16(pcpcap self, const uint8_t *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return self->_swap ? __builtin_bswap16(v) : v;
+}
+static inline uint32_t get32(pcpcap self, const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return self->_swap ? __builtin_bswap32(v) : v;
+}
+/* Set in our byte order */
+static inline void set16(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+static inline void set32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+static inline uint16_t getNet16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+static inline int64_t toNs(uint64_t units, uint64_t t)
+{
+    return (int64_t)(t / units) * NSEC_PER_SEC +
+        (int64_t)((double)(t % units) * NSEC_PER_SEC / units);
+}
+static uint8_t *getData(ppcap self, size_t size)
+{
+    if(size > self->_dataSize) {
+        uint8_t *d = realloc(self->_data, size);
+        if(d == NULL) {
+            log_err("memory allocation failed");
+            return NULL;
+        }
+        self->_data = d;
+        self->_dataSize = size;
+    }
+    return self->_data;
+}
+static inline bool readFile(ppcap self, void *buf, size_t len)
+{
+    return fread(buf, 1, len, self->_file) == len;
+}
+/* Read a record, leave headroom in front of it */
+static uint8_t *readData(ppcap self, size_t len)
+{
+    uint8_t *d;
+    if(len > PCAP_MAX_REC) {
+        log_err("record is too long %zu", len);
+        return NULL;
+    }
+    d = getData(self, PCAP_HEADROOM + len);
+    if(d == NULL)
+        return NULL;
+    d += PCAP_HEADROOM;
+    if(!readFile(self, d, len)) {
+        log_warning("capture file is truncated");
+        return NULL;
+    }
+    return d;
+}
+static void closeFile(ppcap self)
+{
+    if(self->_file != NULL)
+        fclose(self->_file);
+    self->_file = NULL;
+    free(self->_ifs);
+    self->_ifs = NULL;
+    self->_ifsNum = 0;
+    self->_skipped = 0;
+}
+static void _free(ppcap self)
+{
+    if(LIKELY_COND(self != NULL)) {
+        closeFile(self);
+        free(self->_data);
+    }
+    free(self);
+}
+static bool _open(ppcap self, const char *name)
+{
+    uint8_t h[PCAP_HDR_LEN];
+    uint32_t magic;
+    if(UNLIKELY_COND(self == NULL) || name == NULL)
+        return false;
+    closeFile(self);
+    self->_file = fopen(name, "rb");
+    if(self->_file == NULL) {
+        logp_err("Fail open %s", name);
+        return false;
+    }
+    self->_write = false;
+    self->_swap = false;
+    if(!readFile(self, h, sizeof(uint32_t)))
+        goto err;
+    memcpy(&magic, h, sizeof(magic));
+    if(magic == NG_SHB) {
+        /* Read the Section Header block with the records */
+        self->_ng = true;
+        rewind(self->_file);
+        return true;
+    }
+    self->_ng = false;
+    if(__builtin_bswap32(magic) == PCAP_MAGIC_US ||
+        __builtin_bswap32(magic) == PCAP_MAGIC_NS) {
+        self->_swap = true;
+        magic = __builtin_bswap32(magic);
+    }
+    if(magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS)
+        goto err;
+    if(!readFile(self, h + sizeof(uint32_t), PCAP_HDR_LEN - sizeof(uint32_t)))
+        goto err;
+    self->_units = magic == PCAP_MAGIC_NS ? NSEC_PER_SEC : 1000000;
+    self->_link = get32(self, h + 20);
+    return true;
+err:
+    log_err("%s is not a capture file", name);
+    closeFile(self);
+    return false;
+}
+static bool _create(ppcap self, const char *name)
+{
+    uint8_t h[PCAP_HDR_LEN];
+    if(UNLIKELY_COND(self == NULL) || name == NULL)
+        return false;
+    closeFile(self);
+    self->_file = fopen(name, "wb");
+    if(self->_file == NULL) {
+        logp_err("Fail create %s", name);
+        return false;
+    }
+    self->_write = true;
+    self->_swap = false;
+    self->_ng = false;
+    self->_link = LINK_ETHERNET;
+    self->_units = NSEC_PER_SEC;
+    memset(h, 0, sizeof(h));
+    set32(h, PCAP_MAGIC_NS);
+    set16(h + 4, 2); /* Version 2.4 */
+    set16(h + 6, 4);
+    set32(h + 16, PCAP_SNAPLEN);
+    set32(h + 20, LINK_ETHERNET);
+    if(fwrite(h, 1, sizeof(h), self->_file) != sizeof(h)) {
+        logp_err("Fail write %s", name);
+        closeFile(self);
+        return false;
+    }
+    return true;
+}
+/* Parse a record, we place an Ethernet header in front of IP packets */
+static bool parseRec(pcpcap self, uint32_t link, uint8_t *data, size_t len,
+    struct pkt_info_t *info)
+{
+    size_t hLen;
+    uint16_t type;
+    switch(link) {
+        case LINK_ETHERNET:
+            /* pkt_parse() rejects a VLAN tag, we do not reply on the wire */
+            if(len >= ETH_HDR_LEN + VLAN_HDR_LEN &&
+                getNet16(data + 12) == ETH_TYPE_VLAN) {
+                memmove(data + VLAN_HDR_LEN, data, 12);
+                data += VLAN_HDR_LEN;
+                len -= VLAN_HDR_LEN;
+            }
+            return pkt_parse(data, len, info);
+        case LINK_NULL:
+            /* Protocol family in the order of the capturing host */
+            hLen = 4;
+            if(len < hLen)
+                return false;
+            switch(get32(self, data)) {
+                case 2: /* AF_INET */
+                    type = ETH_TYPE_IP4;
+                    break;
+                case 24: /* AF_INET6 of BSD systems */
+                case 28:
+                case 30:
+                    type = ETH_TYPE_IP6;
+                    break;
+                default:
+                    return false;
+            }
+            break;
+        case LINK_SLL:
+            hLen = 16;
+            if(len < hLen)
+                return false;
+            type = getNet16(data + 14);
+            break;
+        case LINK_SLL2:
+            hLen = 20;
+            if(len < hLen)
+                return false;
+            type = getNet16(data);
+            break;
+        case LINK_RAW:
+            hLen = 0;
+            if(len < 1)
+                return false;
+            type = (data[0] >> 4) == 6 ? ETH_TYPE_IP6 : ETH_TYPE_IP4;
+            break;
+        case LINK_IPV4:
+            hLen = 0;
+            type = ETH_TYPE_IP4;
+            break;
+        case LINK_IPV6:
+            hLen = 0;
+            type = ETH_TYPE_IP6;
+            break;
+        default:
+            return false;
+    }
+    /* The headroom ensure we do not write before the buffer */
+    data += hLen;
+    data -= ETH_HDR_LEN;
+    memset(data, 0, ETH_HDR_LEN);
+    data[12] = type >> 8;
+    data[13] = type & 0xff;
+    return pkt_parse(data, len - hLen + ETH_HDR_LEN, info);
+}
+static bool nextPcap(ppcap self, uint8_t **data, size_t *len, uint32_t *link,
+    int64_t *ns)
+{
+    uint8_t h[PCAP_REC_LEN];
+    if(!readFile(self, h, sizeof(h)))
+        return false; /* End of file */
+    *len = get32(self, h + 8);
+    *data = readData(self, *len);
+    if(*data == NULL)
+        return false;
+    *link = self->_link;
+    *ns = (int64_t)get32(self, h) * NSEC_PER_SEC +
+        toNs(self->_units, get32(self, h + 4));
+    return true;
+}
+static bool addIf(ppcap self, const uint8_t *b, size_t len)
+{
+    struct pcap_if_t *i;
+    size_t off, optLen;
+    uint8_t v;
+    if(len < 8) {
+        log_err("wrong pcapng interface block");
+        return false;
+    }
+    i = realloc(self->_ifs, (self->_ifsNum + 1) * sizeof(struct pcap_if_t));
+    if(i == NULL) {
+        log_err("memory allocation failed");
+        return false;
+    }
+    self->_ifs = i;
+    i += self->_ifsNum++;
+    i->link = get16(self, b);
+    i->units = 1000000;
+    for(off = 8; off + 4 <= len; off += 4 + ((optLen + 3) & ~3)) {
+        uint16_t code = get16(self, b + off);
+        optLen = get16(self, b + off + 2);
+        if(code == NG_OPT_END || off + 4 + optLen > len)
+            break;
+        if(code != NG_OPT_TSRESOL || optLen < 1)
+            continue;
+        /* Negative power of 2 or of 10 */
+        v = b[off + 4];
+        if((v & 0x80) > 0) {
+            if((v & 0x7f) > 63)
+                goto err;
+            i->units = (uint64_t)1 << (v & 0x7f);
+        } else {
+            if(v > 19)
+                goto err;
+            for(i->units = 1; v > 0; v--)
+                i->units *= 10;
+        }
+    }
+    return true;
+err:
+    log_err("wrong pcapng timestamp resolution");
+    return false;
+}
+static bool nextNg(ppcap self, uint8_t **data, size_t *len, uint32_t *link,
+    int64_t *ns)
+{
+    uint8_t h[12];
+    uint32_t type, bLen, id, magic;
+    size_t cap, off;
+    uint64_t t;
+    uint8_t *b;
+    for(;;) {
+        if(!readFile(self, h, 8))
+            return false; /* End of file */
+        type = get32(self, h);
+        if(type == NG_SHB) {
+            /* New section with its own byte order and interfaces */
+            if(!readFile(self, h + 8, 4))
+                return false;
+            memcpy(&magic, h + 8, sizeof(magic));
+            if(magic == NG_BYTE_ORDER)
+                self->_swap = false;
+            else if(__builtin_bswap32(magic) == NG_BYTE_ORDER)
+                self->_swap = true;
+            else {
+                log_err("wrong pcapng byte order");
+                return false;
+            }
+            self->_ifsNum = 0;
+            bLen = get32(self, h + 4);
+            if(bLen < 28 || bLen % 4 != 0) {
+                log_err("wrong pcapng block length");
+                return false;
+            }
+            if(readData(self, bLen - 12) == NULL)
+                return false;
+            continue;
+        }
+        bLen = get32(self, h + 4);
+        if(bLen < 12 || bLen % 4 != 0) {
+            log_err("wrong pcapng block length");
+            return false;
+        }
+        /* Block body and its trailing length */
+        b = readData(self, bLen - 8);
+        if(b == NULL)
+            return false;
+        bLen -= 12;
+        switch(type) {
+            case NG_IDB:
+                if(!addIf(self, b, bLen))
+                    return false;
+                continue;
+            case NG_EPB:
+                if(bLen < 20)
+                    goto err;
+                id = get32(self, b);
+                off = 20;
+                break;
+            case NG_OPB:
+                if(bLen < 20)
+                    goto err;
+                id = get16(self, b);
+                off = 20;
+                break;
+            case NG_SPB:
+                /* Packet without a timestamp from the first interface */
+                if(bLen < 4)
+                    goto err;
+                cap = get32(self, b);
+                if(cap > bLen - 4)
+                    cap = bLen - 4;
+                *data = b + 4;
+                *len = cap;
+                if(self->_ifsNum == 0)
+                    goto err;
+                *link = self->_ifs[0].link;
+                *ns = 0;
+                return true;
+            default:
+                continue;
+        }
+        if(id >= self->_ifsNum)
+            goto err;
+        cap = get32(self, b + 12);
+        if(cap > bLen - off)
+            goto err;
+        t = ((uint64_t)get32(self, b + 4) << 32) | get32(self, b + 8);
+        *data = b + off;
+        *len = cap;
+        *link = self->_ifs[id].link;
+        *ns = toNs(self->_ifs[id].units, t);
+        return true;
+    }
+err:
+    log_err("wrong pcapng packet block");
+    return false;
+}
+static bool _next(ppcap self, struct pkt_info_t *info, pts ts)
+{
+    uint8_t *data;
+    size_t len;
+    uint32_t link;
+    int64_t ns;
+    if(UNLIKELY_COND(self == NULL) || info == NULL || ts == NULL ||
+        self->_file == NULL || self->_write)
+        return false;
+    while(self->_ng ? nextNg(self, &data, &len, &link, &ns) :
+        nextPcap(self, &data, &len, &link, &ns)) {
+        if(parseRec(self, link, data, len, info)) {
+            ts->setTs(ts, ns);
+            return true;
+        }
+        self->_skipped++;
+    }
+    return false;
+}
+static bool _write(ppcap self, const struct pkt_info_t *info, pcts ts)
+{
+    uint8_t *d;
+    size_t hLen, len;
+    int64_t t;
+    if(UNLIKELY_COND(self == NULL) || info == NULL || ts == NULL ||
+        self->_file == NULL || !self->_write)
+        return false;
+    hLen = pkt_hdrLen(info->type);
+    len = hLen + info->len;
+    if(hLen == 0 || info->payload == NULL || len > PCAP_SNAPLEN) {
+        log_err("wrong datagram");
+        return false;
+    }
+    d = getData(self, PCAP_REC_LEN + len);
+    if(d == NULL)
+        return false;
+    memcpy(d + PCAP_REC_LEN + hLen, info->payload, info->len);
+    if(!pkt_build(d + PCAP_REC_LEN, info, info->len))
+        return false;
+    t = ts_getTs(ts);
+    set32(d, t / NSEC_PER_SEC);
+    set32(d + 4, t % NSEC_PER_SEC);
+    set32(d + 8, len);
+    set32(d + 12, len);
+    len += PCAP_REC_LEN;
+    if(fwrite(d, 1, len, self->_file) != len) {
+        logp_err("Fail write capture file");
+        return false;
+    }
+    return true;
+}
+static size_t _skipped(pcpcap self)
+{
+    return UNLIKELY_COND(self == NULL) ? 0 : self->_skipped;
+}
+ppcap pcap_alloc()
+{
+    ppcap ret = malloc(sizeof(struct pcap_file_t));
+    if(ret != NULL) {
+        memset(ret, 0, sizeof(struct pcap_file_t));
+#define asg(a) ret->a = _##a
+        asg(free);
+        asg(open);
+        asg(create);
+        asg(next);
+        asg(write);
+        asg(skipped);
+    }
+    return ret;
+}
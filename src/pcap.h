@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief read and write UDP datagrams in capture files
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_PCAP_H_
+#define __CSPTP_PCAP_H_
+
+#include "src/pkt.h"
+#include "src/time.h"
+
+typedef struct pcap_file_t *ppcap;
+typedef const struct pcap_file_t *pcpcap;
+
+struct pcap_if_t;
+
+struct pcap_file_t {
+    void *_file; /**> stdio file */
+    bool _write; /**> file is created */
+    bool _swap; /**> file byte order differs from ours */
+    bool _ng; /**> file uses the pcapng format */
+    uint32_t _link; /**> link type of pcap file */
+    uint64_t _units; /**> timestamp units per second of pcap file */
+    struct pcap_if_t *_ifs; /**> interfaces of pcapng section */
+    size_t _ifsNum; /**> number of interfaces in pcapng section */
+    uint8_t *_data; /**> record data */
+    size_t _dataSize; /**> size of record data */
+    size_t _skipped; /**> number of records that are not UDP datagrams */
+
+    /**
+     * Free this capture file object
+     * @param[in, out] self capture file object
+     * @note close the file
+     */
+    void (*free)(ppcap self);
+
+    /**
+     * Open capture file for reading
+     * @param[in, out] self capture file object
+     * @param[in] name of file
+     * @return true on success
+     * @note support pcap and pcapng files in both byte orders
+     * @note support Ethernet, Linux cooked, BSD loopback and raw IP links
+     */
+    bool (*open)(ppcap self, const char *name);
+
+    /**
+     * Create capture file for writing
+     * @param[in, out] self capture file object
+     * @param[in] name of file
+     * @return true on success
+     * @note write a pcap file with Ethernet link and nanoseconds timestamps
+     */
+    bool (*create)(ppcap self, const char *name);
+
+    /**
+     * Read next UDP datagram
+     * @param[in, out] self capture file object
+     * @param[out] info of datagram, the payload is valid till next read
+     * @param[out] ts capture time
+     * @return true on success, false on end of file or error
+     * @note skip records that are not UDP datagrams
+     */
+    bool (*next)(ppcap self, struct pkt_info_t *info, pts ts);
+
+    /**
+     * Write UDP datagram
+     * @param[in, out] self capture file object
+     * @param[in] info of datagram with its payload
+     * @param[in] ts capture time
+     * @return true on success
+     */
+    bool (*write)(ppcap self, const struct pkt_info_t *info, pcts ts);
+
+    /**
+     * Get number of skipped records
+     * @param[in] self capture file object
+     * @return number of records that are not UDP datagrams
+     */
+    size_t (*skipped)(pcpcap self);
+};
+
+/**
+ * Allocate a capture file object
+ * @return pointer to a new capture file object or null
+ */
+ppcap pcap_alloc();
+
+#endif /* __CSPTP_PCAP_H_ */
@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief Ethernet, IP and UDP headers of raw frames
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/pkt.h"
+#include "src/log.h"
+
+#define ETH_HDR_LEN (14)
+#define IP4_HDR_LEN (20)
+#define IP6_HDR_LEN (40)
+#define UDP_HDR_LEN (8)
+#define ETH_TYPE_IP4 (0x0800)
+#define ETH_TYPE_IP6 (0x86dd)
+#define IP_PROTO_UDP (17)
+#define IP_TTL (64)
+#define IP4_DF (0x4000) /* Do not fragment */
+#define IP4_FRAG (0x3fff) /* More fragments and fragment offset */
+
+static inline uint16_t get16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+static inline void set16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+/* Internet checksum, RFC 1071 */
+static inline uint32_t sum(uint32_t s, const uint8_t *p, size_t len)
+{
+    for(; len > 1; p += 2, len -= 2)
+        s += get16(p);
+    if(len > 0)
+        s += p[0] << 8;
+    return s;
+}
+static inline uint16_t fold(uint32_t s)
+{
+    while(s > UINT16_MAX)
+        s = (s & UINT16_MAX) + (s >> 16);
+    return ~s & UINT16_MAX;
+}
+bool pkt_parse(const uint8_t *frame, size_t len, struct pkt_info_t *info)
+{
+    uint16_t type;
+    size_t ipLen, total;
+    const uint8_t *ip, *udp;
+    if(frame == NULL || info == NULL || len < ETH_HDR_LEN)
+        return false;
+    memcpy(info->dstMac, frame, PKT_MAC_LEN);
+    memcpy(info->srcMac, frame + PKT_MAC_LEN, PKT_MAC_LEN);
+    type = get16(frame + 12);
+    ip = frame + ETH_HDR_LEN;
+    len -= ETH_HDR_LEN;
+    /* VLAN tagged frames fall to the default,
+     * the reply would be untagged */
+    switch(type) {
+        case ETH_TYPE_IP4:
+            if(len < IP4_HDR_LEN || (ip[0] >> 4) != 4 || ip[9] != IP_PROTO_UDP ||
+                (get16(ip + 6) & IP4_FRAG) != 0)
+                return false;
+            ipLen = (ip[0] & 0xf) * 4;
+            total = get16(ip + 2);
+            if(ipLen < IP4_HDR_LEN || total < ipLen || total > len)
+                return false;
+            info->type = UDP_IPv4;
+            memcpy(info->srcIp, ip + 12, IPV4_ADDR_LEN);
+            memcpy(info->dstIp, ip + 16, IPV4_ADDR_LEN);
+            break;
+        case ETH_TYPE_IP6:
+            if(len < IP6_HDR_LEN || (ip[0] >> 4) != 6 || ip[6] != IP_PROTO_UDP)
+                return false;
+            ipLen = IP6_HDR_LEN;
+            total = IP6_HDR_LEN + get16(ip + 4);
+            if(total > len)
+                return false;
+            info->type = UDP_IPv6;
+            memcpy(info->srcIp, ip + 8, IPV6_ADDR_LEN);
+            memcpy(info->dstIp, ip + 24, IPV6_ADDR_LEN);
+            break;
+        default:
+            return false;
+    }
+    /* Ignore the Ethernet padding */
+    len = total - ipLen;
+    udp = ip + ipLen;
+    if(len < UDP_HDR_LEN)
+        return false;
+    total = get16(udp + 4);
+    if(total < UDP_HDR_LEN || total > len)
+        return false;
+    info->srcPort = get16(udp);
+    info->dstPort = get16(udp + 2);
+    info->payload = udp + UDP_HDR_LEN;
+    info->len = total - UDP_HDR_LEN;
+    return true;
+}
+size_t pkt_hdrLen(prot type)
+{
+    switch(type) {
+        case UDP_IPv4:
+            return ETH_HDR_LEN + IP4_HDR_LEN + UDP_HDR_LEN;
+        case UDP_IPv6:
+            return ETH_HDR_LEN + IP6_HDR_LEN + UDP_HDR_LEN;
+        default:
+            return 0;
+    }
+}
+bool pkt_build(uint8_t *head, const struct pkt_info_t *info, size_t len)
+{
+    uint32_t s;
+    uint16_t csum;
+    uint8_t *ip, *udp;
+    size_t ipLen, addrLen, udpLen = UDP_HDR_LEN + len;
+    if(head == NULL || info == NULL)
+        return false;
+    switch(info->type) {
+        case UDP_IPv4:
+            ipLen = IP4_HDR_LEN;
+            addrLen = IPV4_ADDR_LEN;
+            break;
+        case UDP_IPv6:
+            ipLen = IP6_HDR_LEN;
+            addrLen = IPV6_ADDR_LEN;
+            break;
+        default:
+            log_err("unkown protocol %d", info->type);
+            return false;
+    }
+    if(ipLen + udpLen > UINT16_MAX) {
+        log_err("payload is too long %zu", len);
+        return false;
+    }
+    memcpy(head, info->dstMac, PKT_MAC_LEN);
+    memcpy(head + PKT_MAC_LEN, info->srcMac, PKT_MAC_LEN);
+    ip = head + ETH_HDR_LEN;
+    udp = ip + ipLen;
+    if(info->type == UDP_IPv4) {
+        set16(head + 12, ETH_TYPE_IP4);
+        ip[0] = 0x45; /* Version and header length */
+        ip[1] = 0;
+        set16(ip + 2, ipLen + udpLen);
+        set16(ip + 4, 0);
+        set16(ip + 6, IP4_DF);
+        ip[8] = IP_TTL;
+        ip[9] = IP_PROTO_UDP;
+        set16(ip + 10, 0);
+        memcpy(ip + 12, info->srcIp, IPV4_ADDR_LEN);
+        memcpy(ip + 16, info->dstIp, IPV4_ADDR_LEN);
+        set16(ip + 10, fold(sum(0, ip, IP4_HDR_LEN)));
+    } else {
+        set16(head + 12, ETH_TYPE_IP6);
+        ip[0] = 0x60; /* Version */
+        ip[1] = 0;
+        set16(ip + 2, 0);
+        set16(ip + 4, udpLen);
+        ip[6] = IP_PROTO_UDP;
+        ip[7] = IP_TTL;
+        memcpy(ip + 8, info->srcIp, IPV6_ADDR_LEN);
+        memcpy(ip + 24, info->dstIp, IPV6_ADDR_LEN);
+    }
+    set16(udp, info->srcPort);
+    set16(udp + 2, info->dstPort);
+    set16(udp + 4, udpLen);
+    set16(udp + 6, 0);
+    /* Pseudo header and the UDP datagram */
+    s = sum(0, info->srcIp, addrLen);
+    s = sum(s, info->dstIp, addrLen);
+    s += IP_PROTO_UDP + udpLen;
+    csum = fold(sum(s, udp, udpLen));
+    /* Zero means no checksum */
+    set16(udp + 6, csum == 0 ? UINT16_MAX : csum);
+    return true;
+}
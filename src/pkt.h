@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief Ethernet, IP and UDP headers of raw frames
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_PKT_H_
+#define __CSPTP_PKT_H_
+
+#include "src/common.h"
+
+/** MAC address length */
+#define PKT_MAC_LEN (6)
+
+struct pkt_info_t {
+    prot type; /**> UDP_IPv4 or UDP_IPv6 */
+    uint8_t srcMac[PKT_MAC_LEN]; /**> Source MAC address */
+    uint8_t dstMac[PKT_MAC_LEN]; /**> Destination MAC address */
+    uint8_t srcIp[IPV6_ADDR_LEN]; /**> Source IP address in network order */
+    uint8_t dstIp[IPV6_ADDR_LEN]; /**> Destination IP address in network order */
+    uint16_t srcPort; /**> Source UDP port */
+    uint16_t dstPort; /**> Destination UDP port */
+    const uint8_t *payload; /**> UDP payload in the frame */
+    size_t len; /**> UDP payload length */
+};
+
+/**
+ * Parse the headers of a received frame
+ * @param[in] frame starting with the Ethernet header
+ * @param[in] len of frame
+ * @param[out] info of the frame
+ * @return true if the frame is a UDP datagram
+ * @note VLAN tagged frames are rejected, pkt_build() does not tag
+ * @note IP fragments and IPv6 extension headers are not supported
+ */
+bool pkt_parse(const uint8_t *frame, size_t len, struct pkt_info_t *info);
+
+/**
+ * Get the headers length
+ * @param[in] type of IP
+ * @return Ethernet, IP and UDP headers length or zero for unknown type
+ */
+size_t pkt_hdrLen(prot type);
+
+/**
+ * Write the headers in front of the UDP payload
+ * @param[out] head pointer to pkt_hdrLen() octets in front of the payload
+ * @param[in] info of the frame, the payload pointer is not used
+ * @param[in] len of payload following the headers
+ * @return true on success
+ * @note calculate the IPv4 header and UDP checksums
+ */
+bool pkt_build(uint8_t *head, const struct pkt_info_t *info, size_t len);
+
+#endif /* __CSPTP_PKT_H_ */
@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief rate limit of requests per client address
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/rate.h"
+#include "src/log.h"
+#include "src/slab.h"
+
+#define NSEC_PER_SEC (1000000000)
+/* Multiplier of Fibonacci hashing, 2^64 divided by the golden ratio */
+#define HASH_MUL UINT64_C(0x9e3779b97f4a7c15)
+
+struct rate_client_t {
+    uint64_t key; /* Hash of client address, zero for empty */
+    int64_t tat; /* Theoretical arrival time of the client next request */
+};
+
+/* Generic cell rate algorithm, a token bucket with a single value */
+static inline bool conform(int64_t *tat, int64_t now, int64_t interval,
+    int64_t tolerance)
+{
+    int64_t t = *tat > now ? *tat : now;
+    if(t - now > tolerance)
+        return false;
+    *tat = t + interval;
+    return true;
+}
+
+static void _free(prate self)
+{
+    if(LIKELY_COND(self != NULL)) {
+        slab_munmap(self->_clients,
+            (self->_hashMask + 1) * sizeof(struct rate_client_t));
+        free(self);
+    }
+}
+static bool _allow(prate self, pcipaddr addr, int64_t now)
+{
+    uint32_t w;
+    uint64_t h = 0;
+    const uint8_t *ip;
+    struct rate_client_t *c;
+    if(UNLIKELY_COND(self == NULL || addr == NULL))
+        return false;
+    if(self->_clientInterval > 0) {
+        /* The protocol is resolved on allocation */
+        ip = self->_ipLen == IPV4_ADDR_LEN ? addr4_getIP(addr) :
+            addr6_getIP(addr);
+        for(size_t i = 0; i < self->_ipLen; i += sizeof(uint32_t)) {
+            memcpy(&w, ip + i, sizeof(uint32_t));
+            h = (h ^ w) * HASH_MUL;
+        }
+        h |= 1; /* Zero is an empty entry */
+        c = self->_clients + ((h >> 32) & self->_hashMask);
+        if(c->key != h) {
+            /* New client, or another client in the same entry */
+            c->key = h;
+            c->tat = now;
+        }
+        if(!conform(&c->tat, now, self->_clientInterval, self->_clientTolerance)) {
+            self->_dropped++;
+            return false;
+        }
+    }
+    if(self->_interval > 0 &&
+        !conform(&self->_tat, now, self->_interval, self->_tolerance)) {
+        self->_dropped++;
+        return false;
+    }
+    return true;
+}
+static size_t _dropped(pcrate self)
+{
+    return UNLIKELY_COND(self == NULL) ? 0 : self->_dropped;
+}
+
+int64_t rate_now()
+{
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+prate rate_alloc(prot type, size_t hashBitsSize, uint32_t clientRate,
+    uint32_t clientBurst, uint32_t rate)
+{
+    prate ret;
+    size_t hashSize, ipLen;
+    switch(type) {
+        case UDP_IPv4:
+            ipLen = IPV4_ADDR_LEN;
+            break;
+        case UDP_IPv6:
+            ipLen = IPV6_ADDR_LEN;
+            break;
+        default:
+            log_err("protocol not supported %d", type);
+            return NULL;
+    }
+    if(hashBitsSize > 32) {
+        log_warning("hash exceed 32 bits");
+        return NULL;
+    }
+    if(clientBurst == 0)
+        clientBurst = 1;
+    hashSize = (size_t)1 << hashBitsSize;
+    ret = malloc(sizeof(struct rate_t));
+    if(ret == NULL) {
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    /* Zero entries are empty */
+    ret->_clients = slab_mmap(hashSize * sizeof(struct rate_client_t), false);
+    if(ret->_clients == NULL) {
+        free(ret);
+        return NULL;
+    }
+    ret->_hashMask = hashSize - 1;
+    ret->_ipLen = ipLen;
+    ret->_clientInterval = clientRate > 0 ? NSEC_PER_SEC / clientRate : 0;
+    ret->_clientTolerance = ret->_clientInterval * (clientBurst - 1);
+    ret->_interval = rate > 0 ? NSEC_PER_SEC / rate : 0;
+    ret->_tolerance = NSEC_PER_SEC / 10;
+    ret->_tat = 0;
+    ret->_dropped = 0;
+#define asg(a) ret->a = _##a
+    asg(free);
+    asg(allow);
+    asg(dropped);
+    return ret;
+}
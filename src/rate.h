@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief rate limit of requests per client address
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_RATE_H_
+#define __CSPTP_RATE_H_
+
+#include "src/sock.h"
+
+typedef struct rate_t *prate;
+typedef const struct rate_t *pcrate;
+struct rate_client_t;
+
+struct rate_t {
+    struct rate_client_t *_clients; /**> lossy hash table of clients */
+    uint32_t _hashMask; /**> mask for the hash table */
+    size_t _ipLen; /**> IP address length */
+    int64_t _clientInterval; /**> nanoseconds between requests of a client */
+    int64_t _clientTolerance; /**> burst tolerance of a client in nanoseconds */
+    int64_t _interval; /**> nanoseconds between requests */
+    int64_t _tolerance; /**> burst tolerance in nanoseconds */
+    int64_t _tat; /**> theoretical arrival time of the next request */
+    size_t _dropped; /**> number of requests dropped */
+
+    /**
+     * Free this rate object
+     * @param[in, out] self rate object
+     */
+    void (*free)(prate self);
+
+    /**
+     * Check a request against the client and the global limits
+     * @param[in, out] self rate object
+     * @param[in] address of client
+     * @param[in] now monotonic time in nanoseconds
+     * @return true if the request is allowed
+     * @note count the dropped requests
+     */
+    bool (*allow)(prate self, pcipaddr address, int64_t now);
+
+    /**
+     * Get number of requests dropped
+     * @param[in] self rate object
+     * @return number of requests dropped
+     */
+    size_t (*dropped)(pcrate self);
+};
+
+/**
+ * Allocate a rate object
+ * @param[in] protocol of the clients addresses
+ * @param[in] hashSize number of bits of the hash table size (2 ^ hashSize)
+ * @param[in] clientRate requests per second of a client, zero for no limit
+ * @param[in] clientBurst requests a client can send at once
+ * @param[in] rate requests per second of all clients, zero for no limit
+ * @return pointer to a new rate object or null
+ * @note a token bucket per client address, kept as its theoretical
+ *       arrival time. A client that collides with another in the hash
+ *       table replaces it and starts with a full bucket.
+ * @note the global bucket allows a tenth of a second burst
+ * @note the object is not thread safe, use one per worker
+ */
+prate rate_alloc(prot protocol, size_t hashSize, uint32_t clientRate,
+    uint32_t clientBurst, uint32_t rate);
+
+/**
+ * Get monotonic time for the rate object
+ * @return monotonic time in nanoseconds
+ */
+int64_t rate_now();
+
+#endif /* __CSPTP_RATE_H_ */
@@ -0,0 +1,647 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief shared memory socket, rings between the local service and clients
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#define _GNU_SOURCE /* For F_OFD_SETLK */
+#include "src/shmsock.h"
+#include "src/log.h"
+
+#include <errno.h>
+#include <stddef.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#if defined HAVE_UNISTD_H && defined HAVE_FCNTL_H && defined HAVE_POLL_H &&\
+    defined HAVE_SYS_STAT_H && defined HAVE_SYS_MMAN_H
+#define __CSPTP_SHM
+#endif
+
+#ifdef __CSPTP_SHM
+#ifndef F_OFD_SETLK
+/* Process locks, a process can use a single client */
+#define F_OFD_SETLK F_SETLK
+#endif
+
+#define SHM_MAGIC (0x43535054) /* "CSPT" */
+#define SHM_VERSION (1)
+#define SHM_LINE (64) /* Cache line, the producer and consumer do not share */
+#define SHM_MODE (0660) /* File and doorbells, the service user and its group */
+#define NSEC_PER_SEC (1000000000)
+
+struct shm_ent_t {
+    int64_t ts; /* system clock when the producer pushed */
+    uint32_t len;
+    uint8_t data[SHMSOCK_MTU];
+};
+
+/* Single producer single consumer ring, the indexes run freely */
+struct shm_ring_t {
+    uint32_t head _ALIGNED__(SHM_LINE); /* next entry the consumer pops */
+    uint32_t tail _ALIGNED__(SHM_LINE); /* next entry the producer pushes */
+    struct shm_ent_t ents[SHMSOCK_RING] _ALIGNED__(SHM_LINE);
+};
+
+struct shm_slot_t {
+    int32_t owner _ALIGNED__(SHM_LINE); /* client process ID, zero if free */
+    uint32_t gen; /* increment when a client takes the slot */
+    uint32_t sleeping; /* the client waits on its doorbell */
+    struct shm_ring_t req; /* from the client to the service */
+    struct shm_ring_t resp; /* from the service to the client */
+};
+
+/* The shared memory file */
+struct shm_hdr_t {
+    uint32_t magic; /* set last, when the service is ready */
+    uint32_t version;
+    uint32_t slots;
+    uint32_t ring;
+    uint32_t mtu;
+    uint32_t sleeping _ALIGNED__(SHM_LINE); /* the service waits on its doorbell */
+    struct shm_slot_t slot[SHMSOCK_SLOTS] _ALIGNED__(SHM_LINE);
+};
+
+struct shmsock_t {
+    struct shm_hdr_t *hdr; /* mapped file, null before initialized */
+    char *path; /* of the file */
+    char *name; /* doorbell path */
+    size_t nameSize;
+    bool service;
+    /* Client */
+    int fd; /* of the file, hold the lock of our slot */
+    int slot;
+    int srvBell; /* service doorbell */
+    /* Service */
+    uint32_t next; /* slot we receive from */
+    uint32_t burst; /* requests we received from the slot in a row */
+    int bells[SHMSOCK_SLOTS]; /* clients doorbells, opened on first send */
+    uint32_t gens[SHMSOCK_SLOTS]; /* slot generation of the doorbell */
+};
+
+static inline int64_t utcNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+/* Doorbell of the service with negative slot, or of a client */
+static inline const char *bellName(struct shmsock_t *s, int slot)
+{
+    if(slot < 0)
+        snprintf(s->name, s->nameSize, "%s.bell", s->path);
+    else
+        snprintf(s->name, s->nameSize, "%s.%d", s->path, slot);
+    return s->name;
+}
+/* Create our doorbell, we read and keep a writer so it never hangs up */
+static inline int bellCreate(struct shmsock_t *s, int slot)
+{
+    int fd;
+    const char *name = bellName(s, slot);
+    unlink(name);
+    if(mkfifo(name, SHM_MODE) < 0) {
+        logp_err("mkfifo");
+        return -1;
+    }
+    fd = open(name, O_RDWR | O_NONBLOCK);
+    if(fd < 0)
+        logp_err("open");
+    return fd;
+}
+static inline void bellRing(int fd)
+{
+    /* A full doorbell wakes the peer already */
+    if(fd >= 0 && write(fd, "", 1) < 0 && errno != EAGAIN)
+        logp_warning("write");
+}
+/* Call after we push, return true if the consumer waits */
+static inline bool needWake(uint32_t *sleeping)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(sleeping, __ATOMIC_RELAXED) != 0 &&
+        __atomic_exchange_n(sleeping, 0, __ATOMIC_ACQ_REL) != 0;
+}
+static inline bool ringEmpty(const struct shm_ring_t *r)
+{
+    return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head;
+}
+static inline bool ringPush(struct shm_ring_t *r, pcbuffer buffer)
+{
+    struct shm_ent_t *e;
+    uint32_t tail = r->tail;
+    size_t len = buffer_getLen(buffer);
+    if(len > SHMSOCK_MTU) {
+        log_err("datagram does not fit");
+        return false;
+    }
+    if(tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) >= SHMSOCK_RING)
+        return false;
+    e = r->ents + tail % SHMSOCK_RING;
+    memcpy(e->data, buffer_getBuf(buffer), len);
+    e->len = len;
+    e->ts = utcNow();
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+static inline bool ringPop(struct shm_ring_t *r, pbuffer buffer, pts ts)
+{
+    bool ret;
+    uint32_t len;
+    struct shm_ent_t *e;
+    uint32_t head = r->head;
+    if(__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == head)
+        return false;
+    e = r->ents + head % SHMSOCK_RING;
+    /* The peer may write anything at any time, read the length once,
+     * check it and use only our copy */
+    len = __atomic_load_n(&e->len, __ATOMIC_RELAXED);
+    ret = len <= SHMSOCK_MTU && len <= buffer_getSize(buffer);
+    if(ret) {
+        memcpy(buffer_getBuf(buffer), e->data, len);
+        buffer_setLen(buffer, len);
+        ts->setTs(ts, e->ts);
+        ts->setSrc(ts, TS_SRC_USER);
+    } else
+        log_warning("datagram does not fit");
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return ret;
+}
+/* Do we have datagrams to receive */
+static inline bool ready(const struct shmsock_t *s)
+{
+    if(!s->service)
+        return !ringEmpty(&s->hdr->slot[s->slot].resp);
+    for(size_t i = 0; i < SHMSOCK_SLOTS; i++) {
+        if(!ringEmpty(&s->hdr->slot[(s->next + i) % SHMSOCK_SLOTS].req))
+            return true;
+    }
+    return false;
+}
+static inline uint32_t *sleepFlag(const struct shmsock_t *s)
+{
+    return s->service ? &s->hdr->sleeping : &s->hdr->slot[s->slot].sleeping;
+}
+/*
+ * Call when we have nothing to receive.
+ * Producers write to our doorbell once we set the sleeping flag,
+ * a pushed datagram we miss rings the doorbell from here.
+ * The fileno() poll sleeps until a producer pushes.
+ */
+static inline void arm(const struct shmsock_t *s, int bell)
+{
+    char b[64];
+    uint32_t *sleeping = sleepFlag(s);
+    /* The doorbell is empty since we set the flag */
+    if(__atomic_load_n(sleeping, __ATOMIC_RELAXED) != 0)
+        return;
+    while(read(bell, b, sizeof(b)) > 0);
+    __atomic_store_n(sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(ready(s) && needWake(sleeping))
+        bellRing(bell);
+}
+static inline struct shmsock_t *shm(pcsock self)
+{
+    return self->_backend;
+}
+static inline bool isShm(pcsock self)
+{
+    if(UNLIKELY_COND(self == NULL || shm(self)->hdr == NULL)) {
+        log_err("shared memory is not initialized");
+        return false;
+    }
+    return true;
+}
+/* Service open the client doorbell, once per a client taking the slot */
+static inline int clientBell(struct shmsock_t *s, uint32_t slot)
+{
+    uint32_t gen = __atomic_load_n(&s->hdr->slot[slot].gen, __ATOMIC_ACQUIRE);
+    if(s->gens[slot] == gen)
+        return s->bells[slot];
+    if(s->bells[slot] >= 0)
+        close(s->bells[slot]);
+    s->gens[slot] = gen;
+    s->bells[slot] = open(bellName(s, slot), O_WRONLY | O_NONBLOCK);
+    if(s->bells[slot] < 0)
+        logp_warning("open");
+    return s->bells[slot];
+}
+static inline bool pop(struct shmsock_t *s, pbuffer buffer, pipaddr address,
+    pts ts)
+{
+    uint32_t n;
+    if(!s->service)
+        return ringPop(&s->hdr->slot[s->slot].resp, buffer, ts) &&
+            address->setEndpoint(address, SHMSOCK_SERVICE_ID);
+    /* Stay on a slot up to a ring of requests, so all clients get their turn */
+    for(size_t i = 0; i < SHMSOCK_SLOTS; i++) {
+        n = (s->next + i) % SHMSOCK_SLOTS;
+        if(!ringEmpty(&s->hdr->slot[n].req)) {
+            if(i > 0 || ++s->burst >= SHMSOCK_RING) {
+                s->next = n;
+                s->burst = 0;
+            }
+            return ringPop(&s->hdr->slot[n].req, buffer, ts) &&
+                address->setEndpoint(address, SHMSOCK_CLIENT_ID(n));
+        }
+    }
+    return false;
+}
+/* Push a datagram, return the slot or negative on failure */
+static inline int push(struct shmsock_t *s, pcbuffer buffer, pcipaddr address)
+{
+    uint64_t id;
+    uint32_t n;
+    struct shm_slot_t *slot;
+    if(!s->service)
+        return ringPush(&s->hdr->slot[s->slot].req, buffer) ? s->slot : -1;
+    if(!address->getEndpoint(address, &id) || (id & UINT16_MAX) != 0 ||
+        (id >> 16) == 0 || (id >> 16) > SHMSOCK_SLOTS) {
+        log_warning("address is not a shared memory client");
+        return -1;
+    }
+    n = (id >> 16) - 1;
+    slot = s->hdr->slot + n;
+    if(__atomic_load_n(&slot->owner, __ATOMIC_ACQUIRE) == 0 ||
+        !ringPush(&slot->resp, buffer))
+        return -1;
+    return n;
+}
+/* Wake the consumer of the slot we pushed to */
+static inline void wake(struct shmsock_t *s, int slot)
+{
+    if(!s->service) {
+        if(needWake(&s->hdr->sleeping))
+            bellRing(s->srvBell);
+    } else if(needWake(&s->hdr->slot[slot].sleeping))
+        bellRing(clientBell(s, slot));
+}
+static bool sh_close(psock self)
+{
+    struct shmsock_t *s;
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    s = shm(self);
+    if(s->hdr == NULL)
+        return true;
+    if(s->service) {
+        for(size_t i = 0; i < SHMSOCK_SLOTS; i++) {
+            if(s->bells[i] >= 0)
+                close(s->bells[i]);
+            s->bells[i] = -1;
+            s->gens[i] = 0;
+        }
+        unlink(s->path);
+        unlink(bellName(s, -1));
+    } else {
+        __atomic_store_n(&s->hdr->slot[s->slot].owner, 0, __ATOMIC_RELEASE);
+        unlink(bellName(s, s->slot));
+        close(s->srvBell);
+        /* Release the lock of the slot */
+        close(s->fd);
+        s->srvBell = -1;
+        s->fd = -1;
+    }
+    munmap(s->hdr, sizeof(struct shm_hdr_t));
+    s->hdr = NULL;
+    if(self->_fd >= 0)
+        close(self->_fd);
+    self->_fd = -1;
+    return true;
+}
+static void sh_free(psock self)
+{
+    if(LIKELY_COND(self != NULL)) {
+        sh_close(self);
+        free(shm(self)->path);
+        free(shm(self)->name);
+        free(self->_backend);
+    }
+    free(self);
+}
+static int sh_fileno(pcsock self)
+{
+    return UNLIKELY_COND(self == NULL) ? -1 : self->_fd;
+}
+/* Take a free slot, the lock is released when the client exits */
+static inline bool takeSlot(struct shmsock_t *s)
+{
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_len = 1;
+    for(int i = 0; i < SHMSOCK_SLOTS; i++) {
+        fl.l_start = i;
+        if(fcntl(s->fd, F_OFD_SETLK, &fl) == 0) {
+            s->slot = i;
+            return true;
+        }
+    }
+    log_err("shared memory has no free slot");
+    return false;
+}
+static bool sh_init(psock self, prot type)
+{
+    struct stat st;
+    struct shm_slot_t *slot;
+    struct shmsock_t *s;
+    struct shm_hdr_t *h;
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    s = shm(self);
+    if(s->hdr != NULL || type != self->_type) {
+        log_err("wrong shared memory socket");
+        return false;
+    }
+    s->fd = open(s->path, O_RDWR);
+    if(s->fd < 0) {
+        logp_err("open");
+        return false;
+    }
+    if(fstat(s->fd, &st) < 0 || st.st_size != sizeof(struct shm_hdr_t)) {
+        log_err("wrong shared memory file size");
+        goto close;
+    }
+    h = mmap(NULL, sizeof(struct shm_hdr_t), PROT_READ | PROT_WRITE,
+            MAP_SHARED, s->fd, 0);
+    if(h == MAP_FAILED) {
+        logp_err("mmap");
+        goto close;
+    }
+    if(__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC ||
+        h->version != SHM_VERSION || h->slots != SHMSOCK_SLOTS ||
+        h->ring != SHMSOCK_RING || h->mtu != SHMSOCK_MTU) {
+        log_err("shared memory service is not ready or does not match");
+        goto unmap;
+    }
+    /* The service keeps its doorbell open, we fail if it does not run */
+    s->srvBell = open(bellName(s, -1), O_WRONLY | O_NONBLOCK);
+    if(s->srvBell < 0) {
+        logp_err("open");
+        goto unmap;
+    }
+    if(!takeSlot(s))
+        goto bell;
+    self->_fd = bellCreate(s, s->slot);
+    if(self->_fd < 0)
+        goto bell;
+    slot = h->slot + s->slot;
+    /* Drop the responses of a previous client, we wait on an empty doorbell */
+    slot->resp.head = __atomic_load_n(&slot->resp.tail, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&slot->sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->owner, getpid(), __ATOMIC_RELAXED);
+    /* The service opens our new doorbell */
+    __atomic_add_fetch(&slot->gen, 1, __ATOMIC_RELEASE);
+    s->hdr = h;
+    s->service = false;
+    return true;
+bell:
+    close(s->srvBell);
+    s->srvBell = -1;
+unmap:
+    munmap(h, sizeof(struct shm_hdr_t));
+close:
+    close(s->fd);
+    s->fd = -1;
+    return false;
+}
+static bool sh_initSrv(psock self, pcipaddr address)
+{
+    int fd;
+    struct shmsock_t *s;
+    struct shm_hdr_t *h;
+    if(UNLIKELY_COND(self == NULL) || address == NULL)
+        return false;
+    s = shm(self);
+    if(s->hdr != NULL || address->_type != self->_type) {
+        log_err("wrong shared memory socket");
+        return false;
+    }
+    /* Clients of a previous service keep the old file */
+    unlink(s->path);
+    fd = open(s->path, O_RDWR | O_CREAT | O_EXCL, SHM_MODE);
+    if(fd < 0) {
+        logp_err("open");
+        return false;
+    }
+    if(ftruncate(fd, sizeof(struct shm_hdr_t)) < 0) {
+        logp_err("ftruncate");
+        close(fd);
+        unlink(s->path);
+        return false;
+    }
+    h = mmap(NULL, sizeof(struct shm_hdr_t), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if(h == MAP_FAILED) {
+        logp_err("mmap");
+        unlink(s->path);
+        return false;
+    }
+    self->_fd = bellCreate(s, -1);
+    if(self->_fd < 0) {
+        munmap(h, sizeof(struct shm_hdr_t));
+        unlink(s->path);
+        return false;
+    }
+    /* The file is zero filled, we wait on an empty doorbell */
+    h->sleeping = 1;
+    h->version = SHM_VERSION;
+    h->slots = SHMSOCK_SLOTS;
+    h->ring = SHMSOCK_RING;
+    h->mtu = SHMSOCK_MTU;
+    __atomic_store_n(&h->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    s->hdr = h;
+    s->service = true;
+    s->next = 0;
+    s->burst = 0;
+    return true;
+}
+static bool sh_initSrvShard(psock self, pcipaddr address, int cpu)
+{
+    log_err("shared memory supports a single service socket");
+    return false;
+}
+static bool sh_send(pcsock self, pcbuffer buffer, pcipaddr address)
+{
+    int slot;
+    if(!isShm(self))
+        return false;
+    if(buffer == NULL || address == NULL) {
+        log_err("buffer or address is missing");
+        return false;
+    }
+    slot = push(shm(self), buffer, address);
+    if(slot < 0)
+        return false;
+    wake(shm(self), slot);
+    return true;
+}
+static bool sh_recv(pcsock self, pbuffer buffer, pipaddr address, pts ts)
+{
+    bool ret;
+    if(!isShm(self))
+        return false;
+    if(buffer == NULL || address == NULL || ts == NULL) {
+        log_err("buffer, address or timestamp is missing");
+        return false;
+    }
+    ret = pop(shm(self), buffer, address, ts);
+    if(!ready(shm(self)))
+        arm(shm(self), self->_fd);
+    return ret;
+}
+static bool sh_poll(pcsock self, int timeout)
+{
+    struct pollfd fds;
+    if(!isShm(self))
+        return false;
+    if(ready(shm(self)))
+        return true;
+    arm(shm(self), self->_fd);
+    fds.fd = self->_fd;
+    fds.events = POLLIN;
+    if(poll(&fds, 1, timeout) < 0 && errno != EINTR)
+        logp_warning("poll");
+    return ready(shm(self));
+}
+static size_t sh_sendBatch(pcsock self, pcbuffer *buffers, pcipaddr *addresses,
+    size_t num)
+{
+    size_t i;
+    int slot, last = -1;
+    if(!isShm(self))
+        return 0;
+    if(buffers == NULL || addresses == NULL) {
+        log_err("buffers or addresses are missing");
+        return 0;
+    }
+    /* Wake a consumer once per its datagrams in a row */
+    for(i = 0; i < num; i++) {
+        slot = push(shm(self), buffers[i], addresses[i]);
+        if(slot < 0)
+            break;
+        if(last >= 0 && slot != last)
+            wake(shm(self), last);
+        last = slot;
+    }
+    if(last >= 0)
+        wake(shm(self), last);
+    return i;
+}
+static size_t sh_recvBatch(pcsock self, pbuffer *buffers, pipaddr *addresses,
+    pts *ts, size_t num)
+{
+    size_t i;
+    if(!isShm(self))
+        return 0;
+    if(buffers == NULL || addresses == NULL || ts == NULL) {
+        log_err("buffers, addresses or timestamps are missing");
+        return 0;
+    }
+    for(i = 0; i < num && pop(shm(self), buffers[i], addresses[i], ts[i]); i++);
+    if(!ready(shm(self)))
+        arm(shm(self), self->_fd);
+    return i;
+}
+static bool sh_enableTxTs(pcsock self)
+{
+    return false;
+}
+static bool sh_recvTxTs(pcsock self, uint32_t *id, pts ts)
+{
+    return false;
+}
+static prot sh_getType(pcsock self)
+{
+    return UNLIKELY_COND(self == NULL) ? Invalid_PROTO : self->_type;
+}
+#endif /* __CSPTP_SHM */
+
+psock shmsock_alloc(prot type, const char *path)
+{
+    #ifdef __CSPTP_SHM
+    psock ret;
+    struct shmsock_t *s;
+    if(type != UDP_IPv4 && type != UDP_IPv6) {
+        log_err("unkown protocol %d", type);
+        return NULL;
+    }
+    if(path == NULL || *path == 0) {
+        log_err("shared memory path is missing");
+        return NULL;
+    }
+    ret = malloc(sizeof(struct sock_t));
+    s = malloc(sizeof(struct shmsock_t));
+    if(ret == NULL || s == NULL) {
+        free(ret);
+        free(s);
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    /* Room for the slot number of a doorbell */
+    s->nameSize = strlen(path) + 16;
+    s->path = strdup(path);
+    s->name = malloc(s->nameSize);
+    if(s->path == NULL || s->name == NULL) {
+        free(s->path);
+        free(s->name);
+        free(ret);
+        free(s);
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    s->hdr = NULL;
+    s->service = false;
+    s->fd = -1;
+    s->slot = 0;
+    s->srvBell = -1;
+    s->next = 0;
+    s->burst = 0;
+    for(size_t i = 0; i < SHMSOCK_SLOTS; i++) {
+        s->bells[i] = -1;
+        s->gens[i] = 0;
+    }
+    ret->_fd = -1;
+    ret->_type = type;
+    ret->_backend = s;
+#define asg(a) ret->a = sh_##a
+    asg(free);
+    asg(close);
+    asg(fileno);
+    asg(init);
+    asg(initSrv);
+    asg(initSrvShard);
+    asg(send);
+    asg(recv);
+    asg(poll);
+    asg(sendBatch);
+    asg(recvBatch);
+    asg(enableTxTs);
+    asg(recvTxTs);
+    asg(getType);
+    return ret;
+    #else /* __CSPTP_SHM */
+    log_err("shared memory is not supported");
+    return NULL;
+    #endif /* __CSPTP_SHM */
+}
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief shared memory socket, rings between the local service and clients
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_SHMSOCK_H_
+#define __CSPTP_SHMSOCK_H_
+
+#include "src/sock.h"
+
+/** Largest datagram in the rings */
+#define SHMSOCK_MTU (256)
+/** Number of clients that can use the shared memory at once */
+#define SHMSOCK_SLOTS (64)
+/** Number of datagrams in a ring, power of 2 */
+#define SHMSOCK_RING (32)
+
+/** Endpoint ID of the service */
+#define SHMSOCK_SERVICE_ID (0)
+/** Endpoint ID of a client, by its slot, in 0.0.0.0/8 */
+#define SHMSOCK_CLIENT_ID(slot) ENDPOINT_ID((slot) + 1, 0)
+
+/**
+ * Allocate a shared memory socket object
+ * @param[in] type of addresses
+ * @param[in] path of the shared memory file, like /dev/shm/csptp
+ * @return pointer to a new socket object or null
+ * @note initSrv() creates the file, init() attach a client to it
+ * @note each client takes a slot with a requests ring and a responses ring,
+ *       the service receives from the clients by their endpoint IDs
+ * @note fileno() returns a doorbell FIFO, the peer writes to it
+ *       only when we wait, a busy peer does not use system calls
+ * @note the file and the doorbells are created for the service user
+ *       and its group, clients of other users must share the group
+ * @note a single service socket uses the file,
+ *       transmit timestamps are not supported
+ */
+psock shmsock_alloc(prot type, const char *path);
+
+#endif /* __CSPTP_SHMSOCK_H_ */
@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief slab allocator of fixed size objects
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/slab.h"
+#include "src/log.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#define OBJ_ALIGN (16) /* Object alignment */
+#define ROUND(_s, _a) (((_s) + (_a) - 1) & ~((size_t)(_a) - 1))
+
+/* Objects start after the chunk link, keep the chunk alignment */
+#define CHUNK_HEAD SLAB_ALIGN
+
+void *slab_mmap(size_t size, bool hugePages)
+{
+    void *ret;
+    #ifdef HAVE_SYS_MMAN_H
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    #ifdef MAP_POPULATE
+    flags |= MAP_POPULATE; /* Pre-fault */
+    #endif
+    #ifdef MAP_HUGETLB
+    if(hugePages && (size % SLAB_HUGE) == 0) {
+        ret = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if(ret != MAP_FAILED)
+            return ret;
+        log_debug("no reserved huge pages");
+    }
+    #endif
+    ret = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if(ret == MAP_FAILED) {
+        logp_err("mmap");
+        return NULL;
+    }
+    #ifdef MADV_HUGEPAGE
+    if(hugePages && madvise(ret, size, MADV_HUGEPAGE) < 0)
+        log_debug("no transparent huge pages");
+    #endif
+    #else /* HAVE_SYS_MMAN_H */
+    ret = aligned_alloc(SLAB_ALIGN, ROUND(size, SLAB_ALIGN));
+    if(ret == NULL) {
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    memset(ret, 0, size); /* Pre-fault */
+    #endif /* HAVE_SYS_MMAN_H */
+    return ret;
+}
+void slab_munmap(void *mem, size_t size)
+{
+    if(mem == NULL)
+        return;
+    #ifdef HAVE_SYS_MMAN_H
+    munmap(mem, size);
+    #else
+    free(mem);
+    #endif
+}
+
+static inline bool addChunk(pslab self)
+{
+    uint8_t *c;
+    if(self->_maxMem > 0 && self->_memUse + self->_chunkSize > self->_maxMem) {
+        log_warning("slab exceeds memory ceiling %zu", self->_maxMem);
+        return false;
+    }
+    c = slab_mmap(self->_chunkSize, self->_hugePages);
+    if(c == NULL)
+        return false;
+    *(void **)c = self->_chunks;
+    self->_chunks = c;
+    self->_pos = c + CHUNK_HEAD;
+    self->_end = c + self->_chunkSize;
+    self->_memUse += self->_chunkSize;
+    return true;
+}
+/* Objects left to carve from the last chunk */
+static inline size_t left(pcslab self)
+{
+    return (self->_end - self->_pos) / self->_objSize;
+}
+
+static void _free(pslab self)
+{
+    if(LIKELY_COND(self != NULL)) {
+        void *c = self->_chunks;
+        while(c != NULL) {
+            void *nxt = *(void **)c;
+            slab_munmap(c, self->_chunkSize);
+            c = nxt;
+        }
+        free(self);
+    }
+}
+static void *_get(pslab self)
+{
+    void *ret;
+    if(UNLIKELY_COND(self == NULL))
+        return NULL;
+    if(self->_freeList != NULL) {
+        ret = self->_freeList;
+        self->_freeList = *(void **)ret;
+        /* Carved objects are zero */
+        memset(ret, 0, self->_objSize);
+    } else {
+        if(left(self) == 0 && !addChunk(self))
+            return NULL;
+        ret = self->_pos;
+        self->_pos += self->_objSize;
+    }
+    self->_used++;
+    return ret;
+}
+static void _put(pslab self, void *obj)
+{
+    if(UNLIKELY_COND(self == NULL || obj == NULL))
+        return;
+    *(void **)obj = self->_freeList;
+    self->_freeList = obj;
+    self->_used--;
+}
+static bool _reserve(pslab self, size_t num)
+{
+    size_t n;
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    /* Count the objects left in the last chunk and the free objects */
+    n = left(self);
+    for(void *o = self->_freeList; o != NULL && n < num; o = *(void **)o)
+        n++;
+    while(n < num) {
+        /* Keep the objects left in the last chunk on the free list */
+        while(left(self) > 0) {
+            *(void **)self->_pos = self->_freeList;
+            self->_freeList = self->_pos;
+            self->_pos += self->_objSize;
+        }
+        if(!addChunk(self))
+            return false;
+        n += left(self);
+    }
+    return true;
+}
+static size_t _memUse(pcslab self)
+{
+    return UNLIKELY_COND(self == NULL) ? 0 : self->_memUse;
+}
+static size_t _used(pcslab self)
+{
+    return UNLIKELY_COND(self == NULL) ? 0 : self->_used;
+}
+
+pslab slab_alloc(size_t objSize, size_t maxMem, bool hugePages)
+{
+    pslab ret;
+    size_t chunkSize = hugePages ? SLAB_HUGE : SLAB_CHUNK;
+    if(objSize < sizeof(void *))
+        objSize = sizeof(void *); /* Free objects hold the free list link */
+    objSize = ROUND(objSize, OBJ_ALIGN);
+    /* A chunk should hold a few objects */
+    while(chunkSize - CHUNK_HEAD < objSize * 8)
+        chunkSize *= 2;
+    if(maxMem > 0 && maxMem < chunkSize) {
+        log_err("slab memory ceiling %zu is smaller than a chunk", maxMem);
+        return NULL;
+    }
+    ret = malloc(sizeof(struct slab_t));
+    if(ret == NULL) {
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    ret->_chunks = NULL;
+    ret->_freeList = NULL;
+    ret->_pos = NULL;
+    ret->_end = NULL;
+    ret->_objSize = objSize;
+    ret->_chunkSize = chunkSize;
+    ret->_maxMem = maxMem;
+    ret->_memUse = 0;
+    ret->_used = 0;
+    ret->_hugePages = hugePages;
+#define asg(a) ret->a = _##a
+    asg(free);
+    asg(get);
+    asg(put);
+    asg(reserve);
+    asg(memUse);
+    asg(used);
+    return ret;
+}
@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief slab allocator of fixed size objects
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_SLAB_H_
+#define __CSPTP_SLAB_H_
+
+#include "src/common.h"
+
+/** Chunk alignment, cache line size */
+#define SLAB_ALIGN (64)
+/** Default chunk size */
+#define SLAB_CHUNK (64 * 1024)
+/** Chunk size with huge pages */
+#define SLAB_HUGE (2 * 1024 * 1024)
+
+typedef struct slab_t *pslab;
+typedef const struct slab_t *pcslab;
+
+struct slab_t {
+    void *_chunks; /**> list of chunks, link at the chunk start */
+    void *_freeList; /**> list of free objects */
+    uint8_t *_pos; /**> next object to carve from the last chunk */
+    uint8_t *_end; /**> end of the last chunk */
+    size_t _objSize; /**> object size, rounded to the object alignment */
+    size_t _chunkSize; /**> size of a chunk */
+    size_t _maxMem; /**> memory ceiling, zero for no ceiling */
+    size_t _memUse; /**> memory of all chunks */
+    size_t _used; /**> number of objects in use */
+    bool _hugePages; /**> try huge pages for chunks */
+
+    /**
+     * Free this slab object and all its chunks
+     * @param[in, out] self slab object
+     */
+    void (*free)(pslab self);
+
+    /**
+     * Get an object
+     * @param[in, out] self slab object
+     * @return pointer to a zero object or null
+     * @note return null when a new chunk exceeds the ceiling
+     */
+    void *(*get)(pslab self);
+
+    /**
+     * Return an object to the slab
+     * @param[in, out] self slab object
+     * @param[in] obj object to return
+     */
+    void (*put)(pslab self, void *obj);
+
+    /**
+     * Allocate chunks for objects ahead
+     * @param[in, out] self slab object
+     * @param[in] num number of objects to hold
+     * @return true if the chunks can hold the objects
+     * @note the chunks are pre-faulted
+     */
+    bool (*reserve)(pslab self, size_t num);
+
+    /**
+     * Get memory used by the chunks
+     * @param[in] self slab object
+     * @return memory size in bytes
+     */
+    size_t (*memUse)(pcslab self);
+
+    /**
+     * Get number of objects in use
+     * @param[in] self slab object
+     * @return number of objects
+     */
+    size_t (*used)(pcslab self);
+};
+
+/**
+ * Allocate a slab object
+ * @param[in] objSize size of an object
+ * @param[in] maxMem memory ceiling in bytes, zero for no ceiling
+ * @param[in] hugePages try huge pages for chunks
+ * @return pointer to a new slab object or null
+ * @note the slab is not thread safe, the caller should lock it
+ * @note chunks are aligned to cache line, objects are carved
+ *       in allocation order, and the free list is last in first out
+ */
+pslab slab_alloc(size_t objSize, size_t maxMem, bool hugePages);
+
+/**
+ * Allocate a zero memory block
+ * @param[in] size of memory block
+ * @param[in] hugePages try huge pages
+ * @return pointer to the memory block or null
+ * @note the block is aligned to SLAB_ALIGN and pre-faulted
+ * @note huge pages use reserved huge pages,
+ *       or transparent huge pages if there are not enough
+ */
+void *slab_mmap(size_t size, bool hugePages);
+
+/**
+ * Free a memory block allocated by slab_mmap()
+ * @param[in] mem memory block
+ * @param[in] size of memory block
+ */
+void slab_munmap(void *mem, size_t size);
+
+#endif /* __CSPTP_SLAB_H_ */
@@ -16,15 +16,13 @@ static inline pnode _getFreeNode(pslistmgr self, pnode nxt)
 {
     pnode ret;
     if(self->_freeList._head == NULL) {
-        size_t l = self->_dataSize + sizeof(struct node_t);
-        ret = malloc(l);
-        if(ret == NULL)
-            return NULL;
         /**
-         * Ensure a new allocated node is clean
+         * The slab ensure a new allocated node is clean
          * in case it is used with additional allocations
          */
-        memset(ret, 0, l);
+        ret = self->_slab->get(self->_slab);
+        if(ret == NULL)
+            return NULL;
     } else { /* Fetch node from free nodes list */
         self->_freeCount--;
         ret = self->_freeList._head;
@@ -43,7 +41,7 @@ static inline void _freeNode(pslistmgr self, pnode node, bool useFreeList)
         self->_freeList._head = node;
         self->_freeCount++;
     } else /* Release node memory */
-        free(node);
+        self->_slab->put(self->_slab, node);
     self->_count--;
 }
 #define CALL_FUNC(func, node) callFunc(node, cookie, self->_##func)
@@ -82,6 +80,7 @@ static void _free(pslistmgr self)
         _freeList0(self, &self->_freeList, false);
         if(LIKELY_COND(self->_mtx != NULL))
             self->_mtx->free(self->_mtx);
+        self->_slab->free(self->_slab);
         free(self);
     }
 }
@@ -252,15 +251,45 @@ static size_t _getUsedNodes(pslistmgr self)
     munlock(self);
     return ret;
 }
+static bool _reserve(pslistmgr self, size_t nodes)
+{
+    bool ret;
+    if(!mclock(self))
+        return false;
+    ret = self->_slab->reserve(self->_slab, nodes);
+    munlock(self);
+    return ret;
+}
+static size_t _getMemUse(pslistmgr self)
+{
+    size_t ret;
+    if(!mclock(self))
+        return 0;
+    ret = self->_slab->memUse(self->_slab);
+    munlock(self);
+    return ret;
+}
 pslistmgr pslistmgr_alloc(size_t dataSize, sfunc_f cmp, sfunc_f set,
     sfunc_f cleanup, sfunc_f release)
+{
+    return pslistmgr_alloc_slab(dataSize, cmp, set, cleanup, release, 0, false);
+}
+pslistmgr pslistmgr_alloc_slab(size_t dataSize, sfunc_f cmp, sfunc_f set,
+    sfunc_f cleanup, sfunc_f release, size_t maxMem, bool hugePages)
 {
     if(UNLIKELY_COND(dataSize == 0 || cmp == NULL || set == NULL))
         return NULL;
     pslistmgr ret = malloc(sizeof(struct s_link_list_mgr_t));
     if(ret != NULL) {
+        ret->_slab = slab_alloc(dataSize + sizeof(struct node_t), maxMem,
+                hugePages);
+        if(ret->_slab == NULL) {
+            free(ret);
+            return NULL;
+        }
         ret->_mtx = mutex_alloc();
         if(ret->_mtx == NULL) {
+            ret->_slab->free(ret->_slab);
             free(ret);
             return NULL;
         }
@@ -273,6 +302,8 @@ pslistmgr pslistmgr_alloc(size_t dataSize, sfunc_f cmp, sfunc_f set,
         asg(cleanUpNodes);
         asg(getFreeNodes);
         asg(getUsedNodes);
+        asg(reserve);
+        asg(getMemUse);
 #undef asg
 #define asg(a) ret->_##a = a
         /* Data size of a node */
@@ -13,6 +13,7 @@
 #define __CSPTP_SLIST_H_
 
 #include "src/mutex.h"
+#include "src/slab.h"
 
 typedef struct node_t *pnode;
 typedef struct s_link_list_t *pslist;
@@ -33,6 +34,7 @@ struct s_link_list_mgr_t {
     size_t _dataSize; /**> data size of node */
     size_t _freeCount; /**> Number of free nodes */
     pmutex _mtx; /**> mutex for all lists */
+    pslab _slab; /**> allocator of the nodes */
     struct s_link_list_t _freeList; /**> List containing free nodes */
     /**
      * Compare callback.
@@ -141,6 +143,22 @@ struct s_link_list_mgr_t {
      * @return nunber of used nodes.
      */
     size_t (*getUsedNodes)(pslistmgr self);
+
+    /**
+     * Allocate memory for nodes ahead.
+     * @param[in, out] self object
+     * @param[in] nodes number of nodes
+     * @return true if the memory can hold the nodes
+     * @note the memory is pre-faulted
+     */
+    bool (*reserve)(pslistmgr self, size_t nodes);
+
+    /**
+     * Get memory used for nodes by the manager.
+     * @param[in] self object
+     * @return memory size in bytes
+     */
+    size_t (*getMemUse)(pslistmgr self);
 };
 
 /**
@@ -152,8 +170,24 @@ struct s_link_list_mgr_t {
  * @param[in] release function free memory of any allocation done during setting
  * @return pointer to a new single link lists manager or null
  * @note If set do not allocate, release callback can be NULL
+ * @note Nodes are carved from slab chunks, without a memory ceiling
  */
 pslistmgr pslistmgr_alloc(size_t dataSize, sfunc_f cmp, sfunc_f set,
     sfunc_f cleanup, sfunc_f release);
 
+/**
+ * Allocate a new single link lists manager object with slab parameters
+ * @param[in] dataSize size of data to store in node
+ * @param[in] cmp compare function
+ * @param[in] set function that set node
+ * @param[in] cleanup function that predict nodes for cleanup
+ * @param[in] release function free memory of any allocation done during setting
+ * @param[in] maxMem memory ceiling of nodes in bytes, zero for no ceiling
+ * @param[in] hugePages try huge pages for the slab chunks
+ * @return pointer to a new single link lists manager or null
+ * @note updateNode() fails when a new node exceeds the ceiling
+ */
+pslistmgr pslistmgr_alloc_slab(size_t dataSize, sfunc_f cmp, sfunc_f set,
+    sfunc_f cleanup, sfunc_f release, size_t maxMem, bool hugePages);
+
 #endif /* __CSPTP_SLIST_H_ */
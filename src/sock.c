@@ -9,10 +9,13 @@
  *
  */
 
+#define _GNU_SOURCE /* For recvmmsg() and sendmmsg() */
 #include "src/sock.h"
 #include "src/log.h"
 #include "src/swap.h"
+#include "src/pkt.h"
 
+#include <errno.h>
 #ifdef HAVE_POLL_H
 #include <poll.h>
 #endif
@@ -27,7 +30,24 @@
 #endif
 #ifdef __linux__
 #include <linux/net_tstamp.h>
-#endif
+#include <linux/errqueue.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#if defined HAVE_NET_IF_H && defined HAVE_IFADDRS_H
+#define __CSPTP_PACKET
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#endif /* HAVE_NET_IF_H && HAVE_IFADDRS_H */
+#ifdef HAVE_IO_URING
+#define __CSPTP_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif /* HAVE_IO_URING */
+#endif /* HAVE_SYS_MMAN_H */
+#endif /* __linux__ */
 #ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -39,13 +59,49 @@ typedef int socklen_t;
 
 const uint16_t ptp_udp_port = 320;
 
-static inline bool enableTimestamp(int fd, int vclock)
+/* Maximum messages we pass to a single recvmmsg() or sendmmsg() call */
+#define SOCK_BATCH_CHUNK (64)
+
+/* Link headers of the datagram received with the address,
+ * the packet ring fills them and uses them to reply */
+struct ipaddr_link_t {
+    bool valid;
+    uint16_t port; /* peer UDP port */
+    uint8_t ip[IPV6_ADDR_LEN]; /* peer IP address */
+    uint8_t mac[PKT_MAC_LEN]; /* peer MAC address */
+    uint8_t localIp[IPV6_ADDR_LEN]; /* our IP address the peer sent to */
+    uint8_t localMac[PKT_MAC_LEN]; /* our MAC address the peer sent to */
+};
+
+struct uring_t;
+struct packet_t;
+/* UDP socket backend */
+struct udp_t {
+    struct sock_opt_t opt; /* options, with our copy of the interface name */
+    struct uring_t *uring; /* io_uring used to send and receive, or null */
+    struct packet_t *packet; /* packet ring used to send and receive, or null */
+};
+
+static inline struct udp_t *udp(pcsock self)
+{
+    return self->_backend;
+}
+static inline void startRings(psock self, bool srv);
+
+static inline bool enableTimestamp(int fd, int vclock, bool tx)
 {
     #ifdef __linux__
     struct so_timestamping timestamping;
     int flags = SOF_TIMESTAMPING_TX_HARDWARE |
         SOF_TIMESTAMPING_RX_HARDWARE |
-        SOF_TIMESTAMPING_RAW_HARDWARE;
+        SOF_TIMESTAMPING_RAW_HARDWARE |
+        SOF_TIMESTAMPING_RX_SOFTWARE |
+        SOF_TIMESTAMPING_SOFTWARE;
+    /* Transmit timestamps with messages IDs, without the messages data */
+    if(tx)
+        flags |= SOF_TIMESTAMPING_TX_SOFTWARE |
+            SOF_TIMESTAMPING_OPT_ID |
+            SOF_TIMESTAMPING_OPT_TSONLY;
     if(vclock > 0)
         flags |= SOF_TIMESTAMPING_BIND_PHC;
     memset(&timestamping, 0, sizeof(timestamping));
@@ -59,6 +115,50 @@ static inline bool enableTimestamp(int fd, int vclock)
     #endif /* __linux__ */
     return true;
 }
+#ifdef __linux__
+/* Control messages buffer for receive timestamps */
+union sock_ctrl_u {
+    uint8_t buf[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    struct cmsghdr align;
+};
+/* Control messages buffer for transmit timestamps */
+union sock_err_ctrl_u {
+    uint8_t buf[CMSG_SPACE(sizeof(struct scm_timestamping)) +
+            CMSG_SPACE(sizeof(struct sock_extended_err) +
+                sizeof(struct sockaddr_in6))];
+    struct cmsghdr align;
+};
+/* Use the kernel timestamp, prefer hardware over software */
+static inline bool useTimestamp(struct cmsghdr *cm, pts ts)
+{
+    struct scm_timestamping tss;
+    if(cm->cmsg_len < CMSG_LEN(sizeof(tss)))
+        return false;
+    memcpy(&tss, CMSG_DATA(cm), sizeof(tss));
+    /* ts[0] is software, ts[2] is raw hardware */
+    if(tss.ts[2].tv_sec != 0 || tss.ts[2].tv_nsec != 0) {
+        ts->fromTimespec(ts, tss.ts + 2);
+        ts->setSrc(ts, TS_SRC_HW);
+    } else if(tss.ts[0].tv_sec != 0 || tss.ts[0].tv_nsec != 0) {
+        ts->fromTimespec(ts, tss.ts);
+        ts->setSrc(ts, TS_SRC_SW);
+    } else
+        return false;
+    return true;
+}
+/* Use the kernel receive timestamp.
+ * Keep the user space timestamp if the kernel does not pass any */
+static inline void rxTimestamp(struct msghdr *msg, pts ts)
+{
+    struct cmsghdr *cm;
+    for(cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+        if(cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+            useTimestamp(cm, ts);
+            return;
+        }
+    }
+}
+#endif /* __linux__ */
 
 static void a_free(pipaddr self)
 {
@@ -96,6 +196,53 @@ bool a6_eq(pcipaddr self, pcipaddr other)
         memcmp(d1->sin6_addr.s6_addr, d2->sin6_addr.s6_addr,
             sizeof(struct in6_addr)) == 0;
 }
+static bool a4_getEndpoint(pcipaddr self, uint64_t *endpoint)
+{
+    if(LIKELY_COND(self != NULL) && endpoint != NULL) {
+        struct sockaddr_in *d = (struct sockaddr_in *)self->_addr;
+        *endpoint = ENDPOINT_ID(net_to_cpu32(d->sin_addr.s_addr),
+                net_to_cpu16(d->sin_port));
+        return true;
+    }
+    return false;
+}
+/* The IPv4 mapped prefix, ::ffff:0:0/96 */
+static const uint8_t mapped4[12] = { [10] = 0xff, [11] = 0xff };
+static bool a6_getEndpoint(pcipaddr self, uint64_t *endpoint)
+{
+    if(LIKELY_COND(self != NULL) && endpoint != NULL) {
+        struct sockaddr_in6 *d = (struct sockaddr_in6 *)self->_addr;
+        const uint8_t *ip = d->sin6_addr.s6_addr;
+        if(memcmp(ip, mapped4, sizeof(mapped4)) != 0)
+            return false;
+        *endpoint = ENDPOINT_ID(net_to_cpu32(*(uint32_t *)(ip + 12)),
+                net_to_cpu16(d->sin6_port));
+        return true;
+    }
+    return false;
+}
+static bool a4_setEndpoint(pipaddr self, uint64_t endpoint)
+{
+    if(LIKELY_COND(self != NULL) && endpoint <= ENDPOINT_MAX) {
+        struct sockaddr_in *d = (struct sockaddr_in *)self->_addr;
+        d->sin_addr.s_addr = cpu_to_net32(endpoint >> 16);
+        d->sin_port = cpu_to_net16(endpoint & UINT16_MAX);
+        return true;
+    }
+    return false;
+}
+static bool a6_setEndpoint(pipaddr self, uint64_t endpoint)
+{
+    if(LIKELY_COND(self != NULL) && endpoint <= ENDPOINT_MAX) {
+        struct sockaddr_in6 *d = (struct sockaddr_in6 *)self->_addr;
+        uint8_t *ip = d->sin6_addr.s6_addr;
+        memcpy(ip, mapped4, sizeof(mapped4));
+        *(uint32_t *)(ip + 12) = cpu_to_net32(endpoint >> 16);
+        d->sin6_port = cpu_to_net16(endpoint & UINT16_MAX);
+        return true;
+    }
+    return false;
+}
 size_t a4_getSize(pcipaddr self)
 {
     return sizeof(struct sockaddr_in);
@@ -349,9 +496,13 @@ pipaddr addr_alloc(prot type)
             log_err("unkown protocol %d", type);
             return NULL;
     }
-    pipaddr ret = malloc(sizeof(struct ipaddr_t) + len);
+    pipaddr ret = malloc(sizeof(struct ipaddr_t) +
+            sizeof(struct ipaddr_link_t) + len);
     if(ret != NULL) {
-        void *m = (void *)(ret + 1);
+        void *m;
+        ret->_link = (struct ipaddr_link_t *)(ret + 1);
+        ret->_link->valid = false;
+        m = (void *)(ret->_link + 1);
         memset(m, 0, len);
         ret->_addr = m;
         ret->_iPstr = NULL;
@@ -387,6 +538,8 @@ pipaddr addr_alloc(prot type)
                 asg4(getIP6);
                 asg4(getIP6Str);
                 asg4(eq);
+                asg4(getEndpoint);
+                asg4(setEndpoint);
                 ret->getIP = a4_getIP4;
                 ret->setIP = a4_setIP4;
                 ret->getIPStr = a4_getIP4Str;
@@ -417,6 +570,8 @@ pipaddr addr_alloc(prot type)
                 asg6(getIP6);
                 asg6(getIP6Str);
                 asg6(eq);
+                asg6(getEndpoint);
+                asg6(setEndpoint);
                 ret->getIP = a6_getIP6;
                 ret->setIP = a6_setIP6;
                 ret->getIPStr = a6_getIP6Str;
@@ -441,7 +596,11 @@ static bool s_close(psock self)
 }
 static void s_free(psock self)
 {
-    s_close(self);
+    if(LIKELY_COND(self != NULL)) {
+        self->close(self);
+        free((char *)udp(self)->opt.ifName);
+        free(self->_backend);
+    }
     free(self);
 }
 static int s_fileno(pcsock self)
@@ -473,15 +632,40 @@ static bool s_init(psock self, prot type)
         logp_err("socket");
         return false;
     }
-    if(!enableTimestamp(fd, 0)) {
+    if(!enableTimestamp(fd, 0, false)) {
         close(fd);
         return false;
     }
     self->_fd = fd;
     self->_type = type;
+    startRings(self, false);
     return true;
 }
-static bool s_initSrv(psock self, pcipaddr address)
+static inline bool setReusePort(int fd, int cpu)
+{
+    #ifdef SO_REUSEPORT
+    int on = 1;
+    if(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        logp_err("SO_REUSEPORT");
+        return false;
+    }
+    #else /* SO_REUSEPORT */
+    log_err("SO_REUSEPORT is not supported");
+    return false;
+    #endif /* SO_REUSEPORT */
+    if(cpu < 0)
+        return true;
+    #ifdef SO_INCOMING_CPU
+    if(setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0) {
+        logp_err("SO_INCOMING_CPU");
+        return false;
+    }
+    #else /* SO_INCOMING_CPU */
+    log_warning("SO_INCOMING_CPU is not supported");
+    #endif /* SO_INCOMING_CPU */
+    return true;
+}
+static inline bool initSrv(psock self, pcipaddr address, bool reuse, int cpu)
 {
     int fd;
     if(UNLIKELY_COND(self == NULL))
@@ -499,7 +683,7 @@ static bool s_initSrv(psock self, pcipaddr address)
         logp_err("socket");
         return false;
     }
-    if(!enableTimestamp(fd, 0)) {
+    if(!enableTimestamp(fd, 0, false) || (reuse && !setReusePort(fd, cpu))) {
         close(fd);
         return false;
     }
@@ -510,8 +694,17 @@ static bool s_initSrv(psock self, pcipaddr address)
     }
     self->_fd = fd;
     self->_type = address->_type;
+    startRings(self, true);
     return true;
 }
+static bool s_initSrv(psock self, pcipaddr address)
+{
+    return initSrv(self, address, false, -1);
+}
+static bool s_initSrvShard(psock self, pcipaddr address, int cpu)
+{
+    return initSrv(self, address, true, cpu);
+}
 static bool s_send(pcsock self, pcbuffer buffer, pcipaddr address)
 {
     size_t len;
@@ -541,17 +734,15 @@ static bool s_send(pcsock self, pcbuffer buffer, pcipaddr address)
         log_warning("send partial data %zu from %zu", ret, len);
     return false;
 }
-static bool s_poll(pcsock self, int timeout)
+static inline bool pollFd(int fd, int timeout)
 {
     int ret;
     struct pollfd fds;
-    if(UNLIKELY_COND(self == NULL) || timeout == 0)
-        return false;
     if(timeout < 0) {
         timeout = -1;
         log_debug("call infinite poll");
     }
-    fds.fd = self->_fd;
+    fds.fd = fd;
     fds.events = POLLIN; /* TODO POLLERR for HW TX timestamp */
     fds.revents = 0;
     ret = poll(&fds, 1, timeout);
@@ -561,11 +752,22 @@ static bool s_poll(pcsock self, int timeout)
     }
     return ret > 0 && (fds.revents & POLLIN) > 0;
 }
+static bool s_poll(pcsock self, int timeout)
+{
+    if(UNLIKELY_COND(self == NULL) || timeout == 0)
+        return false;
+    return pollFd(self->_fd, timeout);
+}
 static bool s_recv(pcsock self, pbuffer buffer, pipaddr address, pts ts)
 {
     ssize_t ret;
     size_t osize;
     socklen_t size;
+    #ifdef __linux__
+    struct iovec iov;
+    struct msghdr msg;
+    union sock_ctrl_u ctrl;
+    #endif /* __linux__ */
     if(UNLIKELY_COND(self == NULL))
         return false;
     if(self->_fd < 0) {
@@ -582,45 +784,1379 @@ static bool s_recv(pcsock self, pbuffer buffer, pipaddr address, pts ts)
     }
     osize = address->getSize(address);
     size = osize;
-    getUtcClock(ts); // TODO get RX ts from HW
+    #ifdef __linux__
+    iov.iov_base = buffer->getBuf(buffer);
+    iov.iov_len = buffer->getSize(buffer);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = address->getAddr(address);
+    msg.msg_namelen = size;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    /* Used if the kernel does not pass a receive timestamp */
+    getUtcClock(ts);
+    ret = recvmsg(self->_fd, &msg, MSG_DONTWAIT);
+    size = msg.msg_namelen;
+    if(ret > 0)
+        rxTimestamp(&msg, ts);
+    #else /* __linux__ */
+    getUtcClock(ts);
     ret = recvfrom(self->_fd, (void *)buffer->getBuf(buffer),
             buffer->getSize(buffer), MSG_DONTWAIT, address->getAddr(address), &size);
+    #endif /* __linux__ */
     if(ret > 0 && osize == size) {
         buffer->setLen(buffer, ret);
         return true;
     }
     if(ret < 0)
-        logp_err("recvfrom");
+        logp_err("recv");
     else if(osize != size)
         log_err("wrong address size %zu != %zu", osize, size);
     else
-        log_warning("recvfrom partial %d", ret);
+        log_warning("recv partial %d", ret);
     return false;
 }
+/* Size of socket address, resolved once per batch */
+static inline socklen_t addrSize(pcsock self)
+{
+    return self->_type == UDP_IPv4 ? sizeof(struct sockaddr_in) :
+        sizeof(struct sockaddr_in6);
+}
+static size_t s_sendBatch(pcsock self, pcbuffer *buffers, pcipaddr *addresses,
+    size_t num)
+{
+    size_t sent = 0;
+    if(UNLIKELY_COND(self == NULL))
+        return 0;
+    if(self->_fd < 0) {
+        log_warning("socket is NOT initialized");
+        return 0;
+    }
+    if(buffers == NULL || addresses == NULL) {
+        log_err("buffers or addresses are missing");
+        return 0;
+    }
+    #ifdef __linux__
+    socklen_t size = addrSize(self);
+    while(sent < num) {
+        int ret;
+        struct mmsghdr msgs[SOCK_BATCH_CHUNK];
+        struct iovec iovs[SOCK_BATCH_CHUNK];
+        size_t cnt = num - sent;
+        if(cnt > SOCK_BATCH_CHUNK)
+            cnt = SOCK_BATCH_CHUNK;
+        memset(msgs, 0, cnt * sizeof(struct mmsghdr));
+        for(size_t i = 0; i < cnt; i++) {
+            pcbuffer b = buffers[sent + i];
+            pcipaddr a = addresses[sent + i];
+            iovs[i].iov_base = buffer_getBuf(b);
+            iovs[i].iov_len = buffer_getLen(b);
+            msgs[i].msg_hdr.msg_iov = iovs + i;
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = a->_addr;
+            msgs[i].msg_hdr.msg_namelen = size;
+        }
+        ret = sendmmsg(self->_fd, msgs, cnt, 0);
+        if(ret < 0) {
+            logp_err("sendmmsg");
+            break;
+        }
+        sent += ret;
+        if(ret < cnt) {
+            log_warning("send partial batch %d from %zu", ret, cnt);
+            break;
+        }
+    }
+    #else /* __linux__ */
+    while(sent < num && s_send(self, buffers[sent], addresses[sent]))
+        sent++;
+    #endif /* __linux__ */
+    return sent;
+}
+static size_t s_recvBatch(pcsock self, pbuffer *buffers, pipaddr *addresses,
+    pts *ts, size_t num)
+{
+    size_t got = 0;
+    if(UNLIKELY_COND(self == NULL))
+        return 0;
+    if(self->_fd < 0) {
+        log_warning("socket is NOT initialized");
+        return 0;
+    }
+    if(buffers == NULL || addresses == NULL || ts == NULL) {
+        log_err("buffers, addresses or timestamps are missing");
+        return 0;
+    }
+    #ifdef __linux__
+    socklen_t size = addrSize(self);
+    while(got < num) {
+        int ret;
+        struct timespec now;
+        struct mmsghdr msgs[SOCK_BATCH_CHUNK];
+        struct iovec iovs[SOCK_BATCH_CHUNK];
+        union sock_ctrl_u ctrls[SOCK_BATCH_CHUNK];
+        size_t cnt = num - got;
+        if(cnt > SOCK_BATCH_CHUNK)
+            cnt = SOCK_BATCH_CHUNK;
+        memset(msgs, 0, cnt * sizeof(struct mmsghdr));
+        for(size_t i = 0; i < cnt; i++) {
+            pbuffer b = buffers[got + i];
+            pipaddr a = addresses[got + i];
+            iovs[i].iov_base = buffer_getBuf(b);
+            iovs[i].iov_len = buffer_getSize(b);
+            msgs[i].msg_hdr.msg_iov = iovs + i;
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = a->_addr;
+            msgs[i].msg_hdr.msg_namelen = size;
+            msgs[i].msg_hdr.msg_control = ctrls[i].buf;
+            msgs[i].msg_hdr.msg_controllen = sizeof(ctrls[i].buf);
+        }
+        /* Used if the kernel does not pass a receive timestamp */
+        getUtcClock(ts[got]);
+        ts[got]->toTimespec(ts[got], &now);
+        ret = recvmmsg(self->_fd, msgs, cnt, MSG_DONTWAIT, NULL);
+        if(ret < 0) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                logp_err("recvmmsg");
+            break;
+        }
+        for(int i = 0; i < ret; i++) {
+            size_t n = got + i;
+            pbuffer b = buffers[n];
+            if(msgs[i].msg_hdr.msg_namelen != size) {
+                log_err("wrong address size %u != %u", size,
+                    msgs[i].msg_hdr.msg_namelen);
+                /* Keep the slot, the empty message will fail parsing */
+                buffer_setLen(b, 0);
+            } else
+                buffer_setLen(b, msgs[i].msg_len);
+            if(i > 0) {
+                ts[n]->fromTimespec(ts[n], &now);
+                ts[n]->setSrc(ts[n], TS_SRC_USER);
+            }
+            rxTimestamp(&msgs[i].msg_hdr, ts[n]);
+        }
+        got += ret;
+        if(ret < cnt) /* Queue is empty */
+            break;
+    }
+    #else /* __linux__ */
+    /* Without recvmmsg() we can not tell if more messages are waiting */
+    if(num > 0 && s_recv(self, buffers[0], addresses[0], ts[0]))
+        got = 1;
+    #endif /* __linux__ */
+    return got;
+}
+static bool s_enableTxTs(pcsock self)
+{
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    if(self->_fd < 0) {
+        log_warning("socket is NOT initialized");
+        return false;
+    }
+    #ifdef __linux__
+    return enableTimestamp(self->_fd, 0, true);
+    #else /* __linux__ */
+    log_warning("transmit timestamps are not supported");
+    return false;
+    #endif /* __linux__ */
+}
+static bool s_recvTxTs(pcsock self, uint32_t *id, pts ts)
+{
+    #ifdef __linux__
+    ssize_t ret;
+    uint8_t data[8];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    union sock_err_ctrl_u ctrl;
+    struct sock_extended_err err;
+    bool haveTs = false, haveId = false;
+    #endif /* __linux__ */
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    if(self->_fd < 0) {
+        log_warning("socket is NOT initialized");
+        return false;
+    }
+    if(id == NULL || ts == NULL) {
+        log_err("ID or timestamp are missing");
+        return false;
+    }
+    #ifdef __linux__
+    iov.iov_base = data;
+    iov.iov_len = sizeof(data);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    ret = recvmsg(self->_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+    if(ret < 0) {
+        if(errno != EAGAIN && errno != EWOULDBLOCK)
+            logp_err("recvmsg");
+        return false;
+    }
+    for(cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+        switch(cm->cmsg_level) {
+            case SOL_SOCKET:
+                if(cm->cmsg_type == SCM_TIMESTAMPING)
+                    haveTs = useTimestamp(cm, ts);
+                break;
+            case SOL_IP:
+            case SOL_IPV6:
+                if((cm->cmsg_type != IP_RECVERR && cm->cmsg_type != IPV6_RECVERR) ||
+                    cm->cmsg_len < CMSG_LEN(sizeof(err)))
+                    break;
+                memcpy(&err, CMSG_DATA(cm), sizeof(err));
+                if(err.ee_errno == ENOMSG &&
+                    err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+                    *id = err.ee_data;
+                    haveId = true;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return haveTs && haveId;
+    #else /* __linux__ */
+    return false;
+    #endif /* __linux__ */
+}
 static prot s_getType(pcsock self)
 {
     return UNLIKELY_COND(self == NULL) ? 0 : self->_type;
 }
+/* Use the system calls to send and receive */
+static inline void sysMethods(psock self)
+{
+#define asg(a) self->a = s_##a
+    asg(close);
+    asg(fileno);
+    asg(send);
+    asg(recv);
+    asg(poll);
+    asg(sendBatch);
+    asg(recvBatch);
+    asg(enableTxTs);
+    asg(recvTxTs);
+#undef asg
+}
+#ifdef __CSPTP_PACKET
+#define PACKET_BLOCK_SIZE (1 << 16)
+#define PACKET_RX_BLOCKS (8)
+#define PACKET_FRAME_SIZE (2048)
+#define PACKET_FRAMES_PER_BLOCK (PACKET_BLOCK_SIZE / PACKET_FRAME_SIZE)
+#define PACKET_MIN_FRAMES (64)
+#define PACKET_MAX_FRAMES (1 << 14)
+/* Milliseconds the kernel waits before passing a partial block */
+#define PACKET_BLOCK_TOV (1)
+/* Transmit frame data offset */
+#define PACKET_TX_DATA (TPACKET_ALIGN(sizeof(struct tpacket3_hdr)))
+/* Maximum addresses of the interface we answer on */
+#define PACKET_IPS (8)
+
+struct packet_t {
+    int fd; /* packet socket */
+    uint8_t *ring; /* mapped receive and transmit rings */
+    size_t ringSize;
+    uint16_t port; /* our UDP port */
+    size_t ipLen; /* our IP address length */
+    size_t ipNum; /* number of our IP addresses */
+    uint8_t ips[PACKET_IPS][IPV6_ADDR_LEN]; /* our IP addresses */
+    unsigned rxBlock; /* current receive block */
+    unsigned rxLeft; /* frames left in current block */
+    struct tpacket3_hdr *rxFrame; /* next frame in current block */
+    uint8_t *tx; /* transmit ring */
+    unsigned txNum; /* number of transmit frames, power of 2 */
+    unsigned txCur; /* next transmit frame */
+};
+
+/* Keep the headers in the address, the reply uses them */
+static inline void learnPeer(pipaddr address, const struct pkt_info_t *info,
+    size_t ipLen)
+{
+    struct ipaddr_link_t *e = address->_link;
+    e->valid = true;
+    e->port = info->srcPort;
+    memcpy(e->ip, info->srcIp, ipLen);
+    memcpy(e->mac, info->srcMac, PKT_MAC_LEN);
+    memcpy(e->localIp, info->dstIp, ipLen);
+    memcpy(e->localMac, info->dstMac, PKT_MAC_LEN);
+}
+static inline struct tpacket_block_desc *rxBlock(struct packet_t *p)
+{
+    return (struct tpacket_block_desc *)(p->ring +
+            (size_t)p->rxBlock * PACKET_BLOCK_SIZE);
+}
+/* Pass the current block back to the kernel */
+static inline void doneBlock(struct packet_t *p)
+{
+    __atomic_store_n(&rxBlock(p)->hdr.bh1.block_status, TP_STATUS_KERNEL,
+        __ATOMIC_RELEASE);
+    p->rxBlock = (p->rxBlock + 1) % PACKET_RX_BLOCKS;
+}
+/* Next received frame, call doneFrame() after using it */
+static inline struct tpacket3_hdr *nextFrame(struct packet_t *p)
+{
+    struct tpacket3_hdr *f;
+    struct tpacket_block_desc *bd;
+    while(p->rxLeft == 0) {
+        bd = rxBlock(p);
+        if((__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+                TP_STATUS_USER) == 0)
+            return NULL;
+        p->rxLeft = bd->hdr.bh1.num_pkts;
+        p->rxFrame = (struct tpacket3_hdr *)((uint8_t *)bd +
+                bd->hdr.bh1.offset_to_first_pkt);
+        if(p->rxLeft == 0)
+            doneBlock(p);
+    }
+    f = p->rxFrame;
+    p->rxFrame = (struct tpacket3_hdr *)((uint8_t *)f + f->tp_next_offset);
+    return f;
+}
+/* Release the block after its last frame,
+ * the kernel marks the socket readable while we hold a block */
+static inline void doneFrame(struct packet_t *p)
+{
+    if(--p->rxLeft == 0)
+        doneBlock(p);
+}
+/* The reply uses the destination address as its source */
+static inline bool isLocal(const struct packet_t *p, const uint8_t *ip)
+{
+    for(size_t i = 0; i < p->ipNum; i++) {
+        if(memcmp(p->ips[i], ip, p->ipLen) == 0)
+            return true;
+    }
+    return false;
+}
+/* Copy a received frame, return false if it is not for us */
+static inline bool rxFrame(struct packet_t *p, prot type,
+    struct tpacket3_hdr *f, pbuffer buffer, pipaddr address, pts ts)
+{
+    struct timespec t;
+    struct pkt_info_t info;
+    size_t len;
+    /* We do not tag the replies, the kernel may strip the tag on receive */
+    if((f->tp_status & TP_STATUS_VLAN_VALID) > 0 ||
+        !pkt_parse((uint8_t *)f + f->tp_mac, f->tp_snaplen, &info) ||
+        info.type != type || info.dstPort != p->port ||
+        !isLocal(p, info.dstIp))
+        return false;
+    len = info.len;
+    if(len > buffer->getSize(buffer)) {
+        log_warning("recv partial %zu", len);
+        len = buffer->getSize(buffer);
+    }
+    memcpy(buffer->getBuf(buffer), info.payload, len);
+    buffer->setLen(buffer, len);
+    address->setIP(address, info.srcIp);
+    address->setPort(address, info.srcPort);
+    t.tv_sec = f->tp_sec;
+    t.tv_nsec = f->tp_nsec;
+    ts->fromTimespec(ts, &t);
+    if((f->tp_status & TP_STATUS_TS_RAW_HARDWARE) > 0)
+        ts->setSrc(ts, TS_SRC_HW);
+    else if((f->tp_status & TP_STATUS_TS_SOFTWARE) > 0)
+        ts->setSrc(ts, TS_SRC_SW);
+    else
+        ts->setSrc(ts, TS_SRC_USER);
+    learnPeer(address, &info, address->getIPSize(address));
+    return true;
+}
+/* Next transmit frame, null if the kernel did not send it yet */
+static inline struct tpacket3_hdr *txSlot(struct packet_t *p)
+{
+    struct tpacket3_hdr *f = (struct tpacket3_hdr *)(p->tx +
+            (size_t)(p->txCur & (p->txNum - 1)) * PACKET_FRAME_SIZE);
+    return __atomic_load_n(&f->tp_status, __ATOMIC_ACQUIRE) ==
+        TP_STATUS_AVAILABLE ? f : NULL;
+}
+/* Fill a transmit frame, the headers are written in the frame
+ * in front of the payload, the payload is copied once
+ */
+static inline bool txFrame(struct packet_t *p, struct tpacket3_hdr *f,
+    pcbuffer buffer, pcipaddr address)
+{
+    uint8_t *head = (uint8_t *)f + PACKET_TX_DATA;
+    struct pkt_info_t info;
+    const struct ipaddr_link_t *e = address->_link;
+    size_t ipLen = address->getIPSize(address);
+    size_t hLen = pkt_hdrLen(address->getType(address));
+    size_t len = buffer->getLen(buffer);
+    const uint8_t *ip = address->getIP(address);
+    uint16_t port = address->getPort(address);
+    if(PACKET_TX_DATA + hLen + len > PACKET_FRAME_SIZE) {
+        log_err("message is too long %zu", len);
+        return false;
+    }
+    /* The address was changed after we received with it */
+    if(!e->valid || e->port != port || memcmp(e->ip, ip, ipLen) != 0) {
+        log_err("unkown peer, can not find its MAC address");
+        return false;
+    }
+    info.type = address->getType(address);
+    memcpy(info.srcMac, e->localMac, PKT_MAC_LEN);
+    memcpy(info.dstMac, e->mac, PKT_MAC_LEN);
+    memcpy(info.srcIp, e->localIp, ipLen);
+    memcpy(info.dstIp, ip, ipLen);
+    info.srcPort = p->port;
+    info.dstPort = port;
+    memcpy(head + hLen, buffer->getBuf(buffer), len);
+    if(!pkt_build(head, &info, len))
+        return false;
+    f->tp_len = hLen + len;
+    f->tp_snaplen = hLen + len;
+    f->tp_next_offset = 0;
+    __atomic_store_n(&f->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    p->txCur++;
+    return true;
+}
+static inline void freePacket(struct packet_t *p)
+{
+    if(p->ring != NULL)
+        munmap(p->ring, p->ringSize);
+    if(p->fd >= 0)
+        close(p->fd);
+    free(p);
+}
+/* Receive only UDP datagrams to our port, like "udp dst port 320".
+ * Drop frames to other hosts, broadcast and multicast */
+static inline bool setFilter(int fd, prot type, uint16_t port)
+{
+    struct sock_fprog prog;
+    struct sock_filter ip4[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_HOST, 0, 8),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23), /* IP protocol */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20), /* Fragment offset */
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14), /* IP header length */
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16), /* UDP destination port */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, UINT32_MAX),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_filter ip6[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_HOST, 0, 5),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 20), /* IPv6 next header */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 3),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 56), /* UDP destination port */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, UINT32_MAX),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    if(type == UDP_IPv6) {
+        prog.len = sizeof(ip6) / sizeof(struct sock_filter);
+        prog.filter = ip6;
+    } else {
+        prog.len = sizeof(ip4) / sizeof(struct sock_filter);
+        prog.filter = ip4;
+    }
+    if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        logp_err("SO_ATTACH_FILTER");
+        return false;
+    }
+    return true;
+}
+/* The UDP socket only reserves the port, drop all it receives */
+static inline bool dropAll(int fd)
+{
+    struct sock_filter drop[] = { BPF_STMT(BPF_RET | BPF_K, 0) };
+    struct sock_fprog prog = { .len = 1, .filter = drop };
+    if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        logp_err("SO_ATTACH_FILTER");
+        return false;
+    }
+    return true;
+}
+static inline const uint8_t *sockIp(const struct sockaddr *addr)
+{
+    return addr->sa_family == AF_INET6 ?
+        ((const struct sockaddr_in6 *)addr)->sin6_addr.s6_addr :
+        (const uint8_t *)&((const struct sockaddr_in *)addr)->sin_addr;
+}
+/* Our IP addresses, the bound address,
+ * or the interface addresses on start if we bound to any address */
+static inline bool localIps(struct packet_t *p, const char *ifName,
+    const struct sockaddr *bound)
+{
+    static const uint8_t any[IPV6_ADDR_LEN] = { 0 };
+    struct ifaddrs *ifa, *ifaddr;
+    p->ipLen = bound->sa_family == AF_INET6 ? IPV6_ADDR_LEN : IPV4_ADDR_LEN;
+    p->ipNum = 0;
+    if(memcmp(sockIp(bound), any, p->ipLen) != 0) {
+        memcpy(p->ips[p->ipNum++], sockIp(bound), p->ipLen);
+        return true;
+    }
+    if(getifaddrs(&ifaddr) == -1) {
+        logp_err("getifaddrs");
+        return false;
+    }
+    for(ifa = ifaddr; ifa != NULL && p->ipNum < PACKET_IPS;
+        ifa = ifa->ifa_next) {
+        if(ifa->ifa_addr != NULL &&
+            ifa->ifa_addr->sa_family == bound->sa_family &&
+            strcmp(ifa->ifa_name, ifName) == 0)
+            memcpy(p->ips[p->ipNum++], sockIp(ifa->ifa_addr), p->ipLen);
+    }
+    freeifaddrs(ifaddr);
+    if(p->ipNum == 0) {
+        log_err("interface %s has no address", ifName);
+        return false;
+    }
+    return true;
+}
+static inline bool initPacket(struct packet_t *p, prot type, int ifIndex,
+    size_t entries)
+{
+    int val;
+    struct sockaddr_ll sll;
+    struct tpacket_req3 req;
+    size_t rxSize, txSize;
+    uint16_t proto = type == UDP_IPv6 ? ETH_P_IPV6 : ETH_P_IP;
+    p->txNum = PACKET_MIN_FRAMES;
+    while(p->txNum < entries && p->txNum < PACKET_MAX_FRAMES)
+        p->txNum *= 2;
+    /* Do not receive before the filter is set */
+    p->fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if(p->fd < 0) {
+        logp_err("packet socket");
+        return false;
+    }
+    val = TPACKET_V3;
+    if(setsockopt(p->fd, SOL_PACKET, PACKET_VERSION, &val, sizeof(val)) < 0) {
+        logp_err("PACKET_VERSION");
+        return false;
+    }
+    if(!setFilter(p->fd, type, p->port))
+        return false;
+    /* Prefer hardware receive timestamps */
+    val = SOF_TIMESTAMPING_RAW_HARDWARE;
+    if(setsockopt(p->fd, SOL_PACKET, PACKET_TIMESTAMP, &val, sizeof(val)) < 0)
+        logp_warning("PACKET_TIMESTAMP");
+    #ifdef PACKET_IGNORE_OUTGOING
+    val = 1;
+    if(setsockopt(p->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &val,
+            sizeof(val)) < 0)
+        logp_debug("PACKET_IGNORE_OUTGOING");
+    #endif
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = PACKET_BLOCK_SIZE;
+    req.tp_block_nr = PACKET_RX_BLOCKS;
+    req.tp_frame_size = PACKET_FRAME_SIZE;
+    req.tp_frame_nr = PACKET_RX_BLOCKS * PACKET_FRAMES_PER_BLOCK;
+    req.tp_retire_blk_tov = PACKET_BLOCK_TOV;
+    if(setsockopt(p->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        logp_err("PACKET_RX_RING");
+        return false;
+    }
+    rxSize = (size_t)req.tp_block_size * req.tp_block_nr;
+    /* The transmit ring does not use the blocks timeout */
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = PACKET_BLOCK_SIZE;
+    req.tp_frame_size = PACKET_FRAME_SIZE;
+    req.tp_frame_nr = p->txNum;
+    req.tp_block_nr = (p->txNum + PACKET_FRAMES_PER_BLOCK - 1) /
+        PACKET_FRAMES_PER_BLOCK;
+    if(setsockopt(p->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        logp_err("PACKET_TX_RING");
+        return false;
+    }
+    txSize = (size_t)req.tp_block_size * req.tp_block_nr;
+    p->ringSize = rxSize + txSize;
+    p->ring = mmap(NULL, p->ringSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+            p->fd, 0);
+    if(p->ring == MAP_FAILED) {
+        p->ring = NULL;
+        logp_err("mmap packet ring");
+        return false;
+    }
+    p->tx = p->ring + rxSize;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = cpu_to_net16(proto);
+    sll.sll_ifindex = ifIndex;
+    if(bind(p->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        logp_err("bind packet socket");
+        return false;
+    }
+    /* Workers share the interface and port, each gets its own flows */
+    val = p->port | (PACKET_FANOUT_HASH << 16);
+    if(setsockopt(p->fd, SOL_PACKET, PACKET_FANOUT, &val, sizeof(val)) < 0) {
+        logp_err("PACKET_FANOUT");
+        return false;
+    }
+    return true;
+}
+static bool p_close(psock self)
+{
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    freePacket(udp(self)->packet);
+    udp(self)->packet = NULL;
+    sysMethods(self);
+    return s_close(self);
+}
+static int p_fileno(pcsock self)
+{
+    return UNLIKELY_COND(self == NULL) ? -1 : udp(self)->packet->fd;
+}
+static size_t p_sendBatch(pcsock self, pcbuffer *buffers, pcipaddr *addresses,
+    size_t num)
+{
+    size_t sent = 0;
+    struct packet_t *p;
+    if(UNLIKELY_COND(self == NULL))
+        return 0;
+    if(buffers == NULL || addresses == NULL) {
+        log_err("buffers or addresses are missing");
+        return 0;
+    }
+    p = udp(self)->packet;
+    for(size_t i = 0; i < num; i++) {
+        struct tpacket3_hdr *f = txSlot(p);
+        if(f == NULL) {
+            log_warning("transmit ring is full");
+            break;
+        }
+        /* Skip a message we can not build, send the others */
+        if(txFrame(p, f, buffers[i], addresses[i]))
+            sent++;
+    }
+    /* A single system call sends all the frames */
+    if(sent > 0 && send(p->fd, NULL, 0, MSG_DONTWAIT) < 0 &&
+        errno != EAGAIN && errno != EWOULDBLOCK)
+        logp_err("send packet ring");
+    return sent;
+}
+static bool p_send(pcsock self, pcbuffer buffer, pcipaddr address)
+{
+    if(address == NULL) {
+        log_err("address is missing");
+        return false;
+    }
+    if(buffer == NULL) {
+        log_err("buffer is missing");
+        return false;
+    }
+    return p_sendBatch(self, &buffer, &address, 1) == 1;
+}
+static size_t p_recvBatch(pcsock self, pbuffer *buffers, pipaddr *addresses,
+    pts *ts, size_t num)
+{
+    size_t got = 0;
+    struct packet_t *p;
+    struct tpacket3_hdr *f;
+    if(UNLIKELY_COND(self == NULL))
+        return 0;
+    if(buffers == NULL || addresses == NULL || ts == NULL) {
+        log_err("buffers, addresses or timestamps are missing");
+        return 0;
+    }
+    p = udp(self)->packet;
+    while(got < num && (f = nextFrame(p)) != NULL) {
+        if(rxFrame(p, self->_type, f, buffers[got], addresses[got], ts[got]))
+            got++;
+        doneFrame(p);
+    }
+    return got;
+}
+static bool p_recv(pcsock self, pbuffer buffer, pipaddr address, pts ts)
+{
+    if(address == NULL) {
+        log_err("address is missing");
+        return false;
+    }
+    if(buffer == NULL) {
+        log_err("buffer is missing");
+        return false;
+    }
+    return p_recvBatch(self, &buffer, &address, &ts, 1) == 1;
+}
+static bool p_poll(pcsock self, int timeout)
+{
+    struct packet_t *p;
+    if(UNLIKELY_COND(self == NULL) || timeout == 0)
+        return false;
+    p = udp(self)->packet;
+    /* Frames left in the block we hold */
+    if(p->rxLeft > 0)
+        return true;
+    return pollFd(p->fd, timeout);
+}
+static bool p_enableTxTs(pcsock self)
+{
+    log_warning("transmit timestamps are not supported with packet ring");
+    return false;
+}
+static bool p_recvTxTs(pcsock self, uint32_t *id, pts ts)
+{
+    return false;
+}
+#endif /* __CSPTP_PACKET */
+/* Move the service socket to a packet ring */
+static inline bool packetStart(psock self)
+{
+    #ifdef __CSPTP_PACKET
+    int ifIndex;
+    struct packet_t *p;
+    struct sockaddr_storage addr;
+    socklen_t size = sizeof(addr);
+    const char *ifName = udp(self)->opt.ifName;
+    ifIndex = if_nametoindex(ifName);
+    if(ifIndex == 0) {
+        logp_err("interface %s", ifName);
+        return false;
+    }
+    if(getsockname(self->_fd, (struct sockaddr *)&addr, &size) < 0) {
+        logp_err("getsockname");
+        return false;
+    }
+    p = calloc(1, sizeof(struct packet_t));
+    if(p == NULL) {
+        log_err("memory allocation failed");
+        return false;
+    }
+    p->fd = -1;
+    /* IPv4 and IPv6 socket addresses place the port in the same offset */
+    p->port = net_to_cpu16(((struct sockaddr_in *)&addr)->sin_port);
+    if(!localIps(p, ifName, (struct sockaddr *)&addr) ||
+        !initPacket(p, self->_type, ifIndex, udp(self)->opt.entries) ||
+        !dropAll(self->_fd)) {
+        freePacket(p);
+        return false;
+    }
+    udp(self)->packet = p;
+#define asg(a) self->a = p_##a
+    asg(close);
+    asg(fileno);
+    asg(send);
+    asg(recv);
+    asg(poll);
+    asg(sendBatch);
+    asg(recvBatch);
+    asg(enableTxTs);
+    asg(recvTxTs);
+#undef asg
+    return true;
+    #else /* __CSPTP_PACKET */
+    log_warning("packet ring is not supported");
+    return false;
+    #endif /* __CSPTP_PACKET */
+}
+#ifdef __CSPTP_URING
+/* Provided buffers group ID */
+#define URING_BGID (0)
+/* Provided buffer size, holds the receive header, address,
+ * control messages and the message */
+#define URING_BUF_SIZE (1024)
+#define URING_MIN_ENTRIES (64)
+/* Maximum entries of a provided buffers ring */
+#define URING_MAX_ENTRIES (32768)
+/* Receive ring submissions, only to arm the multishot receive */
+#define URING_RX_ENTRIES (4)
+/* Receive completion user data */
+#define URING_RECV (1)
+/* Send completion user data, batch sequence and message index */
+#define URING_TX_DATA(seq, i) (((uint64_t)(seq) << 32) | (uint32_t)(i))
+#define URING_TX_SEQ(data) ((uint32_t)((data) >> 32))
+
+/* io_uring ring, submission and completion queues */
+struct uring_q_t {
+    int fd; /* ring file descriptor */
+    void *ring; /* mapped queues rings */
+    size_t ringSize;
+    struct io_uring_sqe *sqes; /* mapped submission entries */
+    size_t sqesSize;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqFlags;
+    unsigned *sqArray;
+    unsigned sqMask;
+    unsigned sqNum;
+    unsigned toSubmit; /* entries waiting for io_uring_enter() */
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe *cqes;
+};
+/* Transmit and receive completions use separate rings,
+ * so transmit completions never wake the receive poll */
+struct uring_t {
+    struct uring_q_t rx; /* multishot receive ring */
+    struct uring_q_t tx; /* linked send ring */
+    unsigned num; /* number of provided buffers and transmit entries */
+    struct io_uring_buf_ring *br; /* provided buffers ring */
+    size_t brSize;
+    uint16_t brTail;
+    uint8_t *bufs; /* provided buffers */
+    struct msghdr rxMsg; /* multishot receive buffers layout */
+    bool armed; /* multishot receive is active */
+    struct msghdr *txMsgs;
+    struct iovec *txIovs;
+    uint32_t txSeq; /* current send batch */
+    size_t txPending; /* sends submitted and not reaped */
+};
 
+static inline int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+static inline int uring_enter(int fd, unsigned submit, unsigned wait,
+    unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+static inline int uring_register(int fd, unsigned op, void *arg, unsigned num)
+{
+    return syscall(__NR_io_uring_register, fd, op, arg, num);
+}
+static inline bool initQueue(struct uring_q_t *q, unsigned entries,
+    unsigned cqEntries)
+{
+    size_t sqSize, cqSize;
+    struct io_uring_params p;
+    uint8_t *r;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = cqEntries;
+    q->fd = uring_setup(entries, &p);
+    if(q->fd < 0) {
+        logp_err("io_uring_setup");
+        return false;
+    }
+    if((p.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+        log_err("io_uring does not support single mmap, kernel is too old");
+        return false;
+    }
+    sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    q->ringSize = sqSize > cqSize ? sqSize : cqSize;
+    q->ring = mmap(NULL, q->ringSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, q->fd, IORING_OFF_SQ_RING);
+    if(q->ring == MAP_FAILED) {
+        q->ring = NULL;
+        logp_err("mmap io_uring");
+        return false;
+    }
+    q->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    q->sqes = mmap(NULL, q->sqesSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, q->fd, IORING_OFF_SQES);
+    if(q->sqes == MAP_FAILED) {
+        q->sqes = NULL;
+        logp_err("mmap io_uring");
+        return false;
+    }
+    r = q->ring;
+    q->sqHead = (unsigned *)(r + p.sq_off.head);
+    q->sqTail = (unsigned *)(r + p.sq_off.tail);
+    q->sqFlags = (unsigned *)(r + p.sq_off.flags);
+    q->sqArray = (unsigned *)(r + p.sq_off.array);
+    q->sqMask = *(unsigned *)(r + p.sq_off.ring_mask);
+    q->sqNum = p.sq_entries;
+    q->cqHead = (unsigned *)(r + p.cq_off.head);
+    q->cqTail = (unsigned *)(r + p.cq_off.tail);
+    q->cqMask = *(unsigned *)(r + p.cq_off.ring_mask);
+    q->cqes = (struct io_uring_cqe *)(r + p.cq_off.cqes);
+    return true;
+}
+static inline void freeQueue(struct uring_q_t *q)
+{
+    if(q->sqes != NULL)
+        munmap(q->sqes, q->sqesSize);
+    if(q->ring != NULL)
+        munmap(q->ring, q->ringSize);
+    if(q->fd >= 0)
+        close(q->fd);
+}
+/* Submit the queued entries and wait for completions */
+static inline bool enter(struct uring_q_t *q, unsigned wait)
+{
+    int ret;
+    if(q->toSubmit == 0 && wait == 0)
+        return true;
+    ret = uring_enter(q->fd, q->toSubmit, wait,
+            wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if(ret < 0) {
+        /* Interrupted, caller retry */
+        if(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            return true;
+        logp_err("io_uring_enter");
+        return false;
+    }
+    q->toSubmit -= ret;
+    return true;
+}
+static inline struct io_uring_sqe *getSqe(struct uring_q_t *q)
+{
+    struct io_uring_sqe *sqe;
+    unsigned idx, tail = *q->sqTail;
+    if(tail - __atomic_load_n(q->sqHead, __ATOMIC_ACQUIRE) >= q->sqNum) {
+        log_err("io_uring submission queue is full");
+        return NULL;
+    }
+    idx = tail & q->sqMask;
+    q->sqArray[idx] = idx;
+    sqe = q->sqes + idx;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+static inline void pushSqe(struct uring_q_t *q)
+{
+    __atomic_store_n(q->sqTail, *q->sqTail + 1, __ATOMIC_RELEASE);
+    q->toSubmit++;
+}
+static inline struct io_uring_cqe *peekCqe(struct uring_q_t *q)
+{
+    unsigned head = *q->cqHead;
+    if(head == __atomic_load_n(q->cqTail, __ATOMIC_ACQUIRE)) {
+        /* Completions the kernel could not fit in the queue */
+        if((__atomic_load_n(q->sqFlags, __ATOMIC_RELAXED) &
+                IORING_SQ_CQ_OVERFLOW) == 0 ||
+            uring_enter(q->fd, 0, 0, IORING_ENTER_GETEVENTS) < 0 ||
+            head == __atomic_load_n(q->cqTail, __ATOMIC_ACQUIRE))
+            return NULL;
+    }
+    return q->cqes + (head & q->cqMask);
+}
+static inline void popCqe(struct uring_q_t *q)
+{
+    __atomic_store_n(q->cqHead, *q->cqHead + 1, __ATOMIC_RELEASE);
+}
+/* Return a provided buffer to the kernel */
+static inline void putBuf(struct uring_t *u, uint16_t bid)
+{
+    /* Do not write the reserve field, it is the ring tail */
+    struct io_uring_buf *b = u->br->bufs + (u->brTail & (u->num - 1));
+    b->addr = (uintptr_t)(u->bufs + (size_t)bid * URING_BUF_SIZE);
+    b->len = URING_BUF_SIZE;
+    b->bid = bid;
+    u->brTail++;
+    __atomic_store_n(&u->br->tail, u->brTail, __ATOMIC_RELEASE);
+}
+static inline bool armRecv(struct uring_t *u)
+{
+    struct io_uring_sqe *sqe = getSqe(&u->rx);
+    if(sqe == NULL)
+        return false;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = 0; /* Registered socket */
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->addr = (uintptr_t)&u->rxMsg;
+    sqe->len = 1;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = URING_RECV;
+    pushSqe(&u->rx);
+    u->armed = true;
+    return enter(&u->rx, 0);
+}
+/* Copy a received message from its provided buffer */
+static inline void rxMsg(struct uring_t *u, struct io_uring_cqe *cqe,
+    pbuffer buffer, pipaddr address, pts ts)
+{
+    struct msghdr msg;
+    uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    uint8_t *b = u->bufs + (size_t)bid * URING_BUF_SIZE;
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)b;
+    uint8_t *name = b + sizeof(struct io_uring_recvmsg_out);
+    uint8_t *ctrl = name + u->rxMsg.msg_namelen;
+    uint8_t *data = ctrl + u->rxMsg.msg_controllen;
+    size_t len = cqe->res - (data - b);
+    /* Keep the slot, the empty message will fail parsing */
+    buffer->setLen(buffer, 0);
+    if(cqe->res < data - b)
+        log_err("io_uring receive is too short %d", cqe->res);
+    else if(out->namelen != address->getSize(address))
+        log_err("wrong address size %zu != %u", address->getSize(address),
+            out->namelen);
+    else {
+        if(len > buffer->getSize(buffer))
+            len = buffer->getSize(buffer);
+        memcpy(address->getAddr(address), name, out->namelen);
+        memcpy(buffer->getBuf(buffer), data, len);
+        buffer->setLen(buffer, len);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = ctrl;
+        msg.msg_controllen = out->controllen;
+        rxTimestamp(&msg, ts);
+    }
+    putBuf(u, bid);
+}
+static inline void freeUring(struct uring_t *u)
+{
+    freeQueue(&u->rx);
+    freeQueue(&u->tx);
+    if(u->br != NULL)
+        munmap(u->br, u->brSize);
+    free(u->bufs);
+    free(u->txMsgs);
+    free(u->txIovs);
+    free(u);
+}
+static inline bool initUring(struct uring_t *u, int fd)
+{
+    struct io_uring_cqe *cqe;
+    struct io_uring_buf_reg reg;
+    if(!initQueue(&u->rx, URING_RX_ENTRIES, u->num * 2) ||
+        !initQueue(&u->tx, u->num, u->num * 2))
+        return false;
+    if(uring_register(u->rx.fd, IORING_REGISTER_FILES, &fd, 1) < 0 ||
+        uring_register(u->tx.fd, IORING_REGISTER_FILES, &fd, 1) < 0) {
+        logp_err("io_uring register socket");
+        return false;
+    }
+    u->brSize = u->num * sizeof(struct io_uring_buf);
+    u->br = mmap(NULL, u->brSize, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(u->br == MAP_FAILED) {
+        u->br = NULL;
+        logp_err("mmap provided buffers ring");
+        return false;
+    }
+    u->bufs = malloc((size_t)u->num * URING_BUF_SIZE);
+    u->txMsgs = calloc(u->num, sizeof(struct msghdr));
+    u->txIovs = calloc(u->num, sizeof(struct iovec));
+    if(u->bufs == NULL || u->txMsgs == NULL || u->txIovs == NULL) {
+        log_err("memory allocation failed");
+        return false;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)u->br;
+    reg.ring_entries = u->num;
+    reg.bgid = URING_BGID;
+    if(uring_register(u->rx.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        logp_err("io_uring register provided buffers");
+        return false;
+    }
+    for(unsigned i = 0; i < u->num; i++)
+        putBuf(u, i);
+    /* Keep the control messages aligned */
+    u->rxMsg.msg_namelen = sizeof(struct sockaddr_storage);
+    u->rxMsg.msg_controllen = sizeof(union sock_ctrl_u);
+    if(!armRecv(u))
+        return false;
+    /* Kernels without multishot receive fail the request at once */
+    cqe = peekCqe(&u->rx);
+    if(cqe != NULL && cqe->res < 0) {
+        errno = -cqe->res;
+        logp_err("io_uring multishot recvmsg");
+        return false;
+    }
+    return true;
+}
+static bool u_close(psock self)
+{
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    freeUring(udp(self)->uring);
+    udp(self)->uring = NULL;
+    sysMethods(self);
+    return s_close(self);
+}
+static int u_fileno(pcsock self)
+{
+    return UNLIKELY_COND(self == NULL) ? -1 : udp(self)->uring->rx.fd;
+}
+/* Take back the entries the kernel did not get, we do not use SQPOLL */
+static inline void dropSqes(struct uring_t *u)
+{
+    struct uring_q_t *q = &u->tx;
+    __atomic_store_n(q->sqTail, *q->sqTail - q->toSubmit, __ATOMIC_RELEASE);
+    u->txPending -= q->toSubmit;
+    q->toSubmit = 0;
+}
+/* Reap a send completion, return true if it belongs to the current batch,
+ * count the successful sends of the batch if ok is not null */
+static inline bool txReap(struct uring_t *u, struct io_uring_cqe *cqe,
+    size_t *ok)
+{
+    bool cur = URING_TX_SEQ(cqe->user_data) == u->txSeq;
+    if(cqe->res >= 0) {
+        if(cur && ok != NULL)
+            (*ok)++;
+    } else if(cqe->res != -ECANCELED) {
+        errno = -cqe->res;
+        logp_err("io_uring sendmsg");
+    }
+    popCqe(&u->tx);
+    u->txPending--;
+    return cur;
+}
+/* Wait for all the sends the kernel has, they use our messages */
+static inline bool txDrain(struct uring_t *u, size_t *ok)
+{
+    struct io_uring_cqe *cqe;
+    while(u->txPending > 0) {
+        cqe = peekCqe(&u->tx);
+        if(cqe != NULL)
+            txReap(u, cqe, ok);
+        else if(uring_enter(u->tx.fd, 0, u->txPending,
+                IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            logp_err("io_uring_enter");
+            return false;
+        }
+    }
+    return true;
+}
+static size_t u_sendBatch(pcsock self, pcbuffer *buffers, pcipaddr *addresses,
+    size_t num)
+{
+    size_t sent = 0;
+    socklen_t size;
+    struct uring_t *u;
+    if(UNLIKELY_COND(self == NULL))
+        return 0;
+    if(buffers == NULL || addresses == NULL) {
+        log_err("buffers or addresses are missing");
+        return 0;
+    }
+    u = udp(self)->uring;
+    /* Sends of a failed batch, before we reuse their messages */
+    if(u->txPending > 0 && !txDrain(u, NULL))
+        return 0;
+    size = addrSize(self);
+    while(sent < num) {
+        size_t done = 0, ok = 0, cnt = num - sent;
+        struct io_uring_sqe *sqe, *last = NULL;
+        if(cnt > u->num)
+            cnt = u->num;
+        u->txSeq++;
+        for(size_t i = 0; i < cnt; i++) {
+            pcbuffer b = buffers[sent + i];
+            pcipaddr a = addresses[sent + i];
+            struct msghdr *m = u->txMsgs + i;
+            sqe = getSqe(&u->tx);
+            if(sqe == NULL) {
+                cnt = i;
+                break;
+            }
+            u->txIovs[i].iov_base = buffer_getBuf(b);
+            u->txIovs[i].iov_len = buffer_getLen(b);
+            m->msg_iov = u->txIovs + i;
+            m->msg_iovlen = 1;
+            m->msg_name = a->_addr;
+            m->msg_namelen = size;
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = 0; /* Registered socket */
+            /* Keep the messages order, a failure cancels the rest */
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+            sqe->addr = (uintptr_t)m;
+            sqe->len = 1;
+            sqe->user_data = URING_TX_DATA(u->txSeq, i);
+            pushSqe(&u->tx);
+            u->txPending++;
+            last = sqe;
+        }
+        if(last == NULL)
+            break;
+        /* The kernel reads the entries on submit, end the link */
+        last->flags &= ~IOSQE_IO_LINK;
+        /* Submit and wait in a single system call */
+        while(done < cnt) {
+            struct io_uring_cqe *cqe = peekCqe(&u->tx);
+            if(cqe != NULL) {
+                if(txReap(u, cqe, &ok))
+                    done++;
+            } else if(!enter(&u->tx, cnt - done)) {
+                dropSqes(u);
+                txDrain(u, &ok);
+                return sent + ok;
+            }
+        }
+        sent += ok;
+        if(ok < cnt) {
+            log_warning("send partial batch %zu from %zu", ok, cnt);
+            break;
+        }
+    }
+    return sent;
+}
+static bool u_send(pcsock self, pcbuffer buffer, pcipaddr address)
+{
+    if(address == NULL) {
+        log_err("address is missing");
+        return false;
+    }
+    if(buffer == NULL) {
+        log_err("buffer is missing");
+        return false;
+    }
+    return u_sendBatch(self, &buffer, &address, 1) == 1;
+}
+static size_t u_recvBatch(pcsock self, pbuffer *buffers, pipaddr *addresses,
+    pts *ts, size_t num)
+{
+    size_t got = 0;
+    struct uring_t *u;
+    struct io_uring_cqe *cqe;
+    if(UNLIKELY_COND(self == NULL))
+        return 0;
+    if(buffers == NULL || addresses == NULL || ts == NULL) {
+        log_err("buffers, addresses or timestamps are missing");
+        return 0;
+    }
+    u = udp(self)->uring;
+    while(got < num && (cqe = peekCqe(&u->rx)) != NULL) {
+        /* The kernel stops the multishot receive on errors
+         * and when it runs out of provided buffers */
+        if((cqe->flags & IORING_CQE_F_MORE) == 0)
+            u->armed = false;
+        if(cqe->res < 0) {
+            errno = -cqe->res;
+            if(errno != ENOBUFS)
+                logp_err("io_uring recvmsg");
+        } else if((cqe->flags & IORING_CQE_F_BUFFER) > 0) {
+            /* Used if the kernel does not pass a receive timestamp */
+            getUtcClock(ts[got]);
+            rxMsg(u, cqe, buffers[got], addresses[got], ts[got]);
+            got++;
+        }
+        popCqe(&u->rx);
+    }
+    if(!u->armed)
+        armRecv(u);
+    return got;
+}
+static bool u_recv(pcsock self, pbuffer buffer, pipaddr address, pts ts)
+{
+    if(address == NULL) {
+        log_err("address is missing");
+        return false;
+    }
+    if(buffer == NULL) {
+        log_err("buffer is missing");
+        return false;
+    }
+    return u_recvBatch(self, &buffer, &address, &ts, 1) == 1 &&
+        buffer->getLen(buffer) > 0;
+}
+static bool u_poll(pcsock self, int timeout)
+{
+    struct uring_t *u;
+    if(UNLIKELY_COND(self == NULL) || timeout == 0)
+        return false;
+    u = udp(self)->uring;
+    if(!u->armed && !armRecv(u))
+        return false;
+    if(peekCqe(&u->rx) != NULL)
+        return true;
+    return pollFd(u->rx.fd, timeout);
+}
+static bool u_enableTxTs(pcsock self)
+{
+    log_warning("transmit timestamps are not supported with io_uring");
+    return false;
+}
+static bool u_recvTxTs(pcsock self, uint32_t *id, pts ts)
+{
+    return false;
+}
+#endif /* __CSPTP_URING */
+/* Move the socket to io_uring */
+static inline bool uringStart(psock self)
+{
+    #ifdef __CSPTP_URING
+    struct uring_t *u;
+    unsigned num = URING_MIN_ENTRIES;
+    size_t entries = udp(self)->opt.entries;
+    while(num < entries && num < URING_MAX_ENTRIES)
+        num *= 2;
+    u = calloc(1, sizeof(struct uring_t));
+    if(u == NULL) {
+        log_err("memory allocation failed");
+        return false;
+    }
+    u->rx.fd = -1;
+    u->tx.fd = -1;
+    u->num = num;
+    if(!initUring(u, self->_fd)) {
+        freeUring(u);
+        return false;
+    }
+    udp(self)->uring = u;
+#define asg(a) self->a = u_##a
+    asg(close);
+    asg(fileno);
+    asg(send);
+    asg(recv);
+    asg(poll);
+    asg(sendBatch);
+    asg(recvBatch);
+    asg(enableTxTs);
+    asg(recvTxTs);
+#undef asg
+    return true;
+    #else /* __CSPTP_URING */
+    log_warning("io_uring is not supported");
+    return false;
+    #endif /* __CSPTP_URING */
+}
+
+/* The socket keeps using the system calls on failure */
+static inline void startRings(psock self, bool srv)
+{
+    struct udp_t *d = udp(self);
+    if(d->opt.ifName != NULL && (!srv || !packetStart(self)))
+        log_info("packet ring is not used");
+    if(d->opt.useUring) {
+        if(d->packet != NULL)
+            log_info("io_uring is not used with the packet ring");
+        else if(!uringStart(self))
+            log_info("io_uring is not used");
+    }
+}
 psock sock_alloc()
+{
+    return sock_alloc_opt(NULL);
+}
+psock sock_alloc_opt(const struct sock_opt_t *opt)
 {
     psock ret = malloc(sizeof(struct sock_t));
-    if(ret != NULL) {
-        ret->_fd = -1;
-        ret->_type = Invalid_PROTO;
+    struct udp_t *d = calloc(1, sizeof(struct udp_t));
+    if(ret == NULL || d == NULL)
+        goto fail;
+    if(opt != NULL) {
+        d->opt = *opt;
+        if(opt->ifName != NULL) {
+            d->opt.ifName = strdup(opt->ifName);
+            if(d->opt.ifName == NULL)
+                goto fail;
+        }
+    }
+    ret->_fd = -1;
+    ret->_type = Invalid_PROTO;
+    ret->_backend = d;
 #define asg(a) ret->a = s_##a
-        asg(free);
-        asg(close);
-        asg(fileno);
-        asg(init);
-        asg(initSrv);
-        asg(send);
-        asg(recv);
-        asg(poll);
-        asg(getType);
-    } else
-        log_err("memory allocation failed");
+    asg(free);
+    asg(close);
+    asg(fileno);
+    asg(init);
+    asg(initSrv);
+    asg(initSrvShard);
+    asg(send);
+    asg(recv);
+    asg(poll);
+    asg(sendBatch);
+    asg(recvBatch);
+    asg(enableTxTs);
+    asg(recvTxTs);
+    asg(getType);
+#undef asg
     return ret;
+fail:
+    free(ret);
+    free(d);
+    log_err("memory allocation failed");
+    return NULL;
 }
 static inline bool try_inet_pton(const char *ip, prot *_type, uint8_t *addr)
 {
@@ -14,8 +14,12 @@
 
 #include "src/buf.h"
 #include "src/time.h"
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
 
 struct sockaddr;
+struct ipaddr_link_t;
 
 typedef struct ipaddr_t *pipaddr;
 typedef const struct ipaddr_t *pcipaddr;
@@ -24,6 +28,7 @@ typedef const struct sock_t *pcsock;
 
 struct ipaddr_t {
     void *_addr; /**> pointer to BSD socket address object */
+    struct ipaddr_link_t *_link; /**> link headers of the last receive */
     char *_iPstr; /**> store last IP address string */
     int _domain; /**> BSD socet domain */
     prot _type; /**> socket type */
@@ -202,11 +207,36 @@ struct ipaddr_t {
      * @return true if success
      */
     bool (*setIPStr)(pipaddr self, const char *ip);
+
+    /**
+     * Get transport neutral endpoint ID
+     * @param[in] self address object
+     * @param[out] endpoint ID, the IPv4 address in host order and the port
+     * @return true if the address has an endpoint ID
+     * @note IPv6 addresses have an ID if they are IPv4 mapped (::ffff:0:0/96)
+     * @note transports without IP addresses map their peers to IDs
+     */
+    bool (*getEndpoint)(pcipaddr self, uint64_t *endpoint);
+
+    /**
+     * Set transport neutral endpoint ID
+     * @param[in, out] self address object
+     * @param[in] endpoint ID, the IPv4 address in host order and the port
+     * @return true if success
+     * @note IPv6 addresses use the IPv4 mapped address
+     */
+    bool (*setEndpoint)(pipaddr self, uint64_t endpoint);
 };
 
+/** Endpoint ID of IPv4 address in host order and port */
+#define ENDPOINT_ID(ip, port) (((uint64_t)(ip) << 16) | (uint16_t)(port))
+/** Largest endpoint ID */
+#define ENDPOINT_MAX ENDPOINT_ID(UINT32_MAX, UINT16_MAX)
+
 struct sock_t {
     int _fd;
     prot _type;
+    void *_backend; /**> private state, owned by the transport backend */
     /**
      * Free this socket object
      * @param[in, out] self socket object
@@ -243,6 +273,17 @@ struct sock_t {
      */
     bool (*initSrv)(psock self, pcipaddr address);
 
+    /**
+     * Allocate a service socket that shares its address with other sockets
+     * @param[in, out] self socket object
+     * @param[in] address socket object
+     * @param[in] cpu to match with the NIC receive queue, or negative
+     * @return true if socket creation success
+     * @note use SO_REUSEPORT, the kernel spreads clients between the sockets
+     * @note non negative cpu sets SO_INCOMING_CPU
+     */
+    bool (*initSrvShard)(psock self, pcipaddr address, int cpu);
+
     /**
      * Send message
      * @param[in] self socket object
@@ -270,6 +311,50 @@ struct sock_t {
      */
     bool (*poll)(pcsock self, int timeout);
 
+    /**
+     * Send multiple messages
+     * @param[in] self socket object
+     * @param[in] buffers array of buffers to send
+     * @param[in] addresses array of peers addresses, one per buffer
+     * @param[in] num number of messages to send
+     * @return number of messages sent
+     * @note on Linux use sendmmsg(), send the messages one by one otherwise
+     */
+    size_t (*sendBatch)(pcsock self, pcbuffer *buffers, pcipaddr *addresses,
+        size_t num);
+
+    /**
+     * Receive multiple messages, without blocking
+     * @param[in] self socket object
+     * @param[in] buffers array of buffers to receive
+     * @param[in, out] addresses array of peers addresses, one per buffer
+     * @param[out] ts array of receive timestamps, one per buffer
+     * @param[in] num maximum number of messages to receive
+     * @return number of messages received
+     * @note on Linux use recvmmsg(), receive the messages one by one otherwise
+     */
+    size_t (*recvBatch)(pcsock self, pbuffer *buffers, pipaddr *addresses,
+        pts *ts, size_t num);
+
+    /**
+     * Enable transmit timestamps
+     * @param[in] self socket object
+     * @return true on success
+     * @note Each message sent after gets an ID, counting from zero
+     * @note Linux only, fetch the timestamps with recvTxTs()
+     */
+    bool (*enableTxTs)(pcsock self);
+
+    /**
+     * Receive a transmit timestamp, without blocking
+     * @param[in] self socket object
+     * @param[out] id of the message sent
+     * @param[out] ts transmit timestamp
+     * @return true if a timestamp is received
+     * @note prefer hardware timestamp over software
+     */
+    bool (*recvTxTs)(pcsock self, uint32_t *id, pts ts);
+
     /**
      * Get IP protocol
      * @param[in] self address object
@@ -278,6 +363,80 @@ struct sock_t {
     prot(*getType)(pcsock self);
 };
 
+#ifdef HAVE_NETINET_IN_H
+/* Fast path functions of IPv4 and IPv6 addresses, without the object checks.
+ * The caller resolves the protocol once, before the packets loop. */
+
+/**
+ * Get IPv4 address in network order
+ * @param[in] self IPv4 address object
+ * @return ip address
+ */
+static inline const uint8_t *addr4_getIP(pcipaddr self)
+{
+    return (const uint8_t *)&((const struct sockaddr_in *)self->_addr)->sin_addr;
+}
+
+/**
+ * Get IPv6 address
+ * @param[in] self IPv6 address object
+ * @return ip address
+ */
+static inline const uint8_t *addr6_getIP(pcipaddr self)
+{
+    return ((const struct sockaddr_in6 *)self->_addr)->sin6_addr.s6_addr;
+}
+
+/**
+ * Get IPv4 port number
+ * @param[in] self IPv4 address object
+ * @return port number
+ */
+static inline uint16_t addr4_getPort(pcipaddr self)
+{
+    return ntohs(((const struct sockaddr_in *)self->_addr)->sin_port);
+}
+
+/**
+ * Get IPv6 port number
+ * @param[in] self IPv6 address object
+ * @return port number
+ */
+static inline uint16_t addr6_getPort(pcipaddr self)
+{
+    return ntohs(((const struct sockaddr_in6 *)self->_addr)->sin6_port);
+}
+
+/**
+ * Compare IPv4 addresses
+ * @param[in] self IPv4 address object
+ * @param[in] other IPv4 address object
+ * @return true if equal addreses
+ */
+static inline bool addr4_eq(pcipaddr self, pcipaddr other)
+{
+    const struct sockaddr_in *d1 = (const struct sockaddr_in *)self->_addr;
+    const struct sockaddr_in *d2 = (const struct sockaddr_in *)other->_addr;
+    return d1->sin_port == d2->sin_port &&
+        d1->sin_addr.s_addr == d2->sin_addr.s_addr;
+}
+
+/**
+ * Compare IPv6 addresses
+ * @param[in] self IPv6 address object
+ * @param[in] other IPv6 address object
+ * @return true if equal addreses
+ */
+static inline bool addr6_eq(pcipaddr self, pcipaddr other)
+{
+    const struct sockaddr_in6 *d1 = (const struct sockaddr_in6 *)self->_addr;
+    const struct sockaddr_in6 *d2 = (const struct sockaddr_in6 *)other->_addr;
+    return d1->sin6_port == d2->sin6_port &&
+        memcmp(d1->sin6_addr.s6_addr, d2->sin6_addr.s6_addr,
+            sizeof(struct in6_addr)) == 0;
+}
+#endif /* HAVE_NETINET_IN_H */
+
 /**
  * Allocate a new address object
  * @param[in] type soket type
@@ -292,6 +451,41 @@ pipaddr addr_alloc(prot type);
  */
 psock sock_alloc();
 
+/** Options of the UDP socket */
+struct sock_opt_t {
+    size_t entries; /**> number of messages the rings hold */
+    /**
+     * Send and receive using io_uring
+     * @note fileno() returns the ring file descriptor, poll it for receive
+     * @note transmit timestamps are not supported
+     * @note Linux only, kernel 6.0 or newer
+     */
+    bool useUring;
+    /**
+     * Send and receive using a packet mmap ring on this interface, or null
+     * @note service sockets only, the UDP socket only reserves the port
+     * @note fileno() returns the packet socket, poll it for receive
+     * @note send to the addresses objects we received with, they keep
+     *       the link headers
+     * @note sendBatch() skips messages it can not build,
+     *       it stops only when the transmit ring is full
+     * @note transmit timestamps are not supported
+     * @note Linux only, require CAP_NET_RAW
+     */
+    const char *ifName;
+};
+
+/**
+ * Allocate a new socket object with options
+ * @param[in] opt options of the socket, or null
+ * @return pointer to a new socket new object or null
+ * @note init(), initSrv() and initSrvShard() start the rings
+ *       after they create the socket, the packet ring is preferred
+ * @note on a ring failure the socket keeps using the system calls,
+ *       fileno() returns the UDP socket
+ */
+psock sock_alloc_opt(const struct sock_opt_t *opt);
+
 /**
  * Convert Address or host name string tp binary
  * @param[in] string containing the address or host name
@@ -0,0 +1,486 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief service statistics counters and export
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/stats.h"
+#include "src/log.h"
+#include "src/loop.h"
+#include "src/thread.h"
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#define STATS_BUF_SIZE (8192) /* Export text buffer size */
+#define STATS_REQ_SIZE (256) /* Bytes we read of an export request */
+#define STATS_REQ_MS (100) /* Wait in milliseconds for an export request */
+#define NSEC_PER_SEC (1000000000)
+
+/* Counters of the same Prometheus metric follow each other */
+static const struct stats_name_t {
+    const char *name; /* Plain text name */
+    const char *metric; /* Prometheus metric */
+    const char *label; /* Prometheus label of the metric, may be null */
+    const char *help; /* Prometheus metric help */
+} names[STATS_NUM] = {
+#define NAME(_i, _n, _m, _l, _h) [STATS_##_i] = {_n, "csptp_" _m, _l, _h}
+    NAME(RX, "requests", "requests_total", NULL, "Received messages"),
+    NAME(RX_BYTES, "received_bytes", "received_bytes_total", NULL,
+        "Received bytes"),
+    NAME(RX_FOLLOW_UP, "follow_ups", "follow_ups_total", NULL,
+        "Received Follow_Up messages"),
+    NAME(REQ_STATUS, "tlv_status", "tlv_requests_total", "tlv=\"status\"",
+        "Requests of optional TLVs"),
+    NAME(REQ_ALT_TIME, "tlv_alternate_time", "tlv_requests_total",
+        "tlv=\"alternate_time\"", NULL),
+    NAME(TX_SYNC, "responses", "responses_total", "type=\"sync\"",
+        "Sent responses"),
+    NAME(TX_FOLLOW_UP, "responses_follow_up", "responses_total",
+        "type=\"follow_up\"", NULL),
+    NAME(TX_BYTES, "sent_bytes", "sent_bytes_total", NULL, "Sent bytes"),
+    NAME(DROP_RATE, "drops_rate", "drops_total", "reason=\"rate\"",
+        "Dropped messages"),
+    NAME(DROP_ARGS, "drops_args", "drops_total", "reason=\"args\"", NULL),
+    NAME(DROP_SHORT, "drops_short", "drops_total", "reason=\"short\"", NULL),
+    NAME(DROP_LENGTH, "drops_length", "drops_total", "reason=\"length\"", NULL),
+    NAME(DROP_TYPE, "drops_type", "drops_total", "reason=\"type\"", NULL),
+    NAME(DROP_VERSION, "drops_version", "drops_total", "reason=\"version\"",
+        NULL),
+    NAME(DROP_HEADER, "drops_header", "drops_total", "reason=\"header\"", NULL),
+    NAME(DROP_FLAGS, "drops_flags", "drops_total", "reason=\"flags\"", NULL),
+    NAME(DROP_MESSAGE, "drops_message", "drops_total", "reason=\"message\"",
+        NULL),
+    NAME(DROP_NO_REQUEST, "drops_no_request", "drops_total",
+        "reason=\"no_request\"", NULL),
+    NAME(DROP_ORPHAN, "drops_orphan", "drops_total", "reason=\"orphan\"", NULL),
+    NAME(ERR_RECV, "errors_recv", "errors_total", "op=\"recv\"", "Errors"),
+    NAME(ERR_BUILD, "errors_build", "errors_total", "op=\"build\"", NULL),
+    NAME(ERR_SEND, "errors_send", "errors_total", "op=\"send\"", NULL),
+    NAME(STORE_EVICT, "store_evictions", "store_evictions_total", NULL,
+        "Two steps Sync records replaced before their Follow_Up"),
+#undef NAME
+};
+static const struct stats_lat_name_t {
+    const char *name; /* Plain text name */
+    const char *metric; /* Prometheus metric */
+    const char *help; /* Prometheus metric help */
+} latNames[STATS_LAT_NUM] = {
+    [STATS_LAT_TURNAROUND] = {"turnaround", "csptp_turnaround_seconds",
+        "Time from the request receive timestamp to the response transmit time"
+    },
+    [STATS_LAT_QUEUE] = {"queue", "csptp_queue_seconds",
+        "Time from the kernel receive timestamp to the service receive"
+    },
+};
+/* Percentiles we export */
+static const struct stats_pct_t {
+    double pct;
+    const char *name; /* Plain text name */
+    const char *quantile; /* Prometheus quantile */
+} pcts[] = {
+    {50, "p50", "0.5"},
+    {99, "p99", "0.99"},
+    {99.9, "p99.9", "0.999"},
+};
+
+static void _free(pstats self)
+{
+    if(LIKELY_COND(self != NULL)) {
+        for(size_t i = 0; i < STATS_LAT_NUM; i++) {
+            if(self->_lat[i] != NULL)
+                self->_lat[i]->free(self->_lat[i]);
+        }
+        free(self);
+    }
+}
+static uint64_t _get(pcstats self, enum stats_id_e id)
+{
+    return UNLIKELY_COND(self == NULL || id >= STATS_NUM) ? 0 :
+        __atomic_load_n(self->_cnt + id, __ATOMIC_RELAXED);
+}
+static pchist _getLat(pcstats self, enum stats_lat_e id)
+{
+    return UNLIKELY_COND(self == NULL || id >= STATS_LAT_NUM) ? NULL :
+        self->_lat[id];
+}
+
+pstats stats_alloc(bool latency)
+{
+    /* aligned_alloc() needs a size of the alignment multiple */
+    size_t size = (sizeof(struct stats_t) + SLAB_ALIGN - 1) &
+        ~((size_t)SLAB_ALIGN - 1);
+    pstats ret = aligned_alloc(SLAB_ALIGN, size);
+    if(ret == NULL) {
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    memset(ret->_cnt, 0, sizeof(ret->_cnt));
+    for(size_t i = 0; i < STATS_LAT_NUM; i++)
+        ret->_lat[i] = NULL;
+#define asg(a) ret->a = _##a
+    asg(free);
+    asg(get);
+    asg(getLat);
+    for(size_t i = 0; latency && i < STATS_LAT_NUM; i++) {
+        ret->_lat[i] = hist_alloc();
+        if(ret->_lat[i] == NULL) {
+            _free(ret);
+            return NULL;
+        }
+    }
+    return ret;
+}
+void stats_sum(const pcstats *stats, size_t num, uint64_t *values)
+{
+    if(values == NULL)
+        return;
+    memset(values, 0, STATS_NUM * sizeof(uint64_t));
+    if(stats == NULL)
+        return;
+    for(size_t i = 0; i < num; i++) {
+        if(stats[i] == NULL)
+            continue;
+        for(size_t j = 0; j < STATS_NUM; j++)
+            values[j] += __atomic_load_n(stats[i]->_cnt + j, __ATOMIC_RELAXED);
+    }
+}
+size_t stats_print(const uint64_t *values, char *buf, size_t size,
+    bool prometheus)
+{
+    int l;
+    size_t len = 0;
+    if(values == NULL || buf == NULL)
+        return 0;
+    for(size_t i = 0; i < STATS_NUM; i++) {
+        const struct stats_name_t *n = names + i;
+        unsigned long long v = values[i];
+        if(!prometheus)
+            l = snprintf(buf + len, size - len, "%s %llu\n", n->name, v);
+        else if(n->label == NULL)
+            l = snprintf(buf + len, size - len,
+                    "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                    n->metric, n->help, n->metric, n->metric, v);
+        else if(n->help != NULL)
+            l = snprintf(buf + len, size - len,
+                    "# HELP %s %s\n# TYPE %s counter\n%s{%s} %llu\n",
+                    n->metric, n->help, n->metric, n->metric, n->label, v);
+        else
+            l = snprintf(buf + len, size - len, "%s{%s} %llu\n", n->metric,
+                    n->label, v);
+        if(l < 0 || (size_t)l >= size - len)
+            return 0;
+        len += l;
+    }
+    return len;
+}
+
+/* Print nanoseconds as seconds */
+#define SEC_FMT "%llu.%09llu"
+#define SEC_VAL(_v) (unsigned long long)((_v) / NSEC_PER_SEC),\
+    (unsigned long long)((_v) % NSEC_PER_SEC)
+/* Print percentiles of a histogram,
+ * name is the Prometheus metric or the plain text prefix */
+static inline int printLat(const char *name, pchist h, char *buf, size_t size,
+    bool prometheus)
+{
+    int l, len = 0;
+    uint64_t v;
+    for(size_t i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++) {
+        v = h->value(h, pcts[i].pct);
+        if(prometheus)
+            l = snprintf(buf + len, size - len, "%s{quantile=\"%s\"} " SEC_FMT "\n",
+                    name, pcts[i].quantile, SEC_VAL(v));
+        else
+            l = snprintf(buf + len, size - len, "%s_%s %llu\n", name,
+                    pcts[i].name, (unsigned long long)v);
+        if(l < 0 || (size_t)l >= size - len)
+            return -1;
+        len += l;
+    }
+    v = h->max(h);
+    if(prometheus)
+        l = snprintf(buf + len, size - len, "%s{quantile=\"1\"} " SEC_FMT "\n",
+                name, SEC_VAL(v));
+    else
+        l = snprintf(buf + len, size - len, "%s_max %llu\n%s_count %llu\n",
+                name, (unsigned long long)v, name,
+                (unsigned long long)h->count(h));
+    if(l < 0 || (size_t)l >= size - len)
+        return -1;
+    return len + l;
+}
+size_t stats_printLat(const pchist *total, const pchist *window, char *buf,
+    size_t size, bool prometheus)
+{
+    int l;
+    size_t len = 0;
+    char name[64];
+    if(total == NULL || window == NULL || buf == NULL)
+        return 0;
+    for(size_t i = 0; i < STATS_LAT_NUM; i++) {
+        const struct stats_lat_name_t *n = latNames + i;
+        pchist t = total[i], w = window[i];
+        if(t == NULL || w == NULL)
+            return 0;
+        if(prometheus) {
+            uint64_t v = t->sum(t);
+            l = snprintf(buf + len, size - len,
+                    "# HELP %s %s\n# TYPE %s summary\n", n->metric, n->help,
+                    n->metric);
+            if(l < 0 || (size_t)l >= size - len)
+                return 0;
+            len += l;
+            l = printLat(n->metric, t, buf + len, size - len, true);
+            if(l < 0)
+                return 0;
+            len += l;
+            l = snprintf(buf + len, size - len,
+                    "%s_sum " SEC_FMT "\n%s_count %llu\n"
+                    "# HELP %s_window %s, in the last window\n"
+                    "# TYPE %s_window gauge\n",
+                    n->metric, SEC_VAL(v), n->metric,
+                    (unsigned long long)t->count(t), n->metric, n->help,
+                    n->metric);
+            if(l < 0 || (size_t)l >= size - len)
+                return 0;
+            len += l;
+            snprintf(name, sizeof(name), "%s_window", n->metric);
+        } else {
+            l = printLat(n->name, t, buf + len, size - len, false);
+            if(l < 0)
+                return 0;
+            len += l;
+            snprintf(name, sizeof(name), "window_%s", n->name);
+        }
+        l = printLat(name, w, buf + len, size - len, prometheus);
+        if(l < 0)
+            return 0;
+        len += l;
+    }
+    return len;
+}
+
+#if defined HAVE_SYS_SOCKET_H && defined HAVE_SYS_UN_H
+/* Sum the latency of the workers */
+static inline void sumLat(pstatssrv self)
+{
+    for(size_t i = 0; i < STATS_LAT_NUM; i++) {
+        phist t = self->_total[i];
+        t->clear(t);
+        for(size_t j = 0; j < self->_num; j++)
+            t->add(t, self->_stats[j]->getLat(self->_stats[j], i));
+    }
+}
+/* Close the latency window, the window is the difference of the totals */
+static inline void rotate(pstatssrv self)
+{
+    sumLat(self);
+    for(size_t i = 0; i < STATS_LAT_NUM; i++) {
+        phist w = self->_window[i], l = self->_last[i];
+        w->clear(w);
+        w->add(w, self->_total[i]);
+        w->sub(w, l);
+        l->clear(l);
+        l->add(l, self->_total[i]);
+    }
+}
+/* Answer a single connection, the request selects the format */
+static inline void answer(pstatssrv self, int fd)
+{
+    int l;
+    ssize_t n = 0;
+    size_t len;
+    bool http, prometheus;
+    char req[STATS_REQ_SIZE];
+    char buf[STATS_BUF_SIZE];
+    uint64_t values[STATS_NUM];
+    struct pollfd p = { .fd = fd, .events = POLLIN };
+    /* A client may just read */
+    if(poll(&p, 1, STATS_REQ_MS) > 0)
+        n = recv(fd, req, sizeof(req) - 1, MSG_DONTWAIT);
+    req[n > 0 ? n : 0] = 0;
+    http = strncmp(req, "GET ", 4) == 0;
+    prometheus = http || strncmp(req, "prometheus", 10) == 0;
+    if(strncmp(req, "reset", 5) == 0)
+        rotate(self);
+    else
+        sumLat(self);
+    stats_sum(self->_stats, self->_num, values);
+    len = stats_print(values, buf, sizeof(buf), prometheus);
+    if(len > 0) {
+        size_t l = stats_printLat((const pchist *)self->_total,
+                (const pchist *)self->_window, buf + len, sizeof(buf) - len,
+                prometheus);
+        len = l > 0 ? len + l : 0;
+    }
+    if(len == 0) {
+        log_warning("statistics exceed buffer");
+        return;
+    }
+    if(http) {
+        char h[STATS_REQ_SIZE];
+        l = snprintf(h, sizeof(h), "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: %zu\r\n\r\n", len);
+        if(send(fd, h, l, MSG_NOSIGNAL) < 0) {
+            logp_err("send statistics");
+            return;
+        }
+    }
+    if(send(fd, buf, len, MSG_NOSIGNAL) < 0)
+        logp_err("send statistics");
+}
+static bool srv_accept(ploop loop, int events, void *cookie)
+{
+    pstatssrv self = (pstatssrv)cookie;
+    int fd = accept(self->_fd, NULL, NULL);
+    if(fd < 0) {
+        logp_err("accept");
+        return true;
+    }
+    answer(self, fd);
+    close(fd);
+    return true;
+}
+static bool srv_window(ploop loop, int events, void *cookie)
+{
+    rotate((pstatssrv)cookie);
+    return true;
+}
+static bool srv_run(void *cookie)
+{
+    pstatssrv self = (pstatssrv)cookie;
+    self->_loop->run(self->_loop);
+    return true;
+}
+#endif /* HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H */
+
+static void s_free(pstatssrv self)
+{
+    if(LIKELY_COND(self != NULL)) {
+        if(self->_thread != NULL) {
+            self->_loop->stop(self->_loop);
+            self->_thread->free(self->_thread);
+        }
+        if(self->_loop != NULL)
+            self->_loop->free(self->_loop);
+        if(self->_fd >= 0) {
+            close(self->_fd);
+            unlink(self->_path);
+        }
+        for(size_t i = 0; i < STATS_LAT_NUM; i++) {
+#define FREE_LAT(a) do{if(self->a[i] != NULL)self->a[i]->free(self->a[i]);}while(false)
+            FREE_LAT(_total);
+            FREE_LAT(_last);
+            FREE_LAT(_window);
+#undef FREE_LAT
+        }
+        free(self->_path);
+        free(self->_stats);
+        free(self);
+    }
+}
+pstatssrv stats_srv_alloc(const char *path, const pcstats *stats, size_t num,
+    int window)
+{
+    #if defined HAVE_SYS_SOCKET_H && defined HAVE_SYS_UN_H
+    pstatssrv ret;
+    struct stat s;
+    struct sockaddr_un addr;
+    if(path == NULL || stats == NULL || num == 0 || window <= 0)
+        return NULL;
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        log_err("statistics socket path is too long '%s'", path);
+        return NULL;
+    }
+    ret = malloc(sizeof(struct stats_srv_t));
+    if(ret == NULL) {
+        log_err("memory allocation failed");
+        return NULL;
+    }
+    ret->_fd = -1;
+    ret->_loop = NULL;
+    ret->_thread = NULL;
+    ret->_num = num;
+    ret->_path = strdup(path);
+    ret->_stats = malloc(num * sizeof(pcstats));
+    ret->free = s_free;
+    for(size_t i = 0; i < STATS_LAT_NUM; i++) {
+        ret->_total[i] = NULL;
+        ret->_last[i] = NULL;
+        ret->_window[i] = NULL;
+    }
+    for(size_t i = 0; i < STATS_LAT_NUM; i++) {
+        ret->_total[i] = hist_alloc();
+        ret->_last[i] = hist_alloc();
+        ret->_window[i] = hist_alloc();
+        if(ret->_total[i] == NULL || ret->_last[i] == NULL ||
+            ret->_window[i] == NULL) {
+            s_free(ret);
+            return NULL;
+        }
+    }
+    if(ret->_path == NULL || ret->_stats == NULL) {
+        log_err("memory allocation failed");
+        s_free(ret);
+        return NULL;
+    }
+    memcpy(ret->_stats, stats, num * sizeof(pcstats));
+    /* Remove a socket left by a previous run */
+    if(lstat(path, &s) == 0 && S_ISSOCK(s.st_mode))
+        unlink(path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    ret->_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(ret->_fd < 0) {
+        logp_err("socket");
+        s_free(ret);
+        return NULL;
+    }
+    if(bind(ret->_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        logp_err("bind '%s'", path);
+        close(ret->_fd);
+        ret->_fd = -1; /* Do not remove a path we do not own */
+        s_free(ret);
+        return NULL;
+    }
+    if(listen(ret->_fd, 8) < 0) {
+        logp_err("listen");
+        s_free(ret);
+        return NULL;
+    }
+    ret->_loop = loop_alloc();
+    if(ret->_loop == NULL ||
+        ret->_loop->addFd(ret->_loop, ret->_fd, LOOP_IN, srv_accept, ret) < 0 ||
+        ret->_loop->addTimer(ret->_loop, window * 1000, srv_window, ret) < 0) {
+        s_free(ret);
+        return NULL;
+    }
+    ret->_thread = thread_create(srv_run, ret);
+    if(ret->_thread == NULL) {
+        s_free(ret);
+        return NULL;
+    }
+    return ret;
+    #else /* HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H */
+    log_err("Unix sockets are not supported");
+    return NULL;
+    #endif /* HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H */
+}
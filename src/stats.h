@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief service statistics counters and export
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_STATS_H_
+#define __CSPTP_STATS_H_
+
+#include "src/slab.h"
+#include "src/hist.h"
+
+/** Counters of a worker */
+enum stats_id_e {
+    STATS_RX, /**> received messages */
+    STATS_RX_BYTES, /**> received bytes */
+    STATS_RX_FOLLOW_UP, /**> received Follow_Up messages */
+    STATS_REQ_STATUS, /**> requests of CSPTP_STATUS TLV */
+    STATS_REQ_ALT_TIME, /**> requests of ALTERNATE_TIME_OFFSET_INDICATOR TLV */
+    STATS_TX_SYNC, /**> sent Sync responses */
+    STATS_TX_FOLLOW_UP, /**> sent Follow_Up responses */
+    STATS_TX_BYTES, /**> sent bytes */
+    STATS_DROP_RATE, /**> requests over the rate limit */
+    /* Parse failures, in the order of msg_parse_e */
+    STATS_DROP_ARGS, /**> parse without parameters */
+    STATS_DROP_SHORT, /**> message shorter than the PTP header */
+    STATS_DROP_LENGTH, /**> messageLength exceeds the received data */
+    STATS_DROP_TYPE, /**> unsupported message type */
+    STATS_DROP_VERSION, /**> wrong PTP version or SDO ID */
+    STATS_DROP_HEADER, /**> wrong header field value */
+    STATS_DROP_FLAGS, /**> wrong flagField value */
+    STATS_DROP_MESSAGE, /**> message type the service does not answer */
+    STATS_DROP_NO_REQUEST, /**> Sync without CSPTP_REQUEST TLV */
+    STATS_DROP_ORPHAN, /**> Follow_Up without its Sync */
+    STATS_ERR_RECV, /**> receive failures */
+    STATS_ERR_BUILD, /**> response build failures */
+    STATS_ERR_SEND, /**> send failures */
+    STATS_STORE_EVICT, /**> two steps Sync records replaced by a new client */
+    STATS_NUM
+};
+
+/** Latency histograms of a worker */
+enum stats_lat_e {
+    STATS_LAT_TURNAROUND, /**> from receive timestamp to response transmit time */
+    STATS_LAT_QUEUE, /**> from kernel receive timestamp to dequeue */
+    STATS_LAT_NUM
+};
+
+typedef struct stats_t *pstats;
+typedef const struct stats_t *pcstats;
+typedef struct stats_srv_t *pstatssrv;
+struct loop_t;
+struct thread_t;
+
+struct stats_t {
+    uint64_t _cnt[STATS_NUM]; /**> counters, written by the worker only */
+    phist _lat[STATS_LAT_NUM]; /**> latency histograms, or null */
+
+    /**
+     * Free this statistics object
+     * @param[in, out] self statistics object
+     */
+    void (*free)(pstats self);
+
+    /**
+     * Get a counter
+     * @param[in] self statistics object
+     * @param[in] id of counter
+     * @return counter value
+     * @note can be called from another thread
+     */
+    uint64_t (*get)(pcstats self, enum stats_id_e id);
+
+    /**
+     * Get a latency histogram
+     * @param[in] self statistics object
+     * @param[in] id of histogram
+     * @return histogram or null if latency is not recorded
+     * @note can be called from another thread
+     */
+    pchist (*getLat)(pcstats self, enum stats_lat_e id);
+} _ALIGNED__(SLAB_ALIGN);
+
+/**
+ * Add to a counter
+ * @param[in, out] self statistics object, may be null
+ * @param[in] id of counter
+ * @param[in] value to add
+ * @note a single writer, the store is atomic for the readers,
+ *       without a locked instruction
+ */
+static inline void stats_add(pstats self, enum stats_id_e id, uint64_t value)
+{
+    if(self != NULL) {
+        uint64_t *c = self->_cnt + id;
+        __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + value,
+            __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Increment a counter
+ * @param[in, out] self statistics object, may be null
+ * @param[in] id of counter
+ */
+static inline void stats_inc(pstats self, enum stats_id_e id)
+{
+    stats_add(self, id, 1);
+}
+
+/**
+ * Query if latency is recorded
+ * @param[in] self statistics object, may be null
+ * @return true if latency is recorded
+ */
+static inline bool stats_useLat(pcstats self)
+{
+    return self != NULL && self->_lat[0] != NULL;
+}
+
+/**
+ * Record a latency
+ * @param[in, out] self statistics object, may be null
+ * @param[in] id of histogram
+ * @param[in] latency in nanoseconds, negative values are ignored
+ */
+static inline void stats_lat(pstats self, enum stats_lat_e id, int64_t latency)
+{
+    if(stats_useLat(self) && latency >= 0)
+        hist_record(self->_lat[id], latency);
+}
+
+/**
+ * Allocate a statistics object
+ * @param[in] latency record latency histograms
+ * @return pointer to a new statistics object or null
+ * @note the object is cache line aligned, so workers do not share lines
+ */
+pstats stats_alloc(bool latency);
+
+/**
+ * Sum counters of workers
+ * @param[in] stats array of statistics objects
+ * @param[in] num number of statistics objects
+ * @param[out] values array of STATS_NUM counters
+ */
+void stats_sum(const pcstats *stats, size_t num, uint64_t *values);
+
+/**
+ * Print counters
+ * @param[in] values array of STATS_NUM counters
+ * @param[out] buf buffer to print to
+ * @param[in] size of buffer
+ * @param[in] prometheus use Prometheus text format
+ * @return length of text or zero if buffer is too small
+ * @note the plain text has a line per counter, 'name value'
+ */
+size_t stats_print(const uint64_t *values, char *buf, size_t size,
+    bool prometheus);
+
+/**
+ * Print latency percentiles
+ * @param[in] total array of STATS_LAT_NUM histograms since start
+ * @param[in] window array of STATS_LAT_NUM histograms of the last window
+ * @param[out] buf buffer to print to
+ * @param[in] size of buffer
+ * @param[in] prometheus use Prometheus text format
+ * @return length of text or zero if buffer is too small
+ * @note print the 50, 99 and 99.9 percentiles and the highest value.
+ *       Plain text uses nanoseconds, Prometheus uses seconds.
+ */
+size_t stats_printLat(const pchist *total, const pchist *window, char *buf,
+    size_t size, bool prometheus);
+
+struct stats_srv_t {
+    int _fd; /**> listening socket */
+    char *_path; /**> socket path, removed on free */
+    pcstats *_stats; /**> statistics objects of the workers */
+    size_t _num; /**> number of statistics objects */
+    phist _total[STATS_LAT_NUM]; /**> latency of all workers since start */
+    phist _last[STATS_LAT_NUM]; /**> latency since start on the last window */
+    phist _window[STATS_LAT_NUM]; /**> latency of the last window */
+    struct loop_t *_loop; /**> event loop of the export thread */
+    struct thread_t *_thread; /**> export thread */
+
+    /**
+     * Stop export and free this export object
+     * @param[in, out] self export object
+     */
+    void (*free)(pstatssrv self);
+};
+
+/**
+ * Export statistics on a Unix socket
+ * @param[in] path of Unix socket
+ * @param[in] stats array of statistics objects of the workers
+ * @param[in] num number of statistics objects
+ * @param[in] window period in seconds of the latency window
+ * @return pointer to a new export object or null
+ * @note a thread answers each connection and closes it.
+ *       A request starting with 'GET ' gets an HTTP response in
+ *       the Prometheus text format, a request starting with 'prometheus'
+ *       gets the Prometheus text format, any other gets plain text.
+ *       A request starting with 'reset' starts a new latency window.
+ */
+pstatssrv stats_srv_alloc(const char *path, const pcstats *stats, size_t num,
+    int window);
+
+#endif /* __CSPTP_STATS_H_ */
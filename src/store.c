@@ -12,200 +12,380 @@
 #include "src/store.h"
 #include "src/log.h"
 #include "src/swap.h"
+#include "src/slab.h"
 
-struct _nodeIPData {
-    struct timespec ts; /* Last message TX time */
-    time_t last; /* Last time in seconds we store tx time of a client */
-    uint16_t sequenceId; /* The sequence used with the TS */
-    /* uint8_t domainNumber; */ /* Domain number used by client */
-    uint8_t ip[]; /* Address of client */
-};
-struct _cookie_t {
-    pcts ts;
+#define CACHE_LINE SLAB_ALIGN /* Bucket alignment */
+/* Multiplier of Fibonacci hashing, 2^64 divided by the golden ratio */
+#define HASH_MUL UINT64_C(0x9e3779b97f4a7c15)
+#define WHEEL_END UINT32_MAX /* End of an expire wheel list */
+#define QUEUED (1U << 31) /* Bucket is in the expire wheel, flag in used */
+
+struct store_slot_t {
+    int64_t ts; /* Receive time of the client last Sync in nanoseconds */
+    uint32_t last; /* Last time in seconds we store tx time of a client */
+    uint16_t port; /* Port of client */
     uint16_t sequenceId; /* The sequence used with the TS */
-    /* uint8_t domainNumber; */ /* Domain number used by client */
-    time_t last;
-    const void *ip;
+    uint8_t domainNumber; /* Domain number used by client */
+    uint8_t flags; /* Flags kept with the TS */
+    uint8_t ip[]; /* Address of client, the length depends on the protocol */
 };
-typedef struct _nodeIPData *pnodeData;
-typedef struct _cookie_t *pcookie;
+#define BUCKET_HEAD (2 * sizeof(uint32_t))
+/* Records are aligned to the timestamp */
+#define SLOT_SIZE(ipLen) ((offsetof(struct store_slot_t, ip) + (ipLen) + \
+            sizeof(int64_t) - 1) & ~(sizeof(int64_t) - 1))
+/* A writer makes the sequence odd while it changes the bucket,
+ * readers retry if the sequence is odd or changed during the read */
+struct store_bucket_t {
+    uint32_t seq; /* Sequence lock, use atomic access */
+    uint32_t used; /* Bit mask of used slots and QUEUED flag */
+    uint8_t slots[CACHE_LINE - BUCKET_HEAD]; /* Records of the protocol size */
+} _ALIGNED__(CACHE_LINE);
+_Static_assert(sizeof(struct store_bucket_t) == CACHE_LINE,
+    "a bucket is a single cache line");
+_Static_assert(BUCKET_HEAD + STORE_SLOTS_IPV4 * SLOT_SIZE(IPV4_ADDR_LEN) <=
+    CACHE_LINE, "IPv4 records exceed the bucket");
+_Static_assert(BUCKET_HEAD + STORE_SLOTS_IPV6 * SLOT_SIZE(IPV6_ADDR_LEN) <=
+    CACHE_LINE, "IPv6 records exceed the bucket");
 
-#define PER_IP(n)\
-    static int _cmp##n(void *d, void *c)\
-    {\
-        return memcmp(((pnodeData)d)->ip, ((pcookie)c)->ip, IPV##n##_ADDR_LEN);\
-    }\
-    static int _set##n(void *_d, void *_c)\
-    {\
-        pnodeData d = (pnodeData)_d;\
-        pcookie c = (pcookie)_c;\
-        c->ts->toTimespec(c->ts, &d->ts);\
-        d->last = time(NULL);\
-        d->sequenceId = c->sequenceId;\
-        /* d->domainNumber = c->domainNumber; */\
-        memcpy(d->ip, c->ip, IPV##n##_ADDR_LEN);\
-        return 0;\
+static inline struct store_bucket_t *bucket(pcstore self, const uint8_t *ip,
+    uint16_t port)
+{
+    uint32_t w;
+    uint64_t h = port;
+    for(size_t i = 0; i < self->_ipLen; i += sizeof(uint32_t)) {
+        memcpy(&w, ip + i, sizeof(uint32_t));
+        h = (h ^ w) * HASH_MUL;
     }
-PER_IP(4)
-PER_IP(6)
-static int _cleanUp(void *d, void *c)
+    /* Mix the high bits back, the IPv6 rounds alone keep close keys close */
+    h = (h ^ (h >> 32)) * HASH_MUL;
+    return self->_buckets + ((h >> 32) & self->_hashMask);
+}
+static inline struct store_slot_t *getSlot(pcstore self,
+    struct store_bucket_t *b, int slot)
+{
+    return (struct store_slot_t *)(b->slots + slot * self->_slotSize);
+}
+static inline bool isUsed(const struct store_bucket_t *b, int slot)
+{
+    return (b->used & (1 << slot)) > 0;
+}
+/* Push a bucket to the list of the second in the wheel,
+ * the cleanup takes a whole list, so a simple push is safe */
+static inline void wheelPush(pstore self, const struct store_bucket_t *b,
+    uint32_t last)
 {
-    /* Time is too old */
-    return ((pnodeData)d)->last < ((pcookie)c)->last;
+    uint32_t *head = self->_wheel + last % STORE_WHEEL;
+    uint32_t i = b - self->_buckets;
+    uint32_t next = __atomic_load_n(head, __ATOMIC_RELAXED);
+    do
+        self->_next[i] = next;
+    while(!__atomic_compare_exchange_n(head, &next, i, true, __ATOMIC_RELEASE,
+            __ATOMIC_RELAXED));
 }
-size_t _hash4(pcstore self, pcipaddr addr)
+static inline bool match(pcstore self, const struct store_slot_t *s,
+    const uint8_t *ip, uint16_t port)
 {
-    return addr->getIP4Val(addr) & self->_hashMask;
+    return s->port == port && memcmp(s->ip, ip, self->_ipLen) == 0;
+}
+static inline void lock(struct store_bucket_t *b)
+{
+    uint32_t seq = __atomic_load_n(&b->seq, __ATOMIC_RELAXED);
+    for(;;) {
+        if((seq & 1) == 0 && __atomic_compare_exchange_n(&b->seq, &seq,
+                seq + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return;
+        seq = __atomic_load_n(&b->seq, __ATOMIC_RELAXED);
+    }
 }
-size_t _hash6(pcstore self, pcipaddr addr)
+static inline void unlock(struct store_bucket_t *b)
 {
-    /* Convert low 4 octets to host unsigned 32 bits
-       and use the hash bits */
-    return net_to_cpu32(*(uint32_t *)(addr->getIP6(addr) + 12)) & self->_hashMask;
+    __atomic_fetch_add(&b->seq, 1, __ATOMIC_RELEASE);
 }
-size_t _hash0(pcstore self, pcipaddr addr)
+static inline uint32_t readBegin(struct store_bucket_t *b)
 {
-    return 0; /* We do not use hash, we use single list */
+    uint32_t seq;
+    do
+        seq = __atomic_load_n(&b->seq, __ATOMIC_ACQUIRE);
+    while((seq & 1) > 0);
+    return seq;
+}
+static inline bool readRetry(struct store_bucket_t *b, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&b->seq, __ATOMIC_RELAXED) != seq;
 }
 
+/* The protocol is resolved on allocation */
+static inline void getIP(pcstore self, pcipaddr addr, const uint8_t **ip,
+    uint16_t *port)
+{
+    if(self->_ipLen == IPV4_ADDR_LEN) {
+        *ip = addr4_getIP(addr);
+        *port = addr4_getPort(addr);
+    } else {
+        *ip = addr6_getIP(addr);
+        *port = addr6_getPort(addr);
+    }
+}
 static void _free(pstore self)
 {
     if(LIKELY_COND(self != NULL)) {
-        pslistmgr mgr = self->_mgr;
-        if(LIKELY_COND(mgr != NULL)) {
-            if(LIKELY_COND(self->_data != NULL)) {
-                pslist l = self->_data;
-                for(size_t i = 0; i < self->_hashSize; i++)
-                    mgr->freeList(mgr, l++, false);
-            }
-            mgr->free(mgr);
-        }
+        slab_munmap(self->_mem, self->_memSize);
         free(self);
     }
 }
 static bool _update(pstore self, pcipaddr addr, pcts ts, uint16_t sID,
-    uint8_t dNum)
+    uint8_t dNum, uint8_t flags, bool *evicted)
 {
-    struct _cookie_t cookie;
+    int i, j, n = -1;
+    const uint8_t *ip;
+    uint16_t port;
+    struct store_slot_t *s = NULL;
+    struct store_bucket_t *h, *b = NULL, *t = NULL;
     if(UNLIKELY_COND(self == NULL || addr == NULL || ts == NULL ||
-            self->_data == NULL || self->_mgr == NULL))
+            self->_buckets == NULL))
         return false;
-    cookie.ts = ts;
-    cookie.last = 0;
-    cookie.sequenceId = sID;
-    /* cookie.domainNumber = dNum; */
-    cookie.ip = addr->getIP(addr);
-    return self->_mgr->updateNode(self->_mgr, self->_data + self->_hash(self, addr),
-            &cookie);
+    if(evicted != NULL)
+        *evicted = false;
+    getIP(self, addr, &ip, &port);
+    h = bucket(self, ip, port);
+    /* Lock the probed buckets in order, so a client has a single record */
+    for(j = 0; j < self->_probe; j++) {
+        b = h + j;
+        lock(b);
+        for(i = 0; i < self->_slots; i++) {
+            s = getSlot(self, b, i);
+            if(!isUsed(b, i)) {
+                if(t == NULL || isUsed(t, n)) {
+                    t = b; /* Prefer a free slot */
+                    n = i;
+                }
+            } else if(match(self, s, ip, port))
+                break;
+            else if(t == NULL ||
+                (isUsed(t, n) && s->last < getSlot(self, t, n)->last)) {
+                t = b; /* Oldest record */
+                n = i;
+            }
+        }
+        if(i < self->_slots)
+            break;
+    }
+    if(j == self->_probe) {
+        /* New client, replace the oldest if the buckets are full */
+        j--;
+        b = t;
+        s = getSlot(self, b, n);
+        if(!isUsed(b, n)) {
+            b->used |= 1 << n;
+            __atomic_fetch_add(&self->_records, 1, __ATOMIC_RELAXED);
+        } else if(evicted != NULL)
+            *evicted = true;
+        memcpy(s->ip, ip, self->_ipLen);
+        s->port = port;
+    }
+    s->ts = ts_getTs(ts);
+    s->last = time(NULL);
+    s->sequenceId = sID;
+    s->domainNumber = dNum;
+    s->flags = flags;
+    /* A queued bucket is checked again once its records expire */
+    if((b->used & QUEUED) == 0) {
+        b->used |= QUEUED;
+        wheelPush(self, b, s->last);
+    }
+    for(; j >= 0; j--)
+        unlock(h + j);
+    return true;
 }
 static bool _fetch(pstore self, pcipaddr addr, pts ts, uint16_t sID,
-    uint8_t dNum, bool clear)
+    uint8_t dNum, uint8_t *flags, bool clear)
 {
-    pnodeData d;
-    struct _cookie_t cookie;
+    int i = 0, j;
+    int64_t t = 0;
+    uint32_t seq;
+    const uint8_t *ip;
+    uint16_t port, sequenceId = 0;
+    uint8_t domainNumber = 0, f = 0;
+    struct store_slot_t *s = NULL;
+    struct store_bucket_t *b = NULL;
     if(UNLIKELY_COND(self == NULL || addr == NULL || ts == NULL ||
-            self->_data == NULL || self->_mgr == NULL))
+            self->_buckets == NULL))
         return false;
-    cookie.ts = NULL;
-    cookie.last = 0;
-    cookie.sequenceId = sID;
-    /* cookie.domainNumber = dNum; */
-    cookie.ip = addr->getIP(addr);
-    d = (pnodeData)self->_mgr->fetchNode(self->_mgr,
-            self->_data + self->_hash(self, addr), &cookie);
-    if(d == NULL || d->sequenceId != sID /* || d->domainNumber != dNum */)
+    getIP(self, addr, &ip, &port);
+    b = bucket(self, ip, port);
+    /* Updates keep a single record per client, lock one bucket at a time */
+    for(j = 0; j < self->_probe; j++, b++) {
+        if(clear)
+            lock(b);
+        do {
+            seq = clear ? 0 : readBegin(b);
+            for(i = 0; i < self->_slots; i++) {
+                s = getSlot(self, b, i);
+                if(isUsed(b, i) && match(self, s, ip, port)) {
+                    t = s->ts;
+                    sequenceId = s->sequenceId;
+                    domainNumber = s->domainNumber;
+                    f = s->flags;
+                    break;
+                }
+            }
+        } while(!clear && readRetry(b, seq));
+        if(i < self->_slots)
+            break;
+        if(clear)
+            unlock(b);
+    }
+    if(j == self->_probe)
         return false;
-    /* Get timestamp from node */
-    ts->fromTimespec(ts, &d->ts);
-    if(clear) {
-        d->ts.tv_sec = 0;
-        d->ts.tv_nsec = 0;
+    if(sequenceId == sID && domainNumber == dNum) {
+        /* Get timestamp from record */
+        ts->setTs(ts, t);
+        if(flags != NULL)
+            *flags = f;
+        if(clear) {
+            /* The Follow_Up is answered, free the slot */
+            b->used &= ~(1 << i);
+            __atomic_fetch_sub(&self->_records, 1, __ATOMIC_RELAXED);
+        }
+    } else
+        j = self->_probe;
+    if(clear)
+        unlock(b);
+    return j < self->_probe;
+}
+/* Remove the old records of a bucket,
+ * queue it again by its oldest record if it still has records */
+static inline size_t expire(pstore self, struct store_bucket_t *b,
+    uint32_t limit)
+{
+    int oldest = -1;
+    size_t count = 0;
+    lock(b);
+    for(int j = 0; j < self->_slots; j++) {
+        if(!isUsed(b, j))
+            continue;
+        if(getSlot(self, b, j)->last < limit) {
+            /* Time is too old */
+            b->used &= ~(1 << j);
+            count++;
+        } else if(oldest < 0 ||
+            getSlot(self, b, j)->last < getSlot(self, b, oldest)->last)
+            oldest = j;
     }
-    return true;
+    if(oldest < 0)
+        b->used &= ~QUEUED;
+    else
+        wheelPush(self, b, getSlot(self, b, oldest)->last);
+    unlock(b);
+    return count;
 }
 static size_t _cleanup(pstore self, uint32_t timeGap)
 {
-    pslist l;
-    size_t count;
-    struct _cookie_t cookie;
-    if(UNLIKELY_COND(self == NULL || self->_data == NULL || self->_mgr == NULL))
+    int64_t limit, sec;
+    uint32_t i;
+    size_t count = 0;
+    if(UNLIKELY_COND(self == NULL || self->_buckets == NULL))
+        return 0;
+    limit = (int64_t)time(NULL) - timeGap;
+    if(limit <= 0)
         return 0;
-    l = self->_data;
-    cookie.ts = NULL;
-    cookie.last = time(NULL) - timeGap;
-    cookie.sequenceId = 0;
-    /* cookie.domainNumber = 0; */
-    cookie.ip = NULL;
-    count = 0;
-    for(size_t i = 0; i < self->_hashSize; i++)
-        count += self->_mgr->cleanUpNodes(self->_mgr, l++, &cookie);
+    /* Pass the wheel seconds up to the limit, at most a whole round.
+     * On start or when the clock jumps back, pass a whole round */
+    sec = self->_wheelTime;
+    if(sec == 0 || sec > limit + STORE_WHEEL || sec < limit - STORE_WHEEL)
+        sec = limit - STORE_WHEEL;
+    if(sec < 0)
+        sec = 0;
+    for(; sec < limit; sec++) {
+        i = __atomic_exchange_n(self->_wheel + sec % STORE_WHEEL, WHEEL_END,
+                __ATOMIC_ACQUIRE);
+        while(i != WHEEL_END) {
+            /* A bucket we push back goes to a newer second */
+            uint32_t next = self->_next[i];
+            count += expire(self, self->_buckets + i, limit);
+            i = next;
+        }
+    }
+    if(limit > self->_wheelTime)
+        self->_wheelTime = limit;
+    __atomic_fetch_sub(&self->_records, count, __ATOMIC_RELAXED);
     return count;
 }
-size_t _getHashSize(pcstore self)
+static size_t _memUse(pcstore self)
+{
+    return UNLIKELY_COND(self == NULL) ? 0 : self->_memSize;
+}
+static size_t _getHashSize(pcstore self)
 {
     return UNLIKELY_COND(self == NULL) ? 0 : self->_hashSize;
 }
-size_t _records(pcstore self)
+static size_t _records(pcstore self)
 {
-    return UNLIKELY_COND(self == NULL || self->_mgr == NULL) ? 0 :
-        self->_mgr->getUsedNodes(self->_mgr);
+    return UNLIKELY_COND(self == NULL) ? 0 :
+        __atomic_load_n(&self->_records, __ATOMIC_RELAXED);
 }
 
 pstore store_alloc(prot type, size_t hashBitsSize)
 {
     pstore ret;
-    pslistmgr mgr;
-    size_t hashSize, hashAllocSize, dataSize = sizeof(struct _nodeIPData);
+    size_t hashSize, buckets, ipLen, slots, probe, memSize;
+    bool hugePages;
     switch(type) {
         case UDP_IPv4:
-            dataSize += IPV4_ADDR_LEN;
+            ipLen = IPV4_ADDR_LEN;
+            slots = STORE_SLOTS_IPV4;
             break;
         case UDP_IPv6:
-            dataSize += IPV6_ADDR_LEN;
+            ipLen = IPV6_ADDR_LEN;
+            slots = STORE_SLOTS_IPV6;
             break;
         default:
             log_err("protocol not supported %d", type);
             return NULL;
     }
-    if(hashBitsSize > 32) {
-        log_warning("hash exceed 32 bits\n");
+    if(hashBitsSize > 31) {
+        log_warning("hash exceed 31 bits\n");
         return NULL;
     }
-    hashSize = 1 << hashBitsSize;
-    hashAllocSize = hashSize * sizeof(struct s_link_list_t);
-    ret = malloc(sizeof(struct store_t) + hashAllocSize);
+    hashSize = (size_t)1 << hashBitsSize;
+    ret = malloc(sizeof(struct store_t));
     if(ret == NULL)
         return NULL;
-    switch(type) {
-        case UDP_IPv4:
-            ret->_hash = _hash4;
-            mgr = pslistmgr_alloc(dataSize, _cmp4, _set4, _cleanUp, NULL);
-            break;
-        case UDP_IPv6:
-            ret->_hash = _hash6;
-            mgr = pslistmgr_alloc(dataSize, _cmp6, _set6, _cleanUp, NULL);
-            break;
-        default: /* Should not happen */
-            mgr = NULL;
-            break;
-    }
-    if(mgr == NULL) {
+    /* The last buckets probe past the end of the table */
+    probe = STORE_PROBE / slots;
+    buckets = hashSize + probe - 1;
+    memSize = buckets * (sizeof(struct store_bucket_t) + sizeof(uint32_t));
+    /* Large tables use huge pages */
+    hugePages = memSize >= SLAB_HUGE;
+    if(hugePages)
+        memSize = (memSize + SLAB_HUGE - 1) & ~((size_t)SLAB_HUGE - 1);
+    /* Zero buckets are free and unlocked, the memory is pre-faulted */
+    ret->_mem = slab_mmap(memSize, hugePages);
+    if(ret->_mem == NULL) {
         free(ret);
         return NULL;
     }
-    ret->_mgr = mgr;
+    ret->_memSize = memSize;
+    ret->_buckets = (struct store_bucket_t *)ret->_mem;
+    ret->_next = (uint32_t *)(ret->_buckets + buckets);
+    for(size_t i = 0; i < STORE_WHEEL; i++)
+        ret->_wheel[i] = WHEEL_END;
+    ret->_wheelTime = 0;
+    ret->_ipLen = ipLen;
+    ret->_slots = slots;
+    ret->_slotSize = SLOT_SIZE(ipLen);
+    ret->_probe = probe;
     ret->_hashSize = hashSize;
     ret->_hashMask = hashSize - 1;
-    if(hashBitsSize == 0)
-        ret->_hash = _hash0;
+    ret->_records = 0;
 #define asg(a) ret->a = _##a
     asg(free);
     asg(update);
     asg(fetch);
     asg(cleanup);
+    asg(memUse);
     asg(getHashSize);
     asg(records);
-    ret->_data = (pslist)(ret + 1);
-    memset(ret->_data, 0, hashAllocSize);
     return ret;
 }
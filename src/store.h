@@ -13,24 +13,36 @@
 #define __CSPTP_STORE_H_
 
 #include "src/sock.h"
-#include "src/slist.h"
+
+/** Number of IPv4 records in a hash table bucket */
+#define STORE_SLOTS_IPV4 (2)
+/** Number of IPv6 records in a hash table bucket */
+#define STORE_SLOTS_IPV6 (1)
+/** Number of records a new record probes, starting from its hash bucket */
+#define STORE_PROBE (16)
+/** Default number of bits of the hash table size */
+#define STORE_HASH_BITS (14)
+/** Number of seconds in the expire wheel */
+#define STORE_WHEEL (64)
 
 typedef struct store_t *pstore;
 typedef const struct store_t *pcstore;
+struct store_bucket_t;
 
 struct store_t {
-    pslist _data; /**> pointer to hash table of lists */
+    void *_mem; /**> allocated memory of the hash table */
+    size_t _memSize; /**> size of the allocated memory */
+    struct store_bucket_t *_buckets; /**> hash table aligned to cache line */
     uint32_t _hashMask; /**> mask for the hash table */
-    uint32_t _hashSize; /**> mask for the hash table */
-    pslistmgr _mgr; /**> pointer to list manager */
-    /**
-     * Calculate Hash
-     * @param[in, out] self timestamp object
-     * @param[in] address of client
-     * @return hash value on success
-     */
-    size_t (*_hash)(pcstore self, pcipaddr address);
-
+    uint32_t _hashSize; /**> number of buckets in the hash table */
+    size_t _ipLen; /**> IP address length */
+    size_t _slots; /**> number of records in a bucket */
+    size_t _slotSize; /**> size of a record in a bucket */
+    size_t _probe; /**> number of buckets a new record probes */
+    size_t _records; /**> number of records stored, use atomic access */
+    uint32_t *_next; /**> next bucket in the expire wheel list, per bucket */
+    uint32_t _wheel[STORE_WHEEL]; /**> expire wheel list per second, use atomic access */
+    int64_t _wheelTime; /**> expire wheel pass the seconds before it */
     /**
      * Free this timestamp object
      * @param[in, out] self timestamp object
@@ -44,35 +56,51 @@ struct store_t {
      * @param[in] timestamp to store in record
      * @param[in] sequenceId of the messages used to store the timestamp
      * @param[in] domainNumber used by client
+     * @param[in] flags to keep with the timestamp
+     * @param[out] evicted set if the record replaced another client record,
+     *             may be null
      * @return true on success
      */
     bool (*update)(pstore self, pcipaddr address, pcts timestamp,
-        uint16_t sequenceId, uint8_t domainNumber);
+        uint16_t sequenceId, uint8_t domainNumber, uint8_t flags,
+        bool *evicted);
 
     /**
      * Fetch record timestamp
      * @param[in, out] self timestamp object
      * @param[in] address of client
      * @param[out] timestamp to fetch
-     * @param[in] clear timestamp
+     * @param[in] clear remove the record once it is fetched
      * @param[in] sequenceId of the messages used to store the timestamp
      * @param[in] domainNumber used by client
+     * @param[out] flags kept with the timestamp, may be null
      * @return true on success
-     * @note return false if record do not exist
-     *       clear timestamp means zero value timestamp
+     * @note return false if record do not exist,
+     *       or it uses a different sequenceId or domainNumber
+     * @note clear frees the slot of a matched record,
+     *       the bucket leaves the expire wheel on the next cleanup
      */
     bool (*fetch)(pstore self, pcipaddr address, pts timestamp, uint16_t sequenceId,
-        uint8_t domainNumber, bool clear);
+        uint8_t domainNumber, uint8_t *flags, bool clear);
 
     /**
      * cleanup of old records
      * @param[in, out] self timestamp object
-     * @param[in] time gap, all nodes before it will be removed
-     * @return number of nodes removed from all lists
+     * @param[in] time gap, all records before it will be removed
+     * @return number of records removed
      * @note Should be called from a different thread!
+     *       Use a single thread to call it.
+     * @note Work on the buckets with records in the passed seconds only
      */
     size_t (*cleanup)(pstore self, uint32_t time);
 
+    /**
+     * Get memory used by the hash table
+     * @param[in] self timestamp object
+     * @return memory size in bytes
+     */
+    size_t (*memUse)(pcstore self);
+
     /**
      * Get hash table size
      * @param[in] self timestamp object
@@ -93,8 +121,17 @@ struct store_t {
  * @param[in] protocol to use to store recoreds
  * @param[in] hashSize number of bits of the hash table size (2 ^ hashSize)
  * @return pointer to a new store object or null
- * @note hashSize of zero will NOT use hash table.
- *       hashSize is limit upto 32 bits.
+ * @note hashSize of zero use a single bucket.
+ *       hashSize is limit upto 31 bits.
+ * @note Records are keyed by client address and port.
+ *       A bucket fits a cache line and holds STORE_SLOTS_IPV4 or
+ *       STORE_SLOTS_IPV6 records. A new record probes the buckets of
+ *       STORE_PROBE records for a free slot, when all are full it replace
+ *       their oldest record.
+ * @note The hash table is allocated and pre-faulted on start,
+ *       tables of 2 MB and more use huge pages.
+ * @note Fetch without clear is lock free, update and clear lock
+ *       the buckets they probe, cleanup lock a single bucket.
  */
 pstore store_alloc(prot protocol, size_t hashSize);
 
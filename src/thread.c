@@ -9,9 +9,14 @@
  *
  */
 
+#define _GNU_SOURCE /* For sched_setaffinity() */
 #include "src/thread.h"
 #include "src/log.h"
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 static bool _join(pcthread self)
 {
     int e;
@@ -121,3 +126,33 @@ err:
     free(ret);
     return NULL;
 }
+bool thread_pinCpu(int cpu)
+{
+    #ifdef __linux__
+    cpu_set_t set;
+    if(cpu < 0 || cpu >= CPU_SETSIZE) {
+        log_err("CPU %d out of range", cpu);
+        return false;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    /* Zero process ID refer to the calling thread */
+    if(sched_setaffinity(0, sizeof(set), &set) < 0) {
+        logp_err("sched_setaffinity");
+        return false;
+    }
+    return true;
+    #else /* __linux__ */
+    log_warning("CPU pinning is not supported");
+    return false;
+    #endif /* __linux__ */
+}
+int thread_numCpus()
+{
+    #ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n > 0)
+        return n;
+    #endif
+    return 1;
+}
@@ -68,4 +68,18 @@ struct thread_t {
  */
 pthread thread_create(const thread_f function, void *cookie);
 
+/**
+ * Pin the calling thread to a single CPU
+ * @param[in] cpu number
+ * @return true on success
+ * @note supported on Linux only
+ */
+bool thread_pinCpu(int cpu);
+
+/**
+ * Get number of online CPUs
+ * @return number of CPUs, at least 1
+ */
+int thread_numCpus();
+
 #endif /* __CSPTP_THREAD_H_ */
@@ -94,6 +94,15 @@ static int64_t t_getTs(pcts self)
     return UNLIKELY_COND(self == NULL) ? 0 :
         self->_ts.tv_sec * NSEC_PER_SEC + self->_ts.tv_nsec;
 }
+static void t_setSrc(pts self, enum ts_src_e src)
+{
+    if(LIKELY_COND(self != NULL))
+        self->_src = src;
+}
+static enum ts_src_e t_getSrc(pcts self)
+{
+    return UNLIKELY_COND(self == NULL) ? TS_SRC_USER : self->_src;
+}
 static void t_assign(pts self, pcts other)
 {
     if(other == NULL)
@@ -102,6 +111,7 @@ static void t_assign(pts self, pcts other)
             other->_ts.tv_nsec >= 0)) {
         self->_ts.tv_sec = other->_ts.tv_sec;
         self->_ts.tv_nsec = other->_ts.tv_nsec;
+        self->_src = other->_src;
     }
 }
 static bool t_eq(pcts self, pcts other)
@@ -175,6 +185,7 @@ pts ts_alloc()
     if(ret != NULL) {
         ret->_ts.tv_sec = 0;
         ret->_ts.tv_nsec = 0;
+        ret->_src = TS_SRC_USER;
 #define asg(a) ret->a = t_##a
         asg(free);
         asg(fromTimespec);
@@ -183,6 +194,8 @@ pts ts_alloc()
         asg(toTimestamp);
         asg(setTs);
         asg(getTs);
+        asg(setSrc);
+        asg(getSrc);
         asg(assign);
         asg(eq);
         asg(less);
@@ -194,6 +207,19 @@ pts ts_alloc()
     return ret;
 }
 
+const char *ts_srcStr(enum ts_src_e src)
+{
+    switch(src) {
+        case TS_SRC_USER:
+            return "user";
+        case TS_SRC_SW:
+            return "software";
+        case TS_SRC_HW:
+            return "hardware";
+        default:
+            return "unknown";
+    }
+}
 uint64_t get_uint48(pcuint48 num)
 {
     return UNLIKELY_COND(num == NULL) ? 0 :
@@ -44,8 +44,16 @@ struct time_zone_t {
     char name[MAX_TZ_LEN];
 };
 
+/** Source of a timestamp */
+enum ts_src_e {
+    TS_SRC_USER = 0, /**> system clock read in user space */
+    TS_SRC_SW = 1, /**> kernel software timestamp */
+    TS_SRC_HW = 2, /**> network interface hardware timestamp */
+};
+
 struct ts_t {
     struct timespec _ts;
+    enum ts_src_e _src; /**> source of timestamp */
 
     /**
      * Free this timestamp object
@@ -97,11 +105,26 @@ struct ts_t {
      */
     int64_t (*getTs)(pcts self);
 
+    /**
+     * Set timestamp source
+     * @param[in, out] self timestamp object
+     * @param[in] src source of timestamp
+     */
+    void (*setSrc)(pts self, enum ts_src_e src);
+
+    /**
+     * Get timestamp source
+     * @param[in] self timestamp object
+     * @return source of timestamp
+     */
+    enum ts_src_e (*getSrc)(pcts self);
+
     /**
      * Copy value from another timestamp
      * @param[in] self timestamp object
      * @param[in] other timestamp object
      * @return true if timestamps are equal
+     * @note copy the timestamp source too
      */
     void (*assign)(pts self, pcts other);
 
@@ -144,12 +167,39 @@ struct ts_t {
     void (*addMilliseconds)(pts self, int milliseconds);
 };
 
+/**
+ * Get timestamp, fast path without the object check
+ * @param[in] self timestamp object
+ * @return timestamp in nanoseconds
+ */
+static inline int64_t ts_getTs(pcts self)
+{
+    return self->_ts.tv_sec * NSEC_PER_SEC + self->_ts.tv_nsec;
+}
+
+/**
+ * Get timestamp source, fast path without the object check
+ * @param[in] self timestamp object
+ * @return source of timestamp
+ */
+static inline enum ts_src_e ts_getSrc(pcts self)
+{
+    return self->_src;
+}
+
 /**
  * Allocate a new timestamp object
  * Return pointer to a new timestamp object or null
  */
 pts ts_alloc();
 
+/**
+ * Get timestamp source name
+ * @param[in] src source of timestamp
+ * @return source name
+ */
+const char *ts_srcStr(enum ts_src_e src);
+
 /**
  * convert UInteger48_t to unsigned 64 bits integer
  * @param[in] num pointer to UInteger48_t
@@ -208,6 +258,7 @@ struct time_zone_t *getLocalTZ();
 static inline void getUtcClock(pts ts)
 {
     clock_gettime(CLOCK_REALTIME, &ts->_ts);
+    ts->_src = TS_SRC_USER;
 }
 
 #endif /* __CSPTP_TIME_H_ */
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief select the transport of the socket object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/transport.h"
+#include "src/memsock.h"
+#include "src/shmsock.h"
+#include "src/log.h"
+
+const char *transport2str(int64_t value)
+{
+    switch(value) {
+        case TRANSPORT_UDP:
+            return "udp";
+        case TRANSPORT_SHM:
+            return "shm";
+        case TRANSPORT_MEMORY:
+            return "memory";
+    }
+    return NULL;
+}
+psock transport_alloc(enum transport_e transport, prot type, const char *path,
+    size_t entries)
+{
+    switch(transport) {
+        case TRANSPORT_UDP:
+            return sock_alloc();
+        case TRANSPORT_SHM:
+            return shmsock_alloc(type, path);
+        case TRANSPORT_MEMORY:
+            return memsock_alloc(type, entries);
+    }
+    log_err("unknown transport %d", transport);
+    return NULL;
+}
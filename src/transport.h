@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief select the transport of the socket object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_TRANSPORT_H_
+#define __CSPTP_TRANSPORT_H_
+
+#include "src/sock.h"
+
+/** Transports of the socket object */
+enum transport_e {
+    TRANSPORT_UDP = 0, /**> BSD UDP socket */
+    TRANSPORT_SHM = 1, /**> shared memory rings with the local service */
+    TRANSPORT_MEMORY = 2, /**> in-memory queue in our process, for the replay */
+};
+
+/**
+ * Get transport name
+ * @param[in] value transport
+ * @return transport name or null
+ */
+const char *transport2str(int64_t value);
+
+/**
+ * Allocate a new socket object of a transport
+ * @param[in] transport to use
+ * @param[in] type of addresses
+ * @param[in] path of the shared memory file, used by the shared memory
+ * @param[in] entries number of datagrams in the in-memory receive queue
+ * @return pointer to a new socket object or null
+ * @note call init() to use the socket as a client,
+ *       or initSrv() to use it as a service
+ */
+psock transport_alloc(enum transport_e transport, prot type, const char *path,
+    size_t entries);
+
+#endif /* __CSPTP_TRANSPORT_H_ */
@@ -0,0 +1,562 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief XDP program answering one step Sync requests in the driver
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "src/xdp.h"
+#include "src/log.h"
+#include "src/swap.h"
+
+#include <errno.h>
+
+#if defined __linux__ && defined HAVE_BPF_XDP && defined HAVE_NET_IF_H
+#define __CSPTP_XDP
+#include <net/if.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+#endif
+
+#ifdef __CSPTP_XDP
+/* Offsets in the frame */
+#define XDP_IP (14) /* IPv4 header, after Ethernet header */
+#define XDP_UDP (34) /* UDP header, after IPv4 header without options */
+#define XDP_PTP (42) /* PTP message, after UDP header */
+#define XDP_TLV (XDP_PTP + sizeof(struct msg_t)) /* First TLV */
+/* Response length without PAD TLV */
+#define XDP_RESP (sizeof(struct msg_t) + sizeof(struct CSPTP_RESPONSE_t))
+/* PAD TLV after the response */
+#define XDP_PAD (XDP_PTP + XDP_RESP)
+/* The program access directly the frame up to the PAD TLV payload */
+#define XDP_FRAME_MIN (XDP_PAD + sizeof(struct tlv_hdr_t))
+#define XDP_TTL (64) /* Time to live of the response */
+#define XDP_INSN_MAX (256) /* Maximum program instructions */
+#define XDP_PASS_MAX (64) /* Maximum jumps to pass the frame to the service */
+#define XDP_LOG_SIZE (0x10000) /* Size of verifier log */
+/* Registers the program keep between helpers calls */
+#define R_CTX BPF_REG_6 /* XDP context */
+#define R_DATA BPF_REG_7 /* frame start */
+#define R_SIZE BPF_REG_8 /* UDP payload length */
+#define R_CLK BPF_REG_9 /* clock information in map */
+/* Stack */
+#define S_KEY (-4) /* map key */
+#define S_RX (-16) /* receive time */
+
+/* Clock information map value, in host order unless marked */
+struct xdp_clk_t {
+    uint64_t utcOffset; /* nanoseconds to subtract from TAI for UTC */
+    uint8_t organizationId[3];
+    uint8_t organizationSubType[3];
+    uint16_t port; /* UDP port in network order */
+    uint8_t zero[XDP_MSG_MAX]; /* Zeros for the PAD TLV */
+};
+
+struct xdp_asm_t {
+    struct bpf_insn insn[XDP_INSN_MAX]; /* program instructions */
+    size_t len; /* number of instructions */
+    size_t pass[XDP_PASS_MAX]; /* jumps to pass label */
+    size_t numPass; /* number of jumps to pass label */
+};
+
+static inline int sys_bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(union bpf_attr));
+}
+static inline void emit(struct xdp_asm_t *a, uint8_t code, uint8_t dst,
+    uint8_t src, int16_t off, int32_t imm)
+{
+    if(a->len < XDP_INSN_MAX) {
+        struct bpf_insn *i = a->insn + a->len;
+        i->code = code;
+        i->dst_reg = dst;
+        i->src_reg = src;
+        i->off = off;
+        i->imm = imm;
+    }
+    a->len++;
+}
+/* Jump to pass label, the offset is set when we reach the label */
+static inline void passJmp(struct xdp_asm_t *a, uint8_t code, uint8_t dst,
+    uint8_t src, int32_t imm)
+{
+    if(a->numPass < XDP_PASS_MAX)
+        a->pass[a->numPass] = a->len;
+    a->numPass++;
+    emit(a, code, dst, src, 0, imm);
+}
+/* Set offset of jump to current instruction */
+static inline void setJmp(struct xdp_asm_t *a, size_t jmp)
+{
+    if(jmp < XDP_INSN_MAX)
+        a->insn[jmp].off = a->len - jmp - 1;
+}
+#define LDX(s, d, r, o) emit(a, BPF_LDX | BPF_MEM | BPF_##s, d, r, o, 0)
+#define STX(s, d, o, r) emit(a, BPF_STX | BPF_MEM | BPF_##s, d, r, o, 0)
+#define ST(s, d, o, i) emit(a, BPF_ST | BPF_MEM | BPF_##s, d, 0, o, i)
+#define ALU(op, d, i) emit(a, BPF_ALU64 | BPF_##op | BPF_K, d, 0, 0, i)
+#define ALUX(op, d, r) emit(a, BPF_ALU64 | BPF_##op | BPF_X, d, r, 0, 0)
+#define BE(d, bits) emit(a, BPF_ALU | BPF_END | BPF_TO_BE, d, 0, 0, bits)
+#define CALL(f) emit(a, BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_##f)
+#define EXIT(r) do{ALU(MOV, BPF_REG_0, r);\
+        emit(a, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);}while(false)
+#define JMP(op, d, i) emit(a, BPF_JMP | BPF_##op | BPF_K, d, 0, 0, i)
+#define PASS(op, d, i) passJmp(a, BPF_JMP | BPF_##op | BPF_K, d, 0, i)
+#define PASSX(op, d, r) passJmp(a, BPF_JMP | BPF_##op | BPF_X, d, r, 0)
+#define R(n) BPF_REG_##n
+#define PTP(f) (XDP_PTP + offsetof(struct msg_t, f))
+#define RESP(f) (XDP_TLV + offsetof(struct CSPTP_RESPONSE_t, f))
+#define CLK(f) offsetof(struct xdp_clk_t, f)
+/* Load the frame pointers and ensure the frame hold the response */
+static inline void loadFrame(struct xdp_asm_t *a)
+{
+    LDX(W, R_DATA, R_CTX, offsetof(struct xdp_md, data));
+    LDX(W, R(2), R_CTX, offsetof(struct xdp_md, data_end));
+    ALUX(MOV, R(1), R_DATA);
+    ALU(ADD, R(1), XDP_FRAME_MIN);
+}
+/* Store the TAI time in register 1 as UTC timestamp in the frame */
+static inline void storeTs(struct xdp_asm_t *a, int16_t off)
+{
+    LDX(DW, R(2), R_CLK, CLK(utcOffset));
+    ALUX(SUB, R(1), R(2));
+    ALUX(MOV, R(2), R(1));
+    ALU(DIV, R(2), NSEC_PER_SEC); /* seconds */
+    ALUX(MOV, R(3), R(2));
+    ALU(MUL, R(3), NSEC_PER_SEC);
+    ALUX(SUB, R(1), R(3)); /* nanoseconds */
+    BE(R(1), 32);
+    STX(W, R_DATA, off + offsetof(struct Timestamp_t, nanosecondsField), R(1));
+    /* Seconds are 48 bits */
+    ALUX(MOV, R(3), R(2));
+    ALU(RSH, R(3), 32);
+    BE(R(3), 16);
+    STX(H, R_DATA, off, R(3));
+    BE(R(2), 32);
+    STX(W, R_DATA, off + 2, R(2));
+}
+/* Fold one's complement sum in register 3 to 16 bits */
+static inline void foldSum(struct xdp_asm_t *a)
+{
+    ALUX(MOV, R(1), R(3));
+    ALU(RSH, R(1), 16);
+    ALU(AND, R(3), UINT16_MAX);
+    ALUX(ADD, R(3), R(1));
+}
+/* Validate the request the same way as msg->parse() */
+static inline void validate(struct xdp_asm_t *a, const struct msg_t *ref)
+{
+    const uint8_t tlvFlags0 = Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv;
+    LDX(B, R(1), R_DATA, PTP(messageType_majorSdoId));
+    PASS(JNE, R(1), ref->messageType_majorSdoId); /* Sync only */
+    LDX(B, R(1), R_DATA, PTP(versionPTP));
+    PASS(JNE, R(1), ref->versionPTP);
+    LDX(H, R(1), R_DATA, PTP(messageLength));
+    BE(R(1), 16);
+    PASSX(JGT, R(1), R_SIZE);
+    PASS(JLT, R(1), sizeof(struct msg_t) + sizeof(struct CSPTP_REQUEST_t));
+    LDX(B, R(1), R_DATA, PTP(minorSdoId));
+    PASS(JNE, R(1), ref->minorSdoId);
+    /* The service answers two steps requests */
+    LDX(B, R(1), R_DATA, PTP(flagField[0]));
+    PASS(JNE, R(1), ref->flagField[0]);
+    LDX(B, R(1), R_DATA, PTP(flagField[1]));
+    PASS(JSET, R(1), 0xc0);
+    LDX(DW, R(1), R_DATA, PTP(sourcePortIdentity.clockIdentity));
+    PASS(JNE, R(1), 0);
+    LDX(H, R(1), R_DATA, PTP(sourcePortIdentity.portNumber));
+    PASS(JNE, R(1), 0);
+    LDX(B, R(1), R_DATA, PTP(controlField));
+    PASS(JNE, R(1), ref->controlField);
+    LDX(B, R(1), R_DATA, PTP(logMessageInterval));
+    PASS(JNE, R(1), ref->logMessageInterval);
+    /* The service handles other TLVs first and optional TLVs */
+    LDX(H, R(1), R_DATA, XDP_TLV + offsetof(struct tlv_hdr_t, tlvType));
+    PASS(JNE, R(1), cpu_to_net16(CSPTP_REQUEST_id));
+    LDX(H, R(1), R_DATA, XDP_TLV + offsetof(struct tlv_hdr_t, lengthField));
+    PASS(JNE, R(1), cpu_to_net16(sizeof(struct CSPTP_REQUEST_t) -
+            sizeof(struct tlv_hdr_t)));
+    LDX(B, R(1), R_DATA, XDP_TLV + offsetof(struct CSPTP_REQUEST_t,
+            tlvRequestFlags));
+    PASS(JSET, R(1), tlvFlags0);
+}
+/* Turn the request to response in place, like the service Sync template */
+static inline void respond(struct xdp_asm_t *a)
+{
+    size_t jmp;
+    /* Swap MAC addresses */
+    LDX(W, R(1), R_DATA, 0);
+    LDX(H, R(2), R_DATA, 4);
+    LDX(W, R(3), R_DATA, 6);
+    LDX(H, R(4), R_DATA, 10);
+    STX(W, R_DATA, 0, R(3));
+    STX(H, R_DATA, 4, R(4));
+    STX(W, R_DATA, 6, R(1));
+    STX(H, R_DATA, 10, R(2));
+    /* Swap IP addresses, the header checksum is the same */
+    LDX(W, R(1), R_DATA, XDP_IP + 12);
+    LDX(W, R(2), R_DATA, XDP_IP + 16);
+    STX(W, R_DATA, XDP_IP + 12, R(2));
+    STX(W, R_DATA, XDP_IP + 16, R(1));
+    /* Set time to live and update the header checksum, RFC 1624 */
+    LDX(H, R(1), R_DATA, XDP_IP + 8);
+    ST(B, R_DATA, XDP_IP + 8, XDP_TTL);
+    LDX(H, R(2), R_DATA, XDP_IP + 8);
+    LDX(H, R(3), R_DATA, XDP_IP + 10);
+    ALU(XOR, R(3), UINT16_MAX);
+    ALU(XOR, R(1), UINT16_MAX);
+    ALUX(ADD, R(3), R(1));
+    ALUX(ADD, R(3), R(2));
+    foldSum(a);
+    foldSum(a);
+    ALU(XOR, R(3), UINT16_MAX);
+    STX(H, R_DATA, XDP_IP + 10, R(3));
+    /* Swap UDP ports, IPv4 UDP checksum is optional */
+    LDX(H, R(1), R_DATA, XDP_UDP);
+    LDX(H, R(2), R_DATA, XDP_UDP + 2);
+    STX(H, R_DATA, XDP_UDP, R(2));
+    STX(H, R_DATA, XDP_UDP + 2, R(1));
+    ST(H, R_DATA, XDP_UDP + 6, 0);
+    /* PTP header, we keep domainNumber, flagField, correctionField
+     * and sequenceId of the request */
+    ALUX(MOV, R(1), R_SIZE);
+    BE(R(1), 16);
+    STX(H, R_DATA, PTP(messageLength), R(1));
+    ST(W, R_DATA, PTP(messageTypeSpecific), 0);
+    /* CSPTP_RESPONSE TLV replace the CSPTP_REQUEST TLV */
+    ST(H, R_DATA, RESP(hdr.tlvType), cpu_to_net16(CSPTP_RESPONSE_id));
+    ST(H, R_DATA, RESP(hdr.lengthField), cpu_to_net16(
+            sizeof(struct CSPTP_RESPONSE_t) - sizeof(struct tlv_hdr_t)));
+    LDX(W, R(1), R_CLK, CLK(organizationId));
+    LDX(H, R(2), R_CLK, CLK(organizationId) + 4);
+    STX(W, R_DATA, RESP(organizationId), R(1));
+    STX(H, R_DATA, RESP(organizationId) + 4, R(2));
+    ST(DW, R_DATA, RESP(reqCorrectionField), 0);
+    LDX(DW, R(1), BPF_REG_10, S_RX);
+    storeTs(a, RESP(reqIngressTimestamp));
+    /* Add PAD TLV to match the request size */
+    ST(H, R_DATA, XDP_PAD + offsetof(struct tlv_hdr_t, tlvType),
+        cpu_to_net16(PAD_id));
+    ALUX(MOV, R(1), R_SIZE);
+    ALU(SUB, R(1), XDP_RESP + sizeof(struct tlv_hdr_t));
+    BE(R(1), 16);
+    STX(H, R_DATA, XDP_PAD + offsetof(struct tlv_hdr_t, lengthField), R(1));
+    jmp = a->len;
+    JMP(JLE, R_SIZE, XDP_RESP + sizeof(struct tlv_hdr_t)); /* Empty PAD */
+    ALUX(MOV, R(1), R_CTX);
+    ALU(MOV, R(2), XDP_FRAME_MIN);
+    ALUX(MOV, R(3), R_CLK);
+    ALU(ADD, R(3), CLK(zero));
+    ALUX(MOV, R(4), R_SIZE);
+    ALU(SUB, R(4), XDP_RESP + sizeof(struct tlv_hdr_t));
+    CALL(xdp_store_bytes);
+    setJmp(a, jmp);
+    /* The helper may invalidate the frame pointers */
+    loadFrame(a);
+    emit(a, BPF_JMP | BPF_JLE | BPF_X, R(1), R(2), 2, 0); /* Skip the exit */
+    EXIT(XDP_ABORTED);
+    CALL(ktime_get_tai_ns);
+    ALUX(MOV, R(1), BPF_REG_0);
+    storeTs(a, PTP(timestamp));
+    EXIT(XDP_TX);
+}
+/* Build the program, all requests we do not answer pass to the service */
+static inline bool buildProg(struct xdp_asm_t *a, int mapFd,
+    const struct msg_t *ref)
+{
+    a->len = 0;
+    a->numPass = 0;
+    ALUX(MOV, R_CTX, BPF_REG_1);
+    CALL(ktime_get_tai_ns);
+    STX(DW, BPF_REG_10, S_RX, BPF_REG_0);
+    loadFrame(a);
+    PASSX(JGT, R(1), R(2));
+    /* Ethernet unicast with IPv4 */
+    LDX(B, R(1), R_DATA, 0);
+    PASS(JSET, R(1), 1);
+    LDX(H, R(1), R_DATA, 12);
+    PASS(JNE, R(1), cpu_to_net16(ETH_P_IP));
+    /* IPv4 header without options, UDP and not fragmented */
+    LDX(B, R(1), R_DATA, XDP_IP);
+    PASS(JNE, R(1), 0x45);
+    LDX(B, R(1), R_DATA, XDP_IP + 9);
+    PASS(JNE, R(1), IPPROTO_UDP);
+    LDX(H, R(1), R_DATA, XDP_IP + 6);
+    PASS(JSET, R(1), cpu_to_net16(0x3fff));
+    /* Clock information */
+    ST(W, BPF_REG_10, S_KEY, 0);
+    ALUX(MOV, R(2), BPF_REG_10);
+    ALU(ADD, R(2), S_KEY);
+    emit(a, BPF_LD | BPF_DW | BPF_IMM, R(1), BPF_PSEUDO_MAP_FD, 0, mapFd);
+    emit(a, 0, 0, 0, 0, 0);
+    CALL(map_lookup_elem);
+    PASS(JEQ, BPF_REG_0, 0);
+    ALUX(MOV, R_CLK, BPF_REG_0);
+    /* UDP destination port */
+    LDX(H, R(1), R_DATA, XDP_UDP + 2);
+    LDX(H, R(2), R_CLK, CLK(port));
+    PASSX(JNE, R(1), R(2));
+    /* UDP length match the IP length */
+    LDX(H, R_SIZE, R_DATA, XDP_UDP + 4);
+    BE(R_SIZE, 16);
+    LDX(H, R(1), R_DATA, XDP_IP + 2);
+    BE(R(1), 16);
+    ALU(SUB, R(1), XDP_UDP - XDP_IP);
+    PASSX(JNE, R_SIZE, R(1));
+    /* Response size, the same as the request size, see padRespSync()
+     * The frame holds the PAD TLV header, shorter requests pass */
+    ALU(SUB, R_SIZE, XDP_PTP - XDP_UDP);
+    PASS(JSET, R_SIZE, 1); /* The verifier drops the range on bit test */
+    PASS(JGT, R_SIZE, XDP_MSG_MAX);
+    PASS(JLT, R_SIZE, XDP_RESP + sizeof(struct tlv_hdr_t));
+    ALUX(MOV, R(1), R_DATA);
+    ALUX(ADD, R(1), R_SIZE);
+    ALU(ADD, R(1), XDP_PTP);
+    LDX(W, R(2), R_CTX, offsetof(struct xdp_md, data_end));
+    PASSX(JGT, R(1), R(2));
+    validate(a, ref);
+    respond(a);
+    for(size_t i = 0; i < a->numPass && i < XDP_PASS_MAX; i++)
+        setJmp(a, a->pass[i]);
+    EXIT(XDP_PASS);
+    if(a->len > XDP_INSN_MAX || a->numPass > XDP_PASS_MAX) {
+        log_err("XDP program is too long");
+        return false;
+    }
+    return true;
+}
+#undef LDX
+#undef STX
+#undef ST
+#undef ALU
+#undef ALUX
+#undef BE
+#undef CALL
+#undef EXIT
+#undef JMP
+#undef PASS
+#undef PASSX
+#undef R
+#undef PTP
+#undef RESP
+#undef CLK
+/* Sync header fields with fixed values, as msg->init() set them */
+static inline bool refHeader(struct msg_t *ref)
+{
+    bool ret;
+    struct ptp_params_t prms;
+    pbuffer b = buffer_alloc(sizeof(struct msg_t));
+    pmsg m = msg_alloc();
+    memset(&prms, 0, sizeof(struct ptp_params_t));
+    prms.type = Sync;
+    ret = b != NULL && m != NULL && m->init(m, &prms, b);
+    if(ret)
+        memcpy(ref, b->getBuf(b), sizeof(struct msg_t));
+    if(b != NULL)
+        b->free(b);
+    if(m != NULL)
+        m->free(m);
+    return ret;
+}
+static inline bool createMap(pxdp self)
+{
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(union bpf_attr));
+    attr.map_type = BPF_MAP_TYPE_ARRAY;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(struct xdp_clk_t);
+    attr.max_entries = 1;
+    strncpy(attr.map_name, "csptp_clock", BPF_OBJ_NAME_LEN - 1);
+    self->_mapFd = sys_bpf(BPF_MAP_CREATE, &attr);
+    if(self->_mapFd < 0) {
+        logp_err("BPF_MAP_CREATE");
+        return false;
+    }
+    return true;
+}
+static inline bool loadProg(pxdp self)
+{
+    char *log;
+    struct msg_t ref;
+    union bpf_attr attr;
+    struct xdp_asm_t *a;
+    if(!refHeader(&ref))
+        return false;
+    a = malloc(sizeof(struct xdp_asm_t));
+    if(a == NULL) {
+        log_err("memory allocation failed");
+        return false;
+    }
+    if(!buildProg(a, self->_mapFd, &ref)) {
+        free(a);
+        return false;
+    }
+    memset(&attr, 0, sizeof(union bpf_attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uintptr_t)a->insn;
+    attr.insn_cnt = a->len;
+    attr.license = (uintptr_t)"GPL";
+    strncpy(attr.prog_name, "csptp_sync", BPF_OBJ_NAME_LEN - 1);
+    self->_progFd = sys_bpf(BPF_PROG_LOAD, &attr);
+    if(self->_progFd < 0) {
+        logp_err("BPF_PROG_LOAD");
+        /* Load again to fetch the verifier log */
+        log = malloc(XDP_LOG_SIZE);
+        if(log != NULL) {
+            *log = 0;
+            attr.log_buf = (uintptr_t)log;
+            attr.log_size = XDP_LOG_SIZE;
+            attr.log_level = 1;
+            self->_progFd = sys_bpf(BPF_PROG_LOAD, &attr);
+            log_debug("verifier: %s", log);
+            free(log);
+        }
+    }
+    free(a);
+    return self->_progFd >= 0;
+}
+static inline bool linkProg(pxdp self, const char *ifName)
+{
+    union bpf_attr attr;
+    unsigned int ifIndex = if_nametoindex(ifName);
+    if(ifIndex == 0) {
+        logp_err("if_nametoindex %s", ifName);
+        return false;
+    }
+    memset(&attr, 0, sizeof(union bpf_attr));
+    attr.link_create.prog_fd = self->_progFd;
+    attr.link_create.target_ifindex = ifIndex;
+    attr.link_create.attach_type = BPF_XDP;
+    self->_linkFd = sys_bpf(BPF_LINK_CREATE, &attr);
+    if(self->_linkFd < 0) {
+        logp_err("BPF_LINK_CREATE %s", ifName);
+        return false;
+    }
+    return true;
+}
+/* Kernel TAI offset in nanoseconds, rounded to seconds */
+static inline int64_t utcOffset()
+{
+    int64_t d;
+    struct timespec tai, utc;
+    clock_gettime(CLOCK_REALTIME, &utc);
+    clock_gettime(CLOCK_TAI, &tai);
+    d = (int64_t)(tai.tv_sec - utc.tv_sec) * NSEC_PER_SEC +
+        tai.tv_nsec - utc.tv_nsec + NSEC_PER_SEC / 2;
+    return d - d % NSEC_PER_SEC;
+}
+#endif /* __CSPTP_XDP */
+
+static bool s_detach(pxdp self)
+{
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+#define CLOSE(a) do{if(self->a >= 0){close(self->a);self->a = -1;}}while(false)
+    CLOSE(_linkFd);
+    CLOSE(_progFd);
+    CLOSE(_mapFd);
+#undef CLOSE
+    self->_updated = false;
+    return true;
+}
+static void s_free(pxdp self)
+{
+    if(self != NULL) {
+        s_detach(self);
+        free(self);
+    }
+}
+static bool s_attach(pxdp self, const char *ifName, uint16_t port)
+{
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    if(ifName == NULL) {
+        log_err("interface name does not exist");
+        return false;
+    }
+    if(self->_linkFd >= 0) {
+        log_err("XDP program is already attached");
+        return false;
+    }
+#ifdef __CSPTP_XDP
+    self->_port = port;
+    if(createMap(self) && loadProg(self) && linkProg(self, ifName))
+        return true;
+    s_detach(self);
+#else /* __CSPTP_XDP */
+    log_warning("XDP is not supported");
+#endif /* __CSPTP_XDP */
+    return false;
+}
+static bool s_update(pxdp self, const struct ifClk_t *clk)
+{
+#ifdef __CSPTP_XDP
+    int64_t offset;
+    uint32_t key = 0;
+    union bpf_attr attr;
+    struct xdp_clk_t v;
+#endif /* __CSPTP_XDP */
+    if(UNLIKELY_COND(self == NULL))
+        return false;
+    if(clk == NULL) {
+        log_err("clock information does not exist");
+        return false;
+    }
+    if(self->_mapFd < 0) {
+        log_err("XDP program is not attached");
+        return false;
+    }
+#ifdef __CSPTP_XDP
+    offset = utcOffset();
+    if(self->_updated && self->_generation == clk->generation &&
+        self->_utcOffset == offset)
+        return true;
+    memset(&v, 0, sizeof(struct xdp_clk_t));
+    v.utcOffset = offset;
+    memcpy(v.organizationId, clk->organizationId, 3);
+    memcpy(v.organizationSubType, clk->organizationSubType, 3);
+    v.port = cpu_to_net16(self->_port);
+    memset(&attr, 0, sizeof(union bpf_attr));
+    attr.map_fd = self->_mapFd;
+    attr.key = (uintptr_t)&key;
+    attr.value = (uintptr_t)&v;
+    attr.flags = BPF_ANY;
+    if(sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        logp_err("BPF_MAP_UPDATE_ELEM");
+        return false;
+    }
+    self->_generation = clk->generation;
+    self->_utcOffset = offset;
+    self->_updated = true;
+    return true;
+#else /* __CSPTP_XDP */
+    return false;
+#endif /* __CSPTP_XDP */
+}
+pxdp xdp_alloc()
+{
+    pxdp ret = malloc(sizeof(struct xdp_t));
+    if(ret != NULL) {
+        ret->_progFd = -1;
+        ret->_mapFd = -1;
+        ret->_linkFd = -1;
+        ret->_port = 0;
+        ret->_generation = 0;
+        ret->_utcOffset = 0;
+        ret->_updated = false;
+#define asg(a) ret->a = s_##a
+        asg(free);
+        asg(attach);
+        asg(update);
+        asg(detach);
+#undef asg
+    } else
+        log_err("memory allocation failed");
+    return ret;
+}
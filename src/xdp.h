@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief XDP program answering one step Sync requests in the driver
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifndef __CSPTP_XDP_H_
+#define __CSPTP_XDP_H_
+
+#include "src/cmdl.h"
+
+/** Largest request the XDP program answers, longer go to the service */
+#define XDP_MSG_MAX (256)
+
+typedef struct xdp_t *pxdp;
+
+struct xdp_t {
+    int _progFd; /**> XDP program */
+    int _mapFd; /**> map with the clock information */
+    int _linkFd; /**> link of the program to the interface */
+    uint16_t _port; /**> UDP port the program answers */
+    uint32_t _generation; /**> clock information generation in the map */
+    int64_t _utcOffset; /**> TAI to UTC offset in the map */
+    bool _updated; /**> map holds the clock information */
+
+    /**
+     * Free this XDP object
+     * @param[in, out] self XDP object
+     * @note detach the program from the interface
+     */
+    void (*free)(pxdp self);
+
+    /**
+     * Load the program and attach it to an interface
+     * @param[in, out] self XDP object
+     * @param[in] ifName interface name
+     * @param[in] port UDP port of the service
+     * @return true on success
+     * @note the program answers after update() fills the clock information
+     * @note answer IPv4 one step Sync requests, without CSPTP_STATUS or
+     *       ALTERNATE_TIME_OFFSET_INDICATOR TLVs, pass all other
+     * @note Linux only, kernel 6.1 or newer, require CAP_BPF and CAP_NET_ADMIN
+     */
+    bool (*attach)(pxdp self, const char *ifName, uint16_t port);
+
+    /**
+     * Update the clock information the program use
+     * @param[in, out] self XDP object
+     * @param[in] clk clock information
+     * @return true on success
+     * @note update the map only when the clock information generation
+     *       or the system TAI offset change
+     */
+    bool (*update)(pxdp self, const struct ifClk_t *clk);
+
+    /**
+     * Detach the program and release its resources
+     * @param[in, out] self XDP object
+     * @return true on success
+     */
+    bool (*detach)(pxdp self);
+};
+
+/**
+ * Allocate a new XDP object
+ * @return pointer to a new XDP object or null
+ */
+pxdp xdp_alloc();
+
+#endif /* __CSPTP_XDP_H_ */
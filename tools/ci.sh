@@ -31,11 +31,13 @@ run_ci()
  tools/probe.sh
  make CFLAGS=-Werror utest
  make CFLAGS=-Werror
+ make pgo
  out "Build with Clang"
  make clean
  CC=clang tools/probe.sh
  make CFLAGS=-Werror CC=clang CXX=clang++ utest
  make CFLAGS=-Werror CC=clang CXX=clang++
+ make CC=clang pgo
 }
 main()
 {
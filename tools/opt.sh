@@ -0,0 +1,157 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-3.0-or-later
+# SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com>
+#
+# Optimized builds
+#  release: optimized with link time optimization
+#  pgo: release build using the profile of the csptp_train workload
+# Each build is compared with the debug build, size and speed
+#
+# @author Erez Geva <ErezGeva2@@gmail.com>
+# @copyright © 2025 Erez Geva
+#
+###############################################################################
+# build <name> <flags>
+# Build the objects and the binaries in their own directory
+build()
+{
+ local -r dir="$out_dir/$1"
+ shift
+ local n o
+ local -a objs
+ mkdir -p "$dir"
+ rm -f "$dir"/*.o "$dir"/csptp*
+ for n in src/*.c; do
+   o="$dir/$(basename "$n" .c).o"
+   $CC $base_flags "$@" -c "$n" -o "$o"
+   objs+=("$o")
+ done
+ # The archive holds the link time optimization objects as well
+ $AR cr "$dir/csptp.a" "${objs[@]}"
+ for n in $bins; do
+   printf 'int main(int argc,char**argv){return %s(argc,argv);}' \
+     "${n}_main" |\
+   $CC $base_flags "$@" -include src/main.h -c -x c - -o "$dir/$n.o"
+   $CC "$@" "$dir/$n.o" "$dir/csptp.a" -o "$dir/csptp_$n"
+ done
+}
+# train <name>
+# Run the workload, print the requests per second of each phase
+train()
+{
+ "$out_dir/$1/csptp_train" $requests | sed "s/^/$1: /"
+}
+# sizes <name>
+# Print the code size of the binaries
+sizes()
+{
+ local n
+ for n in $bins; do
+   printf "%s: %-14s %8d bytes text %8d bytes file\n" "$1" "csptp_$n"\
+     $(size -A "$out_dir/$1/csptp_$n" | awk '$1==".text"{print $2}')\
+     $(stat -c %s "$out_dir/$1/csptp_$n")
+ done
+}
+report()
+{
+ local n
+ for n in "$@"; do
+   sizes $n
+ done
+ for n in "$@"; do
+   train $n
+ done
+}
+# llvm_tool <name>
+# Find the LLVM tool matching the clang version
+llvm_tool()
+{
+ local -r ver="$($CC --version | sed -n 's/.*clang version \([0-9]*\).*/\1/p')"
+ local n
+ for n in $1-$ver $1; do
+   if command -v $n > /dev/null; then
+     echo $n
+     return
+   fi
+ done
+ echo "$1 is missing" >&2
+ exit 1
+}
+pgo()
+{
+ local -r gen="$out_dir/pgo-gen"
+ out "Build instrumented with $CC"
+ if $use_clang; then
+   build pgo-gen $opt_flags -fprofile-instr-generate
+ else
+   build pgo-gen $opt_flags -fprofile-generate -fprofile-update=single
+ fi
+ out "Train"
+ rm -f "$gen"/*.gcda "$gen"/*.profraw
+ LLVM_PROFILE_FILE="$gen/train-%p.profraw" "$gen/csptp_train" $requests
+ out "Build with profile"
+ if $use_clang; then
+   $(llvm_tool llvm-profdata) merge -o "$gen/csptp.profdata" "$gen"/*.profraw
+   build pgo $opt_flags -fprofile-instr-use="$gen/csptp.profdata"
+ else
+   # The gcc profile follows the objects names, copy it to our objects
+   mkdir -p "$out_dir/pgo"
+   rm -f "$out_dir/pgo"/*.gcda
+   cp "$gen"/*.gcda "$out_dir/pgo"
+   # Keep optimizing the code the workload does not run,
+   # like the packet ring and io_uring
+   build pgo $opt_flags -fprofile-use -fprofile-partial-training\
+     -Wno-missing-profile
+ fi
+}
+out()
+{
+ printf "==== %s ====\n" "$@"
+}
+main()
+{
+ local -r base_dir="$(realpath "$(dirname "$0")/..")"
+ cd "$base_dir"
+ [[ -n "$CC" ]] || local -r CC=cc
+ local -r out_dir=opt bins='service client train'
+ # Requests of each phase of the workload, empty for the default
+ local -r requests=$TRAIN_REQUESTS
+ local use_clang=false opt_flags='-O2'
+ source version
+ local -r base_flags="-I. -Wall -std=gnu11 -DVERSION=\"$maj_ver.$min_ver\" -include config.h"
+ if $CC --version | grep -q clang; then
+   use_clang=true
+   local -r AR=$(llvm_tool llvm-ar)
+   opt_flags+=' -flto=thin'
+   if command -v ld.lld > /dev/null; then
+     opt_flags+=' -fuse-ld=lld'
+   fi
+ else
+   local -r AR=gcc-ar
+   opt_flags+=' -flto=auto'
+ fi
+ [[ -f config.h ]] || CC=$CC tools/probe.sh
+ set -e # Exit with error
+ case "$1" in
+   release)
+     out "Build debug and release with $CC"
+     build debug -g
+     build release $opt_flags
+     out "Compare"
+     report debug release
+     ;;
+   pgo)
+     out "Build debug and release with $CC"
+     build debug -g
+     build release $opt_flags
+     pgo
+     out "Compare"
+     report debug release pgo
+     ;;
+   *)
+     echo "Usage: $0 release|pgo" >&2
+     exit 1
+     ;;
+ esac
+}
+main "$@"
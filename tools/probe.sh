@@ -33,10 +33,12 @@ probe_headers()
   local list='stdbool threads'
   # POSIX headers
   list+=' unistd pthread syslog strings fcntl poll
-         netdb endian sys/stat sys/socket sys/types
+         netdb endian sys/stat sys/socket sys/types sys/mman sys/un
+         sys/resource
          arpa/inet net/if netinet/in'
   # GNU headers
-  list+=' ifaddrs getopt sys/ioctl'
+  list+=' ifaddrs getopt sys/ioctl sys/epoll sys/timerfd sys/signalfd
+         sys/eventfd'
   local n m u
   for n in $list; do
   # u=${n^^} BASH 4
@@ -52,6 +54,10 @@ probe_headers()
   probe_func 'DECL_REALPATH' 'stdlib' 'char b[1],*a=realpath("X",b)'
   probe_func 'DECL_HTONLL' 'arpa/inet' 'uint64_t v,r=htonll(v)'
   probe_func 'TM_GMTOFF' 'time' 'struct tm l;long o=l.tm_gmtoff'
+  probe_func 'IO_URING' 'sys/syscall linux/io_uring'\
+    'struct io_uring_recvmsg_out o;struct io_uring_buf_reg r;long n=__NR_io_uring_setup+IORING_RECV_MULTISHOT'
+  probe_func 'BPF_XDP' 'linux/bpf'\
+    'union bpf_attr a;a.link_create.attach_type=BPF_XDP;int n=BPF_FUNC_ktime_get_tai_ns+BPF_FUNC_xdp_store_bytes'
   echo "#endif" >> $out_h
   rm -f $temp_c
 }
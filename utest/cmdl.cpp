@@ -132,14 +132,35 @@ TEST(cmdlTest, service)
       "-r", "2",
       "-t", "2",
       "-6",
+      "-b", "16",
+      "-u",
+      "-p",
+      "-x",
+      "-q", "100",
+      "-g", "5000",
+      "-m", "/tmp/csptp.stats",
+      "-T", "shm",
+      "-S", "/dev/shm/csptp.test",
       nullptr
   };
   struct service_opt o;
-  EXPECT_EQ(CMD_OK, cmd_service(12, (char **)a, &o));
-  EXPECT_TRUE(o.useRxTwoSteps);
+  EXPECT_EQ(CMD_OK, cmd_service(27, (char **)a, &o));
   EXPECT_TRUE(o.useRxTwoSteps);
+  EXPECT_TRUE(o.useTxTwoSteps);
   EXPECT_STREQ(o.ifName, "eth0");
   EXPECT_EQ(o.type, UDP_IPv6);
+  EXPECT_EQ(o.batchSize, 16);
+  EXPECT_TRUE(o.useUring);
+  EXPECT_TRUE(o.usePacket);
+  EXPECT_TRUE(o.useXdp);
+  EXPECT_EQ(o.clientRate, 100);
+  EXPECT_EQ(o.clientBurst, 8);
+  EXPECT_EQ(o.rate, 5000);
+  EXPECT_EQ(o.storeBits, 14);
+  EXPECT_STREQ(o.statsSocket, "/tmp/csptp.stats");
+  EXPECT_EQ(o.statsWindow, 60);
+  EXPECT_EQ(o.transport, TRANSPORT_SHM);
+  EXPECT_STREQ(o.shmPath, "/dev/shm/csptp.test");
 }
 
 // Test service version
@@ -183,6 +204,14 @@ TEST(cmdlTest, serviceErr)
   struct service_opt o;
   useTestMode(true);
   EXPECT_EQ(CMD_ERR, cmd_service(3, (char **)a_e, &o));
+  // The in-memory transport is used by the replay only
+  const char *a_m[] = {
+      "service",
+      "-T", "memory",
+      nullptr
+  };
+  useTestMode(true);
+  EXPECT_EQ(CMD_ERR, cmd_service(3, (char **)a_m, &o));
   useTestMode(false);
 }
 
@@ -201,10 +230,11 @@ TEST(cmdlTest, client)
       "-4",
       "-d", "4.3.2.1",
       "-n", "137",
+      "-T", "1",
       nullptr
   };
   struct client_opt o;
-  EXPECT_EQ(CMD_OK, cmd_client(15, (char **)a, &o));
+  EXPECT_EQ(CMD_OK, cmd_client(17, (char **)a, &o));
   EXPECT_EQ(o.type, UDP_IPv4);
   EXPECT_FALSE(o.useTwoSteps);
   EXPECT_TRUE(o.useCSPTPstatus);
@@ -212,6 +242,8 @@ TEST(cmdlTest, client)
   EXPECT_STREQ(o.ip, "4.3.2.1");
   EXPECT_STREQ(o.ifName, "eth0");
   EXPECT_EQ(o.domainNumber, 137);
+  EXPECT_EQ(o.transport, TRANSPORT_SHM);
+  EXPECT_STREQ(o.shmPath, "/dev/shm/csptp");
 }
 
 // Test client version
@@ -257,3 +289,141 @@ TEST(cmdlTest, clientErr)
   EXPECT_EQ(CMD_ERR, cmd_client(3, (char **)a_e, &o));
   useTestMode(false);
 }
+
+// Test load generator command line parsing
+TEST(cmdlTest, loadgen)
+{
+  const char *a[] = {
+      "loadgen",
+      "-y",
+      "-e",
+      "-l", "3",
+      "-4",
+      "-d", "127.0.0.1",
+      "-n", "137",
+      "-c", "20000",
+      "-A", "16",
+      "-r", "50000",
+      "-p",
+      "-D", "30",
+      "-w", "200",
+      "-t", "50",
+      "-s", "25",
+      "-a", "10",
+      nullptr
+  };
+  struct loadgen_opt o;
+  EXPECT_EQ(CMD_OK, cmd_loadgen(27, (char **)a, &o));
+  EXPECT_EQ(o.type, UDP_IPv4);
+  EXPECT_STREQ(o.ip, "127.0.0.1");
+  EXPECT_EQ(o.domainNumber, 137);
+  EXPECT_EQ(o.clients, 20000);
+  EXPECT_EQ(o.addresses, 16);
+  EXPECT_EQ(o.rate, 50000);
+  EXPECT_TRUE(o.usePoisson);
+  EXPECT_EQ(o.duration, 30);
+  EXPECT_EQ(o.timeout, 200);
+  EXPECT_EQ(o.twoStepsPct, 50);
+  EXPECT_EQ(o.statusPct, 25);
+  EXPECT_EQ(o.altTimePct, 10);
+}
+
+// Test load generator defaults
+TEST(cmdlTest, loadgenDefault)
+{
+  const char *a[] = {
+      "loadgen",
+      "-d", "127.0.0.1",
+      nullptr
+  };
+  struct loadgen_opt o;
+  EXPECT_EQ(CMD_OK, cmd_loadgen(3, (char **)a, &o));
+  EXPECT_EQ(o.type, Invalid_PROTO);
+  EXPECT_EQ(o.domainNumber, 128);
+  EXPECT_EQ(o.clients, 1000);
+  EXPECT_EQ(o.addresses, 1);
+  EXPECT_EQ(o.rate, 1000);
+  EXPECT_FALSE(o.usePoisson);
+  EXPECT_EQ(o.duration, 10);
+  EXPECT_EQ(o.timeout, 1000);
+  EXPECT_EQ(o.twoStepsPct, 0);
+  EXPECT_EQ(o.statusPct, 0);
+  EXPECT_EQ(o.altTimePct, 0);
+}
+
+// Test load generator error
+TEST(cmdlTest, loadgenErr)
+{
+  const char *a_e[] = {
+      "loadgen",
+      "-t", "101",
+      nullptr
+  };
+  struct loadgen_opt o;
+  useTestMode(true);
+  EXPECT_EQ(CMD_ERR, cmd_loadgen(3, (char **)a_e, &o));
+  useTestMode(false);
+}
+
+// Test replay command line parsing
+TEST(cmdlTest, replay)
+{
+  const char *a[] = {
+      "replay",
+      "-y",
+      "-e",
+      "-p", "/tmp/requests.pcapng",
+      "-o", "/tmp/responses.pcap",
+      "-r", "1",
+      "-t", "1",
+      "-6",
+      "-b", "32",
+      "-P", "31900",
+      "-n", "10",
+      nullptr
+  };
+  struct replay_opt o;
+  EXPECT_EQ(CMD_OK, cmd_replay(18, (char **)a, &o));
+  EXPECT_STREQ(o.input, "/tmp/requests.pcapng");
+  EXPECT_STREQ(o.output, "/tmp/responses.pcap");
+  EXPECT_FALSE(o.useRxTwoSteps);
+  EXPECT_FALSE(o.useTxTwoSteps);
+  EXPECT_EQ(o.type, UDP_IPv6);
+  EXPECT_EQ(o.batchSize, 32);
+  EXPECT_EQ(o.port, 31900);
+  EXPECT_EQ(o.loops, 10);
+}
+
+// Test replay defaults
+TEST(cmdlTest, replayDefault)
+{
+  const char *a[] = {
+      "replay",
+      "-p", "requests.pcap",
+      nullptr
+  };
+  struct replay_opt o;
+  EXPECT_EQ(CMD_OK, cmd_replay(3, (char **)a, &o));
+  EXPECT_STREQ(o.output, "");
+  EXPECT_TRUE(o.useRxTwoSteps);
+  EXPECT_TRUE(o.useTxTwoSteps);
+  EXPECT_EQ(o.type, UDP_IPv4);
+  EXPECT_EQ(o.batchSize, 1);
+  EXPECT_EQ(o.port, 320);
+  EXPECT_EQ(o.loops, 1);
+}
+
+// Test replay without a capture file
+TEST(cmdlTest, replayErr)
+{
+  const char *a_e[] = {
+      "replay",
+      "-b", "32",
+      nullptr
+  };
+  struct replay_opt o;
+  useTestMode(true);
+  EXPECT_EQ(CMD_ERR, cmd_replay(3, (char **)a_e, &o));
+  EXPECT_STREQ(getOut(), "option '-p' is mandatory\n");
+  useTestMode(false);
+}
@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief test log-linear histogram of latency
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+extern "C" {
+#include "src/hist.h"
+}
+
+// Test buckets of values
+// size_t hist_index(uint64_t value)
+TEST(histTest, index)
+{
+  EXPECT_EQ(hist_index(0), 0);
+  EXPECT_EQ(hist_index(63), 63);
+  EXPECT_EQ(hist_index(64), 64);
+  EXPECT_EQ(hist_index(65), 64);
+  EXPECT_EQ(hist_index(66), 65);
+  EXPECT_EQ(hist_index(127), 95);
+  EXPECT_EQ(hist_index(128), 96);
+  EXPECT_EQ(hist_index(131), 96);
+  EXPECT_EQ(hist_index(132), 97);
+  EXPECT_EQ(hist_index((UINT64_C(1) << HIST_MAX_BITS) - 1), HIST_BUCKETS - 1);
+  EXPECT_EQ(hist_index(UINT64_C(1) << HIST_MAX_BITS), HIST_BUCKETS - 1);
+  EXPECT_EQ(hist_index(UINT64_MAX), HIST_BUCKETS - 1);
+  // Buckets are sorted
+  size_t last = 0;
+  for(uint64_t v = 1; v < (UINT64_C(1) << 20); v += 7) {
+    size_t i = hist_index(v);
+    EXPECT_GE(i, last);
+    last = i;
+  }
+}
+
+// Test recording values and percentiles
+// phist hist_alloc()
+// void free(phist self)
+// void clear(phist self)
+// uint64_t count(pchist self)
+// uint64_t sum(pchist self)
+// uint64_t max(pchist self)
+// uint64_t value(pchist self, double percentile)
+// void hist_record(phist self, uint64_t value)
+TEST(histTest, value)
+{
+  phist h = hist_alloc();
+  ASSERT_NE(h, nullptr);
+  EXPECT_EQ(h->count(h), 0);
+  EXPECT_EQ(h->value(h, 50), 0);
+  // 1 to 1000 microseconds
+  for(uint64_t v = 1; v <= 1000; v++)
+    hist_record(h, v * 1000);
+  EXPECT_EQ(h->count(h), 1000);
+  EXPECT_EQ(h->sum(h), 500500000);
+  EXPECT_EQ(h->max(h), 1000000);
+  // Relative error is below 1 / 32
+  uint64_t v = h->value(h, 50);
+  EXPECT_GE(v, 500000);
+  EXPECT_LT(v, 500000 + 500000 / HIST_SUB);
+  v = h->value(h, 99);
+  EXPECT_GE(v, 990000);
+  EXPECT_LT(v, 990000 + 990000 / HIST_SUB);
+  EXPECT_EQ(h->value(h, 100), 1000000);
+  EXPECT_EQ(h->value(h, 0), 1007); // Highest value in the bucket of 1000
+  // Small values are exact
+  h->clear(h);
+  EXPECT_EQ(h->count(h), 0);
+  EXPECT_EQ(h->max(h), 0);
+  hist_record(h, 3);
+  hist_record(h, 5);
+  hist_record(h, 7);
+  hist_record(h, 40);
+  EXPECT_EQ(h->value(h, 50), 5);
+  EXPECT_EQ(h->value(h, 75), 7);
+  EXPECT_EQ(h->value(h, 99.9), 40);
+  h->free(h);
+}
+
+// Test merge and difference of histograms
+// void add(phist self, pchist other)
+// void sub(phist self, pchist other)
+TEST(histTest, merge)
+{
+  phist a = hist_alloc();
+  ASSERT_NE(a, nullptr);
+  phist b = hist_alloc();
+  ASSERT_NE(b, nullptr);
+  phist t = hist_alloc();
+  ASSERT_NE(t, nullptr);
+  for(int i = 0; i < 10; i++) {
+    hist_record(a, 10);
+    hist_record(b, 20);
+  }
+  hist_record(b, 5000);
+  t->add(t, a);
+  t->add(t, b);
+  EXPECT_EQ(t->count(t), 21);
+  EXPECT_EQ(t->sum(t), 5300);
+  EXPECT_EQ(t->max(t), 5000);
+  EXPECT_EQ(t->value(t, 40), 10);
+  EXPECT_EQ(t->value(t, 90), 20);
+  EXPECT_EQ(t->value(t, 100), 5000);
+  // Window of new values
+  phist w = hist_alloc();
+  ASSERT_NE(w, nullptr);
+  hist_record(a, 30);
+  hist_record(a, 40);
+  w->add(w, a);
+  w->add(w, b);
+  w->sub(w, t);
+  EXPECT_EQ(w->count(w), 2);
+  EXPECT_EQ(w->sum(w), 70);
+  EXPECT_EQ(w->value(w, 50), 30);
+  EXPECT_EQ(w->max(w), 40);
+  // Empty window
+  t->clear(t);
+  t->add(t, a);
+  t->add(t, b);
+  w->clear(w);
+  w->add(w, t);
+  w->sub(w, t);
+  EXPECT_EQ(w->count(w), 0);
+  EXPECT_EQ(w->max(w), 0);
+  a->free(a);
+  b->free(b);
+  t->free(t);
+  w->free(w);
+}
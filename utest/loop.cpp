@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief test event loop object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#ifdef __GNUC__
+#ifndef __clang__
+// Somehow GCC C++ fail to understand C `atomic_bool`
+// Anyhow, these varibles are used internaly in C only!!
+typedef std::atomic<bool> atomic_bool;
+#endif /* __clang__ */
+#endif /* __GNUC__ */
+
+extern "C" {
+#include "src/loop.h"
+}
+
+#include <signal.h>
+
+static bool readFd(ploop loop, int events, void *cookie)
+{
+  int *fds = (int *)cookie;
+  char c;
+  EXPECT_EQ(events, LOOP_IN);
+  EXPECT_EQ(read(fds[0], &c, 1), 1);
+  return c != 'q';
+}
+static bool timer(ploop loop, int events, void *cookie)
+{
+  int *count = (int *)cookie;
+  EXPECT_EQ(events, 0);
+  (*count)++;
+  return *count < 2;
+}
+static bool sig(ploop loop, int events, void *cookie)
+{
+  *(bool *)cookie = true;
+  return true;
+}
+
+// Test event loop file descriptors
+// ploop loop_alloc()
+// void free(ploop self)
+// int addFd(ploop self, int fd, int events, const loop_f function, void *cookie)
+// bool del(ploop self, int id)
+// bool runOnce(ploop self, int timeout)
+TEST(loopTest, fd)
+{
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  ploop l = loop_alloc();
+  ASSERT_NE(l, nullptr);
+  int id = l->addFd(l, fds[0], LOOP_IN, readFd, fds);
+  EXPECT_GE(id, 0);
+  EXPECT_TRUE(l->runOnce(l, 0)); // Nothing to read
+  EXPECT_EQ(write(fds[1], "a", 1), 1);
+  EXPECT_TRUE(l->runOnce(l, 100));
+  EXPECT_EQ(write(fds[1], "q", 1), 1);
+  EXPECT_FALSE(l->runOnce(l, 100)); // Call back stop the loop
+  EXPECT_TRUE(l->del(l, id));
+  EXPECT_FALSE(l->del(l, id));
+  l->free(l);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// Test event loop timers
+// int addTimer(ploop self, int interval, const loop_f function, void *cookie)
+// void run(ploop self)
+TEST(loopTest, timer)
+{
+  int count = 0;
+  ploop l = loop_alloc();
+  ASSERT_NE(l, nullptr);
+  EXPECT_LT(l->addTimer(l, 0, timer, &count), 0);
+  EXPECT_GE(l->addTimer(l, 5, timer, &count), 0);
+  l->run(l); // Timer stop after 2 calls
+  EXPECT_EQ(count, 2);
+  l->free(l);
+}
+
+// Test event loop signals
+// int addSignal(ploop self, int signal, const loop_f function, void *cookie)
+// void stop(ploop self)
+TEST(loopTest, signal)
+{
+  bool got = false;
+  ploop l = loop_alloc();
+  ASSERT_NE(l, nullptr);
+  EXPECT_GE(l->addSignal(l, SIGUSR1, sig, &got), 0);
+  EXPECT_EQ(raise(SIGUSR1), 0);
+  EXPECT_TRUE(l->runOnce(l, 100));
+  EXPECT_TRUE(got);
+  l->stop(l);
+  EXPECT_FALSE(l->runOnce(l, 100));
+  l->free(l);
+}
@@ -11,8 +11,19 @@
 
 #include "libsys/libsys.h"
 
+#ifdef __GNUC__
+#ifndef __clang__
+// Somehow GCC C++ fail to understand C `atomic_bool`
+// Anyhow, these varibles are used internaly in C only!!
+typedef std::atomic<bool> atomic_bool;
+#endif /* __clang__ */
+#endif /* __GNUC__ */
+
 extern "C" {
 #include "src/main.h"
+#include "src/memsock.h"
+#include "src/shmsock.h"
+#include "src/loop.h"
 }
 
 // dummy MOCK of socket->poll
@@ -51,14 +62,14 @@ static void utestClockInfo(struct service_opt *opt, struct ifClk_t *clk)
 }
 
 // Test service create socket object
-// psock service_main_create_socket(pcipaddr address)
+// psock service_main_create_socket(pcipaddr address, const struct sock_opt_t *opt)
 TEST(mainServiceTest, createSocket)
 {
   pipaddr a = addr_alloc(UDP_IPv4);
   ASSERT_NE(a, nullptr);
   EXPECT_TRUE(a->setIP4Str(a, "1.2.5.1"));
   useTestMode(true);
-  psock s = service_main_create_socket(a);
+  psock s = service_main_create_socket(a, nullptr);
   ASSERT_NE(s, nullptr);
   s->free(s);
   useTestMode(false);
@@ -70,7 +81,7 @@ TEST(mainServiceTest, createSocket)
 TEST(mainServiceTest, rcvReqSync)
 {
   uint8_t tlvReqFlags0;
-  struct service_state_t st;
+  struct service_state_t st = {};
   pmsg m = msg_alloc();
   ASSERT_NE(m, nullptr);
   st.message = m;
@@ -113,8 +124,8 @@ static bool recv_ReqSync(pcsock s, pbuffer b, pipaddr a, pts t)
 // bool service_main_flow(struct service_state_t *state, bool useTxTwoSteps)
 TEST(mainServiceTest, mainFlow)
 {
-  struct service_state_t st;
-  struct ifClk_t clockInfo;
+  struct service_state_t st = {};
+  struct ifClk_t clockInfo = {};
   pmsg m = msg_alloc();
   ASSERT_NE(m, nullptr);
   st.message = m;
@@ -135,7 +146,7 @@ TEST(mainServiceTest, mainFlow)
   ASSERT_NE(t2, nullptr);
   st.t2 = t2;
   useTestMode(true);
-  psock s = service_main_create_socket(a);
+  psock s = service_main_create_socket(a, nullptr);
   ASSERT_NE(s, nullptr);
   st.socket = s;
   s->poll = dummy_poll; // dummy MOCK socket poll function!
@@ -161,13 +172,344 @@ TEST(mainServiceTest, mainFlow)
 // void service_main_clean()
 TEST(mainServiceTest, createObjs)
 {
-  struct service_opt opt;
-  struct service_state_t st;
-  opt.useRxTwoSteps = true;
+  struct service_opt opt = {};
+  struct service_state_t st = {};
   opt.useRxTwoSteps = true;
+  opt.useTxTwoSteps = true;
   opt.type = UDP_IPv4;
+  opt.batchSize = 4;
   useTestMode(true);
   EXPECT_TRUE(service_main_allocObjs(&opt, &st));
+  EXPECT_NE(st.storage, nullptr); // Receive two steps use the store
+  service_main_clean(&st);
+  // Receiving two steps require sending two steps
+  struct service_state_t st2 = {};
+  opt.useTxTwoSteps = false;
+  EXPECT_FALSE(service_main_allocObjs(&opt, &st2));
+  service_main_clean(&st2);
+  useTestMode(false);
+}
+
+static uint16_t rxSeqId;
+// MOCK of socket->recv for two steps request, Sync and Follow_Up alternately
+static bool recv_TwoSteps(pcsock s, pbuffer b, pipaddr a, pts t)
+{
+  static bool followUp = false;
+  const static uint8_t d[160] = { // Sync message
+      // Header 44 octests
+      0x30, 18, 0, 160, 0, 0, 6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 17, 0, 127, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      // CSPTP_REQUEST 8 octets
+      0xff, 0, 0, 4, 3, 0, 0, 0,
+      // PAD of 108 octets
+      0x80, 0x08, 0, 104
+  };
+  const static uint8_t f[160] = { // Follow_Up message
+      // Header 44 octests
+      0x38, 18, 0, 160, 0, 0, 6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 17, 2, 127, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      // PAD of 116 octets
+      0x80, 0x08, 0, 112
+  };
+  memcpy(b->getBuf(b), followUp ? f : d, 160);
+  b->getBuf(b)[31] = rxSeqId;
+  t->setTs(t, followUp ? 6000000000 : 5000000000);
+  followUp = !followUp;
+  return a->setIP4Str(a, "1.2.3.4") && b->setLen(b, 160);
+}
+static uint8_t lastSent[160];
+static size_t numSent;
+// MOCK of socket->send, keep the last message
+static bool send_keep(pcsock s, pcbuffer b, pcipaddr a)
+{
+  memcpy(lastSent, b->getBuf(b), 160);
+  numSent++;
+  return true;
+}
+// Test service answer two steps request on its Follow_Up
+// bool service_main_flow(struct service_state_t *state, bool useTxTwoSteps)
+TEST(mainServiceTest, mainFlowRxTwoSteps)
+{
+  struct service_opt opt = {};
+  struct service_state_t st = {};
+  opt.useRxTwoSteps = true;
+  opt.useTxTwoSteps = true;
+  opt.type = UDP_IPv4;
+  opt.batchSize = 1;
+  useTestMode(true);
+  setMono(100);
+  ASSERT_TRUE(service_main_allocObjs(&opt, &st));
+  pstore storage = st.storage;
+  ASSERT_NE(storage, nullptr);
+  psock s = st.socket;
+  s->poll = dummy_poll; // dummy MOCK socket poll function!
+  s->recv = recv_TwoSteps; // MOCK socket receive function!
+  s->send = send_keep; // MOCK socket send function!
+  numSent = 0;
+  rxSeqId = 17;
+  EXPECT_FALSE(service_main_flow(&st, true)); // Sync wait for Follow_Up
+  EXPECT_EQ(numSent, 0);
+  EXPECT_EQ(storage->records(storage), 1);
+  EXPECT_TRUE(service_main_flow(&st, true)); // Follow_Up
+  EXPECT_EQ(numSent, 1);
+  EXPECT_EQ(storage->records(storage), 0); // The Follow_Up frees the record
+  pstats stats = st.stats;
+  ASSERT_NE(stats, nullptr);
+  EXPECT_EQ(stats->get(stats, STATS_RX), 2);
+  EXPECT_EQ(stats->get(stats, STATS_RX_FOLLOW_UP), 1);
+  EXPECT_EQ(stats->get(stats, STATS_REQ_STATUS), 1);
+  EXPECT_EQ(stats->get(stats, STATS_REQ_ALT_TIME), 1);
+  EXPECT_EQ(stats->get(stats, STATS_TX_SYNC), 1);
+  EXPECT_EQ(stats->get(stats, STATS_TX_BYTES), 160);
+  pbuffer b = buffer_alloc(160);
+  ASSERT_NE(b, nullptr);
+  memcpy(b->getBuf(b), lastSent, 160);
+  ASSERT_TRUE(b->setLen(b, 160));
+  pmsg m = msg_alloc();
+  ASSERT_NE(m, nullptr);
+  struct ptp_params_t p;
+  ASSERT_TRUE(m->parse(m, &p, b));
+  EXPECT_EQ(p.type, Sync);
+  EXPECT_EQ(p.sequenceId, 17);
+  ASSERT_EQ(m->getTlvs(m), 4); // CSPTP_RESPONSE, CSPTP_STATUS, ALTERNATE and PAD
+  EXPECT_EQ(m->getTlvID(m, 0), CSPTP_RESPONSE_id);
+  struct CSPTP_RESPONSE_t *r = (struct CSPTP_RESPONSE_t *)m->getTlv(m, 0);
+  ASSERT_NE(r, nullptr);
+  // Receive time of the Sync
+  EXPECT_EQ(get_uint48(&r->reqIngressTimestamp.secondsField), 5);
+  EXPECT_EQ(r->reqIngressTimestamp.nanosecondsField, 0);
+  // Follow_Up of a different Sync is dropped
+  rxSeqId = 18;
+  EXPECT_FALSE(service_main_flow(&st, true));
+  rxSeqId = 19;
+  EXPECT_FALSE(service_main_flow(&st, true));
+  EXPECT_EQ(numSent, 1);
+  // Sync without Follow_Up expire
+  EXPECT_FALSE(service_main_flow(&st, true));
+  setMono(103);
+  EXPECT_EQ(storage->cleanup(storage, 2), 1);
+  EXPECT_FALSE(service_main_flow(&st, true));
+  EXPECT_EQ(numSent, 1);
+  EXPECT_EQ(stats->get(stats, STATS_RX), 6);
+  EXPECT_EQ(stats->get(stats, STATS_DROP_ORPHAN), 2);
+  m->free(m);
+  b->free(b);
+  service_main_clean(&st);
+  useTestMode(false);
+}
+
+static uint16_t lastPort;
+// Call back of the in-memory socket, keep the last message
+static void tx_keep(pcbuffer b, pcipaddr a, void *cookie)
+{
+  memcpy(lastSent, b->getBuf(b), 160);
+  lastPort = a->getPort(a);
+  numSent++;
+}
+// Test service with an in-memory socket
+// bool service_main_flow(struct service_state_t *state, bool useTxTwoSteps)
+TEST(mainServiceTest, mainFlowMemory)
+{
+  struct service_opt opt = {};
+  struct service_state_t st = {};
+  opt.type = UDP_IPv4;
+  opt.batchSize = 1;
+  opt.transport = TRANSPORT_MEMORY;
+  useTestMode(true);
+  ASSERT_TRUE(service_main_allocObjs(&opt, &st));
+  psock s = st.socket;
+  EXPECT_EQ(s->fileno(s), -1);
+  memsock_setTx(s, tx_keep, nullptr);
+  EXPECT_FALSE(service_main_flow(&st, false)); // Nothing queued
+  const uint8_t d[160] = { // One step Sync message
+      // Header 44 octests
+      0x30, 18, 0, 160, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 17, 0, 127, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      // CSPTP_REQUEST 8 octets
+      0xff, 0, 0, 4, 0, 0, 0, 0,
+      // PAD of 108 octets
+      0x80, 0x08, 0, 104
+  };
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  EXPECT_TRUE(a->setIP4Str(a, "1.2.3.4"));
+  a->setPort(a, 2000);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  t->setTs(t, 5000000000);
+  EXPECT_TRUE(memsock_push(s, d, sizeof d, a, t));
+  numSent = 0;
+  EXPECT_TRUE(service_main_flow(&st, false));
+  EXPECT_EQ(numSent, 1);
+  EXPECT_EQ(lastPort, 2000);
+  EXPECT_EQ(memsock_queued(s), 0);
+  pbuffer b = buffer_alloc(160);
+  ASSERT_NE(b, nullptr);
+  memcpy(b->getBuf(b), lastSent, 160);
+  ASSERT_TRUE(b->setLen(b, 160));
+  pmsg m = msg_alloc();
+  ASSERT_NE(m, nullptr);
+  struct ptp_params_t p;
+  ASSERT_TRUE(m->parse(m, &p, b));
+  EXPECT_EQ(p.type, Sync);
+  EXPECT_EQ(p.sequenceId, 17);
+  EXPECT_EQ(m->getTlvID(m, 0), CSPTP_RESPONSE_id);
+  struct CSPTP_RESPONSE_t *r = (struct CSPTP_RESPONSE_t *)m->getTlv(m, 0);
+  ASSERT_NE(r, nullptr);
+  // Receive time of the queued request
+  EXPECT_EQ(get_uint48(&r->reqIngressTimestamp.secondsField), 5);
+  a->free(a);
+  t->free(t);
+  m->free(m);
+  b->free(b);
+  service_main_clean(&st);
+  useTestMode(false);
+}
+
+// Test service allocating worker objects
+// psock service_main_create_shard_socket(pcipaddr address, int cpu, const struct sock_opt_t *opt)
+// bool service_main_allocWorker(struct service_opt *options, struct service_state_t *state, int cpu)
+TEST(mainServiceTest, createWorker)
+{
+  struct service_opt opt = {};
+  struct service_state_t st = {};
+  opt.useRxTwoSteps = true;
+  opt.useTxTwoSteps = true;
+  opt.type = UDP_IPv4;
+  opt.batchSize = 1;
+  opt.useIncomingCpu = true;
+  useTestMode(true);
+  EXPECT_TRUE(service_main_allocWorker(&opt, &st, 1));
+  EXPECT_EQ(st.cpu, 1);
+  EXPECT_NE(st.pend, nullptr); // Two steps use transmit timestamps
+  EXPECT_EQ(st.socket->fileno(st.socket), 7);
+  service_main_clean(&st);
+  useTestMode(false);
+}
+
+// MOCK of socket->recvBatch, fill all slots with request Sync
+static size_t recvBatch_ReqSync(pcsock s, pbuffer *b, pipaddr *a, pts *t,
+  size_t num)
+{
+  for(size_t i = 0; i < num; i++) {
+      if(!recv_ReqSync(s, b[i], a[i], t[i]))
+          return i;
+  }
+  return num;
+}
+static size_t batchSent;
+// MOCK of socket->sendBatch, count sent Sync and FollowUp
+static size_t sendBatch_count(pcsock s, pcbuffer *b, pcipaddr *a, size_t num)
+{
+  for(size_t i = 0; i < num; i++) {
+      const uint8_t *d = b[i]->getBuf(b[i]);
+      if(b[i]->getLen(b[i]) != 160 || d[31] != 17 || (d[0] != 0x30 && d[0] != 0x38))
+          return i;
+  }
+  batchSent += num;
+  return num;
+}
+// Test service batch flow
+// bool service_main_flowBatch(struct service_state_t *state, bool useTxTwoSteps)
+TEST(mainServiceTest, mainFlowBatch)
+{
+  struct service_opt opt = {};
+  struct service_state_t st = {};
+  opt.useRxTwoSteps = false;
+  opt.useTxTwoSteps = false; // Follow_Up use the system clock
+  opt.type = UDP_IPv4;
+  opt.batchSize = 4;
+  useTestMode(true);
+  ASSERT_TRUE(service_main_allocObjs(&opt, &st));
+  psock s = st.socket;
+  s->poll = dummy_poll; // dummy MOCK socket poll function!
+  s->recvBatch = recvBatch_ReqSync; // MOCK socket receive batch function!
+  s->sendBatch = sendBatch_count; // MOCK socket send batch function!
+  batchSent = 0;
+  EXPECT_TRUE(service_main_flowBatch(&st, false));
+  EXPECT_EQ(batchSent, 1);
+  EXPECT_EQ(st.batchCur, 2); // Queue fill the batch, grow
+  batchSent = 0;
+  EXPECT_TRUE(service_main_flowBatch(&st, true));
+  EXPECT_EQ(batchSent, 4); // Sync and FollowUp for each request
+  EXPECT_EQ(st.batchCur, 4);
+  batchSent = 0;
+  EXPECT_TRUE(service_main_flowBatch(&st, false));
+  EXPECT_EQ(batchSent, 4);
+  EXPECT_EQ(st.batchCur, 4); // Limit to maximum
+  EXPECT_EQ(st.buffer, st.rxBuffers[0]);
+  service_main_clean(&st);
+  useTestMode(false);
+}
+
+static uint32_t txTsId;
+// MOCK of socket->recvTxTs, timestamp of a single message
+static bool recvTxTs_id(pcsock s, uint32_t *id, pts t)
+{
+  if(txTsId == UINT32_MAX)
+      return false;
+  *id = txTsId;
+  txTsId = UINT32_MAX;
+  t->setTs(t, 9000000000);
+  t->setSrc(t, TS_SRC_SW);
+  return true;
+}
+static uint8_t fuSeconds;
+// MOCK of socket->sendBatch, Follow_Up only
+static size_t sendBatch_fu(pcsock s, pcbuffer *b, pcipaddr *a, size_t num)
+{
+  for(size_t i = 0; i < num; i++) {
+      const uint8_t *d = b[i]->getBuf(b[i]);
+      if(b[i]->getLen(b[i]) != 160 || d[31] != 17 || d[0] != 0x38 ||
+         a[i]->getPort(a[i]) != 320)
+          return i;
+      fuSeconds = d[39]; // preciseOriginTimestamp seconds low octet
+  }
+  batchSent += num;
+  return num;
+}
+// Test service two steps using transmit timestamps
+// bool service_main_txTs(struct service_state_t *state)
+// bool service_main_expireTxTs(struct service_state_t *state)
+TEST(mainServiceTest, txTs)
+{
+  struct service_opt opt = {};
+  struct service_state_t st = {};
+  opt.useRxTwoSteps = false;
+  opt.useTxTwoSteps = true;
+  opt.type = UDP_IPv4;
+  opt.batchSize = 1;
+  useTestMode(true);
+  ASSERT_TRUE(service_main_allocObjs(&opt, &st));
+  ASSERT_NE(st.pend, nullptr);
+  EXPECT_EQ(st.pendNum, 64);
+  psock s = st.socket;
+  s->poll = dummy_poll; // dummy MOCK socket poll function!
+  s->send = dummy_send; // dummy MOCK socket send function!
+  s->recv = recv_ReqSync; // MOCK socket receive function!
+  s->recvTxTs = recvTxTs_id; // MOCK socket transmit timestamp function!
+  s->sendBatch = sendBatch_fu; // MOCK socket send batch function!
+  setReal(2); // Set t2 value
+  // Send Sync, Follow_Up waits for the timestamp
+  EXPECT_TRUE(service_main_flow(&st, true));
+  EXPECT_EQ(st.txId, 1);
+  EXPECT_TRUE(st.pend[0].used);
+  batchSent = 0;
+  txTsId = 7; // Not a Sync we wait for
+  EXPECT_TRUE(service_main_txTs(&st));
+  EXPECT_EQ(batchSent, 0);
+  txTsId = 0;
+  EXPECT_TRUE(service_main_txTs(&st));
+  EXPECT_EQ(batchSent, 1);
+  EXPECT_EQ(fuSeconds, 9); // Use the transmit timestamp
+  EXPECT_FALSE(st.pend[0].used);
+  EXPECT_EQ(st.txId, 2);
+  // No timestamp, Follow_Up expire on second period
+  EXPECT_TRUE(service_main_flow(&st, true));
+  EXPECT_TRUE(st.pend[2].used);
+  EXPECT_TRUE(service_main_expireTxTs(&st));
+  EXPECT_EQ(batchSent, 1);
+  EXPECT_TRUE(service_main_expireTxTs(&st));
+  EXPECT_EQ(batchSent, 2);
+  EXPECT_EQ(fuSeconds, 2); // Use the system clock
+  EXPECT_EQ(st.txId, 4);
   service_main_clean(&st);
   useTestMode(false);
 }
@@ -196,7 +538,7 @@ static bool sendRespSync(pcsock s, pcbuffer b, pcipaddr a)
 // bool service_main_sendRespSync(struct service_state_t *state, size_t size, uint8_t tlvRequestFlags0)
 TEST(mainServiceTest, sendRespSync)
 {
-  struct service_state_t st;
+  struct service_state_t st = {};
   pmsg m = msg_alloc();
   ASSERT_NE(m, nullptr);
   st.message = m;
@@ -215,17 +557,33 @@ TEST(mainServiceTest, sendRespSync)
   pts rx = ts_alloc();
   ASSERT_NE(rx, nullptr);
   st.rxTs = rx;
-  struct service_opt opt;
+  struct service_opt opt = {};
   opt.ifName = "eth0";
-  struct ifClk_t clockInfo;
+  struct ifClk_t clockInfo = {};
   utestClockInfo(&opt, &clockInfo);
   st.clockInfo = &clockInfo;
   useTestMode(true);
-  psock s = service_main_create_socket(a);
+  psock s = service_main_create_socket(a, nullptr);
   ASSERT_NE(s, nullptr);
   st.socket = s;
   s->send = sendRespSync; // MOCK socket send function!
   EXPECT_TRUE(service_main_sendRespSync(&st, 160, Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv));
+  // Template is build on first response
+  EXPECT_EQ(st.respTmpl[3].len, 132);
+  EXPECT_EQ(st.respTmpl[3].generation, clockInfo.generation);
+  EXPECT_EQ(st.respTmpl[0].len, 0);
+  // Use the template, over a dirty buffer
+  memset(b->getBuf(b), 0xaa, 160);
+  st.params.domainNumber = 0;
+  EXPECT_TRUE(service_main_sendRespSync(&st, 160, Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv));
+  // Clock information change, rebuild the template
+  clockInfo.generation++;
+  memset(b->getBuf(b), 0xaa, 160);
+  EXPECT_TRUE(service_main_sendRespSync(&st, 160, Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv));
+  EXPECT_EQ(st.respTmpl[3].generation, clockInfo.generation);
+  // Wrong sizes
+  EXPECT_FALSE(service_main_sendRespSync(&st, 161, Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv));
+  EXPECT_FALSE(service_main_sendRespSync(&st, 134, Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv));
   s->free(s);
   useTestMode(false);
   rx->free(rx);
@@ -252,7 +610,7 @@ static bool respFollowUp(pcsock s, pcbuffer b, pcipaddr a)
 // bool service_main_sendFollowUp(struct service_state_t *state, size_t size)
 TEST(mainServiceTest, sendFollowUp)
 {
-  struct service_state_t st;
+  struct service_state_t st = {};
   pmsg m = msg_alloc();
   ASSERT_NE(m, nullptr);
   st.message = m;
@@ -269,7 +627,7 @@ TEST(mainServiceTest, sendFollowUp)
   memset(&st.params, 0, sizeof(struct ptp_params_t));
   st.params.sequenceId = 71;
   useTestMode(true);
-  psock s = service_main_create_socket(a);
+  psock s = service_main_create_socket(a, nullptr);
   ASSERT_NE(s, nullptr);
   st.socket = s;
   s->send = respFollowUp; // MOCK socket send function!
@@ -291,6 +649,7 @@ TEST(mainClientTest, createAddress)
   opt.ip = "102:304::1";
   opt.domainNumber = 200;
   opt.type = Invalid_PROTO;
+  opt.transport = TRANSPORT_UDP;
   struct log_options_t lopt = {
     .log_level = LOG_DEBUG,
     .useSysLog = false,
@@ -314,6 +673,16 @@ TEST(mainClientTest, createAddress)
   EXPECT_EQ(type, UDP_IPv4);
   EXPECT_STREQ(a->getIPStr(a), "1.2.3.4");
   a->free(a);
+  // The shared memory service use its endpoint ID
+  opt.transport = TRANSPORT_SHM;
+  opt.ip = nullptr;
+  a = client_main_create_address(&opt, &type);
+  ASSERT_NE(a, nullptr);
+  EXPECT_EQ(type, UDP_IPv4);
+  uint64_t id = 1;
+  EXPECT_TRUE(a->getEndpoint(a, &id));
+  EXPECT_EQ(id, SHMSOCK_SERVICE_ID);
+  a->free(a);
 }
 
 // Test client create socket object
@@ -386,6 +755,7 @@ TEST(mainClientTest, setTxParams)
   opt.useAltTimeScale = true;
   opt.domainNumber = 200;
   opt.type = Invalid_PROTO;
+  opt.transport = TRANSPORT_UDP;
   uint8_t tlvRequestFlags0 = client_main_set_tx_params(&opt, &p);
   EXPECT_EQ(tlvRequestFlags0, Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv);
   EXPECT_TRUE(p.useTwoSteps);
@@ -452,6 +822,65 @@ TEST(mainClientTest, rcvRespSync)
   m->free(m);
 }
 
+// Loop function of the client receive test
+static int rxCalls;
+static bool rxDrop(ploop loop, int events, void *cookie)
+{
+  rxCalls++;
+  EXPECT_FALSE(client_main_rx((struct client_run_t *)cookie));
+  return true;
+}
+// Test client drops a message it does not wait for
+// bool client_main_rx(struct client_run_t *run)
+TEST(mainClientTest, rxDrop)
+{
+  struct client_state_t st;
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  EXPECT_TRUE(a->setIP4Str(a, "127.0.0.1"));
+  a->setPort(a, 32324);
+  st.RxAddress = a;
+  psock s = sock_alloc();
+  ASSERT_NE(s, nullptr);
+  EXPECT_TRUE(s->initSrv(s, a));
+  st.socket = s;
+  pbuffer b = buffer_alloc(160);
+  ASSERT_NE(b, nullptr);
+  st.buffer = b;
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  st.tmpTs = t;
+  pipaddr pa = addr_alloc(UDP_IPv4);
+  ASSERT_NE(pa, nullptr);
+  EXPECT_TRUE(pa->setIP4Str(pa, "127.0.0.1"));
+  pa->setPort(pa, 32325);
+  psock p = sock_alloc();
+  ASSERT_NE(p, nullptr);
+  EXPECT_TRUE(p->initSrv(p, pa));
+  ploop l = loop_alloc();
+  ASSERT_NE(l, nullptr);
+  struct client_run_t run = { &st, false, 0, 1, 0 };
+  EXPECT_GE(l->addFd(l, s->fileno(s), LOOP_IN, rxDrop, &run), 0);
+  // A late response, while the client does not wait
+  memset(b->getBuf(b), 0, 44);
+  EXPECT_TRUE(b->setLen(b, 44));
+  EXPECT_TRUE(p->send(p, b, a));
+  rxCalls = 0;
+  EXPECT_TRUE(l->runOnce(l, 1000));
+  EXPECT_EQ(rxCalls, 1);
+  // The message is dropped, the loop blocks
+  EXPECT_TRUE(l->runOnce(l, 100));
+  EXPECT_EQ(rxCalls, 1);
+  EXPECT_FALSE(s->poll(s, 100));
+  l->free(l);
+  p->free(p);
+  pa->free(pa);
+  t->free(t);
+  b->free(b);
+  s->free(s);
+  a->free(a);
+}
+
 // MOCK of socket->recv for FollowUp with one step
 static bool recv_FollowUpOneStep(pcsock s, pbuffer b, pipaddr a, pts t)
 {
@@ -500,6 +929,7 @@ TEST(mainClientTest, mainFlowOneStep)
   opt.useCSPTPstatus = true;
   opt.useAltTimeScale = true;
   opt.type = Invalid_PROTO;
+  opt.transport = TRANSPORT_UDP;
   useTestMode(true);
   EXPECT_TRUE(client_main_allocObjs(&opt, &st));
   st.socket->poll = dummy_poll; // dummy MOCK socket poll function!
@@ -565,6 +995,7 @@ TEST(mainClientTest, mainFlowTwoSteps)
   opt.useCSPTPstatus = true;
   opt.useAltTimeScale = true;
   opt.type = Invalid_PROTO;
+  opt.transport = TRANSPORT_UDP;
   useTestMode(true);
   EXPECT_TRUE(client_main_allocObjs(&opt, &st));
   st.socket->poll = dummy_poll; // dummy MOCK socket poll function!
@@ -596,6 +1027,7 @@ TEST(mainClientTest, createObjs)
   opt.useCSPTPstatus = false;
   opt.useAltTimeScale = false;
   opt.type = Invalid_PROTO;
+  opt.transport = TRANSPORT_UDP;
   useTestMode(true);
   EXPECT_TRUE(client_main_allocObjs(&opt, &st));
   EXPECT_EQ(st.type, UDP_IPv4);
@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief test in-memory socket object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "libsys/libsys.h"
+
+extern "C" {
+#include "src/memsock.h"
+}
+
+struct txRec {
+  size_t num;
+  uint8_t data[16];
+  size_t len;
+  uint16_t port;
+};
+static void txCall(pcbuffer buffer, pcipaddr address, void *cookie)
+{
+  txRec *r = (txRec *)cookie;
+  r->num++;
+  r->len = buffer_getLen(buffer);
+  memcpy(r->data, buffer_getBuf(buffer), r->len);
+  r->port = address->getPort(address);
+}
+
+// Test in-memory socket receive
+// psock memsock_alloc(prot type, size_t entries)
+// bool memsock_push(psock sock, const uint8_t *data, size_t len, pcipaddr address, pcts ts)
+// size_t memsock_queued(pcsock sock)
+// bool poll(pcsock self, int timeout)
+// bool recv(pcsock self, pbuffer buffer, pipaddr address, pts ts)
+// size_t recvBatch(pcsock self, pbuffer *buffers, pipaddr *addresses, pts *ts, size_t num)
+// int fileno(pcsock self)
+// prot getType(pcsock self)
+TEST(memsockTest, recv)
+{
+  EXPECT_EQ(memsock_alloc(Invalid_PROTO, 2), nullptr);
+  EXPECT_EQ(memsock_alloc(UDP_IPv4, 0), nullptr);
+  psock s = memsock_alloc(UDP_IPv4, 2);
+  ASSERT_NE(s, nullptr);
+  EXPECT_EQ(s->getType(s), UDP_IPv4);
+  EXPECT_EQ(s->fileno(s), -1);
+  EXPECT_TRUE(s->initSrv(s, nullptr) == false);
+  EXPECT_FALSE(s->poll(s, 10));
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  pipaddr a6 = addr_alloc(UDP_IPv6);
+  ASSERT_NE(a6, nullptr);
+  EXPECT_TRUE(s->initSrv(s, a));
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  pbuffer b = buffer_alloc(16);
+  ASSERT_NE(b, nullptr);
+  EXPECT_TRUE(a->setIPStr(a, "1.2.3.4"));
+  a->setPort(a, 1234);
+  t->setTs(t, 1000000007);
+  EXPECT_TRUE(memsock_push(s, (const uint8_t *)"test1", 5, a, t));
+  // Wrong address type
+  EXPECT_FALSE(memsock_push(s, (const uint8_t *)"test1", 5, a6, t));
+  EXPECT_TRUE(a->setIPStr(a, "5.6.7.8"));
+  a->setPort(a, 5678);
+  t->setTs(t, 2000000009);
+  EXPECT_TRUE(memsock_push(s, (const uint8_t *)"test22", 6, a, t));
+  // Queue is full
+  EXPECT_FALSE(memsock_push(s, (const uint8_t *)"test3", 5, a, t));
+  EXPECT_EQ(memsock_queued(s), 2);
+  // Not an in-memory socket
+  psock u = sock_alloc();
+  ASSERT_NE(u, nullptr);
+  useTestMode(true);
+  EXPECT_FALSE(memsock_push(u, (const uint8_t *)"test3", 5, a, t));
+  EXPECT_EQ(memsock_queued(u), 0);
+  useTestMode(false);
+  u->free(u);
+  EXPECT_TRUE(s->poll(s, 10));
+  pipaddr r = addr_alloc(UDP_IPv4);
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(s->recv(s, b, r, t));
+  EXPECT_EQ(buffer_getLen(b), 5);
+  EXPECT_EQ(memcmp(buffer_getBuf(b), "test1", 5), 0);
+  EXPECT_STREQ(r->getIPStr(r), "1.2.3.4");
+  EXPECT_EQ(r->getPort(r), 1234);
+  EXPECT_EQ(ts_getTs(t), 1000000007);
+  EXPECT_EQ(ts_getSrc(t), TS_SRC_SW);
+  pbuffer bs[2] = { b, buffer_alloc(16) };
+  ASSERT_NE(bs[1], nullptr);
+  pipaddr rs[2] = { r, addr_alloc(UDP_IPv4) };
+  ASSERT_NE(rs[1], nullptr);
+  pts ts[2] = { t, ts_alloc() };
+  ASSERT_NE(ts[1], nullptr);
+  EXPECT_EQ(s->recvBatch(s, bs, rs, ts, 2), 1);
+  EXPECT_EQ(buffer_getLen(b), 6);
+  EXPECT_EQ(memcmp(buffer_getBuf(b), "test22", 6), 0);
+  EXPECT_STREQ(r->getIPStr(r), "5.6.7.8");
+  EXPECT_EQ(r->getPort(r), 5678);
+  EXPECT_EQ(ts_getTs(t), 2000000009);
+  EXPECT_FALSE(s->poll(s, 10));
+  EXPECT_FALSE(s->recv(s, b, r, t));
+  EXPECT_EQ(s->recvBatch(s, bs, rs, ts, 2), 0);
+  // The ring wraps
+  EXPECT_TRUE(memsock_push(s, (const uint8_t *)"test3", 5, a, t));
+  EXPECT_EQ(memsock_queued(s), 1);
+  EXPECT_TRUE(s->close(s));
+  EXPECT_EQ(memsock_queued(s), 0);
+  a->free(a);
+  a6->free(a6);
+  for(int i = 0; i < 2; i++) {
+    bs[i]->free(bs[i]);
+    rs[i]->free(rs[i]);
+    ts[i]->free(ts[i]);
+  }
+  s->free(s);
+}
+
+// Test in-memory socket send
+// void memsock_setTx(psock sock, memsock_tx_f function, void *cookie)
+// bool send(pcsock self, pcbuffer buffer, pcipaddr address)
+// size_t sendBatch(pcsock self, pcbuffer *buffers, pcipaddr *addresses, size_t num)
+// bool enableTxTs(pcsock self)
+TEST(memsockTest, send)
+{
+  psock s = memsock_alloc(UDP_IPv6, 4);
+  ASSERT_NE(s, nullptr);
+  EXPECT_FALSE(s->enableTxTs(s));
+  pipaddr a = addr_alloc(UDP_IPv6);
+  ASSERT_NE(a, nullptr);
+  a->setPort(a, 320);
+  pbuffer b = buffer_alloc(16);
+  ASSERT_NE(b, nullptr);
+  memcpy(buffer_getBuf(b), "resp1", 5);
+  EXPECT_TRUE(buffer_setLen(b, 5));
+  // Without a call back the datagrams are dropped
+  EXPECT_TRUE(s->send(s, b, a));
+  txRec r = {};
+  memsock_setTx(s, txCall, &r);
+  EXPECT_TRUE(s->send(s, b, a));
+  EXPECT_EQ(r.num, 1);
+  EXPECT_EQ(r.len, 5);
+  EXPECT_EQ(memcmp(r.data, "resp1", 5), 0);
+  EXPECT_EQ(r.port, 320);
+  pcbuffer bs[2] = { b, b };
+  pcipaddr as[2] = { a, a };
+  EXPECT_EQ(s->sendBatch(s, bs, as, 2), 2);
+  EXPECT_EQ(r.num, 3);
+  EXPECT_FALSE(s->send(s, b, nullptr));
+  a->free(a);
+  b->free(b);
+  s->free(s);
+}
@@ -27,6 +27,10 @@ TEST(messageTest, sizes)
   EXPECT_EQ(m->getTlvSize(ALTERNATE_TIME_OFFSET_INDICATOR_id), 30);
   EXPECT_EQ(m->getTlvSize(CSPTP_REQUEST_id), 8);
   EXPECT_EQ(m->getTlvSize(CSPTP_RESPONSE_id), 28);
+  // Without the parent address
+  EXPECT_EQ(m->getTlvSize(CSPTP_STATUS_id), 32);
+  EXPECT_EQ(m->getTlvSize(PAD_id), 4);
+  EXPECT_EQ(m->getTlvSize(Invalid_tlv_ID), 0);
   EXPECT_EQ(m->getCSPTPStatusTlvSize(UDP_IPv4), 36);
   EXPECT_EQ(m->getCSPTPStatusTlvSize(UDP_IPv6), 48);
   EXPECT_EQ(m->getPTPMsgSize(), 44);
@@ -200,6 +204,197 @@ TEST(messageTest, parse)
   b2->free(b2);
 }
 
+// Test reasons of parsing failure
+// bool parse(pmsg self, pparms params, pbuffer buffer)
+// enum msg_parse_e getParseErr(pcmsg self)
+TEST(messageTest, parseErr)
+{
+  pbuffer b = buffer_alloc(60);
+  ASSERT_NE(b, nullptr);
+  const static uint8_t d[44] = { // Sync header
+      0x30, 18, 0, 44, 0, 0, 6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 127, 0, 0, 1, 0, 2, 0, 4, 0, 6, 0,
+  };
+  const struct {
+    size_t offset; // Offset of octet to change
+    uint8_t val; // Value of octet
+    size_t len; // Length of received data
+    enum msg_parse_e err;
+  } c[] = {
+      { 0, 0x30, 44, MSG_PARSE_OK },
+      { 0, 0x30, 20, MSG_PARSE_SHORT },
+      { 3, 60, 44, MSG_PARSE_LENGTH },
+      { 0, 0x3b, 44, MSG_PARSE_TYPE },
+      { 1, 2, 44, MSG_PARSE_VERSION },
+      { 33, 0, 44, MSG_PARSE_HEADER },
+      { 6, 0, 44, MSG_PARSE_FLAGS },
+  };
+  pmsg m = msg_alloc();
+  ASSERT_NE(m, nullptr);
+  struct ptp_params_t p;
+  EXPECT_EQ(m->getParseErr(m), MSG_PARSE_OK);
+  for(size_t i = 0; i < sizeof(c) / sizeof(c[0]); i++) {
+    // Parse converts the header in place
+    memcpy(b->getBuf(b), d, sizeof(d));
+    b->getBuf(b)[c[i].offset] = c[i].val;
+    EXPECT_TRUE(b->setLen(b, c[i].len));
+    EXPECT_EQ(m->parse(m, &p, b), c[i].err == MSG_PARSE_OK);
+    EXPECT_EQ(m->getParseErr(m), c[i].err);
+  }
+  EXPECT_FALSE(m->parse(m, nullptr, b));
+  EXPECT_EQ(m->getParseErr(m), MSG_PARSE_ARGS);
+  m->free(m);
+  b->free(b);
+}
+
+// Test check headers of a batch
+// size_t check(pcmsg self, pcbuffer *buffers, size_t num, bool *valid)
+// bool viewChecked(pmsg self, pparms params, pcbuffer buffer)
+TEST(messageTest, check)
+{
+  const static uint8_t d[44] = { // Sync header
+      0x30, 18, 0, 44, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 127, 0, 0, 1, 0, 2, 0, 4, 0, 6, 0,
+  };
+  const struct {
+    size_t offset; // Offset of octet to change
+    uint8_t val; // Value of octet
+    size_t len; // Length of received data
+    bool valid;
+  } c[] = {
+      { 0, 0x30, 44, true },
+      { 6, 6, 44, true }, // Two steps
+      { 7, 0x3f, 44, true }, // flagField[1] without the reserved bits
+      { 2, 1, 44, true }, // messageLength is checked on parse
+      { 0, 0x30, 43, false },
+      { 0, 0x38, 44, false }, // Follow_Up with Sync controlField
+      { 0, 0x3b, 44, false },
+      { 1, 2, 44, false },
+      { 5, 1, 44, false },
+      { 6, 0, 44, false },
+      { 7, 0x40, 44, false },
+      { 25, 1, 44, false },
+      { 32, 2, 44, false },
+      { 33, 0, 44, false },
+  };
+  const size_t num = sizeof(c) / sizeof(c[0]);
+  pbuffer b[num + 1];
+  bool valid[num + 1];
+  size_t pass = 0;
+  pmsg m = msg_alloc();
+  ASSERT_NE(m, nullptr);
+  for(size_t i = 0; i <= num; i++) {
+    b[i] = buffer_alloc(60);
+    ASSERT_NE(b[i], nullptr);
+    memcpy(b[i]->getBuf(b[i]), d, sizeof(d));
+    EXPECT_TRUE(b[i]->setLen(b[i], sizeof(d)));
+  }
+  for(size_t i = 0; i < num; i++) {
+    b[i]->getBuf(b[i])[c[i].offset] = c[i].val;
+    EXPECT_TRUE(b[i]->setLen(b[i], c[i].len));
+    pass += c[i].valid;
+  }
+  // Follow_Up
+  b[num]->getBuf(b[num])[0] = 0x38;
+  b[num]->getBuf(b[num])[32] = 2;
+  EXPECT_EQ(m->check(m, (pcbuffer *)b, num + 1, valid), pass + 1);
+  for(size_t i = 0; i < num; i++)
+    EXPECT_EQ(valid[i], c[i].valid);
+  EXPECT_TRUE(valid[num]);
+  // The check and the parse agree
+  struct ptp_params_t p;
+  for(size_t i = 0; i < num; i++) {
+    if(c[i].offset == 2)
+      continue;
+    EXPECT_EQ(m->parse(m, &p, b[i]), c[i].valid);
+  }
+  EXPECT_TRUE(m->viewChecked(m, &p, b[num]));
+  EXPECT_EQ(p.type, Follow_Up);
+  EXPECT_FALSE(p.useTwoSteps);
+  // Parse of a message with a longer messageLength
+  EXPECT_FALSE(m->viewChecked(m, &p, b[3]));
+  EXPECT_EQ(m->getParseErr(m), MSG_PARSE_LENGTH);
+  EXPECT_EQ(m->check(m, nullptr, num, valid), 0);
+  for(size_t i = 0; i <= num; i++)
+    b[i]->free(b[i]);
+  m->free(m);
+}
+
+// Test view of received message
+// bool view(pmsg self, pparms params, pcbuffer buffer)
+// const void *findTlv(pcmsg self, enum tlv_type_id id)
+// size_t copyTlv(pcmsg self, enum tlv_type_id id, void *tlv, size_t size)
+TEST(messageTest, view)
+{
+  pbuffer b = buffer_alloc(100);
+  ASSERT_NE(b, nullptr);
+  EXPECT_TRUE(b->setLen(b, 84));
+  const static uint8_t d[84] = { // Use Sync
+      // Header 44 octests
+      0x30, 18, 0, 84, 5, 0, 6, 0x21, 0, 0, 0, 0, 0, 0, 1, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x39, 0, 127, 0, 0, 1, 0, 2, 0, 4, 0, 6, 0,
+      // CSPTP_RESPONSE 28 octets
+      0xff, 1, 0, 24, 1, 2, 3, 4, 5, 6, 0, 0, 4, 0, 3, 0, 0, 4, 0, 3, 1, 2, 3, 4, 5, 6, 7, 8,
+      // CSPTP_REQUEST 8 octets
+      0xff, 0, 0, 4, 3, 0, 0, 0,
+      // PAD of 4 octets
+      0x80, 0x08, 0, 0
+  };
+  memcpy(b->getBuf(b), d, sizeof(d));
+  pmsg m = msg_alloc();
+  ASSERT_NE(m, nullptr);
+  struct ptp_params_t p;
+  EXPECT_TRUE(m->view(m, &p, b));
+  // The message is not changed
+  EXPECT_EQ(0, memcmp(b->getBuf(b), d, sizeof(d)));
+  EXPECT_EQ(p.type, Sync);
+  EXPECT_EQ(p.domainNumber, 5);
+  EXPECT_EQ(p.correctionField, 0x102);
+  EXPECT_EQ(p.sequenceId, 0x39);
+  EXPECT_EQ(p.flagField2, 0x21);
+  EXPECT_TRUE(p.useTwoSteps);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  EXPECT_TRUE(t->fromTimestamp(t, &p.timestamp));
+  EXPECT_EQ(t->getTs(t), 16777728067110400);
+  EXPECT_EQ(m->getMsgLen(m), 84);
+  EXPECT_EQ(m->getTlvs(m), 2); // The PAD without data is skipped
+  const struct CSPTP_REQUEST_t *rq =
+    (const struct CSPTP_REQUEST_t *)m->findTlv(m, CSPTP_REQUEST_id);
+  ASSERT_NE(rq, nullptr);
+  EXPECT_EQ((uint8_t *)rq, b->getBuf(b) + 72);
+  EXPECT_EQ(rq->tlvRequestFlags[0], Flags0_Req_StatusTlv | Flags0_Req_AlternateTimeTlv);
+  EXPECT_EQ(m->findTlv(m, CSPTP_STATUS_id), nullptr);
+  EXPECT_EQ(m->findTlv(m, Invalid_tlv_ID), nullptr);
+  struct CSPTP_RESPONSE_t rp;
+  EXPECT_EQ(m->copyTlv(m, CSPTP_RESPONSE_id, &rp, sizeof(rp) - 1), 0);
+  EXPECT_EQ(m->copyTlv(m, CSPTP_STATUS_id, &rp, sizeof(rp)), 0);
+  EXPECT_EQ(m->copyTlv(m, CSPTP_RESPONSE_id, &rp, sizeof(rp)), 28);
+  EXPECT_EQ(rp.hdr.tlvType, CSPTP_RESPONSE_id);
+  EXPECT_EQ(rp.hdr.lengthField, 24);
+  EXPECT_TRUE(t->fromTimestamp(t, &rp.reqIngressTimestamp));
+  struct timespec tp;
+  t->toTimespec(t, &tp);
+  EXPECT_EQ(tp.tv_sec, 0x4000300);
+  EXPECT_EQ(tp.tv_nsec, 0x40003);
+  EXPECT_EQ(rp.reqCorrectionField, 0x102030405060708);
+  EXPECT_EQ(0, memcmp(b->getBuf(b), d, sizeof(d)));
+  // A view can not be used to build
+  EXPECT_FALSE(m->addTlv(m, CSPTP_RESPONSE_id));
+  EXPECT_FALSE(m->buildDone(m, 0));
+  // The same TLVs after parse, in host order
+  EXPECT_TRUE(m->parse(m, &p, b));
+  EXPECT_EQ(p.correctionField, 0x102);
+  EXPECT_EQ(p.sequenceId, 0x39);
+  const struct CSPTP_RESPONSE_t *r =
+    (const struct CSPTP_RESPONSE_t *)m->findTlv(m, CSPTP_RESPONSE_id);
+  ASSERT_NE(r, nullptr);
+  EXPECT_EQ(r->reqCorrectionField, 0x102030405060708);
+  EXPECT_EQ(m->copyTlv(m, CSPTP_RESPONSE_id, &rp, sizeof(rp)), 28);
+  EXPECT_EQ(rp.reqCorrectionField, 0x102030405060708);
+  EXPECT_EQ(m->findTlv(m, CSPTP_REQUEST_id), (uint8_t *)rq);
+  t->free(t);
+  m->free(m);
+  b->free(b);
+}
+
 // Test build messages
 // bool init(pmsg self, pcparms params, pbuffer buffer)
 // void *nextTlv(pmsg self, size_t need)
@@ -0,0 +1,256 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief test capture files object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "libsys/libsys.h"
+
+#include <string>
+
+extern "C" {
+#include "src/pcap.h"
+}
+
+static void tmpName(char *name, size_t size, const char *ext)
+{
+  snprintf(name, size, "/tmp/csptp_utest_%d.%s", (int)getpid(), ext);
+}
+
+// Test write and read a pcap file
+// ppcap pcap_alloc()
+// bool create(ppcap self, const char *name)
+// bool write(ppcap self, const struct pkt_info_t *info, pcts ts)
+// bool open(ppcap self, const char *name)
+// bool next(ppcap self, struct pkt_info_t *info, pts ts)
+// size_t skipped(pcpcap self)
+// void free(ppcap self)
+TEST(pcapTest, pcap)
+{
+  char name[64];
+  tmpName(name, sizeof(name), "pcap");
+  ppcap p = pcap_alloc();
+  ASSERT_NE(p, nullptr);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  struct pkt_info_t i = {
+    .type = UDP_IPv4,
+    .srcMac = {1, 2, 3, 4, 5, 6},
+    .dstMac = {7, 8, 9, 10, 11, 12},
+    .srcIp = {1, 2, 5, 1},
+    .dstIp = {1, 10, 5, 10},
+    .srcPort = 2567,
+    .dstPort = 320,
+    .payload = (const uint8_t *)"test1",
+    .len = 5,
+  };
+  EXPECT_FALSE(p->write(p, &i, t));
+  ASSERT_TRUE(p->create(p, name));
+  t->setTs(t, 1750000000123456789);
+  EXPECT_TRUE(p->write(p, &i, t));
+  i.type = UDP_IPv6;
+  memcpy(i.srcIp, "\x20\x01\xd\xb8\0\0\0\0\0\0\0\0\0\0\0\x1", 16);
+  i.payload = (const uint8_t *)"test22";
+  i.len = 6;
+  t->setTs(t, 1750000001000000002);
+  EXPECT_TRUE(p->write(p, &i, t));
+  // Reading flush the file
+  ASSERT_TRUE(p->open(p, name));
+  struct pkt_info_t r;
+  EXPECT_TRUE(p->next(p, &r, t));
+  EXPECT_EQ(r.type, UDP_IPv4);
+  EXPECT_EQ(memcmp(r.srcMac, "\x1\x2\x3\x4\x5\x6", 6), 0);
+  EXPECT_EQ(memcmp(r.srcIp, "\x1\x2\x5\x1", 4), 0);
+  EXPECT_EQ(memcmp(r.dstIp, "\x1\xa\x5\xa", 4), 0);
+  EXPECT_EQ(r.srcPort, 2567);
+  EXPECT_EQ(r.dstPort, 320);
+  EXPECT_EQ(r.len, 5);
+  EXPECT_EQ(memcmp(r.payload, "test1", 5), 0);
+  EXPECT_EQ(ts_getTs(t), 1750000000123456789);
+  EXPECT_TRUE(p->next(p, &r, t));
+  EXPECT_EQ(r.type, UDP_IPv6);
+  EXPECT_EQ(memcmp(r.srcIp, i.srcIp, 16), 0);
+  EXPECT_EQ(r.len, 6);
+  EXPECT_EQ(memcmp(r.payload, "test22", 6), 0);
+  EXPECT_EQ(ts_getTs(t), 1750000001000000002);
+  EXPECT_FALSE(p->next(p, &r, t));
+  EXPECT_EQ(p->skipped(p), 0);
+  EXPECT_FALSE(p->write(p, &i, t));
+  p->free(p);
+  t->free(t);
+  unlink(name);
+}
+
+// Big endian octets
+static void be16(std::string &s, uint16_t v)
+{
+  s += (char)(v >> 8);
+  s += (char)(v & 0xff);
+}
+static void be32(std::string &s, uint32_t v)
+{
+  be16(s, v >> 16);
+  be16(s, v & 0xffff);
+}
+static void block(std::string &s, uint32_t type, const std::string &body)
+{
+  be32(s, type);
+  be32(s, body.size() + 12);
+  s += body;
+  be32(s, body.size() + 12);
+}
+
+// Test read a big endian pcapng file with Linux cooked link
+TEST(pcapTest, pcapng)
+{
+  char name[64];
+  tmpName(name, sizeof(name), "pcapng");
+  // UDP datagram in IPv4 packet, we build it in an Ethernet frame
+  uint8_t f[42 + 8];
+  struct pkt_info_t i = {
+    .type = UDP_IPv4,
+    .srcIp = {10, 0, 0, 1},
+    .dstIp = {10, 0, 0, 2},
+    .srcPort = 40000,
+    .dstPort = 320,
+  };
+  memcpy(f + 42, "request8", 8);
+  ASSERT_TRUE(pkt_build(f, &i, 8));
+  std::string ip((const char *)f + 14, sizeof(f) - 14);
+  std::string s, b;
+  // Section Header
+  be32(b, 0x1a2b3c4d);
+  be16(b, 1);
+  be16(b, 0);
+  be32(b, 0xffffffff);
+  be32(b, 0xffffffff);
+  block(s, 0x0a0d0d0a, b);
+  // Interface Description, Linux cooked with milliseconds
+  b.clear();
+  be16(b, 113);
+  be16(b, 0);
+  be32(b, 0);
+  be16(b, 9);
+  be16(b, 1);
+  b += std::string("\x3\0\0\0", 4);
+  be32(b, 0);
+  block(s, 1, b);
+  // Enhanced Packet of ARP
+  b.clear();
+  be32(b, 0);
+  be32(b, 0);
+  be32(b, 1000);
+  be32(b, 20);
+  be32(b, 20);
+  b += std::string(14, '\0') + std::string("\x8\x6", 2) + std::string(4, '\0');
+  block(s, 6, b);
+  // Enhanced Packet of our datagram
+  std::string sll(14, '\0');
+  be16(sll, 0x0800);
+  b.clear();
+  be32(b, 0);
+  be32(b, 0);
+  be32(b, 1750000000);
+  be32(b, sll.size() + ip.size());
+  be32(b, sll.size() + ip.size());
+  b += sll + ip;
+  b += std::string((4 - b.size() % 4) % 4, '\0');
+  block(s, 6, b);
+  FILE *o = fopen(name, "wb");
+  ASSERT_NE(o, nullptr);
+  EXPECT_EQ(fwrite(s.data(), 1, s.size(), o), s.size());
+  fclose(o);
+  ppcap p = pcap_alloc();
+  ASSERT_NE(p, nullptr);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  EXPECT_FALSE(p->open(p, "/tmp/csptp_utest_missing.pcap"));
+  ASSERT_TRUE(p->open(p, name));
+  struct pkt_info_t r;
+  EXPECT_TRUE(p->next(p, &r, t));
+  EXPECT_EQ(r.type, UDP_IPv4);
+  EXPECT_EQ(memcmp(r.srcIp, i.srcIp, 4), 0);
+  EXPECT_EQ(memcmp(r.dstIp, i.dstIp, 4), 0);
+  EXPECT_EQ(r.srcPort, 40000);
+  EXPECT_EQ(r.dstPort, 320);
+  EXPECT_EQ(r.len, 8);
+  EXPECT_EQ(memcmp(r.payload, "request8", 8), 0);
+  EXPECT_EQ(ts_getTs(t), 1750000000000000);
+  EXPECT_FALSE(p->next(p, &r, t));
+  EXPECT_EQ(p->skipped(p), 1);
+  p->free(p);
+  t->free(t);
+  unlink(name);
+}
+
+// Test read a VLAN tagged Ethernet frame, the tag is stripped
+TEST(pcapTest, vlan)
+{
+  char name[64];
+  tmpName(name, sizeof(name), "vlan.pcapng");
+  uint8_t f[42 + 8];
+  struct pkt_info_t i = {
+    .type = UDP_IPv4,
+    .srcIp = {10, 0, 0, 1},
+    .dstIp = {10, 0, 0, 2},
+    .srcPort = 40000,
+    .dstPort = 320,
+  };
+  memcpy(f + 42, "request8", 8);
+  ASSERT_TRUE(pkt_build(f, &i, 8));
+  // Insert a tag of VLAN 5 after the MAC addresses
+  std::string eth((const char *)f, 12);
+  be16(eth, 0x8100);
+  be16(eth, 5);
+  eth += std::string((const char *)f + 12, sizeof(f) - 12);
+  std::string s, b;
+  // Section Header
+  be32(b, 0x1a2b3c4d);
+  be16(b, 1);
+  be16(b, 0);
+  be32(b, 0xffffffff);
+  be32(b, 0xffffffff);
+  block(s, 0x0a0d0d0a, b);
+  // Interface Description, Ethernet with microseconds
+  b.clear();
+  be16(b, 1);
+  be16(b, 0);
+  be32(b, 0);
+  block(s, 1, b);
+  // Enhanced Packet of our tagged datagram
+  b.clear();
+  be32(b, 0);
+  be32(b, 0);
+  be32(b, 0);
+  be32(b, eth.size());
+  be32(b, eth.size());
+  b += eth;
+  b += std::string((4 - b.size() % 4) % 4, '\0');
+  block(s, 6, b);
+  FILE *o = fopen(name, "wb");
+  ASSERT_NE(o, nullptr);
+  EXPECT_EQ(fwrite(s.data(), 1, s.size(), o), s.size());
+  fclose(o);
+  ppcap p = pcap_alloc();
+  ASSERT_NE(p, nullptr);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  ASSERT_TRUE(p->open(p, name));
+  struct pkt_info_t r;
+  EXPECT_TRUE(p->next(p, &r, t));
+  EXPECT_EQ(r.type, UDP_IPv4);
+  EXPECT_EQ(memcmp(r.srcIp, i.srcIp, 4), 0);
+  EXPECT_EQ(r.dstPort, 320);
+  EXPECT_EQ(r.len, 8);
+  EXPECT_EQ(memcmp(r.payload, "request8", 8), 0);
+  EXPECT_FALSE(p->next(p, &r, t));
+  EXPECT_EQ(p->skipped(p), 0);
+  p->free(p);
+  t->free(t);
+  unlink(name);
+}
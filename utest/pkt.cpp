@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief test Ethernet, IP and UDP headers of raw frames
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "libsys/libsys.h"
+
+extern "C" {
+#include "src/pkt.h"
+}
+
+static uint16_t csum(const uint8_t *p, size_t len, uint32_t s = 0)
+{
+  for(; len > 1; p += 2, len -= 2)
+    s += (p[0] << 8) | p[1];
+  if(len > 0)
+    s += p[0] << 8;
+  while(s > 0xffff)
+    s = (s & 0xffff) + (s >> 16);
+  return ~s & 0xffff;
+}
+
+// Test IPv4 frame
+// size_t pkt_hdrLen(prot type)
+// bool pkt_build(uint8_t *head, const struct pkt_info_t *info, size_t len)
+// bool pkt_parse(const uint8_t *frame, size_t len, struct pkt_info_t *info)
+TEST(pktTest, ip4)
+{
+  EXPECT_EQ(pkt_hdrLen(UDP_IPv4), 42);
+  uint8_t f[42 + 5 + 4] = {0};
+  memcpy(f + 42, "test1", 5);
+  struct pkt_info_t i = {
+    .type = UDP_IPv4,
+    .srcMac = {1, 2, 3, 4, 5, 6},
+    .dstMac = {7, 8, 9, 10, 11, 12},
+    .srcIp = {1, 2, 5, 1},
+    .dstIp = {1, 10, 5, 10},
+    .srcPort = 320,
+    .dstPort = 2567,
+  };
+  EXPECT_TRUE(pkt_build(f, &i, 5));
+  EXPECT_EQ(0, memcmp(f, "\x7\x8\x9\xa\xb\xc\x1\x2\x3\x4\x5\x6\x8\x0", 14));
+  // Zero sum verify the checksums
+  EXPECT_EQ(csum(f + 14, 20), 0);
+  uint8_t pseudo[] = {1, 2, 5, 1, 1, 10, 5, 10, 0, 17, 0, 13};
+  EXPECT_EQ(csum(f + 34, 13, 0xffff & ~csum(pseudo, sizeof pseudo)), 0);
+  struct pkt_info_t r;
+  // Ethernet padding is ignored
+  EXPECT_TRUE(pkt_parse(f, sizeof f, &r));
+  EXPECT_EQ(r.type, UDP_IPv4);
+  EXPECT_EQ(0, memcmp(r.srcMac, i.srcMac, 6));
+  EXPECT_EQ(0, memcmp(r.dstMac, i.dstMac, 6));
+  EXPECT_EQ(0, memcmp(r.srcIp, i.srcIp, 4));
+  EXPECT_EQ(0, memcmp(r.dstIp, i.dstIp, 4));
+  EXPECT_EQ(r.srcPort, 320);
+  EXPECT_EQ(r.dstPort, 2567);
+  EXPECT_EQ(r.len, 5);
+  EXPECT_EQ(r.payload, f + 42);
+  EXPECT_FALSE(pkt_parse(f, 40, &r));
+  // Fragment
+  f[20] = 0x20;
+  EXPECT_FALSE(pkt_parse(f, sizeof f, &r));
+  f[20] = 0x40;
+  // Not UDP
+  f[23] = 6;
+  EXPECT_FALSE(pkt_parse(f, sizeof f, &r));
+}
+
+// Test IPv6 frame, reject a VLAN tag
+TEST(pktTest, ip6)
+{
+  EXPECT_EQ(pkt_hdrLen(UDP_IPv6), 62);
+  EXPECT_EQ(pkt_hdrLen(Invalid_PROTO), 0);
+  uint8_t f[4 + 62 + 4];
+  memcpy(f + 4 + 62, "test", 4);
+  struct pkt_info_t i = {
+    .type = UDP_IPv6,
+    .srcMac = {1, 2, 3, 4, 5, 6},
+    .dstMac = {7, 8, 9, 10, 11, 12},
+    .srcIp = {0xfe, 0x80, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14},
+    .dstIp = {0xfe, 0x80, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9},
+    .srcPort = 320,
+    .dstPort = 3000,
+  };
+  EXPECT_TRUE(pkt_build(f + 4, &i, 4));
+  struct pkt_info_t r;
+  EXPECT_TRUE(pkt_parse(f + 4, sizeof f - 4, &r));
+  EXPECT_EQ(r.type, UDP_IPv6);
+  EXPECT_EQ(0, memcmp(r.srcIp, i.srcIp, 16));
+  EXPECT_EQ(0, memcmp(r.dstIp, i.dstIp, 16));
+  EXPECT_EQ(r.srcPort, 320);
+  EXPECT_EQ(r.dstPort, 3000);
+  EXPECT_EQ(r.len, 4);
+  EXPECT_EQ(0, memcmp(r.payload, "test", 4));
+  // Truncated UDP
+  EXPECT_FALSE(pkt_parse(f + 4, sizeof f - 5, &r));
+  // Move the MAC addresses and add a VLAN tag, the reply would be untagged
+  memcpy(f, f + 4, 12);
+  memcpy(f + 12, "\x81\x0\x0\x5", 4);
+  EXPECT_FALSE(pkt_parse(f, sizeof f, &r));
+  i.type = Invalid_PROTO;
+  useTestMode(true);
+  EXPECT_FALSE(pkt_build(f, &i, 4));
+  useTestMode(false);
+}
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief test rate limit of requests
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+extern "C" {
+#include "src/rate.h"
+}
+
+#define MS INT64_C(1000000) // Millisecond in nanoseconds
+
+// Test rate limit of a client
+// void free(prate self)
+// bool allow(prate self, pcipaddr address, int64_t now)
+// size_t dropped(pcrate self)
+// prate rate_alloc(prot protocol, size_t hashSize, uint32_t clientRate, uint32_t clientBurst, uint32_t rate)
+TEST(rateTest, client)
+{
+  prate r = rate_alloc(UDP_IPv4, 8, 10, 3, 0);
+  ASSERT_NE(r, nullptr);
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  pipaddr b = addr_alloc(UDP_IPv4);
+  ASSERT_NE(b, nullptr);
+  EXPECT_TRUE(a->setIP4Str(a, "10.1.2.3"));
+  EXPECT_TRUE(b->setIP4Str(b, "10.1.2.4"));
+  int64_t t = 5000 * MS;
+  // Burst of 3 requests
+  EXPECT_TRUE(r->allow(r, a, t));
+  EXPECT_TRUE(r->allow(r, a, t));
+  EXPECT_TRUE(r->allow(r, a, t));
+  EXPECT_FALSE(r->allow(r, a, t));
+  EXPECT_EQ(r->dropped(r), 1);
+  // Another client have its own bucket
+  EXPECT_TRUE(r->allow(r, b, t));
+  // A request every 100 milliseconds
+  EXPECT_FALSE(r->allow(r, a, t + 50 * MS));
+  EXPECT_TRUE(r->allow(r, a, t + 100 * MS));
+  EXPECT_FALSE(r->allow(r, a, t + 150 * MS));
+  // The bucket fills while the client is quiet
+  t += 1000 * MS;
+  EXPECT_TRUE(r->allow(r, a, t));
+  EXPECT_TRUE(r->allow(r, a, t));
+  EXPECT_TRUE(r->allow(r, a, t));
+  EXPECT_FALSE(r->allow(r, a, t));
+  EXPECT_EQ(r->dropped(r), 4);
+  // The port is not part of the client
+  a->setPort(a, 4000);
+  EXPECT_FALSE(r->allow(r, a, t));
+  b->free(b);
+  a->free(a);
+  r->free(r);
+}
+
+// Test rate limit of all clients
+TEST(rateTest, global)
+{
+  prate r = rate_alloc(UDP_IPv6, 4, 0, 0, 100);
+  ASSERT_NE(r, nullptr);
+  pipaddr a = addr_alloc(UDP_IPv6);
+  ASSERT_NE(a, nullptr);
+  int64_t t = 5000 * MS;
+  size_t allowed = 0;
+  // A tenth of a second burst
+  for(int i = 0; i < 100; i++) {
+    EXPECT_TRUE(a->setIP6Str(a, i % 2 ? "100:90::1" : "100:90::2"));
+    if(r->allow(r, a, t))
+      allowed++;
+  }
+  EXPECT_EQ(allowed, 11);
+  EXPECT_EQ(r->dropped(r), 89);
+  EXPECT_FALSE(r->allow(r, a, t + 5 * MS));
+  EXPECT_TRUE(r->allow(r, a, t + 1000 * MS));
+  a->free(a);
+  r->free(r);
+}
@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief test shared memory socket object
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "libsys/libsys.h"
+
+#include <poll.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+#include "src/shmsock.h"
+}
+
+static bool readable(int fd)
+{
+  struct pollfd fds = { .fd = fd, .events = POLLIN };
+  return poll(&fds, 1, 0) == 1;
+}
+static bool setData(pbuffer b, const char *data)
+{
+  size_t len = strlen(data);
+  memcpy(buffer_getBuf(b), data, len);
+  return buffer_setLen(b, len);
+}
+
+// Test shared memory socket, service and clients
+// psock shmsock_alloc(prot type, const char *path)
+// bool initSrv(psock self, pcipaddr address)
+// bool init(psock self, prot type)
+// bool send(pcsock self, pcbuffer buffer, pcipaddr address)
+// bool recv(pcsock self, pbuffer buffer, pipaddr address, pts ts)
+// bool poll(pcsock self, int timeout)
+// int fileno(pcsock self)
+// bool close(psock self)
+TEST(shmsockTest, service)
+{
+  char path[64];
+  uint64_t id;
+  snprintf(path, sizeof path, "/tmp/csptp_utest_%d.shm", getpid());
+  EXPECT_EQ(shmsock_alloc(Invalid_PROTO, path), nullptr);
+  EXPECT_EQ(shmsock_alloc(UDP_IPv4, ""), nullptr);
+  psock c = shmsock_alloc(UDP_IPv4, path);
+  ASSERT_NE(c, nullptr);
+  // No service
+  EXPECT_FALSE(c->init(c, UDP_IPv4));
+  EXPECT_EQ(c->fileno(c), -1);
+  psock s = shmsock_alloc(UDP_IPv4, path);
+  ASSERT_NE(s, nullptr);
+  EXPECT_EQ(s->getType(s), UDP_IPv4);
+  EXPECT_FALSE(s->enableTxTs(s));
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  EXPECT_FALSE(s->initSrvShard(s, a, -1));
+  EXPECT_TRUE(s->initSrv(s, a));
+  EXPECT_NE(s->fileno(s), -1);
+  // Other users can not access the file or the doorbell
+  struct stat st;
+  ASSERT_EQ(lstat(path, &st), 0);
+  EXPECT_EQ(st.st_mode & S_IRWXO, 0);
+  std::string bell = std::string(path) + ".bell";
+  ASSERT_EQ(lstat(bell.c_str(), &st), 0);
+  EXPECT_EQ(st.st_mode & S_IRWXO, 0);
+  EXPECT_FALSE(s->poll(s, 0));
+  EXPECT_TRUE(c->init(c, UDP_IPv4));
+  EXPECT_NE(c->fileno(c), -1);
+  pbuffer b = buffer_alloc(SHMSOCK_MTU);
+  ASSERT_NE(b, nullptr);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  pipaddr srv = addr_alloc(UDP_IPv4);
+  ASSERT_NE(srv, nullptr);
+  EXPECT_TRUE(srv->setEndpoint(srv, SHMSOCK_SERVICE_ID));
+  // The service waits, the client rings its doorbell
+  EXPECT_FALSE(readable(s->fileno(s)));
+  EXPECT_TRUE(setData(b, "req1"));
+  EXPECT_TRUE(c->send(c, b, srv));
+  EXPECT_TRUE(readable(s->fileno(s)));
+  EXPECT_TRUE(s->poll(s, 0));
+  buffer_setLen(b, 0);
+  EXPECT_TRUE(s->recv(s, b, a, t));
+  EXPECT_EQ(buffer_getLen(b), 4);
+  EXPECT_EQ(memcmp(buffer_getBuf(b), "req1", 4), 0);
+  EXPECT_EQ(ts_getSrc(t), TS_SRC_USER);
+  EXPECT_GT(ts_getTs(t), 0);
+  EXPECT_TRUE(a->getEndpoint(a, &id));
+  EXPECT_EQ(id, SHMSOCK_CLIENT_ID(0));
+  EXPECT_STREQ(a->getIPStr(a), "0.0.0.1");
+  // The receive empties the rings and the doorbell
+  EXPECT_FALSE(readable(s->fileno(s)));
+  EXPECT_FALSE(s->recv(s, b, a, t));
+  // The service responds to the client endpoint
+  EXPECT_FALSE(c->poll(c, 0));
+  EXPECT_TRUE(setData(b, "resp1"));
+  EXPECT_TRUE(s->send(s, b, a));
+  EXPECT_TRUE(readable(c->fileno(c)));
+  EXPECT_TRUE(c->poll(c, 10));
+  pipaddr r = addr_alloc(UDP_IPv4);
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(r->setIPStr(r, "1.2.3.4"));
+  EXPECT_TRUE(c->recv(c, b, r, t));
+  EXPECT_EQ(buffer_getLen(b), 5);
+  EXPECT_EQ(memcmp(buffer_getBuf(b), "resp1", 5), 0);
+  EXPECT_TRUE(r->eq(r, srv));
+  EXPECT_FALSE(readable(c->fileno(c)));
+  // A second client takes the next slot
+  psock c2 = shmsock_alloc(UDP_IPv4, path);
+  ASSERT_NE(c2, nullptr);
+  EXPECT_TRUE(c2->init(c2, UDP_IPv4));
+  EXPECT_TRUE(setData(b, "req2"));
+  EXPECT_TRUE(c2->send(c2, b, srv));
+  EXPECT_TRUE(s->recv(s, b, a, t));
+  EXPECT_EQ(memcmp(buffer_getBuf(b), "req2", 4), 0);
+  EXPECT_TRUE(a->getEndpoint(a, &id));
+  EXPECT_EQ(id, SHMSOCK_CLIENT_ID(1));
+  // Send to an address that is not a client
+  EXPECT_TRUE(r->setIPStr(r, "1.2.3.4"));
+  EXPECT_FALSE(s->send(s, b, r));
+  // The client leaves, a new client takes its slot
+  c->free(c);
+  EXPECT_TRUE(a->setEndpoint(a, SHMSOCK_CLIENT_ID(0)));
+  EXPECT_FALSE(s->send(s, b, a));
+  c = shmsock_alloc(UDP_IPv4, path);
+  ASSERT_NE(c, nullptr);
+  EXPECT_TRUE(c->init(c, UDP_IPv4));
+  EXPECT_TRUE(setData(b, "req3"));
+  EXPECT_TRUE(c->send(c, b, srv));
+  EXPECT_TRUE(s->recv(s, b, a, t));
+  EXPECT_TRUE(a->getEndpoint(a, &id));
+  EXPECT_EQ(id, SHMSOCK_CLIENT_ID(0));
+  EXPECT_TRUE(s->send(s, b, a));
+  EXPECT_TRUE(c->recv(c, b, r, t));
+  EXPECT_EQ(memcmp(buffer_getBuf(b), "req3", 4), 0);
+  c->free(c);
+  c2->free(c2);
+  EXPECT_TRUE(s->close(s));
+  EXPECT_EQ(s->fileno(s), -1);
+  EXPECT_NE(access(path, F_OK), 0);
+  a->free(a);
+  r->free(r);
+  srv->free(srv);
+  b->free(b);
+  t->free(t);
+  s->free(s);
+}
+
+// Test shared memory socket batch functions
+// size_t sendBatch(pcsock self, pcbuffer *buffers, pcipaddr *addresses, size_t num)
+// size_t recvBatch(pcsock self, pbuffer *buffers, pipaddr *addresses, pts *ts, size_t num)
+TEST(shmsockTest, batch)
+{
+  char path[64];
+  snprintf(path, sizeof path, "/tmp/csptp_utest_%d.shm", getpid());
+  psock s = shmsock_alloc(UDP_IPv6, path);
+  ASSERT_NE(s, nullptr);
+  pipaddr a = addr_alloc(UDP_IPv6);
+  ASSERT_NE(a, nullptr);
+  ASSERT_TRUE(s->initSrv(s, a));
+  psock c = shmsock_alloc(UDP_IPv6, path);
+  ASSERT_NE(c, nullptr);
+  ASSERT_TRUE(c->init(c, UDP_IPv6));
+  pbuffer b = buffer_alloc(SHMSOCK_MTU);
+  ASSERT_NE(b, nullptr);
+  EXPECT_TRUE(a->setEndpoint(a, SHMSOCK_SERVICE_ID));
+  // Fill the ring
+  for(int i = 0; i < SHMSOCK_RING; i++) {
+    EXPECT_TRUE(setData(b, "req"));
+    buffer_getBuf(b)[2] = i;
+    EXPECT_TRUE(c->send(c, b, a));
+  }
+  EXPECT_FALSE(c->send(c, b, a));
+  pbuffer bs[SHMSOCK_RING];
+  pipaddr as[SHMSOCK_RING];
+  pts ts[SHMSOCK_RING];
+  for(int i = 0; i < SHMSOCK_RING; i++) {
+    bs[i] = buffer_alloc(SHMSOCK_MTU);
+    as[i] = addr_alloc(UDP_IPv6);
+    ts[i] = ts_alloc();
+    ASSERT_TRUE(bs[i] != nullptr && as[i] != nullptr && ts[i] != nullptr);
+  }
+  EXPECT_EQ(s->recvBatch(s, bs, as, ts, 8), 8);
+  EXPECT_EQ(buffer_getBuf(bs[7])[2], 7);
+  EXPECT_STREQ(as[0]->getIPStr(as[0]), "::ffff:0.0.0.1");
+  EXPECT_TRUE(readable(s->fileno(s)));
+  EXPECT_EQ(s->recvBatch(s, bs + 8, as + 8, ts + 8, SHMSOCK_RING), SHMSOCK_RING - 8);
+  EXPECT_EQ(buffer_getBuf(bs[SHMSOCK_RING - 1])[2], SHMSOCK_RING - 1);
+  EXPECT_FALSE(readable(s->fileno(s)));
+  EXPECT_EQ(s->sendBatch(s, (pcbuffer *)bs, (pcipaddr *)as, SHMSOCK_RING),
+    SHMSOCK_RING);
+  EXPECT_EQ(c->recvBatch(c, bs, as, ts, SHMSOCK_RING), SHMSOCK_RING);
+  EXPECT_EQ(buffer_getBuf(bs[5])[2], 5);
+  EXPECT_FALSE(c->poll(c, 0));
+  for(int i = 0; i < SHMSOCK_RING; i++) {
+    bs[i]->free(bs[i]);
+    as[i]->free(as[i]);
+    ts[i]->free(ts[i]);
+  }
+  c->free(c);
+  s->free(s);
+  a->free(a);
+  b->free(b);
+}
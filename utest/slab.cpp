@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief test slab allocator
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+extern "C" {
+#include "src/slab.h"
+}
+
+// Test slab
+// void free(pslab self)
+// void *get(pslab self)
+// void put(pslab self, void *obj)
+// bool reserve(pslab self, size_t num)
+// size_t memUse(pcslab self)
+// size_t used(pcslab self)
+// pslab slab_alloc(size_t objSize, size_t maxMem, bool hugePages)
+TEST(slabTest, slab)
+{
+  pslab s = slab_alloc(20, 2 * SLAB_CHUNK, false);
+  ASSERT_NE(s, nullptr);
+  EXPECT_EQ(s->memUse(s), 0);
+  uint8_t *o1 = (uint8_t *)s->get(s);
+  ASSERT_NE(o1, nullptr);
+  EXPECT_EQ(s->memUse(s), SLAB_CHUNK);
+  EXPECT_EQ((uintptr_t)o1 % SLAB_ALIGN, 0); // First object follows the chunk link
+  uint8_t *o2 = (uint8_t *)s->get(s);
+  EXPECT_EQ(o2, o1 + 32); // Objects are carved in order
+  EXPECT_EQ(s->used(s), 2);
+  memset(o1, 0xff, 20);
+  s->put(s, o1);
+  EXPECT_EQ(s->used(s), 1);
+  uint8_t *o3 = (uint8_t *)s->get(s);
+  EXPECT_EQ(o3, o1); // Reuse last free object
+  for(int i = 0; i < 20; i++)
+    EXPECT_EQ(o3[i], 0);
+  // The ceiling holds two chunks
+  size_t perChunk = (SLAB_CHUNK - SLAB_ALIGN) / 32;
+  EXPECT_TRUE(s->reserve(s, perChunk * 2 - 2));
+  EXPECT_EQ(s->memUse(s), 2 * SLAB_CHUNK);
+  EXPECT_FALSE(s->reserve(s, perChunk * 2));
+  for(size_t i = 2; i < perChunk * 2; i++)
+    EXPECT_NE(s->get(s), nullptr);
+  EXPECT_EQ(s->get(s), nullptr);
+  EXPECT_EQ(s->used(s), perChunk * 2);
+  s->free(s);
+  EXPECT_EQ(slab_alloc(20, SLAB_CHUNK / 2, false), nullptr);
+}
+
+// Test slab with huge pages
+TEST(slabTest, hugePages)
+{
+  pslab s = slab_alloc(64, 0, true);
+  ASSERT_NE(s, nullptr);
+  EXPECT_TRUE(s->reserve(s, 1));
+  EXPECT_EQ(s->memUse(s), SLAB_HUGE);
+  EXPECT_NE(s->get(s), nullptr);
+  s->free(s);
+}
+
+// Test memory block
+// void *slab_mmap(size_t size, bool hugePages)
+// void slab_munmap(void *mem, size_t size)
+TEST(slabTest, mmap)
+{
+  uint8_t *m = (uint8_t *)slab_mmap(10000, false);
+  ASSERT_NE(m, nullptr);
+  EXPECT_EQ((uintptr_t)m % SLAB_ALIGN, 0);
+  EXPECT_EQ(m[0], 0);
+  EXPECT_EQ(m[9999], 0);
+  slab_munmap(m, 10000);
+}
@@ -146,3 +146,35 @@ TEST(slistTest, slist)
   EXPECT_EQ(m->getUsedNodes(m), 0);
   m->free(m);
 }
+
+// Test slist with a memory ceiling
+// bool reserve(pslistmgr self, size_t nodes)
+// size_t getMemUse(pslistmgr self)
+// pslistmgr pslistmgr_alloc_slab(size_t dataSize, sfunc_f cmp, sfunc_f set, sfunc_f cleanup, sfunc_f release, size_t maxMem, bool hugePages)
+TEST(slistTest, slab)
+{
+  struct data_t d;
+  struct s_link_list_t myList = { 0 };
+  pslistmgr m = pslistmgr_alloc_slab(sizeof(struct data_t), cmp, set, cleanup,
+      nullptr, SLAB_CHUNK, false);
+  ASSERT_NE(m, nullptr);
+  EXPECT_EQ(m->getMemUse(m), 0);
+  EXPECT_TRUE(m->reserve(m, 100));
+  EXPECT_EQ(m->getMemUse(m), SLAB_CHUNK);
+  // A node of 16 octets, the chunk start with the chunk link
+  size_t nodes = (SLAB_CHUNK - SLAB_ALIGN) / 16;
+  EXPECT_FALSE(m->reserve(m, nodes + 1));
+  for(size_t i = 0; i < nodes; i++) {
+    d = { (int)i, 1 };
+    EXPECT_TRUE(m->updateNode(m, &myList, &d));
+  }
+  d = { (int)nodes, 1 };
+  EXPECT_FALSE(m->updateNode(m, &myList, &d)); // Exceeds the ceiling
+  EXPECT_EQ(m->getUsedNodes(m), nodes);
+  EXPECT_EQ(m->getMemUse(m), SLAB_CHUNK);
+  m->freeList(m, &myList, false);
+  EXPECT_EQ(m->getUsedNodes(m), 0);
+  EXPECT_TRUE(m->updateNode(m, &myList, &d)); // Reuse
+  m->freeList(m, &myList, false);
+  m->free(m);
+}
@@ -13,6 +13,7 @@
 
 extern "C" {
 #include "src/sock.h"
+#include "src/pkt.h"
 }
 
 #include <sys/socket.h>
@@ -123,6 +124,42 @@ TEST(addressTest, ipv6)
   a->free(a);
 }
 
+// Test address endpoint ID
+// bool getEndpoint(pcipaddr self, uint64_t *endpoint)
+// bool setEndpoint(pipaddr self, uint64_t endpoint)
+TEST(addressTest, endpoint)
+{
+  uint64_t id;
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  EXPECT_TRUE(a->setIP4Str(a, "1.2.3.4"));
+  a->setPort(a, 320);
+  EXPECT_TRUE(a->getEndpoint(a, &id));
+  EXPECT_EQ(id, 0x010203040140);
+  EXPECT_EQ(id, ENDPOINT_ID(0x01020304, 320));
+  EXPECT_TRUE(a->setEndpoint(a, ENDPOINT_ID(7, 0)));
+  EXPECT_STREQ(a->getIPStr(a), "0.0.0.7");
+  EXPECT_EQ(a->getPort(a), 0);
+  EXPECT_FALSE(a->setEndpoint(a, ENDPOINT_MAX + 1));
+  EXPECT_FALSE(a->getEndpoint(a, nullptr));
+  pipaddr a6 = addr_alloc(UDP_IPv6);
+  ASSERT_NE(a6, nullptr);
+  // Only IPv4 mapped addresses have an ID
+  EXPECT_TRUE(a6->setIPStr(a6, "100:90::1"));
+  EXPECT_FALSE(a6->getEndpoint(a6, &id));
+  EXPECT_TRUE(a6->setEndpoint(a6, 0x010203040140));
+  EXPECT_STREQ(a6->getIPStr(a6), "::ffff:1.2.3.4");
+  EXPECT_EQ(a6->getPort(a6), 320);
+  id = 0;
+  EXPECT_TRUE(a6->getEndpoint(a6, &id));
+  EXPECT_EQ(id, 0x010203040140);
+  EXPECT_TRUE(a6->setIPStr(a6, "::ffff:5.6.7.8"));
+  EXPECT_TRUE(a6->getEndpoint(a6, &id));
+  EXPECT_EQ(id, ENDPOINT_ID(0x05060708, 320));
+  a6->free(a6);
+  a->free(a);
+}
+
 // Test converting of adresses
 // bool addressStringToBinary(const char *string, prot *type, uint8_t *binary)
 TEST(sockTest, convert)
@@ -194,6 +231,9 @@ TEST(sockTest, client)
   EXPECT_EQ(b->getLen(b), 4);
   EXPECT_EQ(memcmp(b->getBuf(b), "test", 4), 0);
   EXPECT_EQ(a->getPort(a), 2567);
+  // Use the kernel software timestamp
+  EXPECT_EQ(t->getTs(t), 7000000000);
+  EXPECT_EQ(t->getSrc(t), TS_SRC_SW);
   EXPECT_TRUE(a->setIPStr(a, "1.10.5.10"));
   EXPECT_TRUE(s->close(s));
   t->free(t);
@@ -217,7 +257,262 @@ TEST(sockTest, service)
   EXPECT_EQ(s->fileno(s), 7);
   EXPECT_EQ(s->getType(s), UDP_IPv4);
   EXPECT_TRUE(s->close(s));
+  // bool initSrvShard(psock self, pcipaddr address, int cpu)
+  EXPECT_TRUE(s->initSrvShard(s, a, 2));
+  EXPECT_EQ(s->fileno(s), 7);
+  EXPECT_TRUE(s->close(s));
+  EXPECT_TRUE(s->initSrvShard(s, a, -1));
+  EXPECT_TRUE(s->close(s));
   a->free(a);
   s->free(s);
   useTestMode(false);
 }
+
+// Tests socket object batch functions
+// size_t sendBatch(pcsock self, pcbuffer *buffers, pcipaddr *addresses, size_t num)
+// size_t recvBatch(pcsock self, pbuffer *buffers, pipaddr *addresses, pts *ts, size_t num)
+TEST(sockTest, batch)
+{
+  useTestMode(true);
+  psock s = sock_alloc();
+  ASSERT_NE(s, nullptr);
+  EXPECT_TRUE(s->init(s, UDP_IPv4));
+  pbuffer b[2];
+  pipaddr a[2];
+  pts t[2];
+  for(int i = 0; i < 2; i++) {
+      a[i] = addr_alloc(UDP_IPv4);
+      ASSERT_NE(a[i], nullptr);
+      EXPECT_TRUE(a[i]->setIP4Str(a[i], "1.2.5.1"));
+      b[i] = buffer_alloc(10);
+      ASSERT_NE(b[i], nullptr);
+      memcpy(b[i]->getBuf(b[i]), "test1246xx", 10);
+      EXPECT_TRUE(b[i]->setLen(b[i], 10));
+      t[i] = ts_alloc();
+      ASSERT_NE(t[i], nullptr);
+  }
+  EXPECT_EQ(s->sendBatch(s, (pcbuffer *)b, (pcipaddr *)a, 2), 2);
+  setReal(5);
+  EXPECT_EQ(s->recvBatch(s, b, a, t, 2), 2);
+  EXPECT_EQ(b[0]->getLen(b[0]), 4);
+  EXPECT_EQ(memcmp(b[0]->getBuf(b[0]), "test", 4), 0);
+  EXPECT_EQ(a[0]->getPort(a[0]), 2567);
+  EXPECT_STREQ(a[0]->getIPStr(a[0]), "1.10.5.10");
+  EXPECT_EQ(t[0]->getTs(t[0]), 5000000000);
+  EXPECT_EQ(t[0]->getSrc(t[0]), TS_SRC_USER);
+  EXPECT_EQ(b[1]->getLen(b[1]), 4);
+  EXPECT_EQ(memcmp(b[1]->getBuf(b[1]), "tst2", 4), 0);
+  EXPECT_EQ(a[1]->getPort(a[1]), 2568);
+  EXPECT_STREQ(a[1]->getIPStr(a[1]), "1.10.5.11");
+  // Use the hardware timestamp
+  EXPECT_EQ(t[1]->getTs(t[1]), 9000000000);
+  EXPECT_EQ(t[1]->getSrc(t[1]), TS_SRC_HW);
+  EXPECT_TRUE(s->close(s));
+  for(int i = 0; i < 2; i++) {
+      t[i]->free(t[i]);
+      b[i]->free(b[i]);
+      a[i]->free(a[i]);
+  }
+  s->free(s);
+  useTestMode(false);
+}
+
+// Tests socket object transmit timestamps
+// bool enableTxTs(pcsock self)
+// bool recvTxTs(pcsock self, uint32_t *id, pts ts)
+TEST(sockTest, txTs)
+{
+  useTestMode(true);
+  psock s = sock_alloc();
+  ASSERT_NE(s, nullptr);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  uint32_t id = 0;
+  EXPECT_FALSE(s->enableTxTs(s)); // socket is not initialized
+  EXPECT_TRUE(s->init(s, UDP_IPv4));
+  EXPECT_TRUE(s->enableTxTs(s));
+  EXPECT_TRUE(s->recvTxTs(s, &id, t));
+  EXPECT_EQ(id, 5);
+  EXPECT_EQ(t->getTs(t), 11000000000);
+  EXPECT_EQ(t->getSrc(t), TS_SRC_SW);
+  EXPECT_FALSE(s->recvTxTs(s, nullptr, t));
+  EXPECT_TRUE(s->close(s));
+  t->free(t);
+  s->free(s);
+  useTestMode(false);
+}
+
+// Tests socket object with io_uring, using the loopback
+// psock sock_alloc_opt(const struct sock_opt_t *opt)
+// size_t sendBatch(pcsock self, pcbuffer *buffers, pcipaddr *addresses, size_t num)
+TEST(sockTest, uring)
+{
+  struct sock_opt_t opt = {};
+  opt.entries = 8;
+  opt.useUring = true;
+  psock s = sock_alloc_opt(&opt);
+  ASSERT_NE(s, nullptr);
+  EXPECT_TRUE(s->init(s, UDP_IPv4));
+  if(s->fileno(s) == s->_fd) {
+    s->free(s);
+    GTEST_SKIP() << "io_uring is not supported";
+  }
+  EXPECT_FALSE(s->enableTxTs(s));
+  psock c = sock_alloc();
+  ASSERT_NE(c, nullptr);
+  EXPECT_TRUE(c->init(c, UDP_IPv4));
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  EXPECT_TRUE(a->setIP4Str(a, "127.0.0.1"));
+  a->setPort(a, 9);
+  pbuffer b = buffer_alloc(10);
+  ASSERT_NE(b, nullptr);
+  memcpy(b->getBuf(b), "test1246xx", 10);
+  EXPECT_TRUE(b->setLen(b, 10));
+  // Bind the client socket to a port
+  EXPECT_TRUE(c->send(c, b, a));
+  socklen_t size = a->getSize(a);
+  EXPECT_EQ(getsockname(c->fileno(c), a->getAddr(a), &size), 0);
+  EXPECT_TRUE(a->setIP4Str(a, "127.0.0.1"));
+  EXPECT_TRUE(s->send(s, b, a));
+  EXPECT_TRUE(c->poll(c, 1000));
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  EXPECT_TRUE(c->recv(c, b, a, t));
+  EXPECT_EQ(b->getLen(b), 10);
+  // Reply to the io_uring socket
+  EXPECT_TRUE(b->setLen(b, 4));
+  EXPECT_TRUE(c->send(c, b, a));
+  EXPECT_TRUE(s->poll(s, 1000));
+  memset(b->getBuf(b), 0, 10);
+  pbuffer bs[1] = { b };
+  pipaddr as[1] = { a };
+  pts ts[1] = { t };
+  EXPECT_EQ(s->recvBatch(s, bs, as, ts, 1), 1);
+  EXPECT_EQ(b->getLen(b), 4);
+  EXPECT_EQ(memcmp(b->getBuf(b), "test", 4), 0);
+  EXPECT_EQ(t->getSrc(t), TS_SRC_SW);
+  EXPECT_EQ(s->recvBatch(s, bs, as, ts, 1), 0);
+  // Linked sends, each batch reaps its own completions
+  pipaddr r = addr_alloc(UDP_IPv4);
+  ASSERT_NE(r, nullptr);
+  pcbuffer tbs[3] = { b, b, b };
+  pcipaddr tas[3] = { a, a, a };
+  for(int i = 0; i < 2; i++) {
+    EXPECT_EQ(s->sendBatch(s, tbs, tas, 3), 3);
+    for(int j = 0; j < 3; j++) {
+      EXPECT_TRUE(c->poll(c, 1000));
+      EXPECT_TRUE(c->recv(c, b, r, t));
+    }
+  }
+  r->free(r);
+  EXPECT_TRUE(s->close(s));
+  EXPECT_EQ(s->fileno(s), -1);
+  t->free(t);
+  b->free(b);
+  a->free(a);
+  c->free(c);
+  s->free(s);
+}
+
+// Tests socket object with packet ring, using the loopback
+// psock sock_alloc_opt(const struct sock_opt_t *opt)
+// size_t sendBatch(pcsock self, pcbuffer *buffers, pcipaddr *addresses, size_t num)
+TEST(sockTest, packet)
+{
+  struct sock_opt_t opt = {};
+  opt.entries = 8;
+  opt.ifName = "lo";
+  psock s = sock_alloc_opt(&opt);
+  ASSERT_NE(s, nullptr);
+  // A client socket does not use the packet ring
+  EXPECT_TRUE(s->init(s, UDP_IPv4));
+  EXPECT_EQ(s->fileno(s), s->_fd);
+  EXPECT_TRUE(s->close(s));
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  EXPECT_TRUE(a->setIP4Str(a, "127.0.0.1"));
+  a->setPort(a, 32320);
+  EXPECT_TRUE(s->initSrv(s, a));
+  if(s->fileno(s) == s->_fd) {
+    a->free(a);
+    s->free(s);
+    GTEST_SKIP() << "packet ring is not permitted";
+  }
+  EXPECT_FALSE(s->enableTxTs(s));
+  // The kernel drops the loopback address from a packet socket,
+  // the client use a packet ring to receive the reply
+  psock c = sock_alloc();
+  ASSERT_NE(c, nullptr);
+  pipaddr ca = addr_alloc(UDP_IPv4);
+  ASSERT_NE(ca, nullptr);
+  EXPECT_TRUE(ca->setIP4Str(ca, "127.0.0.1"));
+  ca->setPort(ca, 32321);
+  EXPECT_TRUE(c->initSrv(c, ca));
+  pbuffer b = buffer_alloc(10);
+  ASSERT_NE(b, nullptr);
+  memcpy(b->getBuf(b), "test1246xx", 10);
+  EXPECT_TRUE(b->setLen(b, 10));
+  EXPECT_TRUE(c->send(c, b, a));
+  EXPECT_TRUE(s->poll(s, 1000));
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  memset(b->getBuf(b), 0, 10);
+  EXPECT_TRUE(s->recv(s, b, a, t));
+  EXPECT_EQ(b->getLen(b), 10);
+  EXPECT_EQ(memcmp(b->getBuf(b), "test1246xx", 10), 0);
+  EXPECT_STREQ(a->getIPStr(a), "127.0.0.1");
+  EXPECT_EQ(a->getPort(a), 32321);
+  EXPECT_EQ(t->getSrc(t), TS_SRC_SW);
+  // We do not answer for another address
+  pipaddr o = addr_alloc(UDP_IPv4);
+  ASSERT_NE(o, nullptr);
+  EXPECT_TRUE(o->setIP4Str(o, "127.0.0.2"));
+  o->setPort(o, 32320);
+  EXPECT_TRUE(b->setLen(b, 10));
+  EXPECT_TRUE(c->send(c, b, o));
+  if(s->poll(s, 100))
+    EXPECT_FALSE(s->recv(s, b, a, t));
+  o->free(o);
+  // Reply through the transmit ring
+  c->free(c);
+  c = sock_alloc_opt(&opt);
+  ASSERT_NE(c, nullptr);
+  EXPECT_TRUE(c->initSrv(c, ca));
+  EXPECT_NE(c->fileno(c), c->_fd);
+  EXPECT_TRUE(b->setLen(b, 4));
+  EXPECT_TRUE(s->send(s, b, a));
+  EXPECT_TRUE(c->poll(c, 1000));
+  memset(b->getBuf(b), 0, 10);
+  EXPECT_TRUE(c->recv(c, b, ca, t));
+  EXPECT_EQ(b->getLen(b), 4);
+  EXPECT_EQ(memcmp(b->getBuf(b), "test", 4), 0);
+  EXPECT_EQ(ca->getPort(ca), 32320);
+  // The batch skips an address we did not receive with
+  pipaddr n = addr_alloc(UDP_IPv4);
+  ASSERT_NE(n, nullptr);
+  EXPECT_TRUE(n->setIP4Str(n, "127.0.0.1"));
+  n->setPort(n, 32321);
+  pcbuffer bs[3] = { b, b, b };
+  pcipaddr as[3] = { n, a, n };
+  useTestMode(true);
+  EXPECT_EQ(s->sendBatch(s, bs, as, 3), 1);
+  useTestMode(false);
+  EXPECT_TRUE(c->poll(c, 1000));
+  EXPECT_TRUE(c->recv(c, b, ca, t));
+  EXPECT_EQ(b->getLen(b), 4);
+  // Unkown peer
+  a->setPort(a, 9);
+  useTestMode(true);
+  EXPECT_FALSE(s->send(s, b, a));
+  useTestMode(false);
+  n->free(n);
+  EXPECT_TRUE(s->close(s));
+  EXPECT_EQ(s->fileno(s), -1);
+  t->free(t);
+  b->free(b);
+  a->free(a);
+  ca->free(ca);
+  c->free(c);
+  s->free(s);
+}
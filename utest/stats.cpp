@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief test service statistics counters and export
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+extern "C" {
+#include "src/stats.h"
+}
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Test counters
+// pstats stats_alloc(false)
+// void free(pstats self)
+// uint64_t get(pcstats self, enum stats_id_e id)
+// void stats_add(pstats self, enum stats_id_e id, uint64_t value)
+// void stats_inc(pstats self, enum stats_id_e id)
+TEST(statsTest, counters)
+{
+  pstats s = stats_alloc(false);
+  ASSERT_NE(s, nullptr);
+  EXPECT_EQ((uintptr_t)s % SLAB_ALIGN, 0);
+  for(int i = 0; i < STATS_NUM; i++)
+    EXPECT_EQ(s->get(s, (enum stats_id_e)i), 0);
+  stats_inc(s, STATS_RX);
+  stats_inc(s, STATS_RX);
+  stats_add(s, STATS_RX_BYTES, 88);
+  stats_inc(s, STATS_DROP_RATE);
+  stats_inc(nullptr, STATS_RX);
+  EXPECT_EQ(s->get(s, STATS_RX), 2);
+  EXPECT_EQ(s->get(s, STATS_RX_BYTES), 88);
+  EXPECT_EQ(s->get(s, STATS_DROP_RATE), 1);
+  EXPECT_EQ(s->get(s, STATS_TX_SYNC), 0);
+  EXPECT_EQ(s->get(s, STATS_NUM), 0);
+  EXPECT_FALSE(stats_useLat(s));
+  EXPECT_EQ(s->getLat(s, STATS_LAT_TURNAROUND), nullptr);
+  stats_lat(s, STATS_LAT_TURNAROUND, 100);
+  s->free(s);
+}
+
+// Test latency
+// pchist getLat(pcstats self, enum stats_lat_e id)
+// bool stats_useLat(pcstats self)
+// void stats_lat(pstats self, enum stats_lat_e id, int64_t latency)
+TEST(statsTest, latency)
+{
+  pstats s = stats_alloc(true);
+  ASSERT_NE(s, nullptr);
+  EXPECT_TRUE(stats_useLat(s));
+  EXPECT_FALSE(stats_useLat(nullptr));
+  pchist t = s->getLat(s, STATS_LAT_TURNAROUND);
+  ASSERT_NE(t, nullptr);
+  pchist q = s->getLat(s, STATS_LAT_QUEUE);
+  ASSERT_NE(q, nullptr);
+  EXPECT_EQ(s->getLat(s, STATS_LAT_NUM), nullptr);
+  stats_lat(s, STATS_LAT_TURNAROUND, 100);
+  stats_lat(s, STATS_LAT_TURNAROUND, 20);
+  stats_lat(s, STATS_LAT_TURNAROUND, -5); // Ignored
+  stats_lat(s, STATS_LAT_QUEUE, 7);
+  EXPECT_EQ(t->count(t), 2);
+  EXPECT_EQ(t->max(t), 100);
+  EXPECT_EQ(q->count(q), 1);
+  EXPECT_EQ(q->max(q), 7);
+  s->free(s);
+}
+
+// Test sum and print of counters
+// void stats_sum(const pcstats *stats, size_t num, uint64_t *values)
+// size_t stats_print(const uint64_t *values, char *buf, size_t size, bool prometheus)
+// size_t stats_printLat(const pchist *total, const pchist *window, char *buf, size_t size, bool prometheus)
+TEST(statsTest, print)
+{
+  pstats s1 = stats_alloc(false);
+  ASSERT_NE(s1, nullptr);
+  pstats s2 = stats_alloc(false);
+  ASSERT_NE(s2, nullptr);
+  stats_add(s1, STATS_RX, 3);
+  stats_add(s2, STATS_RX, 4);
+  stats_inc(s2, STATS_REQ_ALT_TIME);
+  stats_add(s1, STATS_DROP_ORPHAN, 5);
+  stats_inc(s2, STATS_ERR_SEND);
+  pcstats a[] = { s1, s2, nullptr };
+  uint64_t v[STATS_NUM];
+  stats_sum(a, 3, v);
+  EXPECT_EQ(v[STATS_RX], 7);
+  EXPECT_EQ(v[STATS_REQ_ALT_TIME], 1);
+  EXPECT_EQ(v[STATS_DROP_ORPHAN], 5);
+  EXPECT_EQ(v[STATS_ERR_SEND], 1);
+  EXPECT_EQ(v[STATS_TX_SYNC], 0);
+  char buf[4096];
+  size_t l = stats_print(v, buf, sizeof(buf), false);
+  ASSERT_GT(l, 0);
+  EXPECT_EQ(strlen(buf), l);
+  EXPECT_EQ(0, strncmp(buf, "requests 7\n", 11));
+  EXPECT_NE(strstr(buf, "\ntlv_alternate_time 1\n"), nullptr);
+  EXPECT_NE(strstr(buf, "\ndrops_orphan 5\n"), nullptr);
+  EXPECT_NE(strstr(buf, "\nerrors_send 1\n"), nullptr);
+  l = stats_print(v, buf, sizeof(buf), true);
+  ASSERT_GT(l, 0);
+  EXPECT_EQ(strlen(buf), l);
+  EXPECT_EQ(0, strncmp(buf, "# HELP csptp_requests_total Received messages\n"
+          "# TYPE csptp_requests_total counter\n"
+          "csptp_requests_total 7\n", 82));
+  EXPECT_NE(strstr(buf, "\n# TYPE csptp_drops_total counter\n"
+          "csptp_drops_total{reason=\"rate\"} 0\n"), nullptr);
+  EXPECT_NE(strstr(buf, "\ncsptp_drops_total{reason=\"orphan\"} 5\n"), nullptr);
+  EXPECT_NE(strstr(buf, "\ncsptp_tlv_requests_total{tlv=\"alternate_time\"} 1\n"),
+      nullptr);
+  EXPECT_NE(strstr(buf, "\ncsptp_errors_total{op=\"send\"} 1\n"), nullptr);
+  // Metric type is once per metric
+  EXPECT_EQ(strstr(buf, "# TYPE csptp_errors_total counter\ncsptp_errors_total{op=\"recv\"}"),
+      strstr(buf, "# TYPE csptp_errors_total"));
+  EXPECT_EQ(strstr(strstr(buf, "# TYPE csptp_errors_total") + 1,
+          "# TYPE csptp_errors_total"), nullptr);
+  // Buffer too small
+  EXPECT_EQ(stats_print(v, buf, 100, true), 0);
+  // Latency
+  phist h[STATS_LAT_NUM * 2];
+  for(int i = 0; i < STATS_LAT_NUM * 2; i++) {
+    h[i] = hist_alloc();
+    ASSERT_NE(h[i], nullptr);
+  }
+  for(int i = 0; i < 100; i++)
+    hist_record(h[STATS_LAT_TURNAROUND], 20000);
+  hist_record(h[STATS_LAT_TURNAROUND], 1500000000);
+  hist_record(h[STATS_LAT_NUM + STATS_LAT_TURNAROUND], 40);
+  pchist *total = (pchist *)h, *window = (pchist *)h + STATS_LAT_NUM;
+  l = stats_printLat(total, window, buf, sizeof(buf), false);
+  ASSERT_GT(l, 0);
+  EXPECT_EQ(strlen(buf), l);
+  EXPECT_EQ(0, strncmp(buf, "turnaround_p50 20479\n"
+          "turnaround_p99 20479\n"
+          "turnaround_p99.9 1500000000\n"
+          "turnaround_max 1500000000\n"
+          "turnaround_count 101\n"
+          "window_turnaround_p50 40\n", 122));
+  EXPECT_NE(strstr(buf, "\nqueue_count 0\n"), nullptr);
+  EXPECT_NE(strstr(buf, "\nwindow_queue_max 0\n"), nullptr);
+  l = stats_printLat(total, window, buf, sizeof(buf), true);
+  ASSERT_GT(l, 0);
+  EXPECT_EQ(strlen(buf), l);
+  EXPECT_NE(strstr(buf, "# TYPE csptp_turnaround_seconds summary\n"
+          "csptp_turnaround_seconds{quantile=\"0.5\"} 0.000020479\n"), nullptr);
+  EXPECT_NE(strstr(buf, "\ncsptp_turnaround_seconds{quantile=\"1\"} 1.500000000\n"
+          "csptp_turnaround_seconds_sum 1.502000000\n"
+          "csptp_turnaround_seconds_count 101\n"), nullptr);
+  EXPECT_NE(strstr(buf, "# TYPE csptp_turnaround_seconds_window gauge\n"
+          "csptp_turnaround_seconds_window{quantile=\"0.5\"} 0.000000040\n"), nullptr);
+  EXPECT_NE(strstr(buf, "\ncsptp_queue_seconds_count 0\n"), nullptr);
+  EXPECT_EQ(stats_printLat(total, window, buf, 100, true), 0);
+  for(int i = 0; i < STATS_LAT_NUM * 2; i++)
+    h[i]->free(h[i]);
+  s1->free(s1);
+  s2->free(s2);
+}
+
+static std::string statsQuery(const char *path, const char *req)
+{
+  std::string ret;
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0)
+    return ret;
+  if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+    char buf[1024];
+    ssize_t n;
+    if(req != nullptr)
+      send(fd, req, strlen(req), 0);
+    while((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+      ret.append(buf, n);
+  }
+  close(fd);
+  return ret;
+}
+
+// Test export on a Unix socket
+// pstatssrv stats_srv_alloc(const char *path, const pcstats *stats, size_t num, int window)
+// void free(pstatssrv self)
+TEST(statsTest, export)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/csptp_utest_%d.stats", (int)getpid());
+  pstats s = stats_alloc(true);
+  ASSERT_NE(s, nullptr);
+  stats_add(s, STATS_TX_SYNC, 12);
+  stats_lat(s, STATS_LAT_TURNAROUND, 30);
+  pcstats a[] = { s };
+  EXPECT_EQ(stats_srv_alloc(path, a, 1, 0), nullptr);
+  pstatssrv e = stats_srv_alloc(path, a, 1, 60);
+  ASSERT_NE(e, nullptr);
+  std::string r = statsQuery(path, nullptr);
+  EXPECT_NE(r.find("\nresponses 12\n"), std::string::npos);
+  EXPECT_EQ(r.find("HTTP"), std::string::npos);
+  EXPECT_NE(r.find("\nturnaround_max 30\nturnaround_count 1\n"), std::string::npos);
+  EXPECT_NE(r.find("\nwindow_turnaround_count 0\n"), std::string::npos);
+  // New window
+  r = statsQuery(path, "reset");
+  EXPECT_NE(r.find("\nwindow_turnaround_count 1\n"), std::string::npos);
+  stats_lat(s, STATS_LAT_TURNAROUND, 50);
+  stats_lat(s, STATS_LAT_TURNAROUND, 60);
+  r = statsQuery(path, "reset\n");
+  EXPECT_NE(r.find("\nwindow_turnaround_p50 50\n"), std::string::npos);
+  EXPECT_NE(r.find("\nwindow_turnaround_max 60\nwindow_turnaround_count 2\n"),
+      std::string::npos);
+  EXPECT_NE(r.find("\nturnaround_count 3\n"), std::string::npos);
+  stats_inc(s, STATS_TX_SYNC);
+  r = statsQuery(path, "prometheus\n");
+  EXPECT_EQ(r.find("# HELP"), 0);
+  EXPECT_NE(r.find("\ncsptp_responses_total{type=\"sync\"} 13\n"), std::string::npos);
+  r = statsQuery(path, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  EXPECT_EQ(r.find("HTTP/1.0 200 OK\r\n"), 0);
+  size_t h = r.find("\r\n\r\n");
+  ASSERT_NE(h, std::string::npos);
+  char cl[64];
+  snprintf(cl, sizeof(cl), "Content-Length: %zu\r\n", r.size() - h - 4);
+  EXPECT_NE(r.find(cl), std::string::npos);
+  EXPECT_NE(r.find("\ncsptp_responses_total{type=\"sync\"} 13\n"), std::string::npos);
+  e->free(e);
+  // The socket is removed
+  EXPECT_NE(access(path, F_OK), 0);
+  s->free(s);
+}
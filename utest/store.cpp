@@ -11,15 +11,18 @@
 
 #include "libsys/libsys.h"
 
+#include <thread>
+
 extern "C" {
 #include "src/store.h"
 }
 
 // Test store with hash table
 // void free(pstore self)
-// bool update(pstore self, pcipaddr address, pcts timestamp, uint16_t sequenceId, uint8_t domainNumber)
-// bool fetch(pstore self, pcipaddr address, pts timestamp, uint16_t sequenceId, uint8_t domainNumber, bool clear)
+// bool update(pstore self, pcipaddr address, pcts timestamp, uint16_t sequenceId, uint8_t domainNumber, uint8_t flags, bool *evicted)
+// bool fetch(pstore self, pcipaddr address, pts timestamp, uint16_t sequenceId, uint8_t domainNumber, uint8_t *flags, bool clear)
 // size_t cleanup(pstore self, uint32_t time)
+// size_t memUse(pcstore self)
 // size_t getHashSize(pcstore self)
 // size_t records(pcstore self)
 // pstore store_alloc(prot protocol, size_t hashSize)
@@ -28,6 +31,8 @@ TEST(storeTest, hash)
   pstore s = store_alloc(UDP_IPv4, 8);
   ASSERT_NE(s, nullptr);
   EXPECT_EQ(s->getHashSize(s), 256);
+  // A bucket is a cache line, the last bucket probes past the table end
+  EXPECT_EQ(s->memUse(s), (256 + STORE_PROBE / STORE_SLOTS_IPV4 - 1) * (64 + 4));
   EXPECT_EQ(s->records(s), 0);
   pipaddr a = addr_alloc(UDP_IPv4);
   ASSERT_NE(a, nullptr);
@@ -37,22 +42,23 @@ TEST(storeTest, hash)
   t->setTs(t, 12000000075);
   useTestMode(true);
   setMono(400);
-  EXPECT_TRUE(s->update(s, a, t, 2, 2));
+  EXPECT_TRUE(s->update(s, a, t, 2, 2, 0, nullptr));
   EXPECT_EQ(s->records(s), 1);
   a->setIPStr(a, "4.3.2.2");
   t->setTs(t, 12000000076);
   setMono(200);
-  EXPECT_TRUE(s->update(s, a, t, 2, 2));
+  EXPECT_TRUE(s->update(s, a, t, 2, 2, 0, nullptr));
   EXPECT_EQ(s->records(s), 2);
   a->setIPStr(a, "4.3.2.1");
-  EXPECT_FALSE(s->fetch(s, a, t, 1, 1, false));
-  EXPECT_TRUE(s->fetch(s, a, t, 2, 2, true));
+  EXPECT_FALSE(s->fetch(s, a, t, 1, 1, nullptr, false));
+  EXPECT_TRUE(s->fetch(s, a, t, 2, 2, nullptr, true));
   EXPECT_EQ(t->getTs(t), 12000000075);
-  EXPECT_TRUE(s->fetch(s, a, t, 2, 2, false));
-  EXPECT_EQ(t->getTs(t), 0);
+  // Clear frees the record
+  EXPECT_EQ(s->records(s), 1);
+  EXPECT_FALSE(s->fetch(s, a, t, 2, 2, nullptr, false));
   setMono(700); // 700 - 400 = 300
   EXPECT_EQ(s->cleanup(s, 400), 1);
-  EXPECT_EQ(s->records(s), 1);
+  EXPECT_EQ(s->records(s), 0);
   useTestMode(false);
   t->free(t);
   a->free(a);
@@ -74,22 +80,23 @@ TEST(storeTest, single)
   t->setTs(t, 12000000075);
   useTestMode(true);
   setMono(400);
-  EXPECT_TRUE(s->update(s, a, t, 2, 2));
+  EXPECT_TRUE(s->update(s, a, t, 2, 2, 0, nullptr));
   EXPECT_EQ(s->records(s), 1);
   a->setIPStr(a, "4.3.2.2");
   t->setTs(t, 12000000076);
   setMono(200);
-  EXPECT_TRUE(s->update(s, a, t, 2, 2));
+  EXPECT_TRUE(s->update(s, a, t, 2, 2, 0, nullptr));
   EXPECT_EQ(s->records(s), 2);
   a->setIPStr(a, "4.3.2.1");
-  EXPECT_FALSE(s->fetch(s, a, t, 1, 1, false));
-  EXPECT_TRUE(s->fetch(s, a, t, 2, 2, true));
+  EXPECT_FALSE(s->fetch(s, a, t, 1, 1, nullptr, false));
+  EXPECT_TRUE(s->fetch(s, a, t, 2, 2, nullptr, true));
   EXPECT_EQ(t->getTs(t), 12000000075);
-  EXPECT_TRUE(s->fetch(s, a, t, 2, 2, false));
-  EXPECT_EQ(t->getTs(t), 0);
+  // Clear frees the record
+  EXPECT_EQ(s->records(s), 1);
+  EXPECT_FALSE(s->fetch(s, a, t, 2, 2, nullptr, false));
   setMono(700); // 700 - 400 = 300
   EXPECT_EQ(s->cleanup(s, 400), 1);
-  EXPECT_EQ(s->records(s), 1);
+  EXPECT_EQ(s->records(s), 0);
   useTestMode(false);
   t->free(t);
   a->free(a);
@@ -111,24 +118,202 @@ TEST(storeTest, hash6)
   t->setTs(t, 12000000075);
   useTestMode(true);
   setMono(400);
-  EXPECT_TRUE(s->update(s, a, t, 2, 2));
+  EXPECT_TRUE(s->update(s, a, t, 2, 2, 0, nullptr));
   EXPECT_EQ(s->records(s), 1);
   a->setIPStr(a, "100:90::2");
   t->setTs(t, 12000000076);
   setMono(200);
-  EXPECT_TRUE(s->update(s, a, t, 2, 2));
+  EXPECT_TRUE(s->update(s, a, t, 2, 2, 0, nullptr));
   EXPECT_EQ(s->records(s), 2);
   a->setIPStr(a, "100:90::1");
-  EXPECT_FALSE(s->fetch(s, a, t, 1, 1, false));
-  EXPECT_TRUE(s->fetch(s, a, t, 2, 2, true));
+  EXPECT_FALSE(s->fetch(s, a, t, 1, 1, nullptr, false));
+  EXPECT_TRUE(s->fetch(s, a, t, 2, 2, nullptr, true));
   EXPECT_EQ(t->getTs(t), 12000000075);
-  EXPECT_TRUE(s->fetch(s, a, t, 2, 2, false));
-  EXPECT_EQ(t->getTs(t), 0);
+  // Clear frees the record
+  EXPECT_EQ(s->records(s), 1);
+  EXPECT_FALSE(s->fetch(s, a, t, 2, 2, nullptr, false));
   setMono(700); // 700 - 400 = 300
   EXPECT_EQ(s->cleanup(s, 400), 1);
-  EXPECT_EQ(s->records(s), 1);
+  EXPECT_EQ(s->records(s), 0);
+  useTestMode(false);
+  t->free(t);
+  a->free(a);
+  s->free(s);
+}
+
+// Test store replace the oldest record when the probed buckets are full
+TEST(storeTest, full)
+{
+  pstore s = store_alloc(UDP_IPv4, 0);
+  ASSERT_NE(s, nullptr);
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  a->setIPStr(a, "4.3.2.1");
+  useTestMode(true);
+  // Same address with different ports are different clients
+  const int slots = STORE_PROBE;
+  bool evicted = true;
+  for(int i = 0; i < slots; i++) {
+    setMono(200 + i);
+    a->setPort(a, 1000 + i);
+    t->setTs(t, 12000000000 + i);
+    EXPECT_TRUE(s->update(s, a, t, i, 2, 0, &evicted));
+    EXPECT_FALSE(evicted);
+  }
+  EXPECT_EQ(s->records(s), slots);
+  setMono(300);
+  a->setPort(a, 2000);
+  EXPECT_TRUE(s->update(s, a, t, 7, 2, 0, &evicted));
+  EXPECT_TRUE(evicted);
+  EXPECT_EQ(s->records(s), slots);
+  a->setPort(a, 1000);
+  EXPECT_FALSE(s->fetch(s, a, t, 0, 2, nullptr, false));
+  a->setPort(a, 1001);
+  EXPECT_TRUE(s->fetch(s, a, t, 1, 2, nullptr, false));
+  EXPECT_EQ(t->getTs(t), 12000000001);
+  a->setPort(a, 2000);
+  EXPECT_TRUE(s->fetch(s, a, t, 7, 2, nullptr, false));
+  EXPECT_EQ(t->getTs(t), 12000000000 + slots - 1);
+  useTestMode(false);
+  t->free(t);
+  a->free(a);
+  s->free(s);
+}
+
+// Test store keep all clients of a loaded table by probing
+TEST(storeTest, probe)
+{
+  for(prot type : { UDP_IPv4, UDP_IPv6 }) {
+    pstore s = store_alloc(type, 12);
+    ASSERT_NE(s, nullptr);
+    pipaddr a = addr_alloc(type);
+    ASSERT_NE(a, nullptr);
+    pts t = ts_alloc();
+    ASSERT_NE(t, nullptr);
+    a->setIPStr(a, type == UDP_IPv4 ? "4.3.2.1" : "100:90::1");
+    // Fill 65% of the slots
+    size_t clients = (type == UDP_IPv4 ? STORE_SLOTS_IPV4 : STORE_SLOTS_IPV6)
+      * 4096 * 65 / 100;
+    for(size_t i = 0; i < clients; i++) {
+      a->setPort(a, 1000 + i);
+      t->setTs(t, i);
+      EXPECT_TRUE(s->update(s, a, t, 1, 2, 0, nullptr));
+    }
+    // Probing keeps nearly all clients
+    size_t records = s->records(s);
+    EXPECT_GE(records, clients * 99 / 100);
+    size_t found = 0;
+    for(size_t i = 0; i < clients; i++) {
+      a->setPort(a, 1000 + i);
+      if(s->fetch(s, a, t, 1, 2, nullptr, false) && t->getTs(t) == (int64_t)i)
+        found++;
+    }
+    EXPECT_EQ(found, records);
+    t->free(t);
+    a->free(a);
+    s->free(s);
+  }
+}
+
+// Test store match the domain and keep the flags
+TEST(storeTest, flags)
+{
+  uint8_t flags = 0;
+  pstore s = store_alloc(UDP_IPv4, 2);
+  ASSERT_NE(s, nullptr);
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  a->setIPStr(a, "4.3.2.1");
+  a->setPort(a, 1000);
+  t->setTs(t, 12000000075);
+  EXPECT_TRUE(s->update(s, a, t, 5, 3, 0x81, nullptr));
+  EXPECT_FALSE(s->fetch(s, a, t, 5, 4, &flags, false));
+  EXPECT_EQ(flags, 0);
+  EXPECT_TRUE(s->fetch(s, a, t, 5, 3, &flags, true));
+  EXPECT_EQ(flags, 0x81);
+  EXPECT_EQ(t->getTs(t), 12000000075);
+  t->free(t);
+  a->free(a);
+  s->free(s);
+}
+
+// Test store expire records with the wheel
+TEST(storeTest, wheel)
+{
+  pstore s = store_alloc(UDP_IPv4, 10);
+  ASSERT_NE(s, nullptr);
+  pipaddr a = addr_alloc(UDP_IPv4);
+  ASSERT_NE(a, nullptr);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  a->setIPStr(a, "4.3.2.1");
+  t->setTs(t, 12000000075);
+  useTestMode(true);
+  // 100 clients each second
+  for(int i = 0; i < 300; i++) {
+    setMono(1000 + i / 100);
+    a->setPort(a, 1000 + i);
+    EXPECT_TRUE(s->update(s, a, t, 1, 2, 0, nullptr));
+  }
+  EXPECT_EQ(s->records(s), 300);
+  // Client refresh its record
+  setMono(1003);
+  a->setPort(a, 1000);
+  EXPECT_TRUE(s->update(s, a, t, 2, 2, 0, nullptr));
+  EXPECT_EQ(s->cleanup(s, 2), 99); // before 1001
+  EXPECT_EQ(s->cleanup(s, 2), 0); // pass the same seconds
+  setMono(1004);
+  EXPECT_EQ(s->cleanup(s, 2), 100); // before 1002
+  setMono(1005 + STORE_WHEEL * 2);
+  EXPECT_EQ(s->cleanup(s, 2), 101); // Skip a whole round
+  EXPECT_EQ(s->records(s), 0);
+  // Clock jump back
+  setMono(500);
+  EXPECT_TRUE(s->update(s, a, t, 3, 2, 0, nullptr));
+  setMono(510);
+  EXPECT_EQ(s->cleanup(s, 2), 1);
+  EXPECT_EQ(s->records(s), 0);
   useTestMode(false);
   t->free(t);
   a->free(a);
   s->free(s);
 }
+
+// Test store fetch while another thread update
+TEST(storeTest, threads)
+{
+  pstore s = store_alloc(UDP_IPv6, 4);
+  ASSERT_NE(s, nullptr);
+  pipaddr a = addr_alloc(UDP_IPv6);
+  ASSERT_NE(a, nullptr);
+  a->setIPStr(a, "100:90::1");
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  t->setTs(t, 0);
+  EXPECT_TRUE(s->update(s, a, t, 0, 2, 0, nullptr));
+  std::atomic<bool> run(true);
+  std::thread w([&] {
+    pts wt = ts_alloc();
+    for(uint16_t i = 1; run; i++) {
+      wt->setTs(wt, i * 1000);
+      s->update(s, a, wt, i, 2, 0, nullptr);
+    }
+    wt->free(wt);
+  });
+  size_t torn = 0;
+  for(uint16_t i = 0; i < 50000; i++) {
+    if(s->fetch(s, a, t, i, 2, nullptr, false) && t->getTs(t) != i * 1000)
+      torn++;
+  }
+  run = false;
+  w.join();
+  EXPECT_EQ(torn, 0);
+  EXPECT_EQ(s->records(s), 1);
+  t->free(t);
+  a->free(a);
+  s->free(s);
+}
@@ -48,3 +48,23 @@ TEST(threadTest, thread)
   EXPECT_TRUE(m->retVal(m));
   m->free(m);
 }
+
+static bool pinThread(void *cookie)
+{
+  return thread_pinCpu(*(int *)cookie);
+}
+
+// Test thread CPU functions
+// bool thread_pinCpu(int cpu)
+// int thread_numCpus()
+TEST(threadTest, cpu)
+{
+  int cpu = thread_numCpus() - 1;
+  EXPECT_GE(cpu, 0);
+  pthread m = thread_create(pinThread, &cpu);
+  ASSERT_NE(m, nullptr);
+  EXPECT_TRUE(m->join(m));
+  EXPECT_TRUE(m->retVal(m));
+  m->free(m);
+  EXPECT_FALSE(thread_pinCpu(-1));
+}
@@ -25,6 +25,8 @@ extern "C" {
 // void setTs(pts self, int64_t ts)
 // int64_t getTs(pcts self)
 // bool eq(pcts self, pcts other)
+// void setSrc(pts self, enum ts_src_e src)
+// enum ts_src_e getSrc(pcts self)
 // void assign(pts self, pcts other)
 // pts ts_alloc()
 TEST(timestampTest, timestampTest)
@@ -48,8 +50,16 @@ TEST(timestampTest, timestampTest)
   t->setTs(t, 975);
   EXPECT_EQ(t->getTs(t), 975);
   EXPECT_FALSE(t->eq(t, t2));
+  EXPECT_EQ(t->getSrc(t), TS_SRC_USER);
+  t->setSrc(t, TS_SRC_HW);
+  EXPECT_EQ(t->getSrc(t), TS_SRC_HW);
   t2->assign(t2, t);
   EXPECT_TRUE(t->eq(t, t2));
+  EXPECT_EQ(t2->getSrc(t2), TS_SRC_HW);
+  // const char *ts_srcStr(enum ts_src_e src)
+  EXPECT_STREQ(ts_srcStr(TS_SRC_USER), "user");
+  EXPECT_STREQ(ts_srcStr(TS_SRC_SW), "software");
+  EXPECT_STREQ(ts_srcStr(TS_SRC_HW), "hardware");
   t2->free(t2);
   t->free(t);
 }
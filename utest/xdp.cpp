@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+   SPDX-FileCopyrightText: Copyright © 2025 Erez Geva <ErezGeva2@gmail.com> */
+
+/** @file
+ * @brief test XDP program answering one step Sync requests
+ *
+ * @author Erez Geva <ErezGeva2@@gmail.com>
+ * @copyright © 2025 Erez Geva
+ *
+ */
+
+#include "libsys/libsys.h"
+
+extern "C" {
+#include "src/xdp.h"
+#include "src/sock.h"
+}
+
+static bool sendReq(pmsg m, pbuffer b, psock s, pcipaddr a, uint8_t flags,
+  size_t len = 96)
+{
+  struct ptp_params_t p = {};
+  p.type = Sync;
+  p.domainNumber = 7;
+  p.sequenceId = 0x1234;
+  return m->init(m, &p, b) && m->addCSPTPReqTlv(m, flags) &&
+    m->buildDone(m, len) && s->send(s, b, a);
+}
+
+// Test answer in XDP
+// pxdp xdp_alloc()
+// void free(pxdp self)
+// bool attach(pxdp self, const char *ifName, uint16_t port)
+// bool update(pxdp self, const struct ifClk_t *clk)
+// bool detach(pxdp self)
+TEST(xdpTest, sync)
+{
+  pxdp x = xdp_alloc();
+  ASSERT_NE(x, nullptr);
+  struct ifClk_t clk = {};
+  memcpy(clk.organizationId, "\x1\x2\x3", 3);
+  memcpy(clk.organizationSubType, "\x4\x5\x6", 3);
+  clk.generation = 1;
+  EXPECT_FALSE(x->update(x, &clk)); // program is not attached
+  if(!x->attach(x, "lo", 32322)) {
+    x->free(x);
+    GTEST_SKIP() << "XDP is not permitted";
+  }
+  EXPECT_FALSE(x->attach(x, "lo", 32322));
+  EXPECT_TRUE(x->update(x, &clk));
+  // The service socket receive the requests the program pass
+  pipaddr sa = addr_alloc(UDP_IPv4);
+  ASSERT_NE(sa, nullptr);
+  EXPECT_TRUE(sa->setIP4Str(sa, "127.0.0.1"));
+  sa->setPort(sa, 32322);
+  psock s = sock_alloc();
+  ASSERT_NE(s, nullptr);
+  EXPECT_TRUE(s->initSrv(s, sa));
+  pipaddr ca = addr_alloc(UDP_IPv4);
+  ASSERT_NE(ca, nullptr);
+  EXPECT_TRUE(ca->setIP4Str(ca, "127.0.0.1"));
+  ca->setPort(ca, 32323);
+  psock c = sock_alloc();
+  ASSERT_NE(c, nullptr);
+  EXPECT_TRUE(c->initSrv(c, ca));
+  pmsg m = msg_alloc();
+  ASSERT_NE(m, nullptr);
+  pbuffer b = buffer_alloc(256);
+  ASSERT_NE(b, nullptr);
+  pts t = ts_alloc();
+  ASSERT_NE(t, nullptr);
+  struct ptp_params_t p;
+  // The program answers
+  EXPECT_TRUE(sendReq(m, b, c, sa, 0));
+  EXPECT_TRUE(c->poll(c, 1000));
+  EXPECT_TRUE(c->recv(c, b, ca, t));
+  EXPECT_EQ(ca->getPort(ca), 32322);
+  EXPECT_EQ(b->getLen(b), 96);
+  EXPECT_TRUE(m->parse(m, &p, b));
+  EXPECT_EQ(p.type, Sync);
+  EXPECT_FALSE(p.useTwoSteps);
+  EXPECT_EQ(p.domainNumber, 7);
+  EXPECT_EQ(p.sequenceId, 0x1234);
+  uint64_t sec = get_uint48(&p.timestamp.secondsField);
+  EXPECT_LE(sec, (uint64_t)time(nullptr));
+  EXPECT_GE(sec + 2, (uint64_t)time(nullptr));
+  ASSERT_EQ(m->getTlvs(m), 2);
+  EXPECT_EQ(m->getTlvID(m, 0), CSPTP_RESPONSE_id);
+  struct CSPTP_RESPONSE_t *r = (struct CSPTP_RESPONSE_t *)m->getTlv(m, 0);
+  ASSERT_NE(r, nullptr);
+  EXPECT_EQ(memcmp(r->organizationId, "\x1\x2\x3", 3), 0);
+  EXPECT_EQ(memcmp(r->organizationSubType, "\x4\x5\x6", 3), 0);
+  EXPECT_LE(get_uint48(&r->reqIngressTimestamp.secondsField), sec);
+  EXPECT_EQ(m->getTlvID(m, 1), PAD_id);
+  EXPECT_FALSE(s->poll(s, 100));
+  // Requests with CSPTP_STATUS pass to the service
+  EXPECT_TRUE(sendReq(m, b, c, sa, Flags0_Req_StatusTlv));
+  EXPECT_TRUE(s->poll(s, 1000));
+  EXPECT_TRUE(s->recv(s, b, ca, t));
+  EXPECT_EQ(ca->getPort(ca), 32323);
+  EXPECT_TRUE(m->parse(m, &p, b));
+  ASSERT_GT(m->getTlvs(m), 0);
+  EXPECT_EQ(m->getTlvID(m, 0), CSPTP_REQUEST_id);
+  EXPECT_FALSE(c->poll(c, 100));
+  // Requests without room for the PAD TLV header pass to the service
+  EXPECT_TRUE(sendReq(m, b, c, sa, 0, 72));
+  EXPECT_TRUE(s->poll(s, 1000));
+  EXPECT_TRUE(s->recv(s, b, ca, t));
+  EXPECT_EQ(b->getLen(b), 72);
+  EXPECT_FALSE(c->poll(c, 100));
+  EXPECT_TRUE(x->detach(x));
+  EXPECT_FALSE(x->update(x, &clk));
+  t->free(t);
+  b->free(b);
+  m->free(m);
+  c->free(c);
+  ca->free(ca);
+  s->free(s);
+  sa->free(sa);
+  x->free(x);
+}